@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+// Build tool: embeds SPIR-V binaries as C arrays, together with a table of them by name, into one
+// header that src/shader.c includes.
+//
+//     embed-spirv OUTPUT.h NAME... -- FILE.spv...
+//
+// The n-th name goes with the n-th file. Each array is `spirv_<NAME>`.
+
+static uint32_t *readSpirv(const char *path, size_t *wordCount) {
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        fprintf(stderr, "Could not read `%s`.\n", path);
+        exit(1);
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (size <= 0 || size % 4 != 0) {
+        fprintf(stderr, "`%s` is not SPIR-V: its size is not a positive multiple of 4.\n", path);
+        exit(1);
+    }
+
+    uint32_t *words = malloc((size_t) size);
+
+    if (words == NULL || fread(words, (size_t) size, 1, file) != 1) {
+        fprintf(stderr, "Could not read `%s`.\n", path);
+        exit(1);
+    }
+
+    fclose(file);
+
+    if (words[0] != 0x07230203) {
+        fprintf(stderr, "`%s` is not SPIR-V: the magic number is missing.\n", path);
+        exit(1);
+    }
+
+    *wordCount = (size_t) size / 4;
+
+    return words;
+}
+
+int main(int argc, char *argv[]) {
+    int separator = 2;
+
+    while (separator < argc && strcmp(argv[separator], "--") != 0) {
+        separator += 1;
+    }
+
+    int nameCount = separator - 2;
+
+    if (argc < 2 || separator == argc || argc - separator - 1 != nameCount) {
+        fprintf(stderr, "Usage: %s OUTPUT.h NAME... -- FILE.spv...\n", argv[0]);
+        return 1;
+    }
+
+    FILE *output = fopen(argv[1], "w");
+
+    if (output == NULL) {
+        fprintf(stderr, "Could not write `%s`.\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(output, "// Generated by embed-spirv from the shader variants in meson.build, do not edit\n\n");
+
+    for (int i = 0; i < nameCount; i += 1) {
+        size_t wordCount;
+        uint32_t *words = readSpirv(argv[separator + 1 + i], &wordCount);
+
+        fprintf(output, "static const uint32_t spirv_%s[] = {", argv[2 + i]);
+
+        for (size_t w = 0; w < wordCount; w += 1) {
+            fprintf(output, "%s0x%08" PRIx32 ",", w % 8 == 0 ? "\n    " : " ", words[w]);
+        }
+
+        fprintf(output, "\n};\n\n");
+        free(words);
+    }
+
+    fprintf(output, "static const EmbeddedShader embeddedShaders[] = {\n");
+
+    for (int i = 0; i < nameCount; i += 1) {
+        fprintf(output, "    { \"%s\", spirv_%s, sizeof(spirv_%s) },\n", argv[2 + i], argv[2 + i], argv[2 + i]);
+    }
+
+    fprintf(output, "};\n");
+
+    return fclose(output) == 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+// Shared by the primitive kernels (reduce, scan, compaction and radix sort). The build compiles every
+// kernel twice: with USE_SUBGROUPS=1 for Vulkan 1.1, and with USE_SUBGROUPS=0 as the shared-memory
+// fallback for devices without subgroup arithmetic in compute shaders.
+
+#if USE_SUBGROUPS
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
+
+// The minimum maxComputeWorkGroupInvocations, so the kernels run everywhere; matches
+// PRIMITIVE_WORKGROUP_SIZE in src/primitives.h
+#define WORKGROUP_SIZE 128
+
+#define PRIMITIVE_FLAG_EXCLUSIVE 1u
+#define PRIMITIVE_FLAG_PREDICATE 2u
+// The counts come from record `shift` of the indirect arguments instead of the push constants
+#define PRIMITIVE_FLAG_INDIRECT 4u
+
+#define REDUCE_SUM 0u
+#define REDUCE_MIN 1u
+#define REDUCE_MAX 2u
+
+#define RADIX_BITS 4u
+#define RADIX_SIZE (1u << RADIX_BITS)
+
+layout (local_size_x = WORKGROUP_SIZE) in;
+
+// Matches `PrimitiveParameters` in src/primitives.h
+layout(push_constant) uniform Parameters {
+    uint elementCount;
+    uint groupCount;
+    uint operation;
+    uint flags;
+    uint shift;
+    // maxComputeWorkGroupCount[0], for kernels that size grids themselves
+    uint maxGroupCountX;
+} parameters;
+
+// Matches `PrimitiveIndirectArguments` in src/primitives.h: a VkDispatchIndirectCommand, followed by
+// the counts the dispatched kernel uses in place of its push constants
+struct IndirectArguments {
+    uint x;
+    uint y;
+    uint z;
+    uint elementCount;
+    uint groupCount;
+};
+
+// Grids larger than maxComputeWorkGroupCount[0] spill into y and z; workgroups past
+// `groupCount` only exist to round the grid up and must return straight away
+uint groupIndex() {
+    return gl_WorkGroupID.x + gl_NumWorkGroups.x * (gl_WorkGroupID.y + gl_NumWorkGroups.y * gl_WorkGroupID.z);
+}
+
+// Position of this invocation's element within the workgroup. Scans follow subgroup order, which
+// Vulkan does not tie to gl_LocalInvocationIndex, so elements are assigned in that order too.
+uint localIndex() {
+#if USE_SUBGROUPS
+    return gl_SubgroupID * gl_SubgroupSize + gl_SubgroupInvocationID;
+#else
+    return gl_LocalInvocationIndex;
+#endif
+}
+
+shared uint scanPartials[WORKGROUP_SIZE];
+shared uint scanTotal;
+
+// Inclusive sum over the workgroup in `localIndex` order, leaving the workgroup total in
+// `scanTotal`. Every invocation of the workgroup must call it.
+uint workgroupInclusiveScan(uint value) {
+    uint local = gl_LocalInvocationIndex;
+#if USE_SUBGROUPS
+    uint inclusive = subgroupInclusiveAdd(value);
+    uint subgroupTotal = subgroupAdd(value);
+
+    if (subgroupElect()) {
+        scanPartials[gl_SubgroupID] = subgroupTotal;
+    }
+
+    barrier();
+
+    // There are only a handful of subgroups, so one invocation turns their totals into offsets
+    if (local == 0) {
+        uint running = 0;
+
+        for (uint i = 0; i < gl_NumSubgroups; i++) {
+            uint total = scanPartials[i];
+            scanPartials[i] = running;
+            running += total;
+        }
+
+        scanTotal = running;
+    }
+
+    barrier();
+    inclusive += scanPartials[gl_SubgroupID];
+#else
+    scanPartials[local] = value;
+    barrier();
+
+    for (uint offset = 1; offset < WORKGROUP_SIZE; offset *= 2) {
+        uint previous = local >= offset ? scanPartials[local - offset] : 0;
+        barrier();
+        scanPartials[local] += previous;
+        barrier();
+    }
+
+    uint inclusive = scanPartials[local];
+
+    if (local == WORKGROUP_SIZE - 1) {
+        scanTotal = inclusive;
+    }
+#endif
+
+    // Lets the caller read `scanTotal`, and the next call reuse `scanPartials`
+    barrier();
+
+    return inclusive;
+}
@@ -0,0 +1,487 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "allocator.h"
+#include "util.h"
+#include "host_allocator.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+static uint32_t sizeClass(VkDeviceSize size) {
+    uint32_t class = 0;
+
+    while (size > 1 && class + 1 < ALLOCATOR_SIZE_CLASS_COUNT) {
+        size >>= 1;
+        class += 1;
+    }
+
+    return class;
+}
+
+// Whether the last byte of one range and the first byte of the next share a granularity page
+static bool onSamePage(VkDeviceSize lastByte, VkDeviceSize firstByte, VkDeviceSize granularity) {
+    return lastByte / granularity == firstByte / granularity;
+}
+
+static void pushFreeRange(Allocator *allocator, AllocatorRange *range) {
+    AllocatorRange **list = &allocator->memoryTypes[range->block->memoryTypeIndex].freeLists[sizeClass(range->size)];
+
+    range->free = true;
+    range->previousFree = NULL;
+    range->nextFree = *list;
+
+    if (*list != NULL) {
+        (*list)->previousFree = range;
+    }
+
+    *list = range;
+}
+
+static void removeFreeRange(Allocator *allocator, AllocatorRange *range) {
+    AllocatorRange **list = &allocator->memoryTypes[range->block->memoryTypeIndex].freeLists[sizeClass(range->size)];
+
+    if (range->previousFree != NULL) {
+        range->previousFree->nextFree = range->nextFree;
+    } else {
+        *list = range->nextFree;
+    }
+
+    if (range->nextFree != NULL) {
+        range->nextFree->previousFree = range->previousFree;
+    }
+
+    range->free = false;
+    range->previousFree = NULL;
+    range->nextFree = NULL;
+}
+
+static AllocatorRange *createRange(AllocatorBlock *block, VkDeviceSize offset, VkDeviceSize size) {
+    AllocatorRange *range = calloc(1, sizeof(AllocatorRange));
+
+    if (range == NULL) {
+        fprintf(stderr, "Could not allocate memory for the allocator.\n");
+        exit(1);
+    }
+
+    range->offset = offset;
+    range->size = size;
+    range->block = block;
+
+    return range;
+}
+
+// Inserts a new range covering [offset, offset + size) right after `range` in the block
+static AllocatorRange *splitRangeAfter(AllocatorRange *range, VkDeviceSize offset, VkDeviceSize size) {
+    AllocatorRange *split = createRange(range->block, offset, size);
+
+    split->previous = range;
+    split->next = range->next;
+
+    if (range->next != NULL) {
+        range->next->previous = split;
+    }
+
+    range->next = split;
+
+    return split;
+}
+
+static void unlinkRange(AllocatorRange *range) {
+    if (range->previous != NULL) {
+        range->previous->next = range->next;
+    } else {
+        range->block->ranges = range->next;
+    }
+
+    if (range->next != NULL) {
+        range->next->previous = range->previous;
+    }
+
+    free(range);
+}
+
+// Returns the offset `size` bytes would be placed at in the free `range`, or UINT64_MAX if they do not fit
+static VkDeviceSize fitInRange(const Allocator *allocator, const AllocatorRange *range, VkDeviceSize size,
+        VkDeviceSize alignment, bool linear) {
+    VkDeviceSize offset = alignUp(range->offset, alignment);
+    const AllocatorRange *previous = range->previous;
+    const AllocatorRange *next = range->next;
+
+    if (previous != NULL && !previous->free && previous->linear != linear
+            && onSamePage(previous->offset + previous->size - 1, offset, allocator->bufferImageGranularity)) {
+        offset = alignUp(offset, allocator->bufferImageGranularity);
+    }
+
+    if (offset + size > range->offset + range->size) {
+        return UINT64_MAX;
+    }
+
+    if (next != NULL && !next->free && next->linear != linear
+            && onSamePage(offset + size - 1, next->offset, allocator->bufferImageGranularity)) {
+        return UINT64_MAX;
+    }
+
+    return offset;
+}
+
+// NULL, with nothing changed, when the device is out of memory or allocations
+static AllocatorBlock *createBlock(Allocator *allocator, uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated) {
+    if (allocator->deviceAllocationCount >= allocator->maxMemoryAllocationCount) {
+        return NULL;
+    }
+
+    const VkMemoryAllocateInfo memoryAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = NULL,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex,
+    };
+
+    VkDeviceMemory memory;
+
+    if (vkAllocateMemory(allocator->device, &memoryAllocateInfo, hostAllocationCallbacks(), &memory) != VK_SUCCESS) {
+        return NULL;
+    }
+
+    AllocatorBlock *block = calloc(1, sizeof(AllocatorBlock));
+
+    if (block == NULL) {
+        fprintf(stderr, "Could not allocate memory for the allocator.\n");
+        exit(1);
+    }
+
+    block->memory = memory;
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->dedicated = dedicated;
+    block->ranges = createRange(block, 0, size);
+
+    if (allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        BAIL_ON_BAD_RESULT(vkMapMemory(allocator->device, memory, 0, VK_WHOLE_SIZE, 0, &block->mapped));
+    }
+
+    AllocatorMemoryType *memoryType = &allocator->memoryTypes[memoryTypeIndex];
+
+    block->next = memoryType->blocks;
+
+    if (memoryType->blocks != NULL) {
+        memoryType->blocks->previous = block;
+    }
+
+    memoryType->blocks = block;
+    allocator->deviceAllocationCount += 1;
+    allocator->heapBytesReserved[allocator->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += size;
+
+    if (!dedicated) {
+        pushFreeRange(allocator, block->ranges);
+        memoryType->emptyBlockCount += 1;
+    }
+
+    return block;
+}
+
+static void destroyBlock(Allocator *allocator, AllocatorBlock *block) {
+    AllocatorMemoryType *memoryType = &allocator->memoryTypes[block->memoryTypeIndex];
+
+    if (block->previous != NULL) {
+        block->previous->next = block->next;
+    } else {
+        memoryType->blocks = block->next;
+    }
+
+    if (block->next != NULL) {
+        block->next->previous = block->previous;
+    }
+
+    for (AllocatorRange *range = block->ranges, *next; range != NULL; range = next) {
+        next = range->next;
+
+        if (range->free) {
+            removeFreeRange(allocator, range);
+        }
+
+        free(range);
+    }
+
+    if (block->mapped != NULL) {
+        vkUnmapMemory(allocator->device, block->memory);
+    }
+
+    vkFreeMemory(allocator->device, block->memory, hostAllocationCallbacks());
+    allocator->deviceAllocationCount -= 1;
+    allocator->heapBytesReserved[allocator->memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex] -= block->size;
+    free(block);
+}
+
+void initAllocator(Allocator *allocator, VkDevice device, VkPhysicalDevice physicalDevice, bool memoryBudget,
+        const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties) {
+    *allocator = (Allocator) {
+        .device = device,
+        .physicalDevice = physicalDevice,
+        .memoryBudget = memoryBudget,
+        .memoryProperties = *physicalDeviceMemoryProperties,
+        .bufferImageGranularity = physicalDeviceProperties->limits.bufferImageGranularity > 0
+            ? physicalDeviceProperties->limits.bufferImageGranularity : 1,
+        .nonCoherentAtomSize = physicalDeviceProperties->limits.nonCoherentAtomSize > 0
+            ? physicalDeviceProperties->limits.nonCoherentAtomSize : 1,
+        .maxMemoryAllocationCount = physicalDeviceProperties->limits.maxMemoryAllocationCount,
+        .blockSize = ALLOCATOR_DEFAULT_BLOCK_SIZE,
+        .deviceAllocationCount = 0,
+    };
+
+    pthread_mutex_init(&allocator->mutex, NULL);
+}
+
+void destroyAllocator(Allocator *allocator) {
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i += 1) {
+        while (allocator->memoryTypes[i].blocks != NULL) {
+            AllocatorBlock *block = allocator->memoryTypes[i].blocks;
+
+            if (block->bytesInUse > 0) {
+                fprintf(stderr, "Destroying the allocator with %" PRIu64 " bytes still in use.\n", (uint64_t) block->bytesInUse);
+            }
+
+            destroyBlock(allocator, block);
+        }
+    }
+
+    pthread_mutex_destroy(&allocator->mutex);
+}
+
+// Smaller heaps get proportionally smaller blocks, so one block never takes most of a heap
+static VkDeviceSize blockSizeFor(const Allocator *allocator, uint32_t memoryTypeIndex) {
+    uint32_t heapIndex = allocator->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    VkDeviceSize heapSize = allocator->memoryProperties.memoryHeaps[heapIndex].size;
+
+    return heapSize / 8 < allocator->blockSize ? heapSize / 8 : allocator->blockSize;
+}
+
+// Called with the mutex held
+static AllocatorRange *findFreeRange(Allocator *allocator, uint32_t memoryTypeIndex, VkDeviceSize size,
+        VkDeviceSize alignment, bool linear, VkDeviceSize *offset) {
+    AllocatorMemoryType *memoryType = &allocator->memoryTypes[memoryTypeIndex];
+
+    for (uint32_t class = sizeClass(size); class < ALLOCATOR_SIZE_CLASS_COUNT; class += 1) {
+        for (AllocatorRange *range = memoryType->freeLists[class]; range != NULL; range = range->nextFree) {
+            *offset = fitInRange(allocator, range, size, alignment, linear);
+
+            if (*offset != UINT64_MAX) {
+                return range;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+bool allocateDeviceMemory(Allocator *allocator, uint32_t memoryTypeIndex, const VkMemoryRequirements *memoryRequirements,
+        bool linear, Allocation *allocation) {
+    VkDeviceSize size = memoryRequirements->size > 0 ? memoryRequirements->size : 1;
+    VkDeviceSize alignment = memoryRequirements->alignment > 0 ? memoryRequirements->alignment : 1;
+    VkDeviceSize blockSize = blockSizeFor(allocator, memoryTypeIndex);
+    VkMemoryPropertyFlags flags = allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+    if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        size = alignUp(size, allocator->nonCoherentAtomSize);
+        alignment = alignment > allocator->nonCoherentAtomSize ? alignment : allocator->nonCoherentAtomSize;
+    }
+
+    pthread_mutex_lock(&allocator->mutex);
+
+    AllocatorRange *range = NULL;
+    VkDeviceSize offset = 0;
+
+    if (size > blockSize / 2) {
+        AllocatorBlock *block = createBlock(allocator, memoryTypeIndex, size, true);
+
+        if (block != NULL) {
+            range = block->ranges;
+        }
+    } else {
+        range = findFreeRange(allocator, memoryTypeIndex, size, alignment, linear, &offset);
+
+        if (range == NULL && createBlock(allocator, memoryTypeIndex, blockSize, false) != NULL) {
+            range = findFreeRange(allocator, memoryTypeIndex, size, alignment, linear, &offset);
+        }
+
+        if (range != NULL) {
+            AllocatorBlock *block = range->block;
+
+            if (block->bytesInUse == 0) {
+                allocator->memoryTypes[memoryTypeIndex].emptyBlockCount -= 1;
+            }
+
+            removeFreeRange(allocator, range);
+
+            if (offset + size < range->offset + range->size) {
+                pushFreeRange(allocator, splitRangeAfter(range, offset + size, range->offset + range->size - offset - size));
+            }
+
+            if (offset > range->offset) {
+                AllocatorRange *used = splitRangeAfter(range, offset, size);
+
+                range->size = offset - range->offset;
+                pushFreeRange(allocator, range);
+                range = used;
+            } else {
+                range->size = size;
+            }
+        }
+    }
+
+    if (range == NULL) {
+        pthread_mutex_unlock(&allocator->mutex);
+        return false;
+    }
+
+    range->free = false;
+    range->linear = linear;
+    range->block->bytesInUse += range->size;
+
+    *allocation = (Allocation) {
+        .range = range,
+        .memory = range->block->memory,
+        .offset = range->offset,
+        .size = range->size,
+        .memoryTypeIndex = memoryTypeIndex,
+        .mapped = range->block->mapped != NULL ? (uint8_t*) range->block->mapped + range->offset : NULL,
+    };
+
+    pthread_mutex_unlock(&allocator->mutex);
+
+    return true;
+}
+
+void freeDeviceMemory(Allocator *allocator, Allocation *allocation) {
+    AllocatorRange *range = allocation->range;
+
+    if (range == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&allocator->mutex);
+
+    AllocatorBlock *block = range->block;
+    AllocatorMemoryType *memoryType = &allocator->memoryTypes[block->memoryTypeIndex];
+
+    block->bytesInUse -= range->size;
+
+    if (block->dedicated) {
+        destroyBlock(allocator, block);
+    } else {
+        if (range->previous != NULL && range->previous->free) {
+            AllocatorRange *previous = range->previous;
+
+            removeFreeRange(allocator, previous);
+            previous->size += range->size;
+            unlinkRange(range);
+            range = previous;
+        }
+
+        if (range->next != NULL && range->next->free) {
+            AllocatorRange *next = range->next;
+
+            removeFreeRange(allocator, next);
+            range->size += next->size;
+            unlinkRange(next);
+        }
+
+        pushFreeRange(allocator, range);
+
+        // Keep a few empty blocks around for the next allocations instead of returning them to the driver
+        if (block->bytesInUse == 0) {
+            if (memoryType->emptyBlockCount < ALLOCATOR_MAX_EMPTY_BLOCKS) {
+                memoryType->emptyBlockCount += 1;
+            } else {
+                destroyBlock(allocator, block);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&allocator->mutex);
+
+    *allocation = (Allocation) { .range = NULL };
+}
+
+void getAllocatorHeapRoom(Allocator *allocator, VkDeviceSize heapRoom[VK_MAX_MEMORY_HEAPS]) {
+    const VkPhysicalDeviceMemoryProperties *memoryProperties = &allocator->memoryProperties;
+
+    if (allocator->memoryBudget) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT memoryBudgetProperties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+            .pNext = NULL,
+        };
+        VkPhysicalDeviceMemoryProperties2 memoryProperties2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+            .pNext = &memoryBudgetProperties,
+        };
+
+        vkGetPhysicalDeviceMemoryProperties2(allocator->physicalDevice, &memoryProperties2);
+
+        for (uint32_t heap = 0; heap < memoryProperties->memoryHeapCount; heap += 1) {
+            VkDeviceSize budget = memoryBudgetProperties.heapBudget[heap];
+            VkDeviceSize usage = memoryBudgetProperties.heapUsage[heap];
+
+            heapRoom[heap] = budget > usage ? budget - usage : 0;
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&allocator->mutex);
+
+    for (uint32_t heap = 0; heap < memoryProperties->memoryHeapCount; heap += 1) {
+        VkDeviceSize share = memoryProperties->memoryHeaps[heap].size / 100 * ALLOCATOR_HEAP_SHARE_PERCENT;
+        VkDeviceSize reserved = allocator->heapBytesReserved[heap];
+
+        heapRoom[heap] = share > reserved ? share - reserved : 0;
+    }
+
+    pthread_mutex_unlock(&allocator->mutex);
+}
+
+void getAllocatorStatistics(Allocator *allocator, AllocatorStatistics *statistics) {
+    *statistics = (AllocatorStatistics) { .blockCount = 0 };
+
+    VkDeviceSize bytesFree = 0;
+
+    pthread_mutex_lock(&allocator->mutex);
+
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i += 1) {
+        for (const AllocatorBlock *block = allocator->memoryTypes[i].blocks; block != NULL; block = block->next) {
+            statistics->blockCount += 1;
+            statistics->dedicatedBlockCount += block->dedicated ? 1 : 0;
+            statistics->bytesReserved += block->size;
+            statistics->bytesInUse += block->bytesInUse;
+
+            for (const AllocatorRange *range = block->ranges; range != NULL; range = range->next) {
+                if (!range->free) {
+                    statistics->allocationCount += 1;
+                    continue;
+                }
+
+                statistics->freeRangeCount += 1;
+                bytesFree += range->size;
+
+                if (range->size > statistics->largestFreeRange) {
+                    statistics->largestFreeRange = range->size;
+                }
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&allocator->mutex);
+
+    statistics->fragmentation = bytesFree > 0 ? 1.0 - (double) statistics->largestFreeRange / (double) bytesFree : 0.0;
+}
+
+void printAllocatorStatistics(const AllocatorStatistics *statistics) {
+    printf("allocator { blocks: %" PRIu32 ", dedicated: %" PRIu32 ", allocations: %" PRIu32 ", reserved: %" PRIu64
+           " bytes, inUse: %" PRIu64 " bytes, freeRanges: %" PRIu32 ", largestFree: %" PRIu64 " bytes, fragmentation: %.3f }\n",
+            statistics->blockCount, statistics->dedicatedBlockCount, statistics->allocationCount,
+            (uint64_t) statistics->bytesReserved, (uint64_t) statistics->bytesInUse, statistics->freeRangeCount,
+            (uint64_t) statistics->largestFreeRange, statistics->fragmentation);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <vulkan/vulkan.h>
+
+#define ALLOCATOR_DEFAULT_BLOCK_SIZE (64u << 20)
+// Free ranges are kept in lists by floor(log2(size))
+#define ALLOCATOR_SIZE_CLASS_COUNT 64
+// Fully free blocks kept per memory type instead of being released
+#define ALLOCATOR_MAX_EMPTY_BLOCKS 1
+// Without VK_EXT_memory_budget, the share of a heap the allocator expects to get; the rest is left
+// to the driver, other objects and other processes
+#define ALLOCATOR_HEAP_SHARE_PERCENT 75
+
+struct AllocatorBlock;
+
+// A used or free part of a block. Ranges tile their block and are linked in offset order;
+// free ones are also linked into the size-class list of their memory type.
+typedef struct AllocatorRange {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    bool free;
+    // Buffers are linear resources; only ranges of different kinds need `bufferImageGranularity` apart
+    bool linear;
+    struct AllocatorBlock *block;
+    struct AllocatorRange *previous;
+    struct AllocatorRange *next;
+    struct AllocatorRange *previousFree;
+    struct AllocatorRange *nextFree;
+} AllocatorRange;
+
+typedef struct AllocatorBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t memoryTypeIndex;
+    void *mapped; // the whole block, mapped once when the memory type is host-visible
+    bool dedicated; // holds a single allocation too large to share a block
+    VkDeviceSize bytesInUse;
+    AllocatorRange *ranges;
+    struct AllocatorBlock *previous;
+    struct AllocatorBlock *next;
+} AllocatorBlock;
+
+typedef struct {
+    AllocatorBlock *blocks;
+    AllocatorRange *freeLists[ALLOCATOR_SIZE_CLASS_COUNT];
+    uint32_t emptyBlockCount;
+} AllocatorMemoryType;
+
+// Carves allocations out of large `vkAllocateMemory` blocks per memory type, so the number of
+// device allocations stays far below `maxMemoryAllocationCount`.
+typedef struct {
+    VkDevice device;
+    VkPhysicalDevice physicalDevice;
+    // VK_EXT_memory_budget is enabled, so the room left in a heap can be queried
+    bool memoryBudget;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize bufferImageGranularity;
+    // Allocations of host-visible, non-coherent memory start and end on these, so that flushing or
+    // invalidating whole atoms never touches a neighbouring allocation
+    VkDeviceSize nonCoherentAtomSize;
+    uint32_t maxMemoryAllocationCount;
+    VkDeviceSize blockSize;
+    pthread_mutex_t mutex;
+    AllocatorMemoryType memoryTypes[VK_MAX_MEMORY_TYPES];
+    uint32_t deviceAllocationCount;
+    VkDeviceSize heapBytesReserved[VK_MAX_MEMORY_HEAPS];
+} Allocator;
+
+typedef struct {
+    AllocatorRange *range; // NULL for an empty allocation
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t memoryTypeIndex;
+    void *mapped; // NULL unless the memory type is host-visible
+} Allocation;
+
+typedef struct {
+    uint32_t blockCount;
+    uint32_t dedicatedBlockCount;
+    uint32_t allocationCount;
+    uint32_t freeRangeCount;
+    VkDeviceSize bytesReserved;
+    VkDeviceSize bytesInUse;
+    VkDeviceSize largestFreeRange;
+    // 1 - largest free range / free bytes; 0 when all free memory is contiguous
+    double fragmentation;
+} AllocatorStatistics;
+
+void initAllocator(Allocator *allocator, VkDevice device, VkPhysicalDevice physicalDevice, bool memoryBudget,
+        const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties);
+// All allocations must have been freed
+void destroyAllocator(Allocator *allocator);
+
+// Returns false, with nothing allocated, when the device is out of memory or allocations, so the
+// caller can fall back to another memory type
+bool allocateDeviceMemory(Allocator *allocator, uint32_t memoryTypeIndex, const VkMemoryRequirements *memoryRequirements,
+        bool linear, Allocation *allocation);
+void freeDeviceMemory(Allocator *allocator, Allocation *allocation);
+
+// Bytes that can still be allocated from each heap: the budget left to this process with
+// VK_EXT_memory_budget, otherwise `ALLOCATOR_HEAP_SHARE_PERCENT` of the heap minus the blocks
+// of this allocator
+void getAllocatorHeapRoom(Allocator *allocator, VkDeviceSize heapRoom[VK_MAX_MEMORY_HEAPS]);
+
+void getAllocatorStatistics(Allocator *allocator, AllocatorStatistics *statistics);
+void printAllocatorStatistics(const AllocatorStatistics *statistics);
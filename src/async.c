@@ -0,0 +1,291 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "async.h"
+#include "util.h"
+#include "host_allocator.h"
+
+static bool shouldSubmit(const AsyncQueue *asyncQueue) {
+    if (asyncQueue->pendingCount == 0 || asyncQueue->batchCount == ASYNC_RING_SIZE) {
+        return false;
+    }
+
+    // A busy queue has work to get on with, so jobs are collected into larger batches meanwhile
+    return asyncQueue->batchCount < ASYNC_BUSY_DEPTH
+        || asyncQueue->pendingCount >= ASYNC_MAX_BATCH_SIZE
+        || asyncQueue->stopping;
+}
+
+static void *submitBatches(void *userData) {
+    AsyncQueue *asyncQueue = (AsyncQueue*) userData;
+    VkCommandBuffer commandBuffers[ASYNC_MAX_BATCH_SIZE];
+
+    pthread_mutex_lock(&asyncQueue->mutex);
+
+    while (true) {
+        while (!shouldSubmit(asyncQueue) && !(asyncQueue->stopping && asyncQueue->pendingCount == 0)) {
+            pthread_cond_wait(&asyncQueue->pendingCondition, &asyncQueue->mutex);
+        }
+
+        if (asyncQueue->pendingCount == 0) {
+            break;
+        }
+
+        AsyncBatch *batch = &asyncQueue->batches[(asyncQueue->oldestBatch + asyncQueue->batchCount) % ASYNC_RING_SIZE];
+        batch->futures = asyncQueue->pendingHead;
+        batch->jobCount = 0;
+        batch->submitted = false;
+
+        AsyncFuture *last = NULL;
+
+        for (AsyncFuture *future = asyncQueue->pendingHead;
+                future != NULL && batch->jobCount < ASYNC_MAX_BATCH_SIZE; future = future->next) {
+            commandBuffers[batch->jobCount++] = future->commandBuffer;
+            last = future;
+        }
+
+        asyncQueue->pendingHead = last->next;
+        asyncQueue->pendingTail = asyncQueue->pendingHead != NULL ? asyncQueue->pendingTail : NULL;
+        asyncQueue->pendingCount -= batch->jobCount;
+        last->next = NULL;
+
+        asyncQueue->batchCount += 1;
+        batch->timelineValue = asyncQueue->timeline ? ++asyncQueue->timelineValue : 0;
+
+        pthread_mutex_unlock(&asyncQueue->mutex);
+
+        VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .pNext = NULL,
+            .waitSemaphoreValueCount = 0,
+            .pWaitSemaphoreValues = NULL,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &batch->timelineValue,
+        };
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = asyncQueue->timeline ? &timelineSemaphoreSubmitInfo : NULL,
+            .waitSemaphoreCount = 0,
+            .pWaitSemaphores = NULL,
+            .pWaitDstStageMask = NULL,
+            .commandBufferCount = batch->jobCount,
+            .pCommandBuffers = commandBuffers,
+            .signalSemaphoreCount = asyncQueue->timeline ? 1 : 0,
+            .pSignalSemaphores = asyncQueue->timeline ? &asyncQueue->semaphore : NULL,
+        };
+
+        BAIL_ON_BAD_RESULT(vkQueueSubmit(asyncQueue->queue, 1, &submitInfo,
+                    asyncQueue->timeline ? VK_NULL_HANDLE : batch->fence));
+
+        pthread_mutex_lock(&asyncQueue->mutex);
+        batch->submitted = true;
+        asyncQueue->statistics.submits += 1;
+
+        if (batch->jobCount > asyncQueue->statistics.largestBatch) {
+            asyncQueue->statistics.largestBatch = batch->jobCount;
+        }
+
+        pthread_cond_signal(&asyncQueue->inFlightCondition);
+    }
+
+    pthread_mutex_unlock(&asyncQueue->mutex);
+
+    return NULL;
+}
+
+static void *completeBatches(void *userData) {
+    AsyncQueue *asyncQueue = (AsyncQueue*) userData;
+
+    pthread_mutex_lock(&asyncQueue->mutex);
+
+    while (true) {
+        while (asyncQueue->batchCount == 0 || !asyncQueue->batches[asyncQueue->oldestBatch].submitted) {
+            if (asyncQueue->stopping && asyncQueue->batchCount == 0 && asyncQueue->pendingCount == 0) {
+                pthread_mutex_unlock(&asyncQueue->mutex);
+                return NULL;
+            }
+
+            pthread_cond_wait(&asyncQueue->inFlightCondition, &asyncQueue->mutex);
+        }
+
+        AsyncBatch *batch = &asyncQueue->batches[asyncQueue->oldestBatch];
+        pthread_mutex_unlock(&asyncQueue->mutex);
+
+        // The queue executes batches in submission order, so waiting for the oldest one first is enough
+        if (asyncQueue->timeline) {
+            VkSemaphoreWaitInfo semaphoreWaitInfo = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                .pNext = NULL,
+                .flags = 0,
+                .semaphoreCount = 1,
+                .pSemaphores = &asyncQueue->semaphore,
+                .pValues = &batch->timelineValue,
+            };
+
+            BAIL_ON_BAD_RESULT(asyncQueue->waitSemaphores(asyncQueue->device, &semaphoreWaitInfo, UINT64_MAX));
+        } else {
+            BAIL_ON_BAD_RESULT(vkWaitForFences(asyncQueue->device, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+            BAIL_ON_BAD_RESULT(vkResetFences(asyncQueue->device, 1, &batch->fence));
+        }
+
+        // Outside the lock, so that callbacks can submit more work
+        for (AsyncFuture *future = batch->futures; future != NULL; future = future->next) {
+            if (future->callback != NULL) {
+                future->callback(future->userData);
+            }
+        }
+
+        pthread_mutex_lock(&asyncQueue->mutex);
+
+        // A completed future may be released by its owner right away, so `next` is read first
+        for (AsyncFuture *future = batch->futures, *next; future != NULL; future = next) {
+            next = future->next;
+            future->complete = true;
+        }
+
+        asyncQueue->statistics.jobs += batch->jobCount;
+        asyncQueue->oldestBatch = (asyncQueue->oldestBatch + 1) % ASYNC_RING_SIZE;
+        asyncQueue->batchCount -= 1;
+
+        pthread_cond_broadcast(&asyncQueue->completeCondition);
+        pthread_cond_signal(&asyncQueue->pendingCondition);
+    }
+}
+
+void createAsyncQueue(const ComputeDevice *computeDevice, bool allowTimeline, AsyncQueue *asyncQueue) {
+    *asyncQueue = (AsyncQueue) {
+        .device = computeDevice->device,
+        .queue = computeDevice->queue,
+        .timeline = allowTimeline && computeDevice->timelineSemaphores,
+        .semaphore = VK_NULL_HANDLE,
+        .timelineValue = 0,
+        .waitSemaphores = computeDevice->waitSemaphores,
+        .pendingHead = NULL,
+        .pendingTail = NULL,
+        .pendingCount = 0,
+        .oldestBatch = 0,
+        .batchCount = 0,
+        .stopping = false,
+    };
+
+    if (asyncQueue->timeline) {
+        VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .pNext = NULL,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
+
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &semaphoreTypeCreateInfo,
+            .flags = 0,
+        };
+
+        BAIL_ON_BAD_RESULT(vkCreateSemaphore(asyncQueue->device, &semaphoreCreateInfo, hostAllocationCallbacks(), &asyncQueue->semaphore));
+    } else {
+        VkFenceCreateInfo fenceCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+        };
+
+        for (uint32_t i = 0; i < ASYNC_RING_SIZE; i += 1) {
+            BAIL_ON_BAD_RESULT(vkCreateFence(asyncQueue->device, &fenceCreateInfo, hostAllocationCallbacks(), &asyncQueue->batches[i].fence));
+        }
+    }
+
+    pthread_mutex_init(&asyncQueue->mutex, NULL);
+    pthread_cond_init(&asyncQueue->pendingCondition, NULL);
+    pthread_cond_init(&asyncQueue->inFlightCondition, NULL);
+    pthread_cond_init(&asyncQueue->completeCondition, NULL);
+
+    if (pthread_create(&asyncQueue->submissionThread, NULL, submitBatches, asyncQueue) != 0
+            || pthread_create(&asyncQueue->completionThread, NULL, completeBatches, asyncQueue) != 0) {
+        fprintf(stderr, "Could not start the submission threads.\n");
+        exit(1);
+    }
+}
+
+void destroyAsyncQueue(AsyncQueue *asyncQueue) {
+    pthread_mutex_lock(&asyncQueue->mutex);
+    asyncQueue->stopping = true;
+    pthread_cond_signal(&asyncQueue->pendingCondition);
+    pthread_cond_signal(&asyncQueue->inFlightCondition);
+    pthread_mutex_unlock(&asyncQueue->mutex);
+
+    pthread_join(asyncQueue->submissionThread, NULL);
+    pthread_join(asyncQueue->completionThread, NULL);
+
+    pthread_cond_destroy(&asyncQueue->completeCondition);
+    pthread_cond_destroy(&asyncQueue->inFlightCondition);
+    pthread_cond_destroy(&asyncQueue->pendingCondition);
+    pthread_mutex_destroy(&asyncQueue->mutex);
+
+    if (asyncQueue->timeline) {
+        vkDestroySemaphore(asyncQueue->device, asyncQueue->semaphore, hostAllocationCallbacks());
+    } else {
+        for (uint32_t i = 0; i < ASYNC_RING_SIZE; i += 1) {
+            vkDestroyFence(asyncQueue->device, asyncQueue->batches[i].fence, hostAllocationCallbacks());
+        }
+    }
+}
+
+void asyncSubmit(AsyncQueue *asyncQueue, VkCommandBuffer commandBuffer, AsyncCallback callback, void *userData,
+        AsyncFuture *future) {
+    *future = (AsyncFuture) {
+        .commandBuffer = commandBuffer,
+        .callback = callback,
+        .userData = userData,
+        .complete = false,
+        .next = NULL,
+    };
+
+    pthread_mutex_lock(&asyncQueue->mutex);
+
+    if (asyncQueue->pendingTail != NULL) {
+        asyncQueue->pendingTail->next = future;
+    } else {
+        asyncQueue->pendingHead = future;
+    }
+
+    asyncQueue->pendingTail = future;
+    asyncQueue->pendingCount += 1;
+
+    pthread_cond_signal(&asyncQueue->pendingCondition);
+    pthread_mutex_unlock(&asyncQueue->mutex);
+}
+
+bool asyncPoll(AsyncQueue *asyncQueue, const AsyncFuture *future) {
+    pthread_mutex_lock(&asyncQueue->mutex);
+    bool complete = future->complete;
+    pthread_mutex_unlock(&asyncQueue->mutex);
+
+    return complete;
+}
+
+void asyncWait(AsyncQueue *asyncQueue, const AsyncFuture *future) {
+    pthread_mutex_lock(&asyncQueue->mutex);
+
+    while (!future->complete) {
+        pthread_cond_wait(&asyncQueue->completeCondition, &asyncQueue->mutex);
+    }
+
+    pthread_mutex_unlock(&asyncQueue->mutex);
+}
+
+void getAsyncStatistics(AsyncQueue *asyncQueue, AsyncStatistics *statistics) {
+    pthread_mutex_lock(&asyncQueue->mutex);
+    *statistics = asyncQueue->statistics;
+    pthread_mutex_unlock(&asyncQueue->mutex);
+}
+
+void printAsyncStatistics(const AsyncQueue *asyncQueue, const AsyncStatistics *statistics) {
+    printf("async { completion: %s, jobs: %" PRIu64 ", submits: %" PRIu64 ", averageBatch: %.2f, largestBatch: %" PRIu32 " }\n",
+            asyncQueue->timeline ? "timeline semaphore" : "fence ring",
+            statistics->jobs, statistics->submits,
+            statistics->submits > 0 ? (double) statistics->jobs / (double) statistics->submits : 0.0,
+            statistics->largestBatch);
+}
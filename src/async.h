@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+
+// Batches in flight at once; with fences, the size of the fence ring
+#define ASYNC_RING_SIZE 8
+#define ASYNC_MAX_BATCH_SIZE 32
+// Once this many batches are in flight the queue counts as busy, and new jobs are held back until
+// a batch completes or a full batch has accumulated
+#define ASYNC_BUSY_DEPTH 2
+
+// Runs on the completion thread, before `asyncWait` returns for the job
+typedef void (*AsyncCallback)(void *userData);
+
+// Handle of one submitted command buffer. Owned by the caller, and must stay valid until the job
+// has completed.
+typedef struct AsyncFuture {
+    VkCommandBuffer commandBuffer;
+    AsyncCallback callback;
+    void *userData;
+    bool complete;
+    struct AsyncFuture *next;
+} AsyncFuture;
+
+// Jobs that went to the queue in one `vkQueueSubmit`
+typedef struct {
+    VkFence fence; // unused with a timeline semaphore
+    uint64_t timelineValue; // signalled when the batch completes, with a timeline semaphore
+    AsyncFuture *futures;
+    uint32_t jobCount;
+    bool submitted;
+} AsyncBatch;
+
+typedef struct {
+    uint64_t jobs;
+    uint64_t submits;
+    uint32_t largestBatch;
+} AsyncStatistics;
+
+// Producers only append to a pending list under `mutex`; a submission thread drains it into
+// batches and is the only thread calling `vkQueueSubmit`, so no lock is held around it. A completion
+// thread waits for batches in submission order, then fires their callbacks.
+typedef struct {
+    VkDevice device;
+    VkQueue queue;
+    bool timeline;
+    VkSemaphore semaphore;
+    uint64_t timelineValue;
+    PFN_vkWaitSemaphoresKHR waitSemaphores;
+    pthread_mutex_t mutex;
+    pthread_cond_t pendingCondition; // wakes the submission thread
+    pthread_cond_t inFlightCondition; // wakes the completion thread
+    pthread_cond_t completeCondition; // wakes threads in `asyncWait`
+    AsyncFuture *pendingHead;
+    AsyncFuture *pendingTail;
+    uint32_t pendingCount;
+    AsyncBatch batches[ASYNC_RING_SIZE];
+    uint32_t oldestBatch;
+    uint32_t batchCount;
+    bool stopping;
+    pthread_t submissionThread;
+    pthread_t completionThread;
+    AsyncStatistics statistics;
+} AsyncQueue;
+
+// The queue must not be submitted to by anything else while the AsyncQueue exists. Uses a timeline
+// semaphore when `allowTimeline` is set and the device has one enabled, otherwise a ring of fences.
+void createAsyncQueue(const ComputeDevice *computeDevice, bool allowTimeline, AsyncQueue *asyncQueue);
+// Completes every job submitted so far
+void destroyAsyncQueue(AsyncQueue *asyncQueue);
+
+// May be called from any thread, including callbacks. `callback` may be NULL.
+void asyncSubmit(AsyncQueue *asyncQueue, VkCommandBuffer commandBuffer, AsyncCallback callback, void *userData,
+        AsyncFuture *future);
+bool asyncPoll(AsyncQueue *asyncQueue, const AsyncFuture *future);
+void asyncWait(AsyncQueue *asyncQueue, const AsyncFuture *future);
+
+void getAsyncStatistics(AsyncQueue *asyncQueue, AsyncStatistics *statistics);
+void printAsyncStatistics(const AsyncQueue *asyncQueue, const AsyncStatistics *statistics);
@@ -0,0 +1,117 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "autotune.h"
+#include "cache.h"
+
+static void tunedWorkgroupSizeFileName(char *fileName, size_t fileNameSize, const VkPhysicalDeviceProperties *properties) {
+    snprintf(fileName, fileNameSize, "workgroup-size-%08" PRIx32 "-%08" PRIx32 "-%08" PRIx32,
+            properties->vendorID, properties->deviceID, properties->driverVersion);
+}
+
+uint32_t maxWorkgroupSize(const VkPhysicalDeviceProperties *properties) {
+    uint32_t maxSize = properties->limits.maxComputeWorkGroupSize[0];
+
+    if (properties->limits.maxComputeWorkGroupInvocations < maxSize) {
+        maxSize = properties->limits.maxComputeWorkGroupInvocations;
+    }
+
+    return maxSize > 0 ? maxSize : 1;
+}
+
+uint32_t chooseWorkgroupSize(const VkPhysicalDeviceProperties *properties, uint32_t requested) {
+    uint32_t maxSize = maxWorkgroupSize(properties);
+
+    if (requested == 0 && loadTunedWorkgroupSize(properties, &requested)) {
+        return requested;
+    }
+
+    if (requested == 0) {
+        requested = DEFAULT_WORKGROUP_SIZE;
+    }
+
+    return requested < maxSize ? requested : maxSize;
+}
+
+bool loadTunedWorkgroupSize(const VkPhysicalDeviceProperties *properties, uint32_t *workgroupSize) {
+    char fileName[64];
+    tunedWorkgroupSizeFileName(fileName, sizeof(fileName), properties);
+
+    size_t size;
+    char *data = cacheRead(fileName, &size);
+
+    if (data == NULL) {
+        return false;
+    }
+
+    char text[16] = { 0 };
+    memcpy(text, data, size < sizeof(text) - 1 ? size : sizeof(text) - 1);
+    free(data);
+
+    char *end;
+    unsigned long value = strtoul(text, &end, 10);
+
+    // A stale entry may be larger than what the (same) device reports now; ignore it
+    if (end == text || value == 0 || value > maxWorkgroupSize(properties)) {
+        return false;
+    }
+
+    *workgroupSize = (uint32_t) value;
+
+    return true;
+}
+
+void storeTunedWorkgroupSize(const VkPhysicalDeviceProperties *properties, uint32_t workgroupSize) {
+    char fileName[64];
+    tunedWorkgroupSizeFileName(fileName, sizeof(fileName), properties);
+
+    char text[16];
+    int length = snprintf(text, sizeof(text), "%" PRIu32 "\n", workgroupSize);
+
+    if (!cacheWrite(fileName, text, length)) {
+        fprintf(stderr, "Could not store the tuned workgroup size `%s`.\n", fileName);
+    }
+}
+
+static double benchmarkCandidate(uint32_t workgroupSize, WorkgroupSizeBenchmark benchmark, void *userData) {
+    double duration = benchmark(workgroupSize, AUTOTUNE_REPETITIONS, userData);
+
+    printf("autotune { workgroupSize: %" PRIu32 ", duration: %.3f us }\n", workgroupSize, duration * 1e6);
+
+    return duration;
+}
+
+// Candidates are the powers of two within the device limits, plus the limit itself
+uint32_t autotuneWorkgroupSize(const VkPhysicalDeviceProperties *properties, WorkgroupSizeBenchmark benchmark, void *userData) {
+    const uint32_t maxSize = maxWorkgroupSize(properties);
+    uint32_t bestSize = 1;
+    double bestDuration = INFINITY;
+    uint32_t lastSize = 0;
+
+    for (uint32_t size = 1; size <= maxSize && size > lastSize; size *= 2) {
+        double duration = benchmarkCandidate(size, benchmark, userData);
+
+        if (duration < bestDuration) {
+            bestDuration = duration;
+            bestSize = size;
+        }
+
+        lastSize = size;
+    }
+
+    if (lastSize != maxSize) {
+        double duration = benchmarkCandidate(maxSize, benchmark, userData);
+
+        if (duration < bestDuration) {
+            bestDuration = duration;
+            bestSize = maxSize;
+        }
+    }
+
+    printf("autotune { best: %" PRIu32 ", duration: %.3f us }\n", bestSize, bestDuration * 1e6);
+    storeTunedWorkgroupSize(properties, bestSize);
+
+    return bestSize;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+#define AUTOTUNE_REPETITIONS 8
+#define DEFAULT_WORKGROUP_SIZE 64
+
+// Runs the kernel with the given workgroup size `repetitions` times (after a warm-up)
+// and returns the shortest observed duration in seconds.
+typedef double (*WorkgroupSizeBenchmark)(uint32_t workgroupSize, uint32_t repetitions, void *userData);
+
+uint32_t maxWorkgroupSize(const VkPhysicalDeviceProperties *properties);
+
+// `requested` clamped to the device limit; 0 picks the tuned size, or the default
+uint32_t chooseWorkgroupSize(const VkPhysicalDeviceProperties *properties, uint32_t requested);
+
+// Tuned sizes are stored per vendorID/deviceID/driverVersion, so a driver update triggers a retune.
+bool loadTunedWorkgroupSize(const VkPhysicalDeviceProperties *properties, uint32_t *workgroupSize);
+void storeTunedWorkgroupSize(const VkPhysicalDeviceProperties *properties, uint32_t workgroupSize);
+
+uint32_t autotuneWorkgroupSize(const VkPhysicalDeviceProperties *properties, WorkgroupSizeBenchmark benchmark, void *userData);
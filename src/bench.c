@@ -0,0 +1,951 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+
+#include "util.h"
+#include "autotune.h"
+#include "descriptor.h"
+#include "memory.h"
+#include "kernel.h"
+#include "pipeline_cache.h"
+#include "profile.h"
+#include "device.h"
+#include "format.h"
+#include "shader.h"
+#include "vkcscratch.h"
+#include "host_allocator.h"
+
+#define BENCH_DEFAULT_MIN_SIZE (4 << 10)
+#define BENCH_DEFAULT_MAX_SIZE (256 << 20)
+#define BENCH_DEFAULT_ITERATIONS 10
+#define BENCH_MIN_WORKGROUP_SIZE 16
+#define BENCH_MAX_WORKGROUP_SIZES 8
+#define BENCH_RETAINED_ELEMENT_COUNT 1024
+#define BENCH_ASYNC_PRODUCER_COUNT 4
+#define BENCH_ASYNC_JOBS_PER_PRODUCER 4
+#define BENCH_ASYNC_ROUNDS 64
+// Inputs, and as many outputs; every dispatch copies one input to one output
+#define BENCH_REBIND_BUFFER_COUNT 8
+#define BENCH_REBIND_ELEMENT_COUNT 256
+#define BENCH_REBIND_DISPATCHES 4096
+#define BENCH_REBIND_BATCH_SIZE 256
+
+typedef struct {
+    const char *name;
+    // The shader is the native or the packed variant for the format, see `chooseFormatKernel`
+    ElementFormat format;
+    // Bytes moved through device memory per input byte, for the bandwidth figure
+    uint32_t trafficFactor;
+} BenchKernel;
+
+static const BenchKernel benchKernels[] = {
+    { .name = "copy", .format = ELEMENT_FORMAT_INT32, .trafficFactor = 2 },
+    { .name = "copy", .format = ELEMENT_FORMAT_INT16, .trafficFactor = 2 },
+    { .name = "copy", .format = ELEMENT_FORMAT_INT8, .trafficFactor = 2 },
+    { .name = "copy", .format = ELEMENT_FORMAT_FLOAT16, .trafficFactor = 2 },
+};
+
+static const MemoryPlacement benchPlacements[] = {
+    MEMORY_PLACEMENT_HOST_VISIBLE,
+    MEMORY_PLACEMENT_DEVICE_LOCAL,
+};
+
+typedef struct {
+    const char *deviceSelection; // NULL falls back to VKCSCRATCH_DEVICE, then device 0
+    uint64_t minSize;
+    uint64_t maxSize;
+    uint32_t iterations;
+    const char *csvPath; // NULL to only print the results
+} BenchOptions;
+
+typedef struct {
+    const char *kernel;
+    ElementFormat format;
+    bool native;
+    uint64_t size;
+    uint32_t workgroupSize;
+    MemoryPlacement placement;
+    double uploadSeconds;
+    double dispatchSeconds;
+    double readbackSeconds;
+    double hostSeconds; // submit to fence
+    double memcpySeconds;
+    uint32_t trafficFactor;
+} BenchResult;
+
+void printBenchUsage(const char *programName) {
+    printf("Usage: %s [--device N] [--min-size SIZE] [--max-size SIZE] [--iterations N] [--csv RESULTS.csv]\n"
+           "SIZE is in bytes and may end with K, M or G. The device may also be given by VKCSCRATCH_DEVICE.\n",
+           programName);
+}
+
+BenchOptions parseBenchOptions(int argc, char *argv[]) {
+    BenchOptions options = {
+        .deviceSelection = NULL,
+        .minSize = BENCH_DEFAULT_MIN_SIZE,
+        .maxSize = BENCH_DEFAULT_MAX_SIZE,
+        .iterations = BENCH_DEFAULT_ITERATIONS,
+        .csvPath = NULL,
+    };
+
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+            options.deviceSelection = argv[++i];
+        } else if (strcmp(argv[i], "--min-size") == 0 && i + 1 < argc) {
+            if (!parseSize(argv[++i], &options.minSize)) {
+                fprintf(stderr, "Invalid minimum size.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) {
+            if (!parseSize(argv[++i], &options.maxSize)) {
+                fprintf(stderr, "Invalid maximum size.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            options.iterations = (uint32_t) strtoul(argv[++i], NULL, 10);
+
+            if (options.iterations == 0) {
+                fprintf(stderr, "At least one iteration is required.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            options.csvPath = argv[++i];
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printBenchUsage(argv[0]);
+            exit(0);
+        } else {
+            printBenchUsage(argv[0]);
+            exit(1);
+        }
+    }
+
+    options.minSize = (options.minSize + sizeof(int32_t) - 1) / sizeof(int32_t) * sizeof(int32_t);
+
+    if (options.minSize > options.maxSize) {
+        fprintf(stderr, "The minimum size is larger than the maximum size.\n");
+        exit(1);
+    }
+
+    return options;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double*) a, y = *(const double*) b;
+
+    return (x > y) - (x < y);
+}
+
+// Sorts `values` in place
+static double median(double *values, uint32_t count) {
+    qsort(values, count, sizeof(double), compareDoubles);
+
+    return count % 2 == 1 ? values[count / 2] : 0.5 * (values[count / 2 - 1] + values[count / 2]);
+}
+
+// Two buffers of `maxSize` plus their staging copies have to fit next to each other
+static uint64_t clampBenchSize(const ComputeDevice *computeDevice, uint64_t maxSize) {
+    uint64_t limit = computeDevice->properties.limits.maxStorageBufferRange;
+    VkDeviceSize largestHeap = 0;
+
+    for (uint32_t i = 0; i < computeDevice->memoryProperties.memoryHeapCount; i += 1) {
+        if (computeDevice->memoryProperties.memoryHeaps[i].size > largestHeap) {
+            largestHeap = computeDevice->memoryProperties.memoryHeaps[i].size;
+        }
+    }
+
+    if (largestHeap / 4 < limit) {
+        limit = largestHeap / 4;
+    }
+
+    return (maxSize < limit ? maxSize : limit) / sizeof(int32_t) * sizeof(int32_t);
+}
+
+static double benchMemcpy(uint64_t size, uint32_t iterations) {
+    uint8_t *source = malloc(size);
+    uint8_t *destination = malloc(size);
+    double *seconds = malloc(iterations * sizeof(double));
+
+    if (source == NULL || destination == NULL || seconds == NULL) {
+        fprintf(stderr, "Could not allocate memory for the memcpy baseline.\n");
+        exit(1);
+    }
+
+    memset(source, 0x5a, size);
+    memset(destination, 0, size); // fault the pages in outside the measurement
+
+    for (uint32_t i = 0; i < iterations; i += 1) {
+        double startTime = timeNowSeconds();
+        memcpy(destination, source, size);
+        seconds[i] = timeNowSeconds() - startTime;
+    }
+
+    if (memcmp(destination, source, size) != 0) {
+        fprintf(stderr, "memcpy baseline mismatch.\n");
+        exit(1);
+    }
+
+    double result = median(seconds, iterations);
+
+    free(seconds);
+    free(destination);
+    free(source);
+
+    return result;
+}
+
+static double gigabytesPerSecond(double bytes, double seconds) {
+    return seconds > 0.0 ? bytes / seconds * 1e-9 : 0.0;
+}
+
+static double benchDeviceSeconds(const BenchResult *result) {
+    return result->uploadSeconds + result->dispatchSeconds + result->readbackSeconds;
+}
+
+// Billions of elements per second through the kernel; the same bandwidth carries more narrow elements
+static double kernelElementRate(const BenchResult *result) {
+    return gigabytesPerSecond((double) result->size / elementFormatSize(result->format), result->dispatchSeconds);
+}
+
+void printBenchResult(const BenchResult *result) {
+    printf("bench { kernel: %s, format: %s, access: %s, size: %" PRIu64 ", workgroupSize: %" PRIu32 ", memory: %s, "
+           "upload: %.3f ms, dispatch: %.3f ms, readback: %.3f ms, submitToFence: %.3f ms, "
+           "kernelBandwidth: %.2f GB/s, kernelElements: %.2f G/s, endToEndBandwidth: %.2f GB/s, memcpyBandwidth: %.2f GB/s, "
+           "dispatchOverhead: %.1f us }\n",
+            result->kernel, elementFormatString(result->format), result->native ? "native" : "packed", result->size,
+            result->workgroupSize, memoryPlacementString(result->placement),
+            result->uploadSeconds * 1e3, result->dispatchSeconds * 1e3, result->readbackSeconds * 1e3,
+            result->hostSeconds * 1e3,
+            gigabytesPerSecond((double) result->trafficFactor * result->size, result->dispatchSeconds),
+            kernelElementRate(result),
+            gigabytesPerSecond((double) result->size, result->hostSeconds),
+            gigabytesPerSecond((double) result->size, result->memcpySeconds),
+            (result->hostSeconds - benchDeviceSeconds(result)) * 1e6);
+}
+
+void writeBenchResultCsvHeader(FILE *file) {
+    fprintf(file, "kernel,format,access,size,workgroupSize,memory,uploadSeconds,dispatchSeconds,readbackSeconds,"
+            "submitToFenceSeconds,kernelGBps,kernelGElementsPerSecond,endToEndGBps,memcpyGBps,dispatchOverheadUs\n");
+}
+
+void writeBenchResultCsv(FILE *file, const BenchResult *result) {
+    fprintf(file, "%s,%s,%s,%" PRIu64 ",%" PRIu32 ",%s,%.9f,%.9f,%.9f,%.9f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+            result->kernel, elementFormatString(result->format), result->native ? "native" : "packed", result->size,
+            result->workgroupSize, memoryPlacementString(result->placement),
+            result->uploadSeconds, result->dispatchSeconds, result->readbackSeconds, result->hostSeconds,
+            gigabytesPerSecond((double) result->trafficFactor * result->size, result->dispatchSeconds),
+            kernelElementRate(result),
+            gigabytesPerSecond((double) result->size, result->hostSeconds),
+            gigabytesPerSecond((double) result->size, result->memcpySeconds),
+            (result->hostSeconds - benchDeviceSeconds(result)) * 1e6);
+}
+
+// Records upload, dispatch and readback into one reusable command buffer and submits it `iterations` times;
+// `invocationCount` is the element count of the kernel parameters
+static bool benchConfiguration(const ComputeDevice *computeDevice, Profile *profile, VkCommandPool commandPool,
+        VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet *descriptorSets,
+        const PlacedBuffer *inputBuffer, const PlacedBuffer *outputBuffer, uint32_t invocationCount, DispatchGrid grid,
+        uint32_t iterations, BenchResult *result) {
+    VkDevice device = computeDevice->device;
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer commandBuffer;
+    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer));
+
+    beginCommandBuffer(commandBuffer, 0);
+    profileResetDeviceRegions(profile, commandBuffer);
+
+    uint32_t uploadRegion = profileBeginDeviceRegion(profile, commandBuffer, "upload");
+    recordPlacedBufferUpload(commandBuffer, inputBuffer);
+    profileEndDeviceRegion(profile, commandBuffer, uploadRegion);
+
+    uint32_t dispatchRegion = profileBeginDeviceRegion(profile, commandBuffer, "dispatch");
+    KernelParameters parameters = contiguousKernelParameters(invocationCount);
+    recordDispatch(commandBuffer, pipeline, pipelineLayout, descriptorSets, &parameters, grid);
+    profileEndDeviceRegion(profile, commandBuffer, dispatchRegion);
+
+    uint32_t readbackRegion = profileBeginDeviceRegion(profile, commandBuffer, "readback");
+    recordPlacedBufferReadback(commandBuffer, outputBuffer);
+    profileEndDeviceRegion(profile, commandBuffer, readbackRegion);
+
+    BAIL_ON_BAD_RESULT(vkEndCommandBuffer(commandBuffer));
+
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+
+    VkFence fence;
+    BAIL_ON_BAD_RESULT(vkCreateFence(device, &fenceCreateInfo, hostAllocationCallbacks(), &fence));
+
+    VkCommandBuffer commandBuffers[] = { commandBuffer };
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = commandBuffers,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL,
+    };
+
+    double *samples = malloc(4 * iterations * sizeof(double));
+
+    if (samples == NULL) {
+        fprintf(stderr, "Could not allocate memory for the samples.\n");
+        exit(1);
+    }
+
+    double *uploadSamples = samples;
+    double *dispatchSamples = samples + iterations;
+    double *readbackSamples = samples + 2 * iterations;
+    double *hostSamples = samples + 3 * iterations;
+
+    for (uint32_t i = 0; i < iterations; i += 1) {
+        // The recorded regions rewrite their queries on every submission, so re-arm them and keep only this one
+        profile->entryCount = 0;
+        profile->regionCount = readbackRegion == UINT32_MAX ? 0 : 3;
+
+        double submitTime = timeNowSeconds();
+        BAIL_ON_BAD_RESULT(vkQueueSubmit(computeDevice->queue, 1, &submitInfo, fence));
+        BAIL_ON_BAD_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+        hostSamples[i] = timeNowSeconds() - submitTime;
+        BAIL_ON_BAD_RESULT(vkResetFences(device, 1, &fence));
+
+        profileCollectDeviceRegions(profile, device);
+
+        // Without timestamps the whole submission is attributed to the dispatch
+        uploadSamples[i] = profile->entryCount == 3 ? profile->entries[0].seconds : 0.0;
+        dispatchSamples[i] = profile->entryCount == 3 ? profile->entries[1].seconds : hostSamples[i];
+        readbackSamples[i] = profile->entryCount == 3 ? profile->entries[2].seconds : 0.0;
+    }
+
+    result->uploadSeconds = median(uploadSamples, iterations);
+    result->dispatchSeconds = median(dispatchSamples, iterations);
+    result->readbackSeconds = median(readbackSamples, iterations);
+    result->hostSeconds = median(hostSamples, iterations);
+
+    free(samples);
+    vkDestroyFence(device, fence, hostAllocationCallbacks());
+    vkFreeCommandBuffers(device, commandPool, 1, commandBuffers);
+
+    invalidatePlacedBuffer(&computeDevice->allocator, outputBuffer, outputBuffer->size);
+
+    return memcmp(inputBuffer->mapped, outputBuffer->mapped, inputBuffer->size) == 0;
+}
+
+// Small jobs are dominated by setup; compare building a job from scratch with rerunning it on a warm context
+static bool benchRetainedContext(const BenchOptions *options) {
+    VkcsContextOptions contextOptions;
+    vkcsDefaultContextOptions(&contextOptions);
+    contextOptions.deviceSelection = options->deviceSelection;
+
+    VkcsContext *context = vkcsCreateContext(&contextOptions);
+    VkDeviceSize size = BENCH_RETAINED_ELEMENT_COUNT * sizeof(int32_t);
+    VkcsBuffer *input = vkcsCreateBuffer(context, size, VKCS_MEMORY_AUTO);
+    VkcsBuffer *output = vkcsCreateBuffer(context, size, VKCS_MEMORY_AUTO);
+    int32_t *inputElements = vkcsBufferMapping(input);
+
+    for (uint32_t i = 0; i < BENCH_RETAINED_ELEMENT_COUNT; i += 1) {
+        inputElements[i] = (int32_t) (i * 2654435761u);
+    }
+
+    double coldStartTime = timeNowSeconds();
+    VkcsKernel *kernel = vkcsCreateKernel(context, NULL, 0, 0);
+    VkcsJob *job = vkcsCreateJob(kernel, input, output, BENCH_RETAINED_ELEMENT_COUNT);
+    vkcsRunJob(job);
+    double coldSeconds = timeNowSeconds() - coldStartTime;
+
+    double *seconds = malloc(options->iterations * sizeof(double));
+
+    if (seconds == NULL) {
+        fprintf(stderr, "Could not allocate memory for the samples.\n");
+        exit(1);
+    }
+
+    for (uint32_t i = 0; i < options->iterations; i += 1) {
+        double startTime = timeNowSeconds();
+        vkcsRunJob(job);
+        seconds[i] = timeNowSeconds() - startTime;
+    }
+
+    bool matches = memcmp(vkcsBufferMapping(input), vkcsBufferMapping(output), size) == 0;
+
+    printf("retained { size: %" PRIu64 ", workgroupSize: %" PRIu32 ", coldJob: %.3f ms, warmRun: %.1f us }\n",
+            (uint64_t) size, vkcsKernelWorkgroupSize(kernel), coldSeconds * 1e3, median(seconds, options->iterations) * 1e6);
+
+    free(seconds);
+    vkcsDestroyJob(job);
+    vkcsDestroyKernel(kernel);
+    vkcsDestroyBuffer(output);
+    vkcsDestroyBuffer(input);
+    vkcsDestroyContext(context);
+
+    return matches;
+}
+
+typedef enum {
+    // One set bound once per batch: the floor the rebinding strategies are measured against
+    BENCH_REBIND_FIXED,
+    // A set allocated from a pool that is reset every batch, and written, for every dispatch
+    BENCH_REBIND_ALLOCATE,
+    // Through a descriptor cache
+    BENCH_REBIND_CACHED,
+} BenchRebindStrategy;
+
+// Records BENCH_REBIND_DISPATCHES small copies between the pairs of inputs and outputs, in batches
+// that are submitted one after the other, and returns the host seconds spent recording each
+// dispatch. `mode` is the one of the cache, whose layouts every strategy uses.
+static double benchRebindStrategy(ComputeDevice *computeDevice, VkPipelineCache pipelineCache, VkShaderModule shaderModule,
+        uint32_t workgroupSize, BenchRebindStrategy strategy, DescriptorMode mode, const PlacedBuffer *inputs,
+        const PlacedBuffer *outputs, VkCommandPool commandPool, bool *matches) {
+    VkDevice device = computeDevice->device;
+    DescriptorCache descriptorCache;
+    createDescriptorCache(computeDevice, mode, 2, sizeof(KernelParameters), &descriptorCache);
+    VkPipeline pipeline = createComputePipeline(device, pipelineCache, shaderModule, descriptorCache.pipelineLayout,
+            workgroupSize);
+
+    VkDescriptorPoolSize descriptorPoolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 2 * BENCH_REBIND_BATCH_SIZE,
+    };
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = BENCH_REBIND_BATCH_SIZE,
+        .poolSizeCount = 1,
+        .pPoolSizes = &descriptorPoolSize,
+    };
+
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+
+    if (strategy == BENCH_REBIND_ALLOCATE) {
+        BAIL_ON_BAD_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, hostAllocationCallbacks(), &descriptorPool));
+    }
+
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+
+    VkFence fence;
+    BAIL_ON_BAD_RESULT(vkCreateFence(device, &fenceCreateInfo, hostAllocationCallbacks(), &fence));
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    KernelParameters parameters = contiguousKernelParameters(BENCH_REBIND_ELEMENT_COUNT);
+    DispatchGrid grid = dispatchGrid(&computeDevice->properties.limits, BENCH_REBIND_ELEMENT_COUNT, workgroupSize);
+    // The input each output was copied from last
+    uint32_t lastInputs[BENCH_REBIND_BUFFER_COUNT];
+    double recordSeconds = 0.0;
+
+    for (uint32_t o = 0; o < BENCH_REBIND_BUFFER_COUNT; o += 1) {
+        lastInputs[o] = UINT32_MAX;
+    }
+
+    for (uint32_t batch = 0; batch < BENCH_REBIND_DISPATCHES / BENCH_REBIND_BATCH_SIZE; batch += 1) {
+        VkCommandBuffer commandBuffer;
+        BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer));
+
+        double startTime = timeNowSeconds();
+        beginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+        if (strategy == BENCH_REBIND_ALLOCATE) {
+            BAIL_ON_BAD_RESULT(vkResetDescriptorPool(device, descriptorPool, 0));
+        } else if (strategy == BENCH_REBIND_FIXED) {
+            VkBuffer buffers[] = { inputs[0].buffer, outputs[0].buffer };
+            DescriptorBinding binding;
+            descriptorCacheAcquire(&descriptorCache, buffers, &binding);
+            recordDescriptorBinding(&descriptorCache, commandBuffer, &binding);
+            lastInputs[0] = 0;
+        }
+
+        for (uint32_t d = 0; d < BENCH_REBIND_BATCH_SIZE; d += 1) {
+            // Every input goes to every output once in BENCH_REBIND_BUFFER_COUNT^2 dispatches
+            uint32_t dispatch = batch * BENCH_REBIND_BATCH_SIZE + d;
+            uint32_t i = dispatch % BENCH_REBIND_BUFFER_COUNT;
+            uint32_t o = (dispatch / BENCH_REBIND_BUFFER_COUNT + i) % BENCH_REBIND_BUFFER_COUNT;
+            VkBuffer buffers[] = { inputs[i].buffer, outputs[o].buffer };
+
+            if (strategy == BENCH_REBIND_ALLOCATE) {
+                VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                    .pNext = NULL,
+                    .descriptorPool = descriptorPool,
+                    .descriptorSetCount = 1,
+                    .pSetLayouts = &descriptorCache.descriptorSetLayout,
+                };
+
+                VkDescriptorSet descriptorSets[1];
+                BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, descriptorSets));
+                updateKernelDescriptorSet(device, descriptorSets[0], buffers[0], buffers[1]);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, descriptorCache.pipelineLayout,
+                        0, 1, descriptorSets, 0, NULL);
+                lastInputs[o] = i;
+            } else if (strategy == BENCH_REBIND_CACHED) {
+                DescriptorBinding binding;
+                descriptorCacheAcquire(&descriptorCache, buffers, &binding);
+                recordDescriptorBinding(&descriptorCache, commandBuffer, &binding);
+                lastInputs[o] = i;
+            }
+
+            recordDispatch(commandBuffer, pipeline, descriptorCache.pipelineLayout, NULL, &parameters, grid);
+            // Orders the copies into the same output
+            recordComputeBarrier(commandBuffer);
+        }
+
+        BAIL_ON_BAD_RESULT(vkEndCommandBuffer(commandBuffer));
+        recordSeconds += timeNowSeconds() - startTime;
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = NULL,
+            .waitSemaphoreCount = 0,
+            .pWaitSemaphores = NULL,
+            .pWaitDstStageMask = NULL,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &commandBuffer,
+            .signalSemaphoreCount = 0,
+            .pSignalSemaphores = NULL,
+        };
+
+        BAIL_ON_BAD_RESULT(vkQueueSubmit(computeDevice->queue, 1, &submitInfo, fence));
+        BAIL_ON_BAD_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+        BAIL_ON_BAD_RESULT(vkResetFences(device, 1, &fence));
+        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    }
+
+    for (uint32_t o = 0; o < BENCH_REBIND_BUFFER_COUNT; o += 1) {
+        if (lastInputs[o] != UINT32_MAX) {
+            invalidatePlacedBuffer(&computeDevice->allocator, &outputs[o], outputs[o].size);
+            *matches = *matches && memcmp(inputs[lastInputs[o]].mapped, outputs[o].mapped, outputs[o].size) == 0;
+        }
+    }
+
+    if (strategy == BENCH_REBIND_CACHED) {
+        DescriptorCacheStatistics descriptorCacheStatistics;
+        getDescriptorCacheStatistics(&descriptorCache, &descriptorCacheStatistics);
+        printDescriptorCacheStatistics(&descriptorCache, &descriptorCacheStatistics);
+    }
+
+    vkDestroyFence(device, fence, hostAllocationCallbacks());
+
+    if (descriptorPool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, descriptorPool, hostAllocationCallbacks());
+    }
+
+    vkDestroyPipeline(device, pipeline, hostAllocationCallbacks());
+    destroyDescriptorCache(&descriptorCache);
+
+    return recordSeconds / BENCH_REBIND_DISPATCHES;
+}
+
+// Host cost of binding different buffers to every dispatch: a fresh set per dispatch against the
+// descriptor cache in every mode the device supports, each above binding one set for all of them
+static bool benchRebinding(ComputeDevice *computeDevice, VkPipelineCache pipelineCache, VkCommandPool commandPool) {
+    VkDeviceSize size = BENCH_REBIND_ELEMENT_COUNT * sizeof(int32_t);
+    PlacedBuffer inputs[BENCH_REBIND_BUFFER_COUNT], outputs[BENCH_REBIND_BUFFER_COUNT];
+
+    for (uint32_t b = 0; b < BENCH_REBIND_BUFFER_COUNT; b += 1) {
+        createPlacedBuffer(&computeDevice->allocator, &computeDevice->properties, MEMORY_PLACEMENT_HOST_VISIBLE,
+                MEMORY_DIRECTION_UPLOAD, size, computeDevice->queueFamilyIndex, &inputs[b]);
+        createPlacedBuffer(&computeDevice->allocator, &computeDevice->properties, MEMORY_PLACEMENT_HOST_VISIBLE,
+                MEMORY_DIRECTION_READBACK, size, computeDevice->queueFamilyIndex, &outputs[b]);
+        fillElements(ELEMENT_FORMAT_INT32, inputs[b].mapped, BENCH_REBIND_ELEMENT_COUNT, 2654435761u * (b + 1));
+        flushPlacedBuffer(&computeDevice->allocator, &inputs[b], size);
+    }
+
+    uint32_t shaderSize;
+    uint32_t *shaderData;
+    shaderLoad(&shaderSize, &shaderData);
+
+    VkShaderModule shaderModule = createKernelShaderModule(computeDevice->device, shaderSize, shaderData);
+    uint32_t workgroupSize = chooseWorkgroupSize(&computeDevice->properties, 0);
+    bool matches = true;
+
+    double fixedSeconds = benchRebindStrategy(computeDevice, pipelineCache, shaderModule, workgroupSize,
+            BENCH_REBIND_FIXED, DESCRIPTOR_MODE_UPDATE, inputs, outputs, commandPool, &matches);
+    double allocateSeconds = benchRebindStrategy(computeDevice, pipelineCache, shaderModule, workgroupSize,
+            BENCH_REBIND_ALLOCATE, DESCRIPTOR_MODE_UPDATE, inputs, outputs, commandPool, &matches);
+    double cachedSeconds[DESCRIPTOR_MODE_COUNT];
+
+    for (DescriptorMode mode = DESCRIPTOR_MODE_UPDATE; mode < DESCRIPTOR_MODE_COUNT; mode += 1) {
+        cachedSeconds[mode] = descriptorModeSupported(computeDevice, mode)
+            ? benchRebindStrategy(computeDevice, pipelineCache, shaderModule, workgroupSize, BENCH_REBIND_CACHED, mode,
+                    inputs, outputs, commandPool, &matches)
+            : -1.0;
+    }
+
+    // Recording cost per dispatch above the fixed binding
+    printf("rebind { pairs: %u, dispatches: %u, fixed: %.3f us, allocate: +%.3f us",
+            BENCH_REBIND_BUFFER_COUNT * BENCH_REBIND_BUFFER_COUNT, BENCH_REBIND_DISPATCHES, fixedSeconds * 1e6,
+            (allocateSeconds - fixedSeconds) * 1e6);
+
+    for (DescriptorMode mode = DESCRIPTOR_MODE_UPDATE; mode < DESCRIPTOR_MODE_COUNT; mode += 1) {
+        if (cachedSeconds[mode] >= 0.0) {
+            printf(", %s: +%.3f us", descriptorModeString(mode), (cachedSeconds[mode] - fixedSeconds) * 1e6);
+        } else {
+            printf(", %s: unsupported", descriptorModeString(mode));
+        }
+    }
+
+    printf(" }\n");
+
+    vkDestroyShaderModule(computeDevice->device, shaderModule, hostAllocationCallbacks());
+
+    for (uint32_t b = 0; b < BENCH_REBIND_BUFFER_COUNT; b += 1) {
+        destroyPlacedBuffer(&computeDevice->allocator, &outputs[b]);
+        destroyPlacedBuffer(&computeDevice->allocator, &inputs[b]);
+    }
+
+    return matches;
+}
+
+typedef struct {
+    VkcsJob *jobs[BENCH_ASYNC_JOBS_PER_PRODUCER];
+    pthread_t thread;
+} BenchProducer;
+
+static void *runBenchProducer(void *userData) {
+    BenchProducer *producer = (BenchProducer*) userData;
+
+    // Resubmitting a job waits for its previous run, so each producer keeps its jobs in flight
+    for (uint32_t round = 0; round < BENCH_ASYNC_ROUNDS; round += 1) {
+        for (uint32_t i = 0; i < BENCH_ASYNC_JOBS_PER_PRODUCER; i += 1) {
+            vkcsSubmitJob(producer->jobs[i]);
+        }
+    }
+
+    for (uint32_t i = 0; i < BENCH_ASYNC_JOBS_PER_PRODUCER; i += 1) {
+        vkcsWaitJob(producer->jobs[i]);
+    }
+
+    return NULL;
+}
+
+// Small jobs from several producer threads, against the same jobs run one at a time
+static bool benchAsyncSubmission(const BenchOptions *options) {
+    VkcsContextOptions contextOptions;
+    vkcsDefaultContextOptions(&contextOptions);
+    contextOptions.deviceSelection = options->deviceSelection;
+
+    const uint32_t jobCount = BENCH_ASYNC_PRODUCER_COUNT * BENCH_ASYNC_JOBS_PER_PRODUCER;
+    const uint32_t runCount = jobCount * BENCH_ASYNC_ROUNDS;
+    VkcsContext *context = vkcsCreateContext(&contextOptions);
+    VkDeviceSize size = BENCH_RETAINED_ELEMENT_COUNT * sizeof(int32_t);
+    VkcsKernel *kernel = vkcsCreateKernel(context, NULL, 0, 0);
+    VkcsBuffer *input = vkcsCreateBuffer(context, size, VKCS_MEMORY_AUTO);
+    VkcsBuffer *outputs[BENCH_ASYNC_PRODUCER_COUNT * BENCH_ASYNC_JOBS_PER_PRODUCER];
+    BenchProducer producers[BENCH_ASYNC_PRODUCER_COUNT];
+    int32_t *inputElements = vkcsBufferMapping(input);
+
+    for (uint32_t i = 0; i < BENCH_RETAINED_ELEMENT_COUNT; i += 1) {
+        inputElements[i] = (int32_t) (i * 2654435761u);
+    }
+
+    for (uint32_t i = 0; i < jobCount; i += 1) {
+        outputs[i] = vkcsCreateBuffer(context, size, VKCS_MEMORY_AUTO);
+        producers[i / BENCH_ASYNC_JOBS_PER_PRODUCER].jobs[i % BENCH_ASYNC_JOBS_PER_PRODUCER] =
+            vkcsCreateJob(kernel, input, outputs[i], BENCH_RETAINED_ELEMENT_COUNT);
+    }
+
+    double syncStartTime = timeNowSeconds();
+
+    for (uint32_t i = 0; i < runCount; i += 1) {
+        vkcsRunJob(producers[i % BENCH_ASYNC_PRODUCER_COUNT].jobs[i / BENCH_ASYNC_PRODUCER_COUNT % BENCH_ASYNC_JOBS_PER_PRODUCER]);
+    }
+
+    double syncSeconds = timeNowSeconds() - syncStartTime;
+
+    VkcsStatistics syncStatistics;
+    vkcsContextStatistics(context, &syncStatistics);
+
+    double asyncStartTime = timeNowSeconds();
+
+    for (uint32_t i = 0; i < BENCH_ASYNC_PRODUCER_COUNT; i += 1) {
+        if (pthread_create(&producers[i].thread, NULL, runBenchProducer, &producers[i]) != 0) {
+            fprintf(stderr, "Could not start the producer threads.\n");
+            exit(1);
+        }
+    }
+
+    for (uint32_t i = 0; i < BENCH_ASYNC_PRODUCER_COUNT; i += 1) {
+        pthread_join(producers[i].thread, NULL);
+    }
+
+    double asyncSeconds = timeNowSeconds() - asyncStartTime;
+
+    VkcsStatistics asyncStatistics;
+    vkcsContextStatistics(context, &asyncStatistics);
+    uint64_t asyncSubmits = asyncStatistics.queueSubmits - syncStatistics.queueSubmits;
+
+    printf("async { producers: %u, jobs: %" PRIu32 ", completion: %s, submits: %" PRIu64 ", averageBatch: %.2f, "
+            "largestBatch: %" PRIu32 ", sync: %.0f jobs/s, async: %.0f jobs/s }\n",
+            BENCH_ASYNC_PRODUCER_COUNT, runCount, asyncStatistics.timelineSemaphores ? "timeline semaphore" : "fence ring",
+            asyncSubmits, asyncSubmits > 0 ? (double) runCount / (double) asyncSubmits : 0.0, asyncStatistics.largestBatch,
+            runCount / syncSeconds, runCount / asyncSeconds);
+
+    bool matches = true;
+
+    for (uint32_t i = 0; i < jobCount; i += 1) {
+        matches = matches && memcmp(inputElements, vkcsBufferMapping(outputs[i]), size) == 0;
+        vkcsDestroyJob(producers[i / BENCH_ASYNC_JOBS_PER_PRODUCER].jobs[i % BENCH_ASYNC_JOBS_PER_PRODUCER]);
+        vkcsDestroyBuffer(outputs[i]);
+    }
+
+    vkcsDestroyBuffer(input);
+    vkcsDestroyKernel(kernel);
+    vkcsDestroyContext(context);
+
+    return matches;
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options = parseBenchOptions(argc, argv);
+
+    bool validationEnabled;
+    VkInstance instance = createInstance(&validationEnabled);
+
+    VkPhysicalDevice *physicalDevices;
+    uint32_t physicalDeviceCount = enumeratePhysicalDevices(instance, &physicalDevices);
+
+    // Only the first selected device is measured
+    uint32_t selectedDeviceIndices[MAX_SELECTED_DEVICES];
+    selectPhysicalDevices(options.deviceSelection, physicalDeviceCount, selectedDeviceIndices, MAX_SELECTED_DEVICES);
+
+    ComputeDevice computeDevice;
+    createComputeDevice(physicalDevices[selectedDeviceIndices[0]], &computeDevice);
+    hostFree(physicalDevices);
+
+    VkDevice device = computeDevice.device;
+    printPhysicalDeviceProperties(&computeDevice.properties);
+
+    Profile profile;
+    initProfile(&profile);
+    createProfileQueryPool(&profile, device, &computeDevice.properties, computeDevice.queueFamilyProperties.timestampValidBits);
+
+    uint64_t maxSize = clampBenchSize(&computeDevice, options.maxSize);
+
+    if (maxSize < options.maxSize) {
+        printf("bench { maxSize: %" PRIu64 " (clamped from %" PRIu64 ") }\n", maxSize, options.maxSize);
+    }
+
+    uint32_t workgroupSizes[BENCH_MAX_WORKGROUP_SIZES];
+    uint32_t workgroupSizeCount = 0;
+
+    for (uint32_t size = BENCH_MIN_WORKGROUP_SIZE;
+            size <= maxWorkgroupSize(&computeDevice.properties) && workgroupSizeCount < BENCH_MAX_WORKGROUP_SIZES;
+            size *= 2) {
+        workgroupSizes[workgroupSizeCount++] = size;
+    }
+
+    bool pipelineCacheWarm;
+    VkPipelineCache pipelineCache = loadPipelineCache(device, &computeDevice.properties, &pipelineCacheWarm);
+
+    VkDescriptorSetLayout descriptorSetLayout = createKernelDescriptorSetLayout(device);
+    VkDescriptorSetLayout descriptorSetLayouts[] = { descriptorSetLayout };
+    VkPipelineLayout pipelineLayout = createKernelPipelineLayout(device, descriptorSetLayout);
+
+    VkDescriptorPoolSize descriptorPoolSizes[] = {
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 2,
+        },
+    };
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = descriptorPoolSizes,
+    };
+
+    VkDescriptorPool descriptorPool;
+    BAIL_ON_BAD_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, hostAllocationCallbacks(), &descriptorPool));
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queueFamilyIndex = computeDevice.queueFamilyIndex,
+    };
+
+    VkCommandPool commandPool;
+    BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, hostAllocationCallbacks(), &commandPool));
+
+    FILE *csv = NULL;
+
+    if (options.csvPath != NULL) {
+        csv = fopen(options.csvPath, "w");
+
+        if (csv == NULL) {
+            fprintf(stderr, "Could not write the results to `%s`.\n", options.csvPath);
+            return 1;
+        }
+
+        writeBenchResultCsvHeader(csv);
+    }
+
+    int exitCode = 0;
+    printElementFormats(&computeDevice);
+
+    for (uint32_t k = 0; k < sizeof(benchKernels) / sizeof(benchKernels[0]); k += 1) {
+        const BenchKernel *kernel = &benchKernels[k];
+        FormatKernel formatKernel;
+        chooseFormatKernel(&computeDevice, kernel->format, &formatKernel);
+
+        uint32_t shaderSize;
+        uint32_t *shaderData;
+
+        if (!shaderLoadNamed(formatKernel.shaderName, &shaderSize, &shaderData)) {
+            fprintf(stderr, "The `%s` shader is not embedded.\n", formatKernel.shaderName);
+            exit(1);
+        }
+
+        VkShaderModule shaderModule = createKernelShaderModule(device, shaderSize, shaderData);
+
+        VkPipeline pipelines[BENCH_MAX_WORKGROUP_SIZES];
+
+        for (uint32_t w = 0; w < workgroupSizeCount; w += 1) {
+            pipelines[w] = createComputePipeline(device, pipelineCache, shaderModule, pipelineLayout, workgroupSizes[w]);
+        }
+
+        for (uint64_t size = options.minSize; size <= maxSize; size *= 4) {
+            double memcpySeconds = benchMemcpy(size, options.iterations);
+            // Sizes are whole words, so packed kernels cover exactly the elements
+            uint64_t elementCount = size / elementFormatSize(kernel->format);
+            uint32_t invocationCount = formatKernelInvocationCount(&formatKernel, elementCount);
+
+            for (uint32_t p = 0; p < sizeof(benchPlacements) / sizeof(benchPlacements[0]); p += 1) {
+                MemoryPlacement placement = chooseMemoryPlacement(&computeDevice.properties,
+                        &computeDevice.memoryProperties, benchPlacements[p], size);
+
+                // Devices without separate device-local memory would measure the same thing twice
+                if (placement != benchPlacements[p]) {
+                    continue;
+                }
+
+                PlacedBuffer inputBuffer, outputBuffer;
+                createPlacedBuffer(&computeDevice.allocator, &computeDevice.properties, placement,
+                        MEMORY_DIRECTION_UPLOAD, size, computeDevice.queueFamilyIndex, &inputBuffer);
+                createPlacedBuffer(&computeDevice.allocator, &computeDevice.properties, placement,
+                        MEMORY_DIRECTION_READBACK, size, computeDevice.queueFamilyIndex, &outputBuffer);
+
+                fillElements(kernel->format, inputBuffer.mapped, elementCount, 2654435761u);
+                flushPlacedBuffer(&computeDevice.allocator, &inputBuffer, size);
+
+                BAIL_ON_BAD_RESULT(vkResetDescriptorPool(device, descriptorPool, 0));
+
+                VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                    .pNext = NULL,
+                    .descriptorPool = descriptorPool,
+                    .descriptorSetCount = 1,
+                    .pSetLayouts = descriptorSetLayouts,
+                };
+
+                VkDescriptorSet descriptorSets[1];
+                BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, descriptorSets));
+                updateKernelDescriptorSet(device, descriptorSets[0], inputBuffer.buffer, outputBuffer.buffer);
+
+                for (uint32_t w = 0; w < workgroupSizeCount; w += 1) {
+                    DispatchGrid grid = dispatchGrid(&computeDevice.properties.limits, invocationCount, workgroupSizes[w]);
+
+                    // Flushed too, so that no dirty cache line can later overwrite what the device wrote
+                    memset(outputBuffer.mapped, 0, size);
+                    flushPlacedBuffer(&computeDevice.allocator, &outputBuffer, size);
+
+                    BenchResult result = {
+                        .kernel = kernel->name,
+                        .format = kernel->format,
+                        .native = formatKernel.native,
+                        .size = size,
+                        .workgroupSize = workgroupSizes[w],
+                        .placement = placement,
+                        .memcpySeconds = memcpySeconds,
+                        .trafficFactor = kernel->trafficFactor,
+                    };
+
+                    if (!benchConfiguration(&computeDevice, &profile, commandPool, pipelines[w], pipelineLayout,
+                                descriptorSets, &inputBuffer, &outputBuffer, invocationCount, grid, options.iterations, &result)) {
+                        fprintf(stderr, "%s: output differs from the input (format %s, size %" PRIu64 ", workgroup size %" PRIu32 ", %s).\n",
+                                kernel->name, elementFormatString(kernel->format), size, workgroupSizes[w],
+                                memoryPlacementString(placement));
+                        exitCode = 1;
+                    }
+
+                    printBenchResult(&result);
+
+                    if (csv != NULL) {
+                        writeBenchResultCsv(csv, &result);
+                    }
+                }
+
+                destroyPlacedBuffer(&computeDevice.allocator, &outputBuffer);
+                destroyPlacedBuffer(&computeDevice.allocator, &inputBuffer);
+            }
+        }
+
+        for (uint32_t w = 0; w < workgroupSizeCount; w += 1) {
+            vkDestroyPipeline(device, pipelines[w], hostAllocationCallbacks());
+        }
+
+        vkDestroyShaderModule(device, shaderModule, hostAllocationCallbacks());
+    }
+
+    if (!benchRebinding(&computeDevice, pipelineCache, commandPool)) {
+        fprintf(stderr, "Rebound output differs from the input.\n");
+        exitCode = 1;
+    }
+
+    if (!benchRetainedContext(&options)) {
+        fprintf(stderr, "Retained-context output differs from the input.\n");
+        exitCode = 1;
+    }
+
+    if (!benchAsyncSubmission(&options)) {
+        fprintf(stderr, "Asynchronously submitted output differs from the input.\n");
+        exitCode = 1;
+    }
+
+    if (csv != NULL && fclose(csv) != 0) {
+        fprintf(stderr, "Could not write the results to `%s`.\n", options.csvPath);
+        exitCode = 1;
+    }
+
+    storePipelineCache(device, &computeDevice.properties, pipelineCache);
+
+    destroyProfile(&profile, device);
+    vkDestroyCommandPool(device, commandPool, hostAllocationCallbacks());
+    vkDestroyDescriptorPool(device, descriptorPool, hostAllocationCallbacks());
+    vkDestroyPipelineLayout(device, pipelineLayout, hostAllocationCallbacks());
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, hostAllocationCallbacks());
+    vkDestroyPipelineCache(device, pipelineCache, hostAllocationCallbacks());
+    destroyComputeDevice(&computeDevice);
+    destroyInstance(instance);
+
+    return exitCode;
+}
@@ -0,0 +1,115 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+static bool makeDirectories(char *path) {
+    for (char *separator = strchr(path + 1, '/'); separator != NULL; separator = strchr(separator + 1, '/')) {
+        *separator = '\0';
+        bool created = mkdir(path, 0755) == 0 || errno == EEXIST;
+        *separator = '/';
+
+        if (!created) {
+            return false;
+        }
+    }
+
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+bool cacheDirectory(char *path, size_t pathSize) {
+    const char *directory;
+    int length;
+
+    if ((directory = getenv("VKCSCRATCH_CACHE_DIR")) != NULL && *directory != '\0') {
+        length = snprintf(path, pathSize, "%s", directory);
+    } else if ((directory = getenv("XDG_CACHE_HOME")) != NULL && *directory != '\0') {
+        length = snprintf(path, pathSize, "%s/vkcscratch", directory);
+    } else if ((directory = getenv("HOME")) != NULL && *directory != '\0') {
+        length = snprintf(path, pathSize, "%s/.cache/vkcscratch", directory);
+    } else {
+        return false;
+    }
+
+    if (length < 0 || (size_t) length >= pathSize) {
+        return false;
+    }
+
+    return makeDirectories(path);
+}
+
+static bool cacheFilePath(char *path, size_t pathSize, const char *fileName) {
+    char directory[PATH_MAX];
+
+    if (!cacheDirectory(directory, sizeof(directory))) {
+        return false;
+    }
+
+    int length = snprintf(path, pathSize, "%s/%s", directory, fileName);
+
+    return length >= 0 && (size_t) length < pathSize;
+}
+
+void *cacheRead(const char *fileName, size_t *size) {
+    char path[PATH_MAX];
+
+    if (!cacheFilePath(path, sizeof(path), fileName)) {
+        return NULL;
+    }
+
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void *data = length > 0 ? malloc(length) : NULL;
+
+    if (data == NULL || fread(data, length, 1, file) != 1) {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *size = length;
+
+    return data;
+}
+
+bool cacheWrite(const char *fileName, const void *data, size_t size) {
+    char path[PATH_MAX];
+    char temporaryPath[PATH_MAX + 32];
+
+    if (!cacheFilePath(path, sizeof(path), fileName)) {
+        return false;
+    }
+
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.%ld.tmp", path, (long) getpid());
+
+    FILE *file = fopen(temporaryPath, "wb");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    bool written = fwrite(data, size, 1, file) == 1
+        && fflush(file) == 0
+        && fsync(fileno(file)) == 0;
+
+    if (fclose(file) != 0 || !written || rename(temporaryPath, path) != 0) {
+        unlink(temporaryPath);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Files persisted between runs live in `$VKCSCRATCH_CACHE_DIR`,
+// `$XDG_CACHE_HOME/vkcscratch` or `$HOME/.cache/vkcscratch`, in that order.
+bool cacheDirectory(char *path, size_t pathSize);
+
+// Returns a malloc'd copy of the cached file, or NULL if it does not exist.
+void *cacheRead(const char *fileName, size_t *size);
+
+// Replaces the cached file atomically, so concurrent readers never see a partial write.
+bool cacheWrite(const char *fileName, const void *data, size_t size);
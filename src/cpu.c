@@ -0,0 +1,749 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#include <immintrin.h>
+#else
+#define CPU_X86 0
+#endif
+
+#include "cpu.h"
+
+// Byte digits: four passes over 32-bit keys
+#define CPU_RADIX_BITS 8
+#define CPU_RADIX_DIGIT_COUNT (1u << CPU_RADIX_BITS)
+
+// The inner loops for one instruction set; each runs over a single range on a single thread
+typedef struct CpuKernels {
+    void (*copy)(const int32_t *input, int32_t *output, uint64_t count);
+    uint64_t (*countMismatches)(const int32_t *a, const int32_t *b, uint64_t count);
+    uint64_t (*countNonZero)(const int32_t *input, uint64_t count);
+    int32_t (*reduce)(ReduceOperation operation, const int32_t *input, uint64_t count);
+    // Returns the running sum after the range, `carry` being the one before it
+    uint32_t (*scan)(bool inclusive, const uint32_t *input, uint32_t *output, uint64_t count, uint32_t carry);
+    // Returns the number of elements written
+    uint64_t (*compact)(const int32_t *input, int32_t *output, uint64_t count);
+} CpuKernels;
+
+static int32_t reduceIdentity(ReduceOperation operation) {
+    switch (operation) {
+        case REDUCE_MIN: return INT32_MAX;
+        case REDUCE_MAX: return INT32_MIN;
+        default: return 0;
+    }
+}
+
+static int32_t reduceCombine(ReduceOperation operation, int32_t a, int32_t b) {
+    switch (operation) {
+        case REDUCE_MIN: return a < b ? a : b;
+        case REDUCE_MAX: return a > b ? a : b;
+        // Sums wrap around like they do on the device
+        default: return (int32_t) ((uint32_t) a + (uint32_t) b);
+    }
+}
+
+static void copyScalar(const int32_t *input, int32_t *output, uint64_t count) {
+    for (uint64_t i = 0; i < count; i += 1) {
+        output[i] = input[i];
+    }
+}
+
+static uint64_t countMismatchesScalar(const int32_t *a, const int32_t *b, uint64_t count) {
+    uint64_t mismatches = 0;
+
+    for (uint64_t i = 0; i < count; i += 1) {
+        mismatches += a[i] != b[i] ? 1 : 0;
+    }
+
+    return mismatches;
+}
+
+static uint64_t countNonZeroScalar(const int32_t *input, uint64_t count) {
+    uint64_t nonZero = 0;
+
+    for (uint64_t i = 0; i < count; i += 1) {
+        nonZero += input[i] != 0 ? 1 : 0;
+    }
+
+    return nonZero;
+}
+
+static int32_t reduceScalar(ReduceOperation operation, const int32_t *input, uint64_t count) {
+    int32_t result = reduceIdentity(operation);
+
+    for (uint64_t i = 0; i < count; i += 1) {
+        result = reduceCombine(operation, result, input[i]);
+    }
+
+    return result;
+}
+
+static uint32_t scanScalar(bool inclusive, const uint32_t *input, uint32_t *output, uint64_t count, uint32_t carry) {
+    for (uint64_t i = 0; i < count; i += 1) {
+        uint32_t value = input[i];
+
+        output[i] = inclusive ? carry + value : carry;
+        carry += value;
+    }
+
+    return carry;
+}
+
+static uint64_t compactScalar(const int32_t *input, int32_t *output, uint64_t count) {
+    uint64_t kept = 0;
+
+    // Branchy on purpose: writing unconditionally would touch the first slot of the next range
+    for (uint64_t i = 0; i < count; i += 1) {
+        if (input[i] != 0) {
+            output[kept++] = input[i];
+        }
+    }
+
+    return kept;
+}
+
+#if CPU_X86
+
+__attribute__((target("sse4.1")))
+static void copySse41(const int32_t *input, int32_t *output, uint64_t count) {
+    uint64_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*) (output + i), _mm_loadu_si128((const __m128i*) (input + i)));
+    }
+
+    copyScalar(input + i, output + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+static uint64_t countMismatchesSse41(const int32_t *a, const int32_t *b, uint64_t count) {
+    uint64_t mismatches = 0;
+    uint64_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (a + i)), _mm_loadu_si128((const __m128i*) (b + i)));
+        mismatches += 4 - (uint64_t) __builtin_popcount((unsigned) _mm_movemask_ps(_mm_castsi128_ps(equal)));
+    }
+
+    return mismatches + countMismatchesScalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+static uint64_t countNonZeroSse41(const int32_t *input, uint64_t count) {
+    uint64_t nonZero = 0;
+    uint64_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i zero = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (input + i)), _mm_setzero_si128());
+        nonZero += 4 - (uint64_t) __builtin_popcount((unsigned) _mm_movemask_ps(_mm_castsi128_ps(zero)));
+    }
+
+    return nonZero + countNonZeroScalar(input + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+static int32_t reduceSse41(ReduceOperation operation, const int32_t *input, uint64_t count) {
+    __m128i accumulator = _mm_set1_epi32(reduceIdentity(operation));
+    uint64_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i value = _mm_loadu_si128((const __m128i*) (input + i));
+
+        switch (operation) {
+            case REDUCE_MIN: accumulator = _mm_min_epi32(accumulator, value); break;
+            case REDUCE_MAX: accumulator = _mm_max_epi32(accumulator, value); break;
+            default: accumulator = _mm_add_epi32(accumulator, value); break;
+        }
+    }
+
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i*) lanes, accumulator);
+    int32_t result = reduceScalar(operation, input + i, count - i);
+
+    for (uint32_t lane = 0; lane < 4; lane += 1) {
+        result = reduceCombine(operation, result, lanes[lane]);
+    }
+
+    return result;
+}
+
+// Log-step scan within a vector. Each vector depends on the one before, so wider registers would
+// only lengthen the shuffle chain; the AVX2 and AVX-512 engines use this one too.
+__attribute__((target("sse4.1")))
+static uint32_t scanSse41(bool inclusive, const uint32_t *input, uint32_t *output, uint64_t count, uint32_t carry) {
+    __m128i carryVector = _mm_set1_epi32((int) carry);
+    uint64_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i value = _mm_loadu_si128((const __m128i*) (input + i));
+        __m128i sum = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+        sum = _mm_add_epi32(sum, _mm_slli_si128(sum, 8));
+        sum = _mm_add_epi32(sum, carryVector);
+
+        _mm_storeu_si128((__m128i*) (output + i), inclusive ? sum : _mm_sub_epi32(sum, value));
+        carryVector = _mm_shuffle_epi32(sum, 0xff);
+    }
+
+    return scanScalar(inclusive, input + i, output + i, count - i, (uint32_t) _mm_cvtsi128_si32(carryVector));
+}
+
+__attribute__((target("avx2")))
+static void copyAvx2(const int32_t *input, int32_t *output, uint64_t count) {
+    uint64_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i*) (output + i), _mm256_loadu_si256((const __m256i*) (input + i)));
+    }
+
+    copyScalar(input + i, output + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t countMismatchesAvx2(const int32_t *a, const int32_t *b, uint64_t count) {
+    uint64_t mismatches = 0;
+    uint64_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (a + i)),
+                _mm256_loadu_si256((const __m256i*) (b + i)));
+        mismatches += 8 - (uint64_t) __builtin_popcount((unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(equal)));
+    }
+
+    return mismatches + countMismatchesScalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t countNonZeroAvx2(const int32_t *input, uint64_t count) {
+    uint64_t nonZero = 0;
+    uint64_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i zero = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (input + i)), _mm256_setzero_si256());
+        nonZero += 8 - (uint64_t) __builtin_popcount((unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(zero)));
+    }
+
+    return nonZero + countNonZeroScalar(input + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static int32_t reduceAvx2(ReduceOperation operation, const int32_t *input, uint64_t count) {
+    __m256i accumulator = _mm256_set1_epi32(reduceIdentity(operation));
+    uint64_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i value = _mm256_loadu_si256((const __m256i*) (input + i));
+
+        switch (operation) {
+            case REDUCE_MIN: accumulator = _mm256_min_epi32(accumulator, value); break;
+            case REDUCE_MAX: accumulator = _mm256_max_epi32(accumulator, value); break;
+            default: accumulator = _mm256_add_epi32(accumulator, value); break;
+        }
+    }
+
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i*) lanes, accumulator);
+    int32_t result = reduceScalar(operation, input + i, count - i);
+
+    for (uint32_t lane = 0; lane < 8; lane += 1) {
+        result = reduceCombine(operation, result, lanes[lane]);
+    }
+
+    return result;
+}
+
+__attribute__((target("avx512f")))
+static void copyAvx512(const int32_t *input, int32_t *output, uint64_t count) {
+    uint64_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        _mm512_storeu_si512((void*) (output + i), _mm512_loadu_si512((const void*) (input + i)));
+    }
+
+    copyScalar(input + i, output + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static uint64_t countMismatchesAvx512(const int32_t *a, const int32_t *b, uint64_t count) {
+    uint64_t mismatches = 0;
+    uint64_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __mmask16 differ = _mm512_cmpneq_epi32_mask(_mm512_loadu_si512((const void*) (a + i)),
+                _mm512_loadu_si512((const void*) (b + i)));
+        mismatches += (uint64_t) __builtin_popcount((unsigned) differ);
+    }
+
+    return mismatches + countMismatchesScalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static uint64_t countNonZeroAvx512(const int32_t *input, uint64_t count) {
+    uint64_t nonZero = 0;
+    uint64_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512i value = _mm512_loadu_si512((const void*) (input + i));
+        nonZero += (uint64_t) __builtin_popcount((unsigned) _mm512_test_epi32_mask(value, value));
+    }
+
+    return nonZero + countNonZeroScalar(input + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static int32_t reduceAvx512(ReduceOperation operation, const int32_t *input, uint64_t count) {
+    __m512i accumulator = _mm512_set1_epi32(reduceIdentity(operation));
+    uint64_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512i value = _mm512_loadu_si512((const void*) (input + i));
+
+        switch (operation) {
+            case REDUCE_MIN: accumulator = _mm512_min_epi32(accumulator, value); break;
+            case REDUCE_MAX: accumulator = _mm512_max_epi32(accumulator, value); break;
+            default: accumulator = _mm512_add_epi32(accumulator, value); break;
+        }
+    }
+
+    int32_t lanes[16];
+    _mm512_storeu_si512((void*) lanes, accumulator);
+    int32_t result = reduceScalar(operation, input + i, count - i);
+
+    for (uint32_t lane = 0; lane < 16; lane += 1) {
+        result = reduceCombine(operation, result, lanes[lane]);
+    }
+
+    return result;
+}
+
+// Compress-stores write only the kept lanes, so the output of the range is never overrun
+__attribute__((target("avx512f")))
+static uint64_t compactAvx512(const int32_t *input, int32_t *output, uint64_t count) {
+    uint64_t kept = 0;
+    uint64_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512i value = _mm512_loadu_si512((const void*) (input + i));
+        __mmask16 nonZero = _mm512_test_epi32_mask(value, value);
+
+        _mm512_mask_compressstoreu_epi32((void*) (output + kept), nonZero, value);
+        kept += (uint64_t) __builtin_popcount((unsigned) nonZero);
+    }
+
+    return kept + compactScalar(input + i, output + kept, count - i);
+}
+
+#endif
+
+// Indexed by CpuIsa
+static const CpuKernels cpuKernels[] = {
+    {
+        .copy = copyScalar,
+        .countMismatches = countMismatchesScalar,
+        .countNonZero = countNonZeroScalar,
+        .reduce = reduceScalar,
+        .scan = scanScalar,
+        .compact = compactScalar,
+    },
+#if CPU_X86
+    {
+        .copy = copySse41,
+        .countMismatches = countMismatchesSse41,
+        .countNonZero = countNonZeroSse41,
+        .reduce = reduceSse41,
+        .scan = scanSse41,
+        .compact = compactScalar,
+    },
+    {
+        .copy = copyAvx2,
+        .countMismatches = countMismatchesAvx2,
+        .countNonZero = countNonZeroAvx2,
+        .reduce = reduceAvx2,
+        .scan = scanSse41,
+        .compact = compactScalar,
+    },
+    {
+        .copy = copyAvx512,
+        .countMismatches = countMismatchesAvx512,
+        .countNonZero = countNonZeroAvx512,
+        .reduce = reduceAvx512,
+        .scan = scanSse41,
+        .compact = compactAvx512,
+    },
+#endif
+};
+
+const char *cpuIsaString(CpuIsa isa) {
+    switch (isa) {
+        case CPU_ISA_SCALAR: return "scalar";
+        case CPU_ISA_SSE41: return "sse4.1";
+        case CPU_ISA_AVX2: return "avx2";
+        case CPU_ISA_AVX512: return "avx512";
+        default: return "undefined";
+    }
+}
+
+bool parseCpuIsa(const char *string, CpuIsa *isa) {
+    for (CpuIsa candidate = CPU_ISA_SCALAR; candidate <= CPU_ISA_AVX512; candidate += 1) {
+        if (strcmp(string, cpuIsaString(candidate)) == 0) {
+            *isa = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+CpuIsa detectCpuIsa(void) {
+#if CPU_X86
+    // Also checks that the OS saves the wider registers
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        return CPU_ISA_AVX512;
+    }
+
+    if (__builtin_cpu_supports("avx2")) {
+        return CPU_ISA_AVX2;
+    }
+
+    if (__builtin_cpu_supports("sse4.1")) {
+        return CPU_ISA_SSE41;
+    }
+#endif
+
+    return CPU_ISA_SCALAR;
+}
+
+void createCpuEngine(CpuIsa maxIsa, uint32_t threadCount, CpuEngine *engine) {
+    CpuIsa isa = detectCpuIsa();
+
+    if (threadCount == 0) {
+        long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = processorCount > 0 ? (uint32_t) processorCount : 1;
+    }
+
+    *engine = (CpuEngine) {
+        .isa = isa < maxIsa ? isa : maxIsa,
+        .threadCount = threadCount < CPU_MAX_THREADS ? threadCount : CPU_MAX_THREADS,
+    };
+
+    engine->kernels = &cpuKernels[engine->isa];
+}
+
+void printCpuEngine(const CpuEngine *engine) {
+    printf("cpu { isa: %s, detected: %s, threads: %" PRIu32 " }\n",
+            cpuIsaString(engine->isa), cpuIsaString(detectCpuIsa()), engine->threadCount);
+}
+
+typedef void (*CpuRangeFunction)(void *task, uint64_t begin, uint64_t end, uint32_t rangeIndex);
+
+typedef struct {
+    CpuRangeFunction function;
+    void *task;
+    uint64_t begin;
+    uint64_t end;
+    uint32_t rangeIndex;
+} CpuRange;
+
+static uint32_t cpuRangeCount(const CpuEngine *engine, uint64_t count) {
+    uint64_t rangeCount = count / CPU_MIN_ELEMENTS_PER_THREAD;
+
+    if (rangeCount > engine->threadCount) {
+        rangeCount = engine->threadCount;
+    }
+
+    return rangeCount > 0 ? (uint32_t) rangeCount : 1;
+}
+
+static void *runCpuRange(void *userData) {
+    CpuRange *range = (CpuRange*) userData;
+
+    range->function(range->task, range->begin, range->end, range->rangeIndex);
+
+    return NULL;
+}
+
+// Splits [0, count) into `cpuRangeCount` contiguous ranges and runs them on as many threads; the
+// split only depends on `count`, so consecutive passes over the same data see the same ranges
+static void parallelFor(const CpuEngine *engine, uint64_t count, CpuRangeFunction function, void *task) {
+    uint32_t rangeCount = cpuRangeCount(engine, count);
+    CpuRange ranges[CPU_MAX_THREADS];
+    pthread_t threads[CPU_MAX_THREADS];
+    bool started[CPU_MAX_THREADS];
+
+    for (uint32_t i = 0; i < rangeCount; i += 1) {
+        ranges[i] = (CpuRange) {
+            .function = function,
+            .task = task,
+            .begin = count * i / rangeCount,
+            .end = count * (i + 1) / rangeCount,
+            .rangeIndex = i,
+        };
+    }
+
+    // The calling thread takes the first range; a range whose thread cannot start runs here too
+    for (uint32_t i = 1; i < rangeCount; i += 1) {
+        started[i] = pthread_create(&threads[i], NULL, runCpuRange, &ranges[i]) == 0;
+    }
+
+    runCpuRange(&ranges[0]);
+
+    for (uint32_t i = 1; i < rangeCount; i += 1) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            runCpuRange(&ranges[i]);
+        }
+    }
+}
+
+typedef struct {
+    const CpuKernels *kernels;
+    const int32_t *input;
+    const int32_t *other;
+    int32_t *output;
+    ReduceOperation operation;
+    bool inclusive;
+    // Per range
+    uint64_t results[CPU_MAX_THREADS];
+} CpuTask;
+
+static void copyRange(void *userData, uint64_t begin, uint64_t end, uint32_t rangeIndex) {
+    CpuTask *task = (CpuTask*) userData;
+    (void) rangeIndex;
+
+    task->kernels->copy(task->input + begin, task->output + begin, end - begin);
+}
+
+void cpuCopy(const CpuEngine *engine, const int32_t *input, int32_t *output, uint64_t count) {
+    CpuTask task = {
+        .kernels = engine->kernels,
+        .input = input,
+        .output = output,
+    };
+
+    parallelFor(engine, count, copyRange, &task);
+}
+
+static void countMismatchesRange(void *userData, uint64_t begin, uint64_t end, uint32_t rangeIndex) {
+    CpuTask *task = (CpuTask*) userData;
+
+    task->results[rangeIndex] = task->kernels->countMismatches(task->input + begin, task->other + begin, end - begin);
+}
+
+uint64_t cpuCountMismatches(const CpuEngine *engine, const int32_t *a, const int32_t *b, uint64_t count) {
+    CpuTask task = {
+        .kernels = engine->kernels,
+        .input = a,
+        .other = b,
+    };
+
+    parallelFor(engine, count, countMismatchesRange, &task);
+
+    uint64_t mismatches = 0;
+
+    for (uint32_t i = 0; i < cpuRangeCount(engine, count); i += 1) {
+        mismatches += task.results[i];
+    }
+
+    return mismatches;
+}
+
+static void reduceRange(void *userData, uint64_t begin, uint64_t end, uint32_t rangeIndex) {
+    CpuTask *task = (CpuTask*) userData;
+
+    task->results[rangeIndex] = (uint64_t) (uint32_t) task->kernels->reduce(task->operation, task->input + begin, end - begin);
+}
+
+int32_t cpuReduce(const CpuEngine *engine, ReduceOperation operation, const int32_t *input, uint64_t count) {
+    CpuTask task = {
+        .kernels = engine->kernels,
+        .input = input,
+        .operation = operation,
+    };
+
+    parallelFor(engine, count, reduceRange, &task);
+
+    int32_t result = reduceIdentity(operation);
+
+    for (uint32_t i = 0; i < cpuRangeCount(engine, count); i += 1) {
+        result = reduceCombine(operation, result, (int32_t) (uint32_t) task.results[i]);
+    }
+
+    return result;
+}
+
+static void scanRange(void *userData, uint64_t begin, uint64_t end, uint32_t rangeIndex) {
+    CpuTask *task = (CpuTask*) userData;
+
+    task->kernels->scan(task->inclusive, (const uint32_t*) task->input + begin, (uint32_t*) task->output + begin,
+            end - begin, (uint32_t) task->results[rangeIndex]);
+}
+
+void cpuScan(const CpuEngine *engine, bool inclusive, const uint32_t *input, uint32_t *output, uint64_t count) {
+    CpuTask task = {
+        .kernels = engine->kernels,
+        .input = (const int32_t*) input,
+        .output = (int32_t*) output,
+        .operation = REDUCE_SUM,
+        .inclusive = inclusive,
+        .results = { 0 },
+    };
+
+    // Sums of the ranges first, which become the carries into the scans of the later ranges
+    uint32_t rangeCount = cpuRangeCount(engine, count);
+
+    if (rangeCount > 1) {
+        parallelFor(engine, count, reduceRange, &task);
+
+        uint32_t carry = 0;
+
+        for (uint32_t i = 0; i < rangeCount; i += 1) {
+            uint32_t sum = (uint32_t) task.results[i];
+            task.results[i] = carry;
+            carry += sum;
+        }
+    }
+
+    parallelFor(engine, count, scanRange, &task);
+}
+
+static void countNonZeroRange(void *userData, uint64_t begin, uint64_t end, uint32_t rangeIndex) {
+    CpuTask *task = (CpuTask*) userData;
+
+    task->results[rangeIndex] = task->kernels->countNonZero(task->input + begin, end - begin);
+}
+
+static void compactRange(void *userData, uint64_t begin, uint64_t end, uint32_t rangeIndex) {
+    CpuTask *task = (CpuTask*) userData;
+
+    task->kernels->compact(task->input + begin, task->output + task->results[rangeIndex], end - begin);
+}
+
+uint64_t cpuCompact(const CpuEngine *engine, const int32_t *input, int32_t *output, uint64_t count) {
+    CpuTask task = {
+        .kernels = engine->kernels,
+        .input = input,
+        .output = output,
+    };
+
+    parallelFor(engine, count, countNonZeroRange, &task);
+
+    uint64_t keptCount = 0;
+
+    for (uint32_t i = 0; i < cpuRangeCount(engine, count); i += 1) {
+        uint64_t rangeKeptCount = task.results[i];
+        task.results[i] = keptCount;
+        keptCount += rangeKeptCount;
+    }
+
+    parallelFor(engine, count, compactRange, &task);
+
+    return keptCount;
+}
+
+typedef struct {
+    const uint32_t *keys;
+    const uint32_t *values;
+    uint32_t *sortedKeys;
+    uint32_t *sortedValues;
+    uint32_t shift;
+    // Digit counts of each range, then where the range writes each digit
+    uint64_t (*offsets)[CPU_RADIX_DIGIT_COUNT];
+} CpuSortTask;
+
+static void histogramRange(void *userData, uint64_t begin, uint64_t end, uint32_t rangeIndex) {
+    CpuSortTask *task = (CpuSortTask*) userData;
+    uint64_t *offsets = task->offsets[rangeIndex];
+
+    memset(offsets, 0, sizeof(uint64_t) * CPU_RADIX_DIGIT_COUNT);
+
+    for (uint64_t i = begin; i < end; i += 1) {
+        offsets[(task->keys[i] >> task->shift) & (CPU_RADIX_DIGIT_COUNT - 1)] += 1;
+    }
+}
+
+static void scatterRange(void *userData, uint64_t begin, uint64_t end, uint32_t rangeIndex) {
+    CpuSortTask *task = (CpuSortTask*) userData;
+    uint64_t *offsets = task->offsets[rangeIndex];
+
+    for (uint64_t i = begin; i < end; i += 1) {
+        uint64_t position = offsets[(task->keys[i] >> task->shift) & (CPU_RADIX_DIGIT_COUNT - 1)]++;
+
+        task->sortedKeys[position] = task->keys[i];
+        task->sortedValues[position] = task->values[i];
+    }
+}
+
+// Least-significant-digit sort over bytes. Ranges scatter in order, and each in its own order,
+// so the sort is stable; passes whose digit is the same for every key are skipped.
+void cpuRadixSort(const CpuEngine *engine, uint32_t *keys, uint32_t *values, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t rangeCount = cpuRangeCount(engine, count);
+    uint32_t *sortedKeys = malloc(sizeof(uint32_t) * (size_t) count);
+    uint32_t *sortedValues = malloc(sizeof(uint32_t) * (size_t) count);
+    uint64_t (*offsets)[CPU_RADIX_DIGIT_COUNT] = malloc(sizeof(*offsets) * rangeCount);
+
+    if (sortedKeys == NULL || sortedValues == NULL || offsets == NULL) {
+        fprintf(stderr, "Could not allocate memory for the CPU sort.\n");
+        exit(1);
+    }
+
+    CpuSortTask task = {
+        .keys = keys,
+        .values = values,
+        .sortedKeys = sortedKeys,
+        .sortedValues = sortedValues,
+        .offsets = offsets,
+    };
+
+    for (uint32_t shift = 0; shift < 32; shift += CPU_RADIX_BITS) {
+        task.shift = shift;
+        parallelFor(engine, count, histogramRange, &task);
+
+        bool singleDigit = false;
+        uint64_t running = 0;
+
+        for (uint32_t digit = 0; digit < CPU_RADIX_DIGIT_COUNT; digit += 1) {
+            uint64_t digitStart = running;
+
+            for (uint32_t i = 0; i < rangeCount; i += 1) {
+                uint64_t digitCount = offsets[i][digit];
+                offsets[i][digit] = running;
+                running += digitCount;
+            }
+
+            singleDigit = singleDigit || running - digitStart == count;
+        }
+
+        if (singleDigit) {
+            continue;
+        }
+
+        parallelFor(engine, count, scatterRange, &task);
+
+        // The sorted arrays are the input of the next pass
+        const uint32_t *previousKeys = task.keys;
+        const uint32_t *previousValues = task.values;
+        task.keys = task.sortedKeys;
+        task.values = task.sortedValues;
+        task.sortedKeys = (uint32_t*) previousKeys;
+        task.sortedValues = (uint32_t*) previousValues;
+    }
+
+    if (task.keys != keys) {
+        cpuCopy(engine, (const int32_t*) task.keys, (int32_t*) keys, count);
+        cpuCopy(engine, (const int32_t*) task.values, (int32_t*) values, count);
+    }
+
+    free(offsets);
+    free(sortedValues);
+    free(sortedKeys);
+}
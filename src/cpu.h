@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "primitives.h"
+
+#define CPU_MAX_THREADS 64
+// Smaller inputs run on fewer threads, down to one
+#define CPU_MIN_ELEMENTS_PER_THREAD (1u << 16)
+
+typedef enum {
+    CPU_ISA_SCALAR,
+    CPU_ISA_SSE41,
+    CPU_ISA_AVX2,
+    CPU_ISA_AVX512,
+} CpuIsa;
+
+struct CpuKernels;
+
+// Host implementation of the kernel set: the copy kernel, the primitives, and a comparison for
+// verifying device results. Work is split into contiguous ranges across threads, and each range
+// runs the widest vector code the processor supports. With CPU_ISA_SCALAR and one thread it is
+// the plain reference implementation.
+typedef struct CpuEngine {
+    CpuIsa isa;
+    uint32_t threadCount;
+    const struct CpuKernels *kernels;
+} CpuEngine;
+
+const char *cpuIsaString(CpuIsa isa);
+bool parseCpuIsa(const char *string, CpuIsa *isa);
+
+// The widest instruction set that both the processor and the OS support
+CpuIsa detectCpuIsa(void);
+
+// Uses the detected instruction set up to `maxIsa`; `threadCount` 0 uses every online processor
+void createCpuEngine(CpuIsa maxIsa, uint32_t threadCount, CpuEngine *engine);
+void printCpuEngine(const CpuEngine *engine);
+
+void cpuCopy(const CpuEngine *engine, const int32_t *input, int32_t *output, uint64_t count);
+// Number of positions at which `a` and `b` differ
+uint64_t cpuCountMismatches(const CpuEngine *engine, const int32_t *a, const int32_t *b, uint64_t count);
+
+// Same semantics as the device primitives: sums wrap around, the scan may run in place and the sort is stable
+int32_t cpuReduce(const CpuEngine *engine, ReduceOperation operation, const int32_t *input, uint64_t count);
+void cpuScan(const CpuEngine *engine, bool inclusive, const uint32_t *input, uint32_t *output, uint64_t count);
+uint64_t cpuCompact(const CpuEngine *engine, const int32_t *input, int32_t *output, uint64_t count);
+void cpuRadixSort(const CpuEngine *engine, uint32_t *keys, uint32_t *values, uint64_t count);
@@ -0,0 +1,643 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+#include "host_allocator.h"
+#include "shader.h"
+#include "vkcscratch.h"
+
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_MAX_KERNELS 8
+// How often the accept loop checks for a shutdown request
+#define DAEMON_POLL_MILLISECONDS 200
+
+// One memfd mapping of a client, imported into the context
+typedef struct {
+    VkcsBuffer *buffer; // NULL when the index is unused
+    void *mapping;
+    size_t size;
+} DaemonBuffer;
+
+// Jobs are cached per kernel, buffers and element count, so a client running the same job again
+// only pays for the submission
+typedef struct {
+    VkcsJob *job;
+    uint32_t kernel;
+    uint32_t input;
+    uint32_t output;
+    uint32_t elementCount;
+} DaemonJob;
+
+struct Daemon;
+
+typedef struct {
+    struct Daemon *daemon;
+    int socket;
+    pthread_t thread;
+    bool finished; // guarded by the daemon's session mutex
+    // The session thread and the completion thread both reply
+    pthread_mutex_t sendMutex;
+    DaemonBuffer buffers[DAEMON_MAX_BUFFERS];
+    DaemonJob jobs[DAEMON_MAX_PENDING_JOBS];
+    uint32_t jobCount;
+    // Next cached job to reuse when all of them are taken
+    uint32_t nextEviction;
+} DaemonSession;
+
+// Handed to the completion callback of one submission
+typedef struct {
+    DaemonSession *session;
+    uint64_t ticket;
+} DaemonSubmission;
+
+typedef struct Daemon {
+    VkcsContext *context;
+    VkcsKernel *kernels[DAEMON_MAX_KERNELS];
+    uint32_t kernelCount;
+    // Creating and destroying context objects must happen from one thread at a time
+    pthread_mutex_t contextMutex;
+    pthread_mutex_t sessionMutex;
+    DaemonSession *sessions[DAEMON_MAX_CLIENTS];
+    uint32_t clientCount;
+} Daemon;
+
+typedef struct {
+    const char *deviceSelection; // NULL falls back to VKCSCRATCH_DEVICE, then device 0
+    const char *socketPath;
+    char *kernelPaths[DAEMON_MAX_KERNELS];
+    uint32_t kernelPathCount;
+} DaemonOptions;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int signalNumber) {
+    (void) signalNumber;
+    stopRequested = 1;
+}
+
+void printDaemonUsage(const char *programName) {
+    printf("Usage: %s [--device N] [--socket PATH] [--kernel FILE.spv]...\n"
+           "Kernel 0 is the built-in copy; every --kernel adds the next one. The socket defaults to\n"
+           "%s, then %s.\n",
+           programName, DAEMON_SOCKET_ENVIRONMENT_VARIABLE, DAEMON_DEFAULT_SOCKET_PATH);
+}
+
+DaemonOptions parseDaemonOptions(int argc, char *argv[]) {
+    DaemonOptions options = {
+        .deviceSelection = NULL,
+        .socketPath = getenv(DAEMON_SOCKET_ENVIRONMENT_VARIABLE),
+        .kernelPathCount = 0,
+    };
+
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+            options.deviceSelection = argv[++i];
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            options.socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            if (options.kernelPathCount + 1 == DAEMON_MAX_KERNELS) {
+                fprintf(stderr, "The daemon serves at most %u kernels.\n", DAEMON_MAX_KERNELS);
+                exit(1);
+            }
+
+            options.kernelPaths[options.kernelPathCount++] = argv[++i];
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printDaemonUsage(argv[0]);
+            exit(0);
+        } else {
+            printDaemonUsage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (options.socketPath == NULL || options.socketPath[0] == '\0') {
+        options.socketPath = DAEMON_DEFAULT_SOCKET_PATH;
+    }
+
+    return options;
+}
+
+// A client that does not drain its replies loses its connection rather than stalling the
+// completion thread, which serves every client
+static void sendReply(DaemonSession *session, const DaemonReply *reply) {
+    pthread_mutex_lock(&session->sendMutex);
+
+    if (send(session->socket, reply, sizeof(DaemonReply), MSG_NOSIGNAL | MSG_DONTWAIT) != sizeof(DaemonReply)) {
+        shutdown(session->socket, SHUT_RDWR);
+    }
+
+    pthread_mutex_unlock(&session->sendMutex);
+}
+
+// Returns false once the client disconnected or sent something that is not a request. `fd` is the
+// descriptor passed along with the request, -1 when there is none.
+static bool receiveRequest(int socket, DaemonRequest *request, int *fd) {
+    union {
+        struct cmsghdr header;
+        char data[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = {
+        .iov_base = request,
+        .iov_len = sizeof(DaemonRequest),
+    };
+    struct msghdr message = {
+        .msg_name = NULL,
+        .msg_namelen = 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.data,
+        .msg_controllen = sizeof(control.data),
+        .msg_flags = 0,
+    };
+
+    *fd = -1;
+
+    ssize_t received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+
+    for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); received > 0 && header != NULL;
+            header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            memcpy(fd, CMSG_DATA(header), sizeof(int));
+        }
+    }
+
+    if (received != sizeof(DaemonRequest) || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        if (*fd >= 0) {
+            close(*fd);
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+static void destroyDaemonJob(DaemonSession *session, DaemonJob *job) {
+    vkcsWaitJob(job->job);
+
+    pthread_mutex_lock(&session->daemon->contextMutex);
+    vkcsDestroyJob(job->job);
+    pthread_mutex_unlock(&session->daemon->contextMutex);
+
+    *job = session->jobs[--session->jobCount];
+}
+
+static void unmapDaemonBuffer(DaemonSession *session, uint32_t index) {
+    DaemonBuffer *buffer = &session->buffers[index];
+
+    for (uint32_t j = 0; j < session->jobCount; ) {
+        if (session->jobs[j].input == index || session->jobs[j].output == index) {
+            destroyDaemonJob(session, &session->jobs[j]);
+        } else {
+            j += 1;
+        }
+    }
+
+    pthread_mutex_lock(&session->daemon->contextMutex);
+    vkcsDestroyBuffer(buffer->buffer);
+    pthread_mutex_unlock(&session->daemon->contextMutex);
+
+    munmap(buffer->mapping, buffer->size);
+    *buffer = (DaemonBuffer) { .buffer = NULL };
+}
+
+static DaemonStatus mapDaemonBuffer(DaemonSession *session, const DaemonRequest *request, int fd) {
+    struct stat status;
+
+    if (fd < 0 || request->buffer >= DAEMON_MAX_BUFFERS || session->buffers[request->buffer].buffer != NULL
+            || request->size == 0 || fstat(fd, &status) != 0 || (uint64_t) status.st_size < request->size) {
+        return DAEMON_STATUS_INVALID_REQUEST;
+    }
+
+    // Without these seals the client could shrink the file under the mapping and fault the daemon
+    int seals = fcntl(fd, F_GET_SEALS);
+
+    if (seals < 0 || (seals & F_SEAL_SHRINK) == 0) {
+        return DAEMON_STATUS_INVALID_REQUEST;
+    }
+
+    void *mapping = mmap(NULL, request->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (mapping == MAP_FAILED) {
+        return DAEMON_STATUS_OUT_OF_MEMORY;
+    }
+
+    pthread_mutex_lock(&session->daemon->contextMutex);
+    VkcsBuffer *buffer = vkcsImportBuffer(session->daemon->context, mapping, request->size);
+    pthread_mutex_unlock(&session->daemon->contextMutex);
+
+    if (buffer == NULL) {
+        munmap(mapping, request->size);
+        return DAEMON_STATUS_OUT_OF_MEMORY;
+    }
+
+    session->buffers[request->buffer] = (DaemonBuffer) {
+        .buffer = buffer,
+        .mapping = mapping,
+        .size = request->size,
+    };
+
+    return DAEMON_STATUS_OK;
+}
+
+static void completeSubmission(VkcsJob *job, void *userData) {
+    (void) job;
+    DaemonSubmission *submission = userData;
+    DaemonReply reply = {
+        .type = DAEMON_REPLY_COMPLETE,
+        .status = DAEMON_STATUS_OK,
+        .ticket = submission->ticket,
+    };
+
+    sendReply(submission->session, &reply);
+    free(submission);
+}
+
+// Prefers a cached job for the same work that is not pending; a pending one is waited for on
+// resubmission, which is the backpressure for clients that keep too many jobs in flight
+static DaemonJob *findDaemonJob(DaemonSession *session, const DaemonRequest *request) {
+    DaemonJob *pendingMatch = NULL;
+
+    for (uint32_t j = 0; j < session->jobCount; j += 1) {
+        DaemonJob *job = &session->jobs[j];
+
+        if (job->kernel == request->kernel && job->input == request->input && job->output == request->output
+                && job->elementCount == request->elementCount) {
+            if (vkcsJobComplete(job->job)) {
+                return job;
+            }
+
+            pendingMatch = job;
+        }
+    }
+
+    if (pendingMatch != NULL && session->jobCount == DAEMON_MAX_PENDING_JOBS) {
+        return pendingMatch;
+    }
+
+    if (session->jobCount == DAEMON_MAX_PENDING_JOBS) {
+        destroyDaemonJob(session, &session->jobs[session->nextEviction]);
+        session->nextEviction = (session->nextEviction + 1) % DAEMON_MAX_PENDING_JOBS;
+    }
+
+    pthread_mutex_lock(&session->daemon->contextMutex);
+    VkcsJob *job = vkcsCreateJob(session->daemon->kernels[request->kernel], session->buffers[request->input].buffer,
+            session->buffers[request->output].buffer, request->elementCount);
+    pthread_mutex_unlock(&session->daemon->contextMutex);
+
+    if (job == NULL) {
+        return NULL;
+    }
+
+    session->jobs[session->jobCount] = (DaemonJob) {
+        .job = job,
+        .kernel = request->kernel,
+        .input = request->input,
+        .output = request->output,
+        .elementCount = request->elementCount,
+    };
+
+    return &session->jobs[session->jobCount++];
+}
+
+// Jobs of all clients go through the context's queue, so submissions that arrive while the device
+// is busy share one `vkQueueSubmit`
+static void submitDaemonJob(DaemonSession *session, const DaemonRequest *request) {
+    uint64_t bytes = (uint64_t) request->elementCount * sizeof(int32_t);
+    DaemonReply reply = {
+        .type = DAEMON_REPLY_COMPLETE,
+        .status = DAEMON_STATUS_INVALID_REQUEST,
+        .ticket = request->ticket,
+    };
+
+    if (request->kernel >= session->daemon->kernelCount || request->elementCount == 0
+            || request->input >= DAEMON_MAX_BUFFERS || session->buffers[request->input].buffer == NULL
+            || request->output >= DAEMON_MAX_BUFFERS || session->buffers[request->output].buffer == NULL
+            || bytes > session->buffers[request->input].size || bytes > session->buffers[request->output].size) {
+        sendReply(session, &reply);
+        return;
+    }
+
+    DaemonJob *job = findDaemonJob(session, request);
+    DaemonSubmission *submission = malloc(sizeof(DaemonSubmission));
+
+    if (job == NULL || submission == NULL) {
+        free(submission);
+        reply.status = DAEMON_STATUS_OUT_OF_MEMORY;
+        sendReply(session, &reply);
+        return;
+    }
+
+    *submission = (DaemonSubmission) {
+        .session = session,
+        .ticket = request->ticket,
+    };
+
+    vkcsSubmitJobWithCallback(job->job, completeSubmission, submission);
+}
+
+static void replyStatistics(DaemonSession *session) {
+    VkcsStatistics statistics;
+
+    vkcsContextStatistics(session->daemon->context, &statistics);
+
+    pthread_mutex_lock(&session->daemon->sessionMutex);
+    uint32_t clientCount = session->daemon->clientCount;
+    pthread_mutex_unlock(&session->daemon->sessionMutex);
+
+    DaemonReply reply = {
+        .type = DAEMON_REPLY_STATISTICS,
+        .status = DAEMON_STATUS_OK,
+        .completedJobs = statistics.completedJobs,
+        .queueSubmits = statistics.queueSubmits,
+        .largestBatch = statistics.largestBatch,
+        .clientCount = clientCount,
+    };
+
+    sendReply(session, &reply);
+}
+
+static void *runSession(void *argument) {
+    DaemonSession *session = argument;
+    Daemon *daemon = session->daemon;
+    DaemonRequest request;
+    int fd;
+
+    while (receiveRequest(session->socket, &request, &fd)) {
+        DaemonReply reply = {
+            .type = DAEMON_REPLY_BUFFER,
+            .status = DAEMON_STATUS_OK,
+        };
+
+        switch (request.type) {
+            case DAEMON_REQUEST_HELLO:
+                reply.type = DAEMON_REPLY_HELLO;
+                reply.version = DAEMON_PROTOCOL_VERSION;
+                reply.importAlignment = vkcsImportAlignment(daemon->context);
+                reply.kernelCount = daemon->kernelCount;
+                sendReply(session, &reply);
+                break;
+            case DAEMON_REQUEST_MAP_BUFFER:
+                reply.status = mapDaemonBuffer(session, &request, fd);
+                sendReply(session, &reply);
+                break;
+            case DAEMON_REQUEST_UNMAP_BUFFER:
+                if (request.buffer < DAEMON_MAX_BUFFERS && session->buffers[request.buffer].buffer != NULL) {
+                    unmapDaemonBuffer(session, request.buffer);
+                } else {
+                    reply.status = DAEMON_STATUS_INVALID_REQUEST;
+                }
+
+                sendReply(session, &reply);
+                break;
+            case DAEMON_REQUEST_SUBMIT:
+                submitDaemonJob(session, &request);
+                break;
+            case DAEMON_REQUEST_STATISTICS:
+                replyStatistics(session);
+                break;
+            default:
+                shutdown(session->socket, SHUT_RDWR);
+                break;
+        }
+
+        // Only mapping requests keep the descriptor, and only for as long as it takes to map it
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // Waits for the outstanding jobs, so that no completion refers to the session afterwards
+    while (session->jobCount > 0) {
+        destroyDaemonJob(session, &session->jobs[0]);
+    }
+
+    for (uint32_t b = 0; b < DAEMON_MAX_BUFFERS; b += 1) {
+        if (session->buffers[b].buffer != NULL) {
+            unmapDaemonBuffer(session, b);
+        }
+    }
+
+    pthread_mutex_lock(&daemon->sessionMutex);
+    session->finished = true;
+    pthread_mutex_unlock(&daemon->sessionMutex);
+
+    return NULL;
+}
+
+static void startSession(Daemon *daemon, int socket) {
+    DaemonSession *session = calloc(1, sizeof(DaemonSession));
+    uint32_t slot = DAEMON_MAX_CLIENTS;
+
+    pthread_mutex_lock(&daemon->sessionMutex);
+
+    for (uint32_t s = 0; s < DAEMON_MAX_CLIENTS && session != NULL; s += 1) {
+        if (daemon->sessions[s] == NULL) {
+            slot = s;
+            break;
+        }
+    }
+
+    if (slot == DAEMON_MAX_CLIENTS) {
+        pthread_mutex_unlock(&daemon->sessionMutex);
+        fprintf(stderr, "Refusing a client: %u clients are connected.\n", DAEMON_MAX_CLIENTS);
+        free(session);
+        close(socket);
+        return;
+    }
+
+    session->daemon = daemon;
+    session->socket = socket;
+    session->finished = false;
+    pthread_mutex_init(&session->sendMutex, NULL);
+
+    if (pthread_create(&session->thread, NULL, runSession, session) != 0) {
+        pthread_mutex_unlock(&daemon->sessionMutex);
+        fprintf(stderr, "Could not start a client thread.\n");
+        pthread_mutex_destroy(&session->sendMutex);
+        free(session);
+        close(socket);
+        return;
+    }
+
+    daemon->sessions[slot] = session;
+    daemon->clientCount += 1;
+    pthread_mutex_unlock(&daemon->sessionMutex);
+}
+
+// Joins finished sessions, or all of them when `all` is set
+static void reapSessions(Daemon *daemon, bool all) {
+    for (uint32_t s = 0; s < DAEMON_MAX_CLIENTS; s += 1) {
+        pthread_mutex_lock(&daemon->sessionMutex);
+        DaemonSession *session = daemon->sessions[s];
+        bool finished = session != NULL && session->finished;
+
+        if (session != NULL && all) {
+            // Ends the session's receive loop
+            shutdown(session->socket, SHUT_RDWR);
+        }
+
+        pthread_mutex_unlock(&daemon->sessionMutex);
+
+        if (session == NULL || !(finished || all)) {
+            continue;
+        }
+
+        pthread_join(session->thread, NULL);
+
+        pthread_mutex_lock(&daemon->sessionMutex);
+        daemon->sessions[s] = NULL;
+        daemon->clientCount -= 1;
+        pthread_mutex_unlock(&daemon->sessionMutex);
+
+        close(session->socket);
+        pthread_mutex_destroy(&session->sendMutex);
+        free(session);
+    }
+}
+
+static int listenOnSocket(const char *socketPath) {
+    struct sockaddr_un address = {
+        .sun_family = AF_UNIX,
+    };
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "The socket path is too long.\n");
+        exit(1);
+    }
+
+    strcpy(address.sun_path, socketPath);
+
+    int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    if (listener < 0) {
+        perror("socket");
+        exit(1);
+    }
+
+    // A stale socket left by a daemon that did not shut down cleanly
+    unlink(socketPath);
+
+    // Only the user running the daemon may connect
+    mode_t mask = umask(0077);
+    int bound = bind(listener, (struct sockaddr*) &address, sizeof(address));
+    umask(mask);
+
+    if (bound != 0 || listen(listener, DAEMON_MAX_CLIENTS) != 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", socketPath, strerror(errno));
+        exit(1);
+    }
+
+    return listener;
+}
+
+int main(int argc, char *argv[]) {
+    DaemonOptions options = parseDaemonOptions(argc, argv);
+    VkcsContextOptions contextOptions;
+    Daemon daemon = {
+        .kernelCount = 0,
+        .clientCount = 0,
+    };
+
+    vkcsDefaultContextOptions(&contextOptions);
+    contextOptions.deviceSelection = options.deviceSelection;
+
+    daemon.context = vkcsCreateContext(&contextOptions);
+
+    if (daemon.context == NULL) {
+        fprintf(stderr, "Could not create the context.\n");
+        exit(1);
+    }
+
+    pthread_mutex_init(&daemon.contextMutex, NULL);
+    pthread_mutex_init(&daemon.sessionMutex, NULL);
+
+    // Every pipeline is built up front, so clients never wait for a compilation
+    daemon.kernels[daemon.kernelCount++] = vkcsCreateKernel(daemon.context, NULL, 0, 0);
+
+    for (uint32_t k = 0; k < options.kernelPathCount; k += 1) {
+        uint32_t shaderSize;
+        uint32_t *shaderData;
+
+        shaderLoadFile(&shaderSize, &shaderData, options.kernelPaths[k]);
+        daemon.kernels[daemon.kernelCount++] = vkcsCreateKernel(daemon.context, shaderData, shaderSize, 0);
+        hostFree(shaderData);
+    }
+
+    for (uint32_t k = 0; k < daemon.kernelCount; k += 1) {
+        if (daemon.kernels[k] == NULL) {
+            fprintf(stderr, "Could not create kernel %" PRIu32 ".\n", k);
+            exit(1);
+        }
+    }
+
+    struct sigaction action = {
+        .sa_handler = requestStop,
+    };
+
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int listener = listenOnSocket(options.socketPath);
+
+    printf("daemon { socket: %s, device: %s, kernels: %" PRIu32 ", importAlignment: %" PRIu64 " }\n",
+            options.socketPath, vkcsContextProperties(daemon.context)->deviceName, daemon.kernelCount,
+            (uint64_t) vkcsImportAlignment(daemon.context));
+    fflush(stdout);
+
+    while (!stopRequested) {
+        struct pollfd pollDescriptor = {
+            .fd = listener,
+            .events = POLLIN,
+        };
+
+        reapSessions(&daemon, false);
+
+        if (poll(&pollDescriptor, 1, DAEMON_POLL_MILLISECONDS) <= 0) {
+            continue;
+        }
+
+        int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+
+        if (client >= 0) {
+            startSession(&daemon, client);
+        }
+    }
+
+    close(listener);
+    unlink(options.socketPath);
+    reapSessions(&daemon, true);
+
+    VkcsStatistics statistics;
+
+    vkcsContextStatistics(daemon.context, &statistics);
+    printf("daemon { completedJobs: %" PRIu64 ", queueSubmits: %" PRIu64 ", averageBatch: %.2f, largestBatch: %"
+            PRIu32 " }\n", statistics.completedJobs, statistics.queueSubmits,
+            statistics.queueSubmits > 0 ? (double) statistics.completedJobs / (double) statistics.queueSubmits : 0.0,
+            statistics.largestBatch);
+
+    for (uint32_t k = 0; k < daemon.kernelCount; k += 1) {
+        vkcsDestroyKernel(daemon.kernels[k]);
+    }
+
+    pthread_mutex_destroy(&daemon.sessionMutex);
+    pthread_mutex_destroy(&daemon.contextMutex);
+    vkcsDestroyContext(daemon.context);
+
+    return 0;
+}
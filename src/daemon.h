@@ -0,0 +1,68 @@
+#pragma once
+
+#include <inttypes.h>
+
+// Wire protocol between vkcscratch-daemon and the client library (src/vkcsclient.h). Every
+// message is one SOCK_SEQPACKET datagram holding a single request or reply; payloads never go
+// through the socket but live in memfd shared memory that both sides map.
+
+#define DAEMON_SOCKET_ENVIRONMENT_VARIABLE "VKCSCRATCH_SOCKET"
+#define DAEMON_DEFAULT_SOCKET_PATH "/tmp/vkcscratch.sock"
+#define DAEMON_PROTOCOL_VERSION 1
+// Per connection
+#define DAEMON_MAX_BUFFERS 64
+// Submitted jobs a connection may have whose completion it has not received yet
+#define DAEMON_MAX_PENDING_JOBS 64
+
+typedef enum {
+    // First request of every connection; answered with the protocol version and import alignment
+    DAEMON_REQUEST_HELLO,
+    // Carries a memfd as SCM_RIGHTS ancillary data; its first `size` bytes become buffer `buffer`
+    DAEMON_REQUEST_MAP_BUFFER,
+    DAEMON_REQUEST_UNMAP_BUFFER,
+    // Runs `kernel` from `input` into `output` over `elementCount` elements; answered once it completes
+    DAEMON_REQUEST_SUBMIT,
+    DAEMON_REQUEST_STATISTICS,
+} DaemonRequestType;
+
+typedef enum {
+    DAEMON_REPLY_HELLO,
+    DAEMON_REPLY_BUFFER,
+    DAEMON_REPLY_COMPLETE,
+    DAEMON_REPLY_STATISTICS,
+} DaemonReplyType;
+
+typedef enum {
+    DAEMON_STATUS_OK = 0,
+    DAEMON_STATUS_INVALID_REQUEST = 1,
+    DAEMON_STATUS_OUT_OF_MEMORY = 2,
+} DaemonStatus;
+
+typedef struct {
+    uint32_t type;
+    uint32_t kernel;
+    // Client-chosen index below DAEMON_MAX_BUFFERS for MAP_BUFFER and UNMAP_BUFFER
+    uint32_t buffer;
+    uint32_t input;
+    uint32_t output;
+    uint32_t elementCount;
+    uint64_t size;
+    // Client-chosen, echoed by the COMPLETE reply
+    uint64_t ticket;
+} DaemonRequest;
+
+// COMPLETE replies arrive in completion order and may interleave with the reply to any other request
+typedef struct {
+    uint32_t type;
+    uint32_t status;
+    uint64_t ticket;
+    // HELLO: 0 when the device copies shared memory instead of accessing it in place
+    uint64_t importAlignment;
+    uint32_t version;
+    uint32_t kernelCount;
+    // STATISTICS, for the whole daemon
+    uint64_t completedJobs;
+    uint64_t queueSubmits;
+    uint32_t largestBatch;
+    uint32_t clientCount;
+} DaemonReply;
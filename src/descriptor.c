@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "descriptor.h"
+#include "util.h"
+#include "host_allocator.h"
+
+const char *descriptorModeString(DescriptorMode mode) {
+    switch (mode) {
+        case DESCRIPTOR_MODE_UPDATE: return "update";
+        case DESCRIPTOR_MODE_TEMPLATE: return "template";
+        case DESCRIPTOR_MODE_PUSH: return "push";
+        default: return "undefined";
+    }
+}
+
+bool parseDescriptorMode(const char *string, DescriptorMode *mode) {
+    for (DescriptorMode candidate = DESCRIPTOR_MODE_UPDATE; candidate < DESCRIPTOR_MODE_COUNT; candidate += 1) {
+        if (strcmp(string, descriptorModeString(candidate)) == 0) {
+            *mode = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool descriptorModeSupported(const ComputeDevice *computeDevice, DescriptorMode mode) {
+    switch (mode) {
+        case DESCRIPTOR_MODE_UPDATE: return true;
+        case DESCRIPTOR_MODE_TEMPLATE: return computeDevice->descriptorUpdateTemplates;
+        case DESCRIPTOR_MODE_PUSH: return computeDevice->pushDescriptors && computeDevice->descriptorUpdateTemplates;
+        default: return false;
+    }
+}
+
+DescriptorMode preferredDescriptorMode(const ComputeDevice *computeDevice, bool allowPush) {
+    if (allowPush && descriptorModeSupported(computeDevice, DESCRIPTOR_MODE_PUSH)) {
+        return DESCRIPTOR_MODE_PUSH;
+    }
+
+    return descriptorModeSupported(computeDevice, DESCRIPTOR_MODE_TEMPLATE) ? DESCRIPTOR_MODE_TEMPLATE : DESCRIPTOR_MODE_UPDATE;
+}
+
+// The data the update template reads: one VkDescriptorBufferInfo per binding
+static void fillBufferInfos(uint32_t bindingCount, const VkBuffer *buffers, VkDescriptorBufferInfo *bufferInfos) {
+    for (uint32_t i = 0; i < bindingCount; i += 1) {
+        bufferInfos[i] = (VkDescriptorBufferInfo) {
+            .buffer = buffers[i],
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+        };
+    }
+}
+
+static VkDescriptorUpdateTemplate createUpdateTemplate(DescriptorCache *cache) {
+    VkDescriptorUpdateTemplateEntry updateTemplateEntries[MAX_STORAGE_BINDINGS];
+
+    for (uint32_t i = 0; i < cache->bindingCount; i += 1) {
+        updateTemplateEntries[i] = (VkDescriptorUpdateTemplateEntry) {
+            .dstBinding = i,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .offset = i * sizeof(VkDescriptorBufferInfo),
+            .stride = sizeof(VkDescriptorBufferInfo),
+        };
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo updateTemplateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .descriptorUpdateEntryCount = cache->bindingCount,
+        .pDescriptorUpdateEntries = updateTemplateEntries,
+        .templateType = cache->mode == DESCRIPTOR_MODE_PUSH
+            ? VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR
+            : VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+        .descriptorSetLayout = cache->descriptorSetLayout,
+        // Only used for push descriptors
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_COMPUTE,
+        .pipelineLayout = cache->pipelineLayout,
+        .set = 0,
+    };
+
+    VkDescriptorUpdateTemplate updateTemplate;
+    BAIL_ON_BAD_RESULT(vkCreateDescriptorUpdateTemplate(cache->device, &updateTemplateCreateInfo, hostAllocationCallbacks(),
+                &updateTemplate));
+
+    return updateTemplate;
+}
+
+void createDescriptorCache(const ComputeDevice *computeDevice, DescriptorMode mode, uint32_t bindingCount,
+        uint32_t pushConstantSize, DescriptorCache *cache) {
+    if (!descriptorModeSupported(computeDevice, mode)) {
+        fprintf(stderr, "The device does not support %s descriptors.\n", descriptorModeString(mode));
+        exit(1);
+    }
+
+    *cache = (DescriptorCache) {
+        .device = computeDevice->device,
+        .mode = mode,
+        .bindingCount = bindingCount,
+        .updateTemplate = VK_NULL_HANDLE,
+        .cmdPushDescriptorSetWithTemplate = computeDevice->cmdPushDescriptorSetWithTemplate,
+        .capacity = DESCRIPTOR_CACHE_INITIAL_CAPACITY,
+    };
+
+    cache->descriptorSetLayout = createStorageDescriptorSetLayoutWithFlags(cache->device, bindingCount,
+            mode == DESCRIPTOR_MODE_PUSH ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0);
+    cache->pipelineLayout = createPipelineLayout(cache->device, cache->descriptorSetLayout, pushConstantSize);
+
+    if (mode != DESCRIPTOR_MODE_UPDATE) {
+        cache->updateTemplate = createUpdateTemplate(cache);
+    }
+
+    cache->entries = calloc(cache->capacity, sizeof(DescriptorCacheEntry));
+
+    if (cache->entries == NULL) {
+        fprintf(stderr, "Could not allocate memory for the descriptor cache.\n");
+        exit(1);
+    }
+
+    pthread_mutex_init(&cache->mutex, NULL);
+}
+
+void destroyDescriptorCache(DescriptorCache *cache) {
+    for (uint32_t i = 0; i < cache->poolCount; i += 1) {
+        vkDestroyDescriptorPool(cache->device, cache->pools[i], hostAllocationCallbacks());
+    }
+
+    if (cache->updateTemplate != VK_NULL_HANDLE) {
+        vkDestroyDescriptorUpdateTemplate(cache->device, cache->updateTemplate, hostAllocationCallbacks());
+    }
+
+    vkDestroyPipelineLayout(cache->device, cache->pipelineLayout, hostAllocationCallbacks());
+    vkDestroyDescriptorSetLayout(cache->device, cache->descriptorSetLayout, hostAllocationCallbacks());
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache->freeSets);
+    free(cache->entries);
+}
+
+// FNV-1a over the handles
+static uint32_t hashBuffers(uint32_t bindingCount, const VkBuffer *buffers) {
+    const unsigned char *bytes = (const unsigned char*) buffers;
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < bindingCount * sizeof(VkBuffer); i += 1) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// The slot holding `buffers`, or the empty slot they would go into
+static uint32_t findSlot(const DescriptorCache *cache, const VkBuffer *buffers) {
+    uint32_t mask = cache->capacity - 1;
+    uint32_t slot = hashBuffers(cache->bindingCount, buffers) & mask;
+
+    while (cache->entries[slot].descriptorSet != VK_NULL_HANDLE
+            && memcmp(cache->entries[slot].buffers, buffers, cache->bindingCount * sizeof(VkBuffer)) != 0) {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+static bool entryBindsBuffer(const DescriptorCache *cache, const DescriptorCacheEntry *entry, VkBuffer buffer) {
+    for (uint32_t i = 0; i < cache->bindingCount; i += 1) {
+        if (entry->buffers[i] == buffer) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void pushFreeSet(DescriptorCache *cache, VkDescriptorSet descriptorSet) {
+    if (cache->freeSetCount == cache->freeSetCapacity) {
+        uint32_t capacity = cache->freeSetCapacity > 0 ? cache->freeSetCapacity * 2 : DESCRIPTOR_CACHE_FIRST_POOL_SETS;
+        VkDescriptorSet *freeSets = realloc(cache->freeSets, capacity * sizeof(VkDescriptorSet));
+
+        if (freeSets == NULL) {
+            fprintf(stderr, "Could not allocate memory for the descriptor cache.\n");
+            exit(1);
+        }
+
+        cache->freeSets = freeSets;
+        cache->freeSetCapacity = capacity;
+    }
+
+    cache->freeSets[cache->freeSetCount++] = descriptorSet;
+}
+
+// Moves the entries into a table of `capacity` slots, except those binding `forgottenBuffer`
+// (unless it is VK_NULL_HANDLE), whose sets go to the free list
+static void rehashDescriptorCache(DescriptorCache *cache, uint32_t capacity, VkBuffer forgottenBuffer) {
+    DescriptorCacheEntry *oldEntries = cache->entries;
+    uint32_t oldCapacity = cache->capacity;
+
+    cache->entries = calloc(capacity, sizeof(DescriptorCacheEntry));
+    cache->capacity = capacity;
+    cache->entryCount = 0;
+
+    if (cache->entries == NULL) {
+        fprintf(stderr, "Could not allocate memory for the descriptor cache.\n");
+        exit(1);
+    }
+
+    for (uint32_t i = 0; i < oldCapacity; i += 1) {
+        const DescriptorCacheEntry *entry = &oldEntries[i];
+
+        if (entry->descriptorSet == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        if (forgottenBuffer != VK_NULL_HANDLE && entryBindsBuffer(cache, entry, forgottenBuffer)) {
+            pushFreeSet(cache, entry->descriptorSet);
+            continue;
+        }
+
+        cache->entries[findSlot(cache, entry->buffers)] = *entry;
+        cache->entryCount += 1;
+    }
+
+    free(oldEntries);
+}
+
+static VkDescriptorSet allocateDescriptorSet(DescriptorCache *cache) {
+    if (cache->freeSetCount > 0) {
+        cache->statistics.recycledSets += 1;
+        return cache->freeSets[--cache->freeSetCount];
+    }
+
+    if (cache->poolSetsLeft == 0) {
+        // Pools survive a reset, so the next one may exist already
+        if (cache->poolsInUse == cache->poolCount) {
+            if (cache->poolCount == DESCRIPTOR_CACHE_MAX_POOLS) {
+                fprintf(stderr, "The descriptor cache is out of pools.\n");
+                exit(1);
+            }
+
+            VkDescriptorPoolSize descriptorPoolSize = {
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = (DESCRIPTOR_CACHE_FIRST_POOL_SETS << cache->poolCount) * cache->bindingCount,
+            };
+
+            VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                .pNext = NULL,
+                .flags = 0,
+                .maxSets = DESCRIPTOR_CACHE_FIRST_POOL_SETS << cache->poolCount,
+                .poolSizeCount = 1,
+                .pPoolSizes = &descriptorPoolSize,
+            };
+
+            BAIL_ON_BAD_RESULT(vkCreateDescriptorPool(cache->device, &descriptorPoolCreateInfo, hostAllocationCallbacks(),
+                        &cache->pools[cache->poolCount]));
+            cache->poolCount += 1;
+        }
+
+        cache->poolSetsLeft = DESCRIPTOR_CACHE_FIRST_POOL_SETS << cache->poolsInUse;
+        cache->poolsInUse += 1;
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = cache->pools[cache->poolsInUse - 1],
+        .descriptorSetCount = 1,
+        .pSetLayouts = &cache->descriptorSetLayout,
+    };
+
+    VkDescriptorSet descriptorSet;
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(cache->device, &descriptorSetAllocateInfo, &descriptorSet));
+    cache->poolSetsLeft -= 1;
+
+    return descriptorSet;
+}
+
+static void writeDescriptorSet(const DescriptorCache *cache, VkDescriptorSet descriptorSet, const VkBuffer *buffers) {
+    if (cache->updateTemplate != VK_NULL_HANDLE) {
+        VkDescriptorBufferInfo bufferInfos[MAX_STORAGE_BINDINGS];
+        fillBufferInfos(cache->bindingCount, buffers, bufferInfos);
+        vkUpdateDescriptorSetWithTemplate(cache->device, descriptorSet, cache->updateTemplate, bufferInfos);
+    } else {
+        updateStorageDescriptorSet(cache->device, descriptorSet, buffers, cache->bindingCount);
+    }
+}
+
+void descriptorCacheAcquire(DescriptorCache *cache, const VkBuffer *buffers, DescriptorBinding *binding) {
+    *binding = (DescriptorBinding) {
+        .descriptorSet = VK_NULL_HANDLE,
+    };
+
+    memcpy(binding->buffers, buffers, cache->bindingCount * sizeof(VkBuffer));
+
+    // Pushed when recorded; there is nothing to look up
+    if (cache->mode == DESCRIPTOR_MODE_PUSH) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    cache->statistics.lookups += 1;
+
+    // At most three quarters full, so probes stay short
+    if ((cache->entryCount + 1) * 4 > cache->capacity * 3) {
+        rehashDescriptorCache(cache, cache->capacity * 2, VK_NULL_HANDLE);
+    }
+
+    DescriptorCacheEntry *entry = &cache->entries[findSlot(cache, binding->buffers)];
+
+    if (entry->descriptorSet != VK_NULL_HANDLE) {
+        cache->statistics.hits += 1;
+    } else {
+        memcpy(entry->buffers, binding->buffers, sizeof(entry->buffers));
+        entry->descriptorSet = allocateDescriptorSet(cache);
+        writeDescriptorSet(cache, entry->descriptorSet, entry->buffers);
+        cache->entryCount += 1;
+        cache->statistics.writes += 1;
+    }
+
+    binding->descriptorSet = entry->descriptorSet;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void descriptorCacheForgetBuffer(DescriptorCache *cache, VkBuffer buffer) {
+    if (cache->mode == DESCRIPTOR_MODE_PUSH || buffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    rehashDescriptorCache(cache, cache->capacity, buffer);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void resetDescriptorCache(DescriptorCache *cache) {
+    pthread_mutex_lock(&cache->mutex);
+
+    for (uint32_t i = 0; i < cache->poolsInUse; i += 1) {
+        BAIL_ON_BAD_RESULT(vkResetDescriptorPool(cache->device, cache->pools[i], 0));
+    }
+
+    memset(cache->entries, 0, cache->capacity * sizeof(DescriptorCacheEntry));
+    cache->entryCount = 0;
+    // They were allocated from the pools just reset
+    cache->freeSetCount = 0;
+    cache->poolsInUse = 0;
+    cache->poolSetsLeft = 0;
+    cache->statistics.resets += 1;
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void recordDescriptorBinding(const DescriptorCache *cache, VkCommandBuffer commandBuffer, const DescriptorBinding *binding) {
+    if (cache->mode == DESCRIPTOR_MODE_PUSH) {
+        VkDescriptorBufferInfo bufferInfos[MAX_STORAGE_BINDINGS];
+        fillBufferInfos(cache->bindingCount, binding->buffers, bufferInfos);
+        cache->cmdPushDescriptorSetWithTemplate(commandBuffer, cache->updateTemplate, cache->pipelineLayout, 0, bufferInfos);
+    } else {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cache->pipelineLayout, 0, 1,
+                &binding->descriptorSet, 0, NULL);
+    }
+}
+
+void getDescriptorCacheStatistics(DescriptorCache *cache, DescriptorCacheStatistics *statistics) {
+    pthread_mutex_lock(&cache->mutex);
+    *statistics = cache->statistics;
+    statistics->cachedSets = cache->entryCount;
+    statistics->pools = cache->poolCount;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void printDescriptorCacheStatistics(const DescriptorCache *cache, const DescriptorCacheStatistics *statistics) {
+    printf("descriptors { mode: %s, lookups: %" PRIu64 ", hits: %" PRIu64 " (%.1f%%), writes: %" PRIu64 ", "
+            "recycled: %" PRIu64 ", resets: %" PRIu64 ", sets: %" PRIu32 ", pools: %" PRIu32 " }\n",
+            descriptorModeString(cache->mode), statistics->lookups, statistics->hits,
+            statistics->lookups > 0 ? 100.0 * (double) statistics->hits / (double) statistics->lookups : 0.0,
+            statistics->writes, statistics->recycledSets, statistics->resets, statistics->cachedSets, statistics->pools);
+}
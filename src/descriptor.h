@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "kernel.h"
+
+// Sets in the first pool of a cache; every further pool holds twice as many as the one before
+#define DESCRIPTOR_CACHE_FIRST_POOL_SETS 16
+#define DESCRIPTOR_CACHE_MAX_POOLS 16
+#define DESCRIPTOR_CACHE_INITIAL_CAPACITY 64
+
+typedef enum {
+    // Cached sets, written with vkUpdateDescriptorSets
+    DESCRIPTOR_MODE_UPDATE,
+    // Cached sets, written through a descriptor update template
+    DESCRIPTOR_MODE_TEMPLATE,
+    // No sets at all: the buffers are pushed into the command buffer (VK_KHR_push_descriptor)
+    DESCRIPTOR_MODE_PUSH,
+    DESCRIPTOR_MODE_COUNT,
+} DescriptorMode;
+
+// What a dispatch binds its storage buffers with
+typedef struct {
+    VkDescriptorSet descriptorSet; // VK_NULL_HANDLE with push descriptors
+    VkBuffer buffers[MAX_STORAGE_BINDINGS];
+} DescriptorBinding;
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    // Sets written on a miss, from the free list or a pool
+    uint64_t writes;
+    // Sets of forgotten buffers reused for other bindings
+    uint64_t recycledSets;
+    uint64_t resets;
+    uint32_t cachedSets;
+    uint32_t pools;
+} DescriptorCacheStatistics;
+
+typedef struct {
+    VkBuffer buffers[MAX_STORAGE_BINDINGS];
+    VkDescriptorSet descriptorSet; // VK_NULL_HANDLE for an empty slot
+} DescriptorCacheEntry;
+
+// Descriptor sets of whole storage buffers, cached by the buffers they bind, so that rebinding a
+// combination seen before is one hash lookup instead of a pool allocation and a descriptor write.
+// Sets come from pools that only grow; a set is written once, and only handed out again when one
+// of its buffers is forgotten or the cache is reset, which recycles all pools at once. With push
+// descriptors nothing is cached: the buffers go straight into the command buffer.
+typedef struct {
+    VkDevice device;
+    DescriptorMode mode;
+    uint32_t bindingCount;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    // VK_NULL_HANDLE with DESCRIPTOR_MODE_UPDATE
+    VkDescriptorUpdateTemplate updateTemplate;
+    PFN_vkCmdPushDescriptorSetWithTemplateKHR cmdPushDescriptorSetWithTemplate;
+    // Guards everything below, so bindings can be acquired from several threads
+    pthread_mutex_t mutex;
+    // Open addressing with linear probing; the capacity is a power of two
+    DescriptorCacheEntry *entries;
+    uint32_t capacity;
+    uint32_t entryCount;
+    VkDescriptorSet *freeSets;
+    uint32_t freeSetCount;
+    uint32_t freeSetCapacity;
+    VkDescriptorPool pools[DESCRIPTOR_CACHE_MAX_POOLS];
+    uint32_t poolCount;
+    // Pools allocated from since the last reset; sets come from the last of them, which has
+    // `poolSetsLeft` left
+    uint32_t poolsInUse;
+    uint32_t poolSetsLeft;
+    DescriptorCacheStatistics statistics;
+} DescriptorCache;
+
+const char *descriptorModeString(DescriptorMode mode);
+bool parseDescriptorMode(const char *string, DescriptorMode *mode);
+bool descriptorModeSupported(const ComputeDevice *computeDevice, DescriptorMode mode);
+// Push descriptors where supported unless `allowPush` is false (sets are needed to hand them to
+// code that binds sets itself), then templates, then plain updates
+DescriptorMode preferredDescriptorMode(const ComputeDevice *computeDevice, bool allowPush);
+
+// Creates the descriptor set layout of `bindingCount` storage buffers and a pipeline layout with a
+// push constant range of `pushConstantSize` bytes; pipelines used with the cache's bindings must
+// be created with `cache->pipelineLayout`
+void createDescriptorCache(const ComputeDevice *computeDevice, DescriptorMode mode, uint32_t bindingCount,
+        uint32_t pushConstantSize, DescriptorCache *cache);
+void destroyDescriptorCache(DescriptorCache *cache);
+
+// Binds buffer `i` to binding `i`. The set stays valid until one of its buffers is forgotten or
+// the cache is reset, so command buffers recorded with it may be resubmitted until then.
+void descriptorCacheAcquire(DescriptorCache *cache, const VkBuffer *buffers, DescriptorBinding *binding);
+// Must be called before `buffer` is destroyed, so that a later buffer with the same handle cannot
+// hit its stale sets; they are recycled
+void descriptorCacheForgetBuffer(DescriptorCache *cache, VkBuffer buffer);
+// Drops every binding and resets the pools, once no command buffer using them is pending: for
+// transient bindings that are recorded afresh for every batch
+void resetDescriptorCache(DescriptorCache *cache);
+
+// Binds the set, or pushes the buffers, at set 0 of the cache's pipeline layout
+void recordDescriptorBinding(const DescriptorCache *cache, VkCommandBuffer commandBuffer, const DescriptorBinding *binding);
+
+void getDescriptorCacheStatistics(DescriptorCache *cache, DescriptorCacheStatistics *statistics);
+void printDescriptorCacheStatistics(const DescriptorCache *cache, const DescriptorCacheStatistics *statistics);
@@ -0,0 +1,634 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "device.h"
+#include "util.h"
+#include "host_allocator.h"
+
+#define VALIDATION_LAYER_NAME "VK_LAYER_LUNARG_standard_validation"
+#define MAX_DEBUG_REPORT_INSTANCES 8
+
+// The debug report callback of every instance created with validation, destroyed with it
+typedef struct {
+    VkInstance instance;
+    VkDebugReportCallbackEXT callback;
+} DebugReportRegistration;
+
+static DebugReportRegistration debugReportRegistrations[MAX_DEBUG_REPORT_INSTANCES];
+static pthread_mutex_t debugReportMutex = PTHREAD_MUTEX_INITIALIZER;
+
+const char* getPhysicalDeviceTypeString(int physicalDeviceType) {
+    switch (physicalDeviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_OTHER: return "Other";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "Integrated GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "Discrete GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "Virtual GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: return "CPU";
+        default: return "Undefined";
+    }
+}
+
+void printPhysicalDeviceProperties(const VkPhysicalDeviceProperties *properties) {
+    printf("%s {\n\tapiVersion: %i.%i.%i\n\tdriverVersion: %i\n\tvendorID: %i\n\tdeviceID: %i\n\tdeviceType: %s\n\tdeviceName: %s\n}\n",
+            properties->deviceName,
+            VK_VERSION_MAJOR(properties->apiVersion),
+            VK_VERSION_MINOR(properties->apiVersion),
+            VK_VERSION_PATCH(properties->apiVersion),
+            properties->driverVersion,
+            properties->vendorID,
+            properties->deviceID,
+            getPhysicalDeviceTypeString(properties->deviceType),
+            properties->deviceName
+        );
+}
+
+// Prefer devices with VK_QUEUE_COMPUTE_BIT only
+uint32_t chooseQueueFamilyIndex(uint32_t queueFamilyPropertiesCount, VkQueueFamilyProperties *const queueFamilyProperties) {
+    uint32_t index;
+    bool foundIndex = false;
+
+    for (uint32_t i = 0; i < queueFamilyPropertiesCount; i += 1) {
+        VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+
+        if (!(VK_QUEUE_GRAPHICS_BIT & flags) && (VK_QUEUE_COMPUTE_BIT & flags))
+        {
+            return i;
+        }
+
+        if (!foundIndex && (VK_QUEUE_COMPUTE_BIT & flags)) {
+            index = i;
+            foundIndex = true;
+        }
+    }
+
+    if (!foundIndex) {
+        fprintf(stderr, "Could not find any queue on this device with compute capabilities.\n");
+        exit(1);
+    }
+
+    return index;
+}
+
+uint32_t chooseTransferQueueFamilyIndex(uint32_t queueFamilyPropertiesCount, VkQueueFamilyProperties *const queueFamilyProperties,
+        uint32_t computeQueueFamilyIndex) {
+    for (uint32_t i = 0; i < queueFamilyPropertiesCount; i += 1) {
+        VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+
+        if ((VK_QUEUE_TRANSFER_BIT & flags) && !(VK_QUEUE_COMPUTE_BIT & flags) && !(VK_QUEUE_GRAPHICS_BIT & flags)
+                && queueFamilyProperties[i].queueCount > 0) {
+            return i;
+        }
+    }
+
+    return computeQueueFamilyIndex;
+}
+
+static void appendPrefix(size_t *prefixLen, char *prefix, char character) {
+    if (*prefixLen > 0) {
+        prefix[(*prefixLen)++] = '|';
+    }
+
+    prefix[(*prefixLen)++] = character;
+}
+
+static void buildPrefix(VkDebugReportFlagsEXT *flags, size_t *prefixLen, char *prefix, VkDebugReportFlagBitsEXT bit, char character) {
+    if ((*flags & bit) == bit) {
+        appendPrefix(prefixLen, prefix, character);
+
+        *flags -= bit;
+    }
+}
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
+        VkDebugReportFlagsEXT flags,
+        VkDebugReportObjectTypeEXT objType,
+        uint64_t obj,
+        size_t location,
+        int32_t code,
+        const char *layerPrefix,
+        const char *msg,
+        void *userData) {
+    size_t prefixLen = 0;
+    char prefix[12]; // max 5 items, max 1 unknown item, max 5 separators, zero byte
+
+    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_INFORMATION_BIT_EXT, 'I');
+    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_WARNING_BIT_EXT, 'W');
+    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT, 'P');
+    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_ERROR_BIT_EXT, 'E');
+    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_DEBUG_BIT_EXT, 'D');
+
+    if (flags != 0) {
+        appendPrefix(&prefixLen, prefix, '?');
+    }
+
+    prefix[prefixLen] = '\0';
+
+    printf("[%s] %s\n", prefix, msg);
+
+    return VK_FALSE;
+}
+
+bool isInstanceLayerAvailable(const char *layerName) {
+    uint32_t layerCount;
+    BAIL_ON_BAD_RESULT(vkEnumerateInstanceLayerProperties(&layerCount, NULL));
+
+    VkLayerProperties *const layers = (VkLayerProperties*) malloc(sizeof(VkLayerProperties) * layerCount);
+    BAIL_ON_BAD_RESULT(vkEnumerateInstanceLayerProperties(&layerCount, layers));
+
+    bool available = false;
+
+    for (uint32_t i = 0; i < layerCount && !available; i += 1) {
+        available = strcmp(layers[i].layerName, layerName) == 0;
+    }
+
+    free(layers);
+
+    return available;
+}
+
+bool isDeviceExtensionAvailable(VkPhysicalDevice physicalDevice, const char *extensionName) {
+    uint32_t extensionCount;
+    BAIL_ON_BAD_RESULT(vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL));
+
+    VkExtensionProperties *const extensions = (VkExtensionProperties*) malloc(sizeof(VkExtensionProperties) * extensionCount);
+    BAIL_ON_BAD_RESULT(vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, extensions));
+
+    bool available = false;
+
+    for (uint32_t i = 0; i < extensionCount && !available; i += 1) {
+        available = strcmp(extensions[i].extensionName, extensionName) == 0;
+    }
+
+    free(extensions);
+
+    return available;
+}
+
+// Extensions need to be loaded manually
+VkResult loadVkCreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
+    PFN_vkCreateDebugReportCallbackEXT func = (PFN_vkCreateDebugReportCallbackEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
+
+    if (func != NULL) {
+        return func(instance, pCreateInfo, pAllocator, pCallback);
+    } else {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+
+void loadVkDestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback, const VkAllocationCallbacks* pAllocator) {
+    PFN_vkDestroyDebugReportCallbackEXT func = (PFN_vkDestroyDebugReportCallbackEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
+
+    if (func != NULL) {
+        func(instance, callback, pAllocator);
+    }
+}
+
+uint32_t chooseInstanceApiVersion(void) {
+    // A 1.0 loader does not export vkEnumerateInstanceVersion
+    PFN_vkEnumerateInstanceVersion enumerateInstanceVersion =
+        (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(NULL, "vkEnumerateInstanceVersion");
+    uint32_t loaderApiVersion;
+
+    if (enumerateInstanceVersion != NULL && enumerateInstanceVersion(&loaderApiVersion) == VK_SUCCESS
+            && loaderApiVersion >= VK_API_VERSION_1_1) {
+        return VK_API_VERSION_1_1;
+    }
+
+    return VK_MAKE_VERSION(1, 0, 65);
+}
+
+bool tryCreateInstance(bool *validationEnabled, VkInstance *instance) {
+    const VkApplicationInfo applicationInfo = {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pNext = NULL,
+        .pApplicationName = "vkcscratch",
+        .applicationVersion = 0,
+        .pEngineName = NULL,
+        .engineVersion = 0,
+        .apiVersion = chooseInstanceApiVersion(),
+    };
+    // Validation is optional, so that the program also runs where the SDK is not installed (e.g. lavapipe on CI)
+    const bool validationAvailable = isInstanceLayerAvailable(VALIDATION_LAYER_NAME);
+    const char *enabledLayerNames[] = { VALIDATION_LAYER_NAME };
+    const char *enabledExtensionNames[] = { VK_EXT_DEBUG_REPORT_EXTENSION_NAME };
+    const VkDebugReportCallbackCreateInfoEXT debugReportCallbackCreateInfoEXT = {
+        .sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT,
+        .pNext = NULL,
+        .flags = VK_DEBUG_REPORT_INFORMATION_BIT_EXT
+            | VK_DEBUG_REPORT_WARNING_BIT_EXT
+            | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT
+            | VK_DEBUG_REPORT_ERROR_BIT_EXT
+            | VK_DEBUG_REPORT_DEBUG_BIT_EXT,
+        .pfnCallback = debugCallback,
+        .pUserData = NULL,
+
+    };
+    const VkInstanceCreateInfo instanceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .pApplicationInfo = &applicationInfo,
+        .enabledLayerCount = validationAvailable ? 1 : 0,
+        .ppEnabledLayerNames = enabledLayerNames,
+        .enabledExtensionCount = validationAvailable ? 1 : 0,
+        .ppEnabledExtensionNames = enabledExtensionNames,
+    };
+
+    VkResult result = vkCreateInstance(&instanceCreateInfo, hostAllocationCallbacks(), instance);
+
+    if (result != VK_SUCCESS) {
+        fprintf(stderr, "Could not create a Vulkan instance (VkResult %d).\n", (int) result);
+        return false;
+    }
+
+    if (validationAvailable) {
+        VkDebugReportCallbackEXT debugReportCallbackEXT;
+        BAIL_ON_BAD_RESULT(loadVkCreateDebugReportCallbackEXT(*instance, &debugReportCallbackCreateInfoEXT, hostAllocationCallbacks(), &debugReportCallbackEXT));
+
+        pthread_mutex_lock(&debugReportMutex);
+        uint32_t r = 0;
+
+        while (r < MAX_DEBUG_REPORT_INSTANCES && debugReportRegistrations[r].instance != VK_NULL_HANDLE) {
+            r += 1;
+        }
+
+        if (r < MAX_DEBUG_REPORT_INSTANCES) {
+            debugReportRegistrations[r] = (DebugReportRegistration) {
+                .instance = *instance,
+                .callback = debugReportCallbackEXT,
+            };
+        }
+
+        pthread_mutex_unlock(&debugReportMutex);
+
+        if (r == MAX_DEBUG_REPORT_INSTANCES) {
+            // Not remembered, so it could not be destroyed before the instance
+            loadVkDestroyDebugReportCallbackEXT(*instance, debugReportCallbackEXT, hostAllocationCallbacks());
+            fprintf(stderr, "Too many instances with validation, not reporting for this one.\n");
+        }
+    } else {
+        fprintf(stderr, "Validation layers are not available, continuing without them.\n");
+    }
+
+    *validationEnabled = validationAvailable;
+
+    return true;
+}
+
+VkInstance createInstance(bool *validationEnabled) {
+    VkInstance instance;
+
+    if (!tryCreateInstance(validationEnabled, &instance)) {
+        exit(1);
+    }
+
+    return instance;
+}
+
+void destroyInstance(VkInstance instance) {
+    pthread_mutex_lock(&debugReportMutex);
+
+    for (uint32_t r = 0; r < MAX_DEBUG_REPORT_INSTANCES; r += 1) {
+        if (debugReportRegistrations[r].instance == instance) {
+            loadVkDestroyDebugReportCallbackEXT(instance, debugReportRegistrations[r].callback, hostAllocationCallbacks());
+            debugReportRegistrations[r].instance = VK_NULL_HANDLE;
+        }
+    }
+
+    pthread_mutex_unlock(&debugReportMutex);
+
+    vkDestroyInstance(instance, hostAllocationCallbacks());
+}
+
+bool hasComputeQueueFamily(VkPhysicalDevice physicalDevice) {
+    uint32_t queueFamilyPropertiesCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, NULL);
+
+    VkQueueFamilyProperties *queueFamilyProperties = malloc(sizeof(VkQueueFamilyProperties) * queueFamilyPropertiesCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, queueFamilyProperties);
+
+    bool found = false;
+
+    for (uint32_t i = 0; i < queueFamilyPropertiesCount; i += 1) {
+        found = found || (queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+    }
+
+    free(queueFamilyProperties);
+
+    return found;
+}
+
+uint32_t enumeratePhysicalDevices(VkInstance instance, VkPhysicalDevice **physicalDevices) {
+    uint32_t physicalDeviceCount;
+    BAIL_ON_BAD_RESULT(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, NULL));
+
+    *physicalDevices = (VkPhysicalDevice*) hostAllocate(sizeof(VkPhysicalDevice) * physicalDeviceCount);
+    BAIL_ON_BAD_RESULT(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, *physicalDevices));
+
+    return physicalDeviceCount;
+}
+
+// Fills one feature struct, whose `pNext` must be NULL, through vkGetPhysicalDeviceFeatures2
+static void queryDeviceFeatures(VkPhysicalDevice physicalDevice, void *features) {
+    VkPhysicalDeviceFeatures2 features2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+}
+
+void createComputeDevice(VkPhysicalDevice physicalDevice, ComputeDevice *computeDevice) {
+    computeDevice->physicalDevice = physicalDevice;
+    vkGetPhysicalDeviceProperties(physicalDevice, &computeDevice->properties);
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &computeDevice->memoryProperties);
+
+    computeDevice->subgroupProperties = (VkPhysicalDeviceSubgroupProperties) {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+        .pNext = NULL,
+    };
+
+    // Properties2 and Features2 are core in Vulkan 1.1
+    const bool vulkan11 = computeDevice->properties.apiVersion >= VK_API_VERSION_1_1
+        && chooseInstanceApiVersion() >= VK_API_VERSION_1_1;
+
+    // The external memory capabilities it builds on are core in Vulkan 1.1
+    const bool externalMemoryHostAvailable = vulkan11
+        && isDeviceExtensionAvailable(physicalDevice, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT externalMemoryHostProperties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+        .pNext = NULL,
+        .minImportedHostPointerAlignment = 0,
+    };
+
+    if (vulkan11) {
+        if (externalMemoryHostAvailable) {
+            computeDevice->subgroupProperties.pNext = &externalMemoryHostProperties;
+        }
+
+        VkPhysicalDeviceProperties2 properties2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &computeDevice->subgroupProperties,
+        };
+
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        computeDevice->subgroupProperties.pNext = NULL;
+    }
+
+    uint32_t queueFamilyPropertiesCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, NULL);
+
+    VkQueueFamilyProperties *const queueFamilyProperties =
+        (VkQueueFamilyProperties*) malloc(sizeof(VkQueueFamilyProperties) * queueFamilyPropertiesCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, queueFamilyProperties);
+
+    computeDevice->queueFamilyIndex = chooseQueueFamilyIndex(queueFamilyPropertiesCount, queueFamilyProperties);
+    computeDevice->queueFamilyProperties = queueFamilyProperties[computeDevice->queueFamilyIndex];
+    computeDevice->transferQueueFamilyIndex = chooseTransferQueueFamilyIndex(queueFamilyPropertiesCount,
+            queueFamilyProperties, computeDevice->queueFamilyIndex);
+    computeDevice->dedicatedTransferQueue = computeDevice->transferQueueFamilyIndex != computeDevice->queueFamilyIndex;
+    free(queueFamilyProperties);
+
+    const float queuePriorities[] = { 1.0f };
+    const VkDeviceQueueCreateInfo queueCreateInfos[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .queueFamilyIndex = computeDevice->queueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = queuePriorities,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .queueFamilyIndex = computeDevice->transferQueueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = queuePriorities,
+        },
+    };
+
+    // Optional extensions are enabled when available; their feature structs are chained into `enabledFeatures`
+    const char *enabledExtensionNames[MAX_DEVICE_EXTENSIONS];
+    uint32_t enabledExtensionCount = 0;
+    void *enabledFeatures = NULL;
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+        .pNext = NULL,
+        .timelineSemaphore = VK_FALSE,
+    };
+
+    if (vulkan11 && isDeviceExtensionAvailable(physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+        queryDeviceFeatures(physicalDevice, &timelineSemaphoreFeatures);
+
+        if (timelineSemaphoreFeatures.timelineSemaphore) {
+            enabledExtensionNames[enabledExtensionCount++] = VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME;
+            timelineSemaphoreFeatures.pNext = enabledFeatures;
+            enabledFeatures = &timelineSemaphoreFeatures;
+        }
+    }
+
+    // Narrow element formats; only what storage buffers and the kernels' arithmetic need is enabled
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+    VkPhysicalDeviceFeatures enabledCoreFeatures = {
+        .shaderInt16 = supportedFeatures.shaderInt16,
+    };
+
+    VkPhysicalDevice16BitStorageFeatures storage16BitFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES,
+        .pNext = NULL,
+        .storageBuffer16BitAccess = VK_FALSE,
+    };
+
+    if (vulkan11) {
+        queryDeviceFeatures(physicalDevice, &storage16BitFeatures);
+
+        if (storage16BitFeatures.storageBuffer16BitAccess) {
+            storage16BitFeatures = (VkPhysicalDevice16BitStorageFeatures) {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES,
+                .pNext = enabledFeatures,
+                .storageBuffer16BitAccess = VK_TRUE,
+            };
+            enabledFeatures = &storage16BitFeatures;
+        }
+    }
+
+    VkPhysicalDevice8BitStorageFeatures storage8BitFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_8BIT_STORAGE_FEATURES,
+        .pNext = NULL,
+        .storageBuffer8BitAccess = VK_FALSE,
+    };
+
+    if (vulkan11 && isDeviceExtensionAvailable(physicalDevice, VK_KHR_8BIT_STORAGE_EXTENSION_NAME)) {
+        queryDeviceFeatures(physicalDevice, &storage8BitFeatures);
+
+        if (storage8BitFeatures.storageBuffer8BitAccess) {
+            enabledExtensionNames[enabledExtensionCount++] = VK_KHR_8BIT_STORAGE_EXTENSION_NAME;
+            storage8BitFeatures = (VkPhysicalDevice8BitStorageFeatures) {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_8BIT_STORAGE_FEATURES,
+                .pNext = enabledFeatures,
+                .storageBuffer8BitAccess = VK_TRUE,
+            };
+            enabledFeatures = &storage8BitFeatures;
+        }
+    }
+
+    VkPhysicalDeviceShaderFloat16Int8Features float16Int8Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES,
+        .pNext = NULL,
+        .shaderFloat16 = VK_FALSE,
+        .shaderInt8 = VK_FALSE,
+    };
+
+    if (vulkan11 && isDeviceExtensionAvailable(physicalDevice, VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME)) {
+        queryDeviceFeatures(physicalDevice, &float16Int8Features);
+
+        if (float16Int8Features.shaderFloat16 || float16Int8Features.shaderInt8) {
+            enabledExtensionNames[enabledExtensionCount++] = VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME;
+            float16Int8Features.pNext = enabledFeatures;
+            enabledFeatures = &float16Int8Features;
+        }
+    }
+
+    const bool externalMemoryHost = externalMemoryHostAvailable
+        && externalMemoryHostProperties.minImportedHostPointerAlignment > 0;
+
+    if (externalMemoryHost) {
+        enabledExtensionNames[enabledExtensionCount++] = VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME;
+    }
+
+    // It has no features to enable; it builds on Properties2, hence Vulkan 1.1
+    const bool pushDescriptors = vulkan11 && isDeviceExtensionAvailable(physicalDevice, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
+    if (pushDescriptors) {
+        enabledExtensionNames[enabledExtensionCount++] = VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME;
+    }
+
+    // Queried through MemoryProperties2, hence Vulkan 1.1 too
+    const bool memoryBudget = vulkan11 && isDeviceExtensionAvailable(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    if (memoryBudget) {
+        enabledExtensionNames[enabledExtensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+    }
+
+    const VkDeviceCreateInfo deviceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = enabledFeatures,
+        .flags = 0,
+        .queueCreateInfoCount = computeDevice->dedicatedTransferQueue ? 2 : 1,
+        .pQueueCreateInfos = queueCreateInfos,
+        .enabledLayerCount = 0,
+        .ppEnabledLayerNames = NULL,
+        .enabledExtensionCount = enabledExtensionCount,
+        .ppEnabledExtensionNames = enabledExtensionNames,
+        .pEnabledFeatures = &enabledCoreFeatures,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateDevice(physicalDevice, &deviceCreateInfo, hostAllocationCallbacks(), &computeDevice->device));
+
+    computeDevice->waitSemaphores = timelineSemaphoreFeatures.timelineSemaphore
+        ? (PFN_vkWaitSemaphoresKHR) vkGetDeviceProcAddr(computeDevice->device, "vkWaitSemaphoresKHR")
+        : NULL;
+    computeDevice->timelineSemaphores = computeDevice->waitSemaphores != NULL;
+
+    computeDevice->getMemoryHostPointerProperties = externalMemoryHost
+        ? (PFN_vkGetMemoryHostPointerPropertiesEXT) vkGetDeviceProcAddr(computeDevice->device, "vkGetMemoryHostPointerPropertiesEXT")
+        : NULL;
+    computeDevice->externalMemoryHost = computeDevice->getMemoryHostPointerProperties != NULL;
+    computeDevice->minImportedHostPointerAlignment = computeDevice->externalMemoryHost
+        ? externalMemoryHostProperties.minImportedHostPointerAlignment
+        : 0;
+
+    computeDevice->storageBuffer8BitAccess = storage8BitFeatures.storageBuffer8BitAccess;
+    computeDevice->storageBuffer16BitAccess = storage16BitFeatures.storageBuffer16BitAccess;
+    computeDevice->shaderInt8 = float16Int8Features.shaderInt8;
+    computeDevice->shaderInt16 = enabledCoreFeatures.shaderInt16;
+    computeDevice->shaderFloat16 = float16Int8Features.shaderFloat16;
+
+    computeDevice->descriptorUpdateTemplates = vulkan11;
+    computeDevice->cmdPushDescriptorSetWithTemplate = pushDescriptors
+        ? (PFN_vkCmdPushDescriptorSetWithTemplateKHR) vkGetDeviceProcAddr(computeDevice->device, "vkCmdPushDescriptorSetWithTemplateKHR")
+        : NULL;
+    computeDevice->pushDescriptors = computeDevice->cmdPushDescriptorSetWithTemplate != NULL;
+    computeDevice->memoryBudget = memoryBudget;
+
+    vkGetDeviceQueue(computeDevice->device, computeDevice->queueFamilyIndex, 0, &computeDevice->queue);
+    vkGetDeviceQueue(computeDevice->device, computeDevice->transferQueueFamilyIndex, 0, &computeDevice->transferQueue);
+    initAllocator(&computeDevice->allocator, computeDevice->device, physicalDevice, computeDevice->memoryBudget,
+            &computeDevice->properties, &computeDevice->memoryProperties);
+}
+
+void destroyComputeDevice(ComputeDevice *computeDevice) {
+    destroyAllocator(&computeDevice->allocator);
+    vkDestroyDevice(computeDevice->device, hostAllocationCallbacks());
+}
+
+uint32_t selectPhysicalDevices(const char *selection, uint32_t physicalDeviceCount, uint32_t *indices, uint32_t maxIndexCount) {
+    if (selection == NULL) {
+        selection = getenv(DEVICE_SELECTION_ENVIRONMENT_VARIABLE);
+    }
+
+    if (selection == NULL || *selection == '\0') {
+        selection = "0";
+    }
+
+    if (physicalDeviceCount == 0) {
+        fprintf(stderr, "No physical devices are available.\n");
+        exit(1);
+    }
+
+    uint32_t count = 0;
+
+    if (strcmp(selection, "all") == 0) {
+        for (uint32_t i = 0; i < physicalDeviceCount && count < maxIndexCount; i += 1) {
+            indices[count++] = i;
+        }
+
+        return count;
+    }
+
+    const char *current = selection;
+
+    while (true) {
+        char *end;
+        unsigned long index = strtoul(current, &end, 10);
+
+        if (end == current || (*end != ',' && *end != '\0')) {
+            fprintf(stderr, "Invalid device selection `%s`, expected `all` or indices such as `0,2`.\n", selection);
+            exit(1);
+        }
+
+        if (index >= physicalDeviceCount) {
+            fprintf(stderr, "Device %lu does not exist, %" PRIu32 " devices are available.\n", index, physicalDeviceCount);
+            exit(1);
+        }
+
+        bool duplicate = false;
+
+        for (uint32_t i = 0; i < count; i += 1) {
+            duplicate = duplicate || indices[i] == (uint32_t) index;
+        }
+
+        if (!duplicate) {
+            if (count == maxIndexCount) {
+                fprintf(stderr, "At most %" PRIu32 " devices can be selected.\n", maxIndexCount);
+                exit(1);
+            }
+
+            indices[count++] = (uint32_t) index;
+        }
+
+        if (*end == '\0') {
+            return count;
+        }
+
+        current = end + 1;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+
+#define DEVICE_SELECTION_ENVIRONMENT_VARIABLE "VKCSCRATCH_DEVICE"
+#define MAX_SELECTED_DEVICES 16
+#define MAX_DEVICE_EXTENSIONS 8
+
+// A logical device with the compute queue everything is submitted to, and a transfer queue for
+// copies that may run next to it
+typedef struct {
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    uint32_t queueFamilyIndex;
+    VkQueueFamilyProperties queueFamilyProperties;
+    VkDevice device;
+    VkQueue queue;
+    // On a transfer-only family when the device has one; otherwise the compute queue and family again
+    uint32_t transferQueueFamilyIndex;
+    VkQueue transferQueue;
+    bool dedicatedTransferQueue;
+    // Zeroed when the instance or the device only supports Vulkan 1.0
+    VkPhysicalDeviceSubgroupProperties subgroupProperties;
+    // VK_KHR_timeline_semaphore is enabled, and `vkWaitSemaphoresKHR` loaded
+    bool timelineSemaphores;
+    PFN_vkWaitSemaphoresKHR waitSemaphores;
+    // VK_EXT_external_memory_host is enabled: host allocations aligned to `minImportedHostPointerAlignment`
+    // can be imported as device memory
+    bool externalMemoryHost;
+    VkDeviceSize minImportedHostPointerAlignment;
+    PFN_vkGetMemoryHostPointerPropertiesEXT getMemoryHostPointerProperties;
+    // Narrow element storage and arithmetic, enabled when supported (see format.h). The 16-bit storage
+    // feature is core in Vulkan 1.1; the others come from VK_KHR_8bit_storage and VK_KHR_shader_float16_int8.
+    bool storageBuffer8BitAccess;
+    bool storageBuffer16BitAccess;
+    bool shaderInt8;
+    bool shaderInt16;
+    bool shaderFloat16;
+    // Descriptor update templates are core in Vulkan 1.1
+    bool descriptorUpdateTemplates;
+    // VK_KHR_push_descriptor is enabled, and `vkCmdPushDescriptorSetWithTemplateKHR` loaded
+    bool pushDescriptors;
+    PFN_vkCmdPushDescriptorSetWithTemplateKHR cmdPushDescriptorSetWithTemplate;
+    // VK_EXT_memory_budget is enabled; the allocator checks the heaps' budgets before picking a memory type
+    bool memoryBudget;
+    Allocator allocator;
+} ComputeDevice;
+
+const char* getPhysicalDeviceTypeString(int physicalDeviceType);
+void printPhysicalDeviceProperties(const VkPhysicalDeviceProperties *properties);
+
+uint32_t chooseQueueFamilyIndex(uint32_t queueFamilyPropertiesCount, VkQueueFamilyProperties *const queueFamilyProperties);
+// A family with transfer but neither compute nor graphics capabilities, usually backed by separate
+// DMA engines; `computeQueueFamilyIndex` when there is none
+uint32_t chooseTransferQueueFamilyIndex(uint32_t queueFamilyPropertiesCount, VkQueueFamilyProperties *const queueFamilyProperties,
+        uint32_t computeQueueFamilyIndex);
+
+bool isInstanceLayerAvailable(const char *layerName);
+bool isDeviceExtensionAvailable(VkPhysicalDevice physicalDevice, const char *extensionName);
+
+// Extensions need to be loaded manually
+VkResult loadVkCreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback);
+void loadVkDestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback, const VkAllocationCallbacks* pAllocator);
+
+// Vulkan 1.1 when the loader supports it, for subgroup properties; 1.0 otherwise
+uint32_t chooseInstanceApiVersion(void);
+
+// Enables validation (and reports through the debug callback) when the layers are installed
+VkInstance createInstance(bool *validationEnabled);
+// Same, but returns false instead of exiting when there is no usable Vulkan implementation
+bool tryCreateInstance(bool *validationEnabled, VkInstance *instance);
+// Destroys the debug callback of the instance, if it has one, and then the instance
+void destroyInstance(VkInstance instance);
+
+// Returns the count; the malloc'd array is stored in `physicalDevices`
+// The list is released with `hostFree`
+uint32_t enumeratePhysicalDevices(VkInstance instance, VkPhysicalDevice **physicalDevices);
+
+// Whether any queue family of the device can run compute work
+bool hasComputeQueueFamily(VkPhysicalDevice physicalDevice);
+
+// Enables the optional extensions the device supports, see the flags in ComputeDevice
+void createComputeDevice(VkPhysicalDevice physicalDevice, ComputeDevice *computeDevice);
+void destroyComputeDevice(ComputeDevice *computeDevice);
+
+// `selection` is `all` or comma-separated indices such as `0,2`; when it is NULL the
+// VKCSCRATCH_DEVICE environment variable is used, and device 0 when that is unset too.
+// Exits on invalid selections; returns the number of distinct indices written.
+uint32_t selectPhysicalDevices(const char *selection, uint32_t physicalDeviceCount, uint32_t *indices, uint32_t maxIndexCount);
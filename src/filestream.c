@@ -0,0 +1,202 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "filestream.h"
+
+static int openFile(const char *path, int flags, int standardFd) {
+    int fd = strcmp(path, "-") == 0 ? dup(standardFd) : open(path, flags, 0666);
+
+    if (fd < 0) {
+        fprintf(stderr, "Could not open `%s`: %s.\n", path, strerror(errno));
+        exit(1);
+    }
+
+    return fd;
+}
+
+// Mapping the output needs read access too, but a process holding a pipe open for reading keeps
+// itself from ever seeing the reader go away, so only regular files are opened that way
+static int openOutputFile(const char *path, bool *truncated) {
+    struct stat status;
+    bool regular = stat(path, &status) != 0 || S_ISREG(status.st_mode);
+
+    *truncated = regular && strcmp(path, "-") != 0;
+
+    return openFile(path, *truncated ? O_RDWR | O_CREAT | O_TRUNC : O_WRONLY, STDOUT_FILENO);
+}
+
+static bool isSameFile(int fd, int otherFd) {
+    struct stat status;
+    struct stat otherStatus;
+
+    return fstat(fd, &status) == 0 && fstat(otherFd, &otherStatus) == 0
+        && status.st_dev == otherStatus.st_dev && status.st_ino == otherStatus.st_ino;
+}
+
+void openFileStream(const char *inputPath, const char *outputPath, FileStream *fileStream) {
+    bool outputTruncated;
+    int outputFd = openOutputFile(outputPath, &outputTruncated);
+
+    *fileStream = (FileStream) {
+        .inputFd = openFile(inputPath, O_RDONLY, STDIN_FILENO),
+        .outputFd = outputFd,
+        .inputMapping = NULL,
+        .outputMapping = NULL,
+        .outputTruncated = outputTruncated,
+        .pageSize = (uint64_t) sysconf(_SC_PAGESIZE),
+    };
+
+    if (isSameFile(fileStream->outputFd, STDOUT_FILENO)) {
+        fflush(stdout);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    struct stat inputStatus;
+
+    if (fstat(fileStream->inputFd, &inputStatus) != 0 || !S_ISREG(inputStatus.st_mode) || inputStatus.st_size == 0) {
+        return;
+    }
+
+    void *inputMapping = mmap(NULL, (size_t) inputStatus.st_size, PROT_READ, MAP_PRIVATE, fileStream->inputFd, 0);
+
+    if (inputMapping == MAP_FAILED) {
+        return;
+    }
+
+    madvise(inputMapping, (size_t) inputStatus.st_size, MADV_SEQUENTIAL);
+    fileStream->inputMapping = (const uint8_t*) inputMapping;
+    fileStream->inputSize = (uint64_t) inputStatus.st_size;
+
+    // The output can only be mapped once its final size is known; stdout is written sequentially
+    struct stat outputStatus;
+
+    if (!fileStream->outputTruncated || fstat(fileStream->outputFd, &outputStatus) != 0 || !S_ISREG(outputStatus.st_mode)
+            || ftruncate(fileStream->outputFd, (off_t) fileStream->inputSize) != 0) {
+        return;
+    }
+
+    void *outputMapping = mmap(NULL, (size_t) fileStream->inputSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fileStream->outputFd, 0);
+
+    if (outputMapping != MAP_FAILED) {
+        madvise(outputMapping, (size_t) fileStream->inputSize, MADV_SEQUENTIAL);
+        fileStream->outputMapping = (uint8_t*) outputMapping;
+    }
+}
+
+void closeFileStream(FileStream *fileStream) {
+    if (fileStream->outputMapping != NULL) {
+        munmap(fileStream->outputMapping, (size_t) fileStream->inputSize);
+    }
+
+    if (fileStream->inputMapping != NULL) {
+        munmap((void*) fileStream->inputMapping, (size_t) fileStream->inputSize);
+    }
+
+    close(fileStream->outputFd);
+    close(fileStream->inputFd);
+}
+
+// Drops the whole pages before `end` from the resident set; dirty pages of the shared output
+// mapping stay in the page cache until they are written back
+static void releaseMappedPages(const uint8_t *mapping, uint64_t pageSize, uint64_t *released, uint64_t end) {
+    uint64_t releaseEnd = end / pageSize * pageSize;
+
+    if (releaseEnd > *released) {
+        madvise((void*) (mapping + *released), (size_t) (releaseEnd - *released), MADV_DONTNEED);
+        *released = releaseEnd;
+    }
+}
+
+static VkDeviceSize readFileChunk(void *chunk, uint64_t offset, VkDeviceSize capacity, void *userData) {
+    FileStream *fileStream = (FileStream*) userData;
+    VkDeviceSize size = 0;
+
+    if (fileStream->inputMapping != NULL) {
+        size = fileStream->inputSize - offset < capacity ? fileStream->inputSize - offset : capacity;
+        memcpy(chunk, fileStream->inputMapping + offset, (size_t) size);
+        releaseMappedPages(fileStream->inputMapping, fileStream->pageSize, &fileStream->inputReleased, offset + size);
+    } else {
+        // Pipes return whatever is buffered, so keep reading until the chunk is full or the input ends
+        while (size < capacity) {
+            ssize_t count = read(fileStream->inputFd, (uint8_t*) chunk + size, (size_t) (capacity - size));
+
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (count < 0) {
+                fprintf(stderr, "Could not read the input: %s.\n", strerror(errno));
+                fileStream->inputFailed = true;
+            }
+
+            if (count <= 0) {
+                break;
+            }
+
+            size += (VkDeviceSize) count;
+        }
+    }
+
+    // Chunks hold whole elements, so the padding always fits
+    VkDeviceSize padding = (sizeof(int32_t) - size % sizeof(int32_t)) % sizeof(int32_t);
+    memset((uint8_t*) chunk + size, 0, (size_t) padding);
+
+    return size;
+}
+
+static void writeFileChunk(const void *chunk, uint64_t offset, VkDeviceSize size, void *userData) {
+    FileStream *fileStream = (FileStream*) userData;
+
+    if (fileStream->outputMapping != NULL) {
+        memcpy(fileStream->outputMapping + offset, chunk, (size_t) size);
+        releaseMappedPages(fileStream->outputMapping, fileStream->pageSize, &fileStream->outputReleased, offset + size);
+        return;
+    }
+
+    VkDeviceSize written = 0;
+
+    while (written < size && !fileStream->outputFailed) {
+        ssize_t count = write(fileStream->outputFd, (const uint8_t*) chunk + written, (size_t) (size - written));
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count < 0) {
+            fprintf(stderr, "Could not write the output: %s.\n", strerror(errno));
+            fileStream->outputFailed = true;
+            break;
+        }
+
+        written += (VkDeviceSize) count;
+    }
+}
+
+static bool finishFileStream(FileStream *fileStream) {
+    // Written back here rather than at exit, so that errors are reported
+    if (fileStream->outputMapping != NULL && msync(fileStream->outputMapping, (size_t) fileStream->inputSize, MS_SYNC) != 0) {
+        fprintf(stderr, "Could not write the output: %s.\n", strerror(errno));
+        fileStream->outputFailed = true;
+    }
+
+    return !fileStream->inputFailed && !fileStream->outputFailed;
+}
+
+bool runFileStream(Stream *stream, FileStream *fileStream, StreamStatistics *statistics) {
+    runStreamReader(stream, readFileChunk, writeFileChunk, fileStream, statistics);
+
+    return finishFileStream(fileStream);
+}
+
+bool runCpuFileStream(const CpuEngine *engine, VkDeviceSize chunkSize, FileStream *fileStream, StreamStatistics *statistics) {
+    runCpuStreamReader(engine, chunkSize, readFileChunk, writeFileChunk, fileStream, statistics);
+
+    return finishFileStream(fileStream);
+}
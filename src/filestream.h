@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "stream.h"
+
+// Input and output of the file streaming mode. Regular files are mapped and only the pages of
+// chunks in flight stay resident; anything else, such as a pipe on /dev/stdin or stdout, is read
+// or written sequentially.
+typedef struct {
+    int inputFd;
+    int outputFd;
+    const uint8_t *inputMapping; // NULL when the input is read sequentially
+    uint8_t *outputMapping; // NULL when the output is written sequentially
+    // The output was opened and truncated by us, read-write, so it may be resized and mapped; never
+    // for `-`, whose file (say under `>>`) is not ours to truncate
+    bool outputTruncated;
+    uint64_t inputSize; // of a mapped input
+    uint64_t pageSize;
+    uint64_t inputReleased; // mapped bytes already dropped from the resident set
+    uint64_t outputReleased;
+    bool inputFailed;
+    bool outputFailed;
+} FileStream;
+
+// `-` stands for stdin or stdout. Exits when a file cannot be opened. When the output is stdout,
+// stdout is pointed at stderr afterwards, so that reports do not end up in the data.
+void openFileStream(const char *inputPath, const char *outputPath, FileStream *fileStream);
+void closeFileStream(FileStream *fileStream);
+
+// Pushes the whole input through `stream` into the output; returns false on I/O errors. A trailing
+// partial element reaches the kernel zero-padded.
+bool runFileStream(Stream *stream, FileStream *fileStream, StreamStatistics *statistics);
+// Same, through the CPU engine's copy kernel in chunks of `chunkSize` bytes
+bool runCpuFileStream(const CpuEngine *engine, VkDeviceSize chunkSize, FileStream *fileStream, StreamStatistics *statistics);
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "format.h"
+
+const char *elementFormatString(ElementFormat format) {
+    switch (format) {
+        case ELEMENT_FORMAT_INT32: return "int32";
+        case ELEMENT_FORMAT_INT16: return "int16";
+        case ELEMENT_FORMAT_INT8: return "int8";
+        case ELEMENT_FORMAT_FLOAT16: return "fp16";
+        default: return "undefined";
+    }
+}
+
+bool parseElementFormat(const char *string, ElementFormat *format) {
+    for (ElementFormat candidate = ELEMENT_FORMAT_INT32; candidate < ELEMENT_FORMAT_COUNT; candidate += 1) {
+        if (strcmp(string, elementFormatString(candidate)) == 0) {
+            *format = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t elementFormatSize(ElementFormat format) {
+    switch (format) {
+        case ELEMENT_FORMAT_INT16: return 2;
+        case ELEMENT_FORMAT_INT8: return 1;
+        case ELEMENT_FORMAT_FLOAT16: return 2;
+        default: return 4;
+    }
+}
+
+VkDeviceSize elementFormatBufferSize(ElementFormat format, uint64_t elementCount) {
+    return (elementFormatSize(format) * (VkDeviceSize) elementCount + 3) / 4 * 4;
+}
+
+bool elementFormatNative(const ComputeDevice *computeDevice, ElementFormat format) {
+    switch (format) {
+        case ELEMENT_FORMAT_INT16: return computeDevice->storageBuffer16BitAccess && computeDevice->shaderInt16;
+        case ELEMENT_FORMAT_INT8: return computeDevice->storageBuffer8BitAccess && computeDevice->shaderInt8;
+        case ELEMENT_FORMAT_FLOAT16: return computeDevice->storageBuffer16BitAccess && computeDevice->shaderFloat16;
+        default: return true;
+    }
+}
+
+void chooseFormatKernel(const ComputeDevice *computeDevice, ElementFormat format, FormatKernel *formatKernel) {
+    // Embedded from shader/copy_format.comp, see meson.build
+    static const char *const nativeShaderNames[ELEMENT_FORMAT_COUNT] = { "copy", "copy_int16", "copy_int8", "copy_fp16" };
+    static const char *const packedShaderNames[ELEMENT_FORMAT_COUNT] = {
+        "copy", "copy_int16_packed", "copy_int8_packed", "copy_fp16_packed",
+    };
+
+    formatKernel->format = format;
+    formatKernel->native = elementFormatNative(computeDevice, format);
+    formatKernel->shaderName = formatKernel->native ? nativeShaderNames[format] : packedShaderNames[format];
+}
+
+uint32_t formatKernelInvocationCount(const FormatKernel *formatKernel, uint64_t elementCount) {
+    if (formatKernel->native) {
+        return (uint32_t) elementCount;
+    }
+
+    return (uint32_t) (elementFormatBufferSize(formatKernel->format, elementCount) / sizeof(uint32_t));
+}
+
+static uint32_t nextRandom(uint32_t *state) {
+    // xorshift32
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return *state;
+}
+
+void fillElements(ElementFormat format, void *elements, uint64_t elementCount, uint32_t seed) {
+    uint32_t state = seed != 0 ? seed : 1;
+    uint64_t size = elementFormatSize(format) * elementCount;
+
+    memset((uint8_t*) elements + size, 0, (size_t) (elementFormatBufferSize(format, elementCount) - size));
+
+    for (uint64_t i = 0; i < elementCount; i += 1) {
+        uint32_t random = nextRandom(&state);
+
+        switch (format) {
+            case ELEMENT_FORMAT_INT16:
+                ((uint16_t*) elements)[i] = (uint16_t) random;
+                break;
+            case ELEMENT_FORMAT_INT8:
+                ((uint8_t*) elements)[i] = (uint8_t) random;
+                break;
+            case ELEMENT_FORMAT_FLOAT16:
+                // Sign and mantissa as drawn; the exponent between 1 and 30 excludes zero, denormals,
+                // infinities and NaNs
+                ((uint16_t*) elements)[i] = (uint16_t) ((random & 0x83ffu) | ((1 + (random >> 16) % 30) << 10));
+                break;
+            default:
+                ((uint32_t*) elements)[i] = random;
+                break;
+        }
+    }
+}
+
+void printElementFormats(const ComputeDevice *computeDevice) {
+    printf("formats {");
+
+    for (ElementFormat format = ELEMENT_FORMAT_INT16; format < ELEMENT_FORMAT_COUNT; format += 1) {
+        printf("%s %s: %s", format == ELEMENT_FORMAT_INT16 ? "" : ",", elementFormatString(format),
+                elementFormatNative(computeDevice, format) ? "native" : "packed");
+    }
+
+    printf(" }\n");
+}
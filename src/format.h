@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+
+// Element types of the copy kernel. Narrower elements move fewer bytes for the same element count,
+// which is what bounds the copy.
+typedef enum {
+    ELEMENT_FORMAT_INT32,
+    ELEMENT_FORMAT_INT16,
+    ELEMENT_FORMAT_INT8,
+    ELEMENT_FORMAT_FLOAT16,
+    ELEMENT_FORMAT_COUNT,
+} ElementFormat;
+
+// The copy kernel for one format on one device
+typedef struct {
+    ElementFormat format;
+    // The kernel accesses the elements as their own type; otherwise it works on 32-bit words and
+    // unpacks them in the shader, because the device lacks the narrow storage or arithmetic features
+    bool native;
+    // Of the embedded shader, see `shaderLoadNamed`
+    const char *shaderName;
+} FormatKernel;
+
+const char *elementFormatString(ElementFormat format);
+bool parseElementFormat(const char *string, ElementFormat *format);
+uint32_t elementFormatSize(ElementFormat format);
+
+// Padded to whole 32-bit words, which the packed kernels read and write
+VkDeviceSize elementFormatBufferSize(ElementFormat format, uint64_t elementCount);
+
+// Whether the features enabled on the device let kernels access the format directly
+bool elementFormatNative(const ComputeDevice *computeDevice, ElementFormat format);
+void chooseFormatKernel(const ComputeDevice *computeDevice, ElementFormat format, FormatKernel *formatKernel);
+// The `elementCount` of the kernel parameters: one invocation per element, or per word when packed
+uint32_t formatKernelInvocationCount(const FormatKernel *formatKernel, uint64_t elementCount);
+
+// Pseudo-random elements from `seed`, leaving the padding of the last word zeroed. Half-precision
+// values are finite and normal, so that packed kernels, which unpack them to 32-bit floats, return
+// the same bits on devices that flush denormals.
+void fillElements(ElementFormat format, void *elements, uint64_t elementCount, uint32_t seed);
+
+void printElementFormats(const ComputeDevice *computeDevice);
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "graph.h"
+#include "util.h"
+#include "host_allocator.h"
+
+void createKernelGraph(ComputeDevice *computeDevice, KernelGraph *graph) {
+    VkDevice device = computeDevice->device;
+
+    *graph = (KernelGraph) {
+        .computeDevice = computeDevice,
+        .bufferCount = 0,
+        .stageCount = 0,
+        .recorded = false,
+    };
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = computeDevice->queueFamilyIndex,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, hostAllocationCallbacks(), &graph->commandPool));
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = graph->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &graph->commandBuffer));
+
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateFence(device, &fenceCreateInfo, hostAllocationCallbacks(), &graph->fence));
+}
+
+void destroyKernelGraph(KernelGraph *graph) {
+    VkDevice device = graph->computeDevice->device;
+
+    vkDestroyFence(device, graph->fence, hostAllocationCallbacks());
+    vkDestroyCommandPool(device, graph->commandPool, hostAllocationCallbacks());
+}
+
+uint32_t addGraphBuffer(KernelGraph *graph, const PlacedBuffer *buffer, GraphBufferRole role) {
+    if (graph->bufferCount == GRAPH_MAX_BUFFERS) {
+        fprintf(stderr, "A kernel graph holds at most %u buffers.\n", GRAPH_MAX_BUFFERS);
+        exit(1);
+    }
+
+    graph->buffers[graph->bufferCount] = (GraphBuffer) {
+        .buffer = buffer,
+        .role = role,
+    };
+    graph->recorded = false;
+
+    return graph->bufferCount++;
+}
+
+uint32_t addGraphStage(KernelGraph *graph, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+        VkDescriptorSet descriptorSet, const KernelParameters *parameters, DispatchGrid grid,
+        const uint32_t *buffers, const GraphAccess *accesses, uint32_t bufferCount) {
+    if (graph->stageCount == GRAPH_MAX_STAGES || bufferCount > MAX_STORAGE_BINDINGS) {
+        fprintf(stderr, "A kernel graph holds at most %u stages of %u buffers each.\n", GRAPH_MAX_STAGES, MAX_STORAGE_BINDINGS);
+        exit(1);
+    }
+
+    GraphStage *stage = &graph->stages[graph->stageCount];
+
+    *stage = (GraphStage) {
+        .pipeline = pipeline,
+        .pipelineLayout = pipelineLayout,
+        .descriptorSet = descriptorSet,
+        .parameters = *parameters,
+        .grid = grid,
+        .bufferCount = bufferCount,
+        .level = 0,
+    };
+
+    for (uint32_t i = 0; i < bufferCount; i += 1) {
+        if (buffers[i] >= graph->bufferCount) {
+            fprintf(stderr, "Stage %" PRIu32 " uses unknown graph buffer %" PRIu32 ".\n", graph->stageCount, buffers[i]);
+            exit(1);
+        }
+
+        // The upload barrier only makes the copy visible to reads
+        if ((accesses[i] & GRAPH_ACCESS_WRITE) && graph->buffers[buffers[i]].role == GRAPH_BUFFER_INPUT) {
+            fprintf(stderr, "Stage %" PRIu32 " writes input buffer %" PRIu32 ".\n", graph->stageCount, buffers[i]);
+            exit(1);
+        }
+
+        stage->buffers[i] = buffers[i];
+        stage->accesses[i] = accesses[i];
+    }
+
+    graph->recorded = false;
+
+    return graph->stageCount++;
+}
+
+static uint32_t assignGraphLevels(KernelGraph *graph) {
+    // One past the highest level that wrote or read each buffer so far, 0 when none did
+    uint32_t writtenBefore[GRAPH_MAX_BUFFERS] = { 0 };
+    uint32_t readBefore[GRAPH_MAX_BUFFERS] = { 0 };
+    uint32_t levelCount = 0;
+
+    for (uint32_t s = 0; s < graph->stageCount; s += 1) {
+        GraphStage *stage = &graph->stages[s];
+        uint32_t level = 0;
+
+        for (uint32_t i = 0; i < stage->bufferCount; i += 1) {
+            uint32_t buffer = stage->buffers[i];
+
+            // Reads and writes both come after the last write; writes also after the last read
+            level = writtenBefore[buffer] > level ? writtenBefore[buffer] : level;
+
+            if ((stage->accesses[i] & GRAPH_ACCESS_WRITE) && readBefore[buffer] > level) {
+                level = readBefore[buffer];
+            }
+        }
+
+        for (uint32_t i = 0; i < stage->bufferCount; i += 1) {
+            uint32_t buffer = stage->buffers[i];
+
+            if ((stage->accesses[i] & GRAPH_ACCESS_WRITE) && writtenBefore[buffer] < level + 1) {
+                writtenBefore[buffer] = level + 1;
+            }
+
+            if ((stage->accesses[i] & GRAPH_ACCESS_READ) && readBefore[buffer] < level + 1) {
+                readBefore[buffer] = level + 1;
+            }
+        }
+
+        stage->level = level;
+        levelCount = level + 1 > levelCount ? level + 1 : levelCount;
+    }
+
+    return levelCount;
+}
+
+// Orders level `level` after everything before it, with buffer barriers for the buffers its stages
+// access that were written since their last barrier. Write-after-read hazards only need the
+// execution dependency.
+static void recordLevelBarrier(KernelGraph *graph, uint32_t level, bool *written) {
+    VkBufferMemoryBarrier bufferMemoryBarriers[GRAPH_MAX_BUFFERS];
+    uint32_t bufferMemoryBarrierCount = 0;
+
+    for (uint32_t s = 0; s < graph->stageCount; s += 1) {
+        const GraphStage *stage = &graph->stages[s];
+
+        for (uint32_t i = 0; i < stage->bufferCount && stage->level == level; i += 1) {
+            uint32_t buffer = stage->buffers[i];
+
+            if (!written[buffer]) {
+                continue;
+            }
+
+            bufferMemoryBarriers[bufferMemoryBarrierCount++] = (VkBufferMemoryBarrier) {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .pNext = NULL,
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer = graph->buffers[buffer].buffer->buffer,
+                .offset = 0,
+                .size = VK_WHOLE_SIZE,
+            };
+            written[buffer] = false;
+        }
+    }
+
+    vkCmdPipelineBarrier(graph->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, NULL, bufferMemoryBarrierCount, bufferMemoryBarriers, 0, NULL);
+
+    graph->pipelineBarrierCount += 1;
+    graph->bufferBarrierCount += bufferMemoryBarrierCount;
+}
+
+void recordKernelGraph(KernelGraph *graph) {
+    VkCommandBuffer commandBuffer = graph->commandBuffer;
+    bool written[GRAPH_MAX_BUFFERS] = { false };
+
+    graph->levelCount = assignGraphLevels(graph);
+    graph->pipelineBarrierCount = 0;
+    graph->bufferBarrierCount = 0;
+
+    BAIL_ON_BAD_RESULT(vkResetCommandBuffer(commandBuffer, 0));
+    // Not one-time-submit: every run resubmits the same recording
+    beginCommandBuffer(commandBuffer, 0);
+
+    for (uint32_t b = 0; b < graph->bufferCount; b += 1) {
+        if (graph->buffers[b].role == GRAPH_BUFFER_INPUT) {
+            recordPlacedBufferUpload(commandBuffer, graph->buffers[b].buffer);
+        }
+    }
+
+    for (uint32_t level = 0; level < graph->levelCount; level += 1) {
+        if (level > 0) {
+            recordLevelBarrier(graph, level, written);
+        }
+
+        for (uint32_t s = 0; s < graph->stageCount; s += 1) {
+            GraphStage *stage = &graph->stages[s];
+
+            if (stage->level != level) {
+                continue;
+            }
+
+            recordDispatch(commandBuffer, stage->pipeline, stage->pipelineLayout, &stage->descriptorSet,
+                    &stage->parameters, stage->grid);
+
+            for (uint32_t i = 0; i < stage->bufferCount; i += 1) {
+                written[stage->buffers[i]] = written[stage->buffers[i]] || (stage->accesses[i] & GRAPH_ACCESS_WRITE);
+            }
+        }
+    }
+
+    for (uint32_t b = 0; b < graph->bufferCount; b += 1) {
+        if (graph->buffers[b].role == GRAPH_BUFFER_OUTPUT) {
+            recordPlacedBufferReadback(commandBuffer, graph->buffers[b].buffer);
+        }
+    }
+
+    BAIL_ON_BAD_RESULT(vkEndCommandBuffer(commandBuffer));
+    graph->recorded = true;
+}
+
+void runKernelGraph(KernelGraph *graph) {
+    ComputeDevice *computeDevice = graph->computeDevice;
+
+    if (!graph->recorded) {
+        recordKernelGraph(graph);
+    }
+
+    for (uint32_t b = 0; b < graph->bufferCount; b += 1) {
+        if (graph->buffers[b].role == GRAPH_BUFFER_INPUT) {
+            flushPlacedBuffer(&computeDevice->allocator, graph->buffers[b].buffer, graph->buffers[b].buffer->size);
+        }
+    }
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &graph->commandBuffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL,
+    };
+
+    BAIL_ON_BAD_RESULT(vkQueueSubmit(computeDevice->queue, 1, &submitInfo, graph->fence));
+    BAIL_ON_BAD_RESULT(vkWaitForFences(computeDevice->device, 1, &graph->fence, VK_TRUE, UINT64_MAX));
+    BAIL_ON_BAD_RESULT(vkResetFences(computeDevice->device, 1, &graph->fence));
+
+    for (uint32_t b = 0; b < graph->bufferCount; b += 1) {
+        if (graph->buffers[b].role == GRAPH_BUFFER_OUTPUT) {
+            invalidatePlacedBuffer(&computeDevice->allocator, graph->buffers[b].buffer, graph->buffers[b].buffer->size);
+        }
+    }
+}
+
+void printKernelGraph(const KernelGraph *graph) {
+    printf("graph { stages: %" PRIu32 ", buffers: %" PRIu32 ", levels: %" PRIu32 ", pipelineBarriers: %" PRIu32
+            ", bufferBarriers: %" PRIu32 " }\n", graph->stageCount, graph->bufferCount, graph->levelCount,
+            graph->pipelineBarrierCount, graph->bufferBarrierCount);
+}
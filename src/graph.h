@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "kernel.h"
+#include "memory.h"
+
+#define GRAPH_MAX_BUFFERS 64
+#define GRAPH_MAX_STAGES 64
+
+typedef enum {
+    // Only accessed by the stages
+    GRAPH_BUFFER_INTERNAL,
+    // Written by the host before every run and uploaded at its start; stages may only read it
+    GRAPH_BUFFER_INPUT,
+    // Read back at the end of every run
+    GRAPH_BUFFER_OUTPUT,
+} GraphBufferRole;
+
+typedef enum {
+    GRAPH_ACCESS_READ = 1,
+    GRAPH_ACCESS_WRITE = 2,
+    GRAPH_ACCESS_READ_WRITE = 3,
+} GraphAccess;
+
+typedef struct {
+    const PlacedBuffer *buffer;
+    GraphBufferRole role;
+} GraphBuffer;
+
+// One dispatch and the graph buffers it accesses, in any binding order
+typedef struct {
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSet descriptorSet;
+    KernelParameters parameters;
+    DispatchGrid grid;
+    uint32_t bufferCount;
+    uint32_t buffers[MAX_STORAGE_BINDINGS];
+    GraphAccess accesses[MAX_STORAGE_BINDINGS];
+    // Set when the graph is recorded: every stage runs after all stages of lower levels it depends on
+    uint32_t level;
+} GraphStage;
+
+// A DAG of kernels recorded into one reusable command buffer. Dependencies follow from the order
+// stages are added in and the buffers they read and write (read after write, write after read and
+// write after write). Stages are grouped into levels, each level depending only on earlier ones,
+// so a single pipeline barrier between consecutive levels orders everything; it carries buffer
+// barriers only for buffers written since their last barrier and read or written again. Stages
+// of one level have no barriers between them, so the device may overlap them.
+typedef struct {
+    ComputeDevice *computeDevice;
+    GraphBuffer buffers[GRAPH_MAX_BUFFERS];
+    uint32_t bufferCount;
+    GraphStage stages[GRAPH_MAX_STAGES];
+    uint32_t stageCount;
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    // Adding stages or buffers invalidates the recording
+    bool recorded;
+    uint32_t levelCount;
+    // Between levels, not counting the barriers of the uploads and readbacks
+    uint32_t pipelineBarrierCount;
+    uint32_t bufferBarrierCount;
+} KernelGraph;
+
+void createKernelGraph(ComputeDevice *computeDevice, KernelGraph *graph);
+// The buffers and the objects of the stages stay owned by the caller
+void destroyKernelGraph(KernelGraph *graph);
+
+// Returns the index stages refer to the buffer by
+uint32_t addGraphBuffer(KernelGraph *graph, const PlacedBuffer *buffer, GraphBufferRole role);
+// `buffers` and `accesses` hold `bufferCount` entries; returns the index of the stage. Exits on
+// unknown buffers, writes to input buffers, or when the graph is full.
+uint32_t addGraphStage(KernelGraph *graph, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+        VkDescriptorSet descriptorSet, const KernelParameters *parameters, DispatchGrid grid,
+        const uint32_t *buffers, const GraphAccess *accesses, uint32_t bufferCount);
+
+// Assigns levels and records the command buffer; `runKernelGraph` calls it when needed
+void recordKernelGraph(KernelGraph *graph);
+// Flushes the inputs, submits the recorded command buffer, waits for it and invalidates the
+// outputs. The host may write new inputs between runs.
+void runKernelGraph(KernelGraph *graph);
+
+void printKernelGraph(const KernelGraph *graph);
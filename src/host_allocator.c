@@ -0,0 +1,493 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_allocator.h"
+#include "util.h"
+
+// Every allocation is aligned to at least this, and so are the chunks and the header space
+#define HOST_MIN_ALIGNMENT 16
+#define HOST_POOL_MIN_SIZE 16
+#define HOST_ARENA_MIN_BLOCK_SIZE 64
+// Larger device- and instance-scope allocations go to the heap
+#define HOST_ARENA_MAX_BLOCK_SIZE ((size_t) HOST_ARENA_MIN_BLOCK_SIZE << (HOST_ARENA_SIZE_CLASS_COUNT - 1))
+
+typedef enum {
+    HOST_ORIGIN_HEAP,
+    HOST_ORIGIN_ARENA,
+    HOST_ORIGIN_POOL,
+} HostOrigin;
+
+typedef struct HostChunk {
+    struct HostChunk *next;
+    size_t size;
+} HostChunk;
+
+// Right before the memory handed out
+typedef struct {
+    void *base; // the start of the block, what the heap or the pool gets back
+    size_t blockSize; // arena blocks only
+    size_t size;
+    uint8_t scope;
+    uint8_t origin;
+    uint8_t sizeClass; // pool and arena blocks
+} HostAllocationHeader;
+
+#define HOST_ALIGN_UP(value, alignment) (((value) + (alignment) - 1) / (alignment) * (alignment))
+#define HOST_CHUNK_HEADER_SPACE HOST_ALIGN_UP(sizeof(HostChunk), HOST_MIN_ALIGNMENT)
+#define HOST_HEADER_SPACE HOST_ALIGN_UP(sizeof(HostAllocationHeader), HOST_MIN_ALIGNMENT)
+
+// Free pool and arena blocks keep the link where the header goes
+typedef struct HostFreeBlock {
+    struct HostFreeBlock *next;
+} HostFreeBlock;
+
+typedef struct {
+    const HostAllocator *allocator;
+    uint64_t generation;
+    HostFreeBlock *freeLists[HOST_POOL_SIZE_CLASS_COUNT];
+    char *chunkCursor;
+    size_t chunkRemaining;
+} HostThreadPool;
+
+static _Thread_local HostThreadPool threadPool;
+// Only changed while no other thread creates or destroys Vulkan objects
+static HostAllocator *installedAllocator = NULL;
+static _Atomic uint64_t nextGeneration = 1;
+
+static void raisePeak(_Atomic uint64_t *peak, uint64_t value) {
+    uint64_t current = atomic_load(peak);
+
+    while (value > current && !atomic_compare_exchange_weak(peak, &current, value)) {
+    }
+}
+
+static void addBytes(HostAllocator *allocator, uint8_t scope, uint64_t size) {
+    HostScopeCounters *counters = &allocator->scopes[scope];
+
+    raisePeak(&counters->peakBytesInUse, atomic_fetch_add(&counters->bytesInUse, size) + size);
+    raisePeak(&allocator->peakBytesInUse, atomic_fetch_add(&allocator->bytesInUse, size) + size);
+}
+
+static void subtractBytes(HostAllocator *allocator, uint8_t scope, uint64_t size) {
+    atomic_fetch_sub(&allocator->scopes[scope].bytesInUse, size);
+    atomic_fetch_sub(&allocator->bytesInUse, size);
+}
+
+static uint8_t scopeIndex(VkSystemAllocationScope scope) {
+    return (uint32_t) scope < HOST_SCOPE_COUNT ? (uint8_t) scope : VK_SYSTEM_ALLOCATION_SCOPE_OBJECT;
+}
+
+// Called with the mutex held for arena chunks; pool chunks are only listed for release
+static HostChunk *createChunk(HostChunk **chunks, size_t size, uint64_t *bytesReserved) {
+    HostChunk *chunk = malloc(HOST_CHUNK_HEADER_SPACE + size);
+
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    chunk->next = *chunks;
+    chunk->size = size;
+    *chunks = chunk;
+    *bytesReserved += size;
+
+    return chunk;
+}
+
+static char *chunkData(HostChunk *chunk) {
+    return (char*) chunk + HOST_CHUNK_HEADER_SPACE;
+}
+
+// Places the header and returns the aligned memory after it. `block` must hold
+// `HOST_HEADER_SPACE + size` bytes plus `alignment` when that exceeds the minimum.
+static void *placeAllocation(char *block, size_t blockSize, size_t size, size_t alignment, uint8_t scope,
+        HostOrigin origin, uint8_t sizeClass) {
+    uintptr_t memory = HOST_ALIGN_UP((uintptr_t) block + HOST_HEADER_SPACE, (uintptr_t) alignment);
+    HostAllocationHeader *header = (HostAllocationHeader*) memory - 1;
+
+    *header = (HostAllocationHeader) {
+        .base = block,
+        .blockSize = blockSize,
+        .size = size,
+        .scope = scope,
+        .origin = (uint8_t) origin,
+        .sizeClass = sizeClass,
+    };
+
+    return (void*) memory;
+}
+
+static HostThreadPool *currentThreadPool(const HostAllocator *allocator) {
+    HostThreadPool *pool = &threadPool;
+
+    // The lists of an earlier allocator point into chunks it has released
+    if (pool->allocator != allocator || pool->generation != allocator->generation) {
+        *pool = (HostThreadPool) {
+            .allocator = allocator,
+            .generation = allocator->generation,
+            .chunkCursor = NULL,
+            .chunkRemaining = 0,
+        };
+    }
+
+    return pool;
+}
+
+static void *allocateFromPool(HostAllocator *allocator, size_t size, uint8_t scope) {
+    HostThreadPool *pool = currentThreadPool(allocator);
+    uint8_t sizeClass = 0;
+
+    while ((size_t) HOST_POOL_MIN_SIZE << sizeClass < size) {
+        sizeClass += 1;
+    }
+
+    char *block = (char*) pool->freeLists[sizeClass];
+
+    if (block != NULL) {
+        pool->freeLists[sizeClass] = pool->freeLists[sizeClass]->next;
+    } else {
+        size_t blockSize = HOST_HEADER_SPACE + ((size_t) HOST_POOL_MIN_SIZE << sizeClass);
+
+        if (pool->chunkRemaining < blockSize) {
+            pthread_mutex_lock(&allocator->mutex);
+            HostChunk *chunk = createChunk(&allocator->poolChunks, HOST_POOL_CHUNK_SIZE, &allocator->poolBytesReserved);
+            pthread_mutex_unlock(&allocator->mutex);
+
+            if (chunk == NULL) {
+                return NULL;
+            }
+
+            pool->chunkCursor = chunkData(chunk);
+            pool->chunkRemaining = HOST_POOL_CHUNK_SIZE;
+        }
+
+        block = pool->chunkCursor;
+        pool->chunkCursor += blockSize;
+        pool->chunkRemaining -= blockSize;
+    }
+
+    atomic_fetch_add(&allocator->poolAllocations, 1);
+
+    return placeAllocation(block, 0, size, HOST_MIN_ALIGNMENT, scope, HOST_ORIGIN_POOL, sizeClass);
+}
+
+static void *allocateFromHeap(size_t size, size_t alignment, uint8_t scope) {
+    char *block = malloc(HOST_HEADER_SPACE + size + (alignment > HOST_MIN_ALIGNMENT ? alignment : 0));
+
+    return block != NULL ? placeAllocation(block, 0, size, alignment, scope, HOST_ORIGIN_HEAP, 0) : NULL;
+}
+
+static void *allocateFromArena(HostAllocator *allocator, size_t size, size_t alignment, uint8_t scope) {
+    size_t neededSize = HOST_HEADER_SPACE + size + (alignment > HOST_MIN_ALIGNMENT ? alignment : 0);
+    uint8_t sizeClass = 0;
+
+    if (neededSize > HOST_ARENA_MAX_BLOCK_SIZE) {
+        return allocateFromHeap(size, alignment, scope);
+    }
+
+    while ((size_t) HOST_ARENA_MIN_BLOCK_SIZE << sizeClass < neededSize) {
+        sizeClass += 1;
+    }
+
+    size_t blockSize = (size_t) HOST_ARENA_MIN_BLOCK_SIZE << sizeClass;
+    char *block = NULL;
+
+    pthread_mutex_lock(&allocator->mutex);
+
+    if (allocator->arenaFreeLists[sizeClass] != NULL) {
+        block = (char*) allocator->arenaFreeLists[sizeClass];
+        allocator->arenaFreeLists[sizeClass] = allocator->arenaFreeLists[sizeClass]->next;
+    } else {
+        // The rest of a full chunk is dropped; it is smaller than the block that did not fit
+        if (allocator->arenaRemaining < blockSize) {
+            HostChunk *chunk = createChunk(&allocator->arenaChunks, HOST_ARENA_CHUNK_SIZE, &allocator->arenaBytesReserved);
+
+            if (chunk != NULL) {
+                allocator->arenaCursor = chunkData(chunk);
+                allocator->arenaRemaining = HOST_ARENA_CHUNK_SIZE;
+            }
+        }
+
+        if (allocator->arenaRemaining >= blockSize) {
+            block = allocator->arenaCursor;
+            allocator->arenaCursor += blockSize;
+            allocator->arenaRemaining -= blockSize;
+        }
+    }
+
+    pthread_mutex_unlock(&allocator->mutex);
+
+    return block != NULL ? placeAllocation(block, blockSize, size, alignment, scope, HOST_ORIGIN_ARENA, sizeClass) : NULL;
+}
+
+// Picks where the allocation comes from by its scope; does not count it
+static void *allocateInScope(HostAllocator *allocator, size_t size, size_t alignment, uint8_t scope) {
+    alignment = alignment > HOST_MIN_ALIGNMENT ? alignment : HOST_MIN_ALIGNMENT;
+
+    switch (scope) {
+        case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+            if (alignment == HOST_MIN_ALIGNMENT && size <= (size_t) HOST_POOL_MIN_SIZE << (HOST_POOL_SIZE_CLASS_COUNT - 1)) {
+                return allocateFromPool(allocator, size, scope);
+            }
+
+            return allocateFromHeap(size, alignment, scope);
+        case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+        case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:
+            return allocateFromArena(allocator, size, alignment, scope);
+        default:
+            return allocateFromHeap(size, alignment, scope);
+    }
+}
+
+// Arena and pool blocks go on the free list of their size, so a long-lived device that keeps
+// creating and destroying objects reuses them instead of reserving more
+static void release(HostAllocator *allocator, HostAllocationHeader *header) {
+    switch (header->origin) {
+        case HOST_ORIGIN_HEAP:
+            free(header->base);
+            break;
+        case HOST_ORIGIN_ARENA: {
+            HostFreeBlock *block = header->base;
+
+            pthread_mutex_lock(&allocator->mutex);
+            block->next = allocator->arenaFreeLists[header->sizeClass];
+            allocator->arenaFreeLists[header->sizeClass] = block;
+            pthread_mutex_unlock(&allocator->mutex);
+            break;
+        }
+        case HOST_ORIGIN_POOL: {
+            HostThreadPool *pool = currentThreadPool(allocator);
+            HostFreeBlock *block = header->base;
+
+            block->next = pool->freeLists[header->sizeClass];
+            pool->freeLists[header->sizeClass] = block;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Whether an arena allocation can grow or shrink to `size` within its block
+static bool fitsArenaBlock(const HostAllocationHeader *header, size_t size) {
+    size_t offset = (size_t) ((const char*) (header + 1) - (const char*) header->base);
+
+    return offset + size <= header->blockSize;
+}
+
+static void *VKAPI_CALL allocateHostMemory(void *userData, size_t size, size_t alignment,
+        VkSystemAllocationScope allocationScope) {
+    HostAllocator *allocator = userData;
+    uint8_t scope = scopeIndex(allocationScope);
+    void *memory = allocateInScope(allocator, size, alignment, scope);
+
+    if (memory != NULL) {
+        atomic_fetch_add(&allocator->scopes[scope].allocations, 1);
+        addBytes(allocator, scope, size);
+    }
+
+    return memory;
+}
+
+static void VKAPI_CALL freeHostMemory(void *userData, void *memory) {
+    HostAllocator *allocator = userData;
+
+    if (memory == NULL) {
+        return;
+    }
+
+    HostAllocationHeader *header = (HostAllocationHeader*) memory - 1;
+
+    atomic_fetch_add(&allocator->scopes[header->scope].frees, 1);
+    subtractBytes(allocator, header->scope, header->size);
+    release(allocator, header);
+}
+
+static void *VKAPI_CALL reallocateHostMemory(void *userData, void *original, size_t size, size_t alignment,
+        VkSystemAllocationScope allocationScope) {
+    HostAllocator *allocator = userData;
+
+    if (original == NULL) {
+        return allocateHostMemory(userData, size, alignment, allocationScope);
+    }
+
+    if (size == 0) {
+        freeHostMemory(userData, original);
+        return NULL;
+    }
+
+    // The original stays valid when the new allocation fails
+    HostAllocationHeader *header = (HostAllocationHeader*) original - 1;
+    uint8_t scope = scopeIndex(allocationScope);
+
+    if (header->origin == HOST_ORIGIN_ARENA && header->scope == scope && fitsArenaBlock(header, size)) {
+        atomic_fetch_add(&allocator->scopes[scope].reallocations, 1);
+        addBytes(allocator, scope, size);
+        subtractBytes(allocator, scope, header->size);
+        header->size = size;
+
+        return original;
+    }
+
+    void *memory = allocateInScope(allocator, size, alignment, scope);
+
+    if (memory == NULL) {
+        return NULL;
+    }
+
+    memcpy(memory, original, header->size < size ? header->size : size);
+
+    atomic_fetch_add(&allocator->scopes[scope].reallocations, 1);
+    addBytes(allocator, scope, size);
+    subtractBytes(allocator, header->scope, header->size);
+    release(allocator, header);
+
+    return memory;
+}
+
+static void VKAPI_CALL notifyInternalAllocation(void *userData, size_t size, VkInternalAllocationType allocationType,
+        VkSystemAllocationScope allocationScope) {
+    (void) allocationType;
+    HostAllocator *allocator = userData;
+    HostScopeCounters *counters = &allocator->scopes[scopeIndex(allocationScope)];
+
+    atomic_fetch_add(&counters->internalAllocations, 1);
+    atomic_fetch_add(&counters->internalBytesInUse, size);
+}
+
+static void VKAPI_CALL notifyInternalFree(void *userData, size_t size, VkInternalAllocationType allocationType,
+        VkSystemAllocationScope allocationScope) {
+    (void) allocationType;
+    HostAllocator *allocator = userData;
+
+    atomic_fetch_sub(&allocator->scopes[scopeIndex(allocationScope)].internalBytesInUse, size);
+}
+
+void createHostAllocator(HostAllocator *allocator) {
+    *allocator = (HostAllocator) {
+        .callbacks = {
+            .pUserData = allocator,
+            .pfnAllocation = allocateHostMemory,
+            .pfnReallocation = reallocateHostMemory,
+            .pfnFree = freeHostMemory,
+            .pfnInternalAllocation = notifyInternalAllocation,
+            .pfnInternalFree = notifyInternalFree,
+        },
+        .generation = atomic_fetch_add(&nextGeneration, 1),
+        .createTime = timeNowSeconds(),
+        .arenaChunks = NULL,
+        .arenaCursor = NULL,
+        .arenaRemaining = 0,
+        .poolChunks = NULL,
+        .arenaBytesReserved = 0,
+        .poolBytesReserved = 0,
+    };
+
+    pthread_mutex_init(&allocator->mutex, NULL);
+}
+
+static void releaseChunks(HostChunk *chunk) {
+    while (chunk != NULL) {
+        HostChunk *next = chunk->next;
+
+        free(chunk);
+        chunk = next;
+    }
+}
+
+void destroyHostAllocator(HostAllocator *allocator) {
+    if (installedAllocator == allocator) {
+        installedAllocator = NULL;
+    }
+
+    releaseChunks(allocator->arenaChunks);
+    releaseChunks(allocator->poolChunks);
+    pthread_mutex_destroy(&allocator->mutex);
+}
+
+void installHostAllocator(HostAllocator *allocator) {
+    installedAllocator = allocator;
+}
+
+HostAllocator *installedHostAllocator(void) {
+    return installedAllocator;
+}
+
+const VkAllocationCallbacks *hostAllocationCallbacks(void) {
+    return installedAllocator != NULL ? &installedAllocator->callbacks : NULL;
+}
+
+void *hostAllocate(size_t size) {
+    if (installedAllocator == NULL) {
+        return malloc(size);
+    }
+
+    return allocateHostMemory(installedAllocator, size, HOST_MIN_ALIGNMENT, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+}
+
+void hostFree(void *memory) {
+    if (installedAllocator == NULL) {
+        free(memory);
+    } else {
+        freeHostMemory(installedAllocator, memory);
+    }
+}
+
+void getHostAllocatorStatistics(HostAllocator *allocator, HostAllocatorStatistics *statistics) {
+    uint64_t allocationCount = 0;
+
+    for (uint32_t s = 0; s < HOST_SCOPE_COUNT; s += 1) {
+        const HostScopeCounters *counters = &allocator->scopes[s];
+
+        statistics->scopes[s] = (HostScopeStatistics) {
+            .allocations = atomic_load(&counters->allocations),
+            .reallocations = atomic_load(&counters->reallocations),
+            .frees = atomic_load(&counters->frees),
+            .bytesInUse = atomic_load(&counters->bytesInUse),
+            .peakBytesInUse = atomic_load(&counters->peakBytesInUse),
+            .internalAllocations = atomic_load(&counters->internalAllocations),
+            .internalBytesInUse = atomic_load(&counters->internalBytesInUse),
+        };
+        allocationCount += statistics->scopes[s].allocations + statistics->scopes[s].reallocations;
+    }
+
+    double seconds = timeNowSeconds() - allocator->createTime;
+
+    pthread_mutex_lock(&allocator->mutex);
+    statistics->arenaBytesReserved = allocator->arenaBytesReserved;
+    statistics->poolBytesReserved = allocator->poolBytesReserved;
+    pthread_mutex_unlock(&allocator->mutex);
+
+    statistics->bytesInUse = atomic_load(&allocator->bytesInUse);
+    statistics->peakBytesInUse = atomic_load(&allocator->peakBytesInUse);
+    statistics->poolAllocations = atomic_load(&allocator->poolAllocations);
+    statistics->allocationRate = seconds > 0.0 ? (double) allocationCount / seconds : 0.0;
+}
+
+const char *hostScopeString(uint32_t scope) {
+    switch (scope) {
+        case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "command";
+        case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "object";
+        case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "cache";
+        case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "device";
+        case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+        default: return "undefined";
+    }
+}
+
+void printHostAllocatorStatistics(const HostAllocatorStatistics *statistics) {
+    printf("hostAllocator { inUse: %" PRIu64 " bytes, peak: %" PRIu64 " bytes, arenaReserved: %" PRIu64
+           " bytes, poolReserved: %" PRIu64 " bytes, poolAllocations: %" PRIu64 ", allocationsPerSecond: %.1f }\n",
+            statistics->bytesInUse, statistics->peakBytesInUse, statistics->arenaBytesReserved,
+            statistics->poolBytesReserved, statistics->poolAllocations, statistics->allocationRate);
+
+    for (uint32_t s = 0; s < HOST_SCOPE_COUNT; s += 1) {
+        const HostScopeStatistics *scope = &statistics->scopes[s];
+
+        printf("hostScope { scope: %s, allocations: %" PRIu64 ", reallocations: %" PRIu64 ", frees: %" PRIu64
+               ", inUse: %" PRIu64 " bytes, peak: %" PRIu64 " bytes, internalAllocations: %" PRIu64
+               ", internalInUse: %" PRIu64 " bytes }\n", hostScopeString(s), scope->allocations,
+                scope->reallocations, scope->frees, scope->bytesInUse, scope->peakBytesInUse,
+                scope->internalAllocations, scope->internalBytesInUse);
+    }
+}
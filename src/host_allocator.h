@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <vulkan/vulkan.h>
+
+// One per VkSystemAllocationScope, COMMAND through INSTANCE
+#define HOST_SCOPE_COUNT 5
+// Thread-local pool classes of 16 to 1024 bytes
+#define HOST_POOL_SIZE_CLASS_COUNT 7
+#define HOST_POOL_CHUNK_SIZE (64u << 10)
+#define HOST_ARENA_CHUNK_SIZE (256u << 10)
+// Arena block classes of 64 bytes to a quarter chunk
+#define HOST_ARENA_SIZE_CLASS_COUNT 11
+
+struct HostChunk;
+struct HostFreeBlock;
+
+typedef struct {
+    _Atomic uint64_t allocations;
+    _Atomic uint64_t reallocations;
+    _Atomic uint64_t frees;
+    _Atomic uint64_t bytesInUse;
+    _Atomic uint64_t peakBytesInUse;
+    // Reported by the driver through the internal allocation notifications; not served by us
+    _Atomic uint64_t internalAllocations;
+    _Atomic uint64_t internalBytesInUse;
+} HostScopeCounters;
+
+// Host memory for Vulkan objects, handed to the driver as VkAllocationCallbacks:
+// - device- and instance-scope allocations, which live as long as the device or instance, are
+//   bumped out of an arena in power-of-two blocks; a freed block goes on the free list of its size
+//   and is handed out again from there, and the arena itself is only released as a whole. Larger
+//   allocations go to the C heap;
+// - command-scope allocations, which only last for one call, come from size-class pools local to
+//   the calling thread, so the hot path takes no lock;
+// - everything else goes to the C heap.
+// Every allocation is counted by scope.
+typedef struct {
+    VkAllocationCallbacks callbacks;
+    // Tells the thread-local pools of an earlier allocator at the same address apart
+    uint64_t generation;
+    double createTime;
+    HostScopeCounters scopes[HOST_SCOPE_COUNT];
+    _Atomic uint64_t bytesInUse;
+    _Atomic uint64_t peakBytesInUse;
+    _Atomic uint64_t poolAllocations;
+    // Guards the arena and the chunk lists
+    pthread_mutex_t mutex;
+    struct HostChunk *arenaChunks;
+    // The free rest of the chunk shared allocations are bumped out of
+    char *arenaCursor;
+    size_t arenaRemaining;
+    struct HostFreeBlock *arenaFreeLists[HOST_ARENA_SIZE_CLASS_COUNT];
+    struct HostChunk *poolChunks;
+    uint64_t arenaBytesReserved;
+    uint64_t poolBytesReserved;
+} HostAllocator;
+
+typedef struct {
+    uint64_t allocations;
+    uint64_t reallocations;
+    uint64_t frees;
+    uint64_t bytesInUse;
+    uint64_t peakBytesInUse;
+    uint64_t internalAllocations;
+    uint64_t internalBytesInUse;
+} HostScopeStatistics;
+
+typedef struct {
+    HostScopeStatistics scopes[HOST_SCOPE_COUNT];
+    uint64_t bytesInUse;
+    uint64_t peakBytesInUse;
+    // Allocations served by the thread-local pools
+    uint64_t poolAllocations;
+    uint64_t arenaBytesReserved;
+    uint64_t poolBytesReserved;
+    // Allocations and reallocations per second since the allocator was created
+    double allocationRate;
+} HostAllocatorStatistics;
+
+void createHostAllocator(HostAllocator *allocator);
+// Releases the arena and the pools whether or not their allocations were freed, so every object
+// created with the allocator must have been destroyed
+void destroyHostAllocator(HostAllocator *allocator);
+
+// Makes `allocator` the one every Vulkan object is created with; NULL restores the driver's own.
+// Objects must be destroyed while the allocator they were created with is installed, so install it
+// before creating the instance.
+void installHostAllocator(HostAllocator *allocator);
+// NULL when none is installed
+HostAllocator *installedHostAllocator(void);
+// The `pAllocator` of every create and destroy call
+const VkAllocationCallbacks *hostAllocationCallbacks(void);
+
+// Host memory of the application itself (device lists, shader code), counted in object scope;
+// falls back to malloc and free when no allocator is installed
+void *hostAllocate(size_t size);
+void hostFree(void *memory);
+
+// Names a VkSystemAllocationScope
+const char *hostScopeString(uint32_t scope);
+
+void getHostAllocatorStatistics(HostAllocator *allocator, HostAllocatorStatistics *statistics);
+void printHostAllocatorStatistics(const HostAllocatorStatistics *statistics);
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kernel.h"
+#include "util.h"
+#include "host_allocator.h"
+
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache, VkShaderModule shaderModule, VkPipelineLayout pipelineLayout, uint32_t workgroupSize) {
+    // constant_id = 0 in the shader, see `local_size_x_id`
+    const VkSpecializationMapEntry specializationMapEntries[] = {
+        {
+            .constantID = 0,
+            .offset = 0,
+            .size = sizeof(uint32_t),
+        },
+    };
+    const VkSpecializationInfo specializationInfo = {
+        .mapEntryCount = 1,
+        .pMapEntries = specializationMapEntries,
+        .dataSize = sizeof(uint32_t),
+        .pData = &workgroupSize,
+    };
+    VkComputePipelineCreateInfo computePipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .stage = (VkPipelineShaderStageCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shaderModule,
+            .pName = "main", // entry point name of the shader for this stage
+            .pSpecializationInfo = &specializationInfo,
+        },
+        .layout = pipelineLayout,
+        .basePipelineHandle = NULL,
+        .basePipelineIndex = 0,
+    };
+
+    VkPipeline pipelines[1];
+    VkComputePipelineCreateInfo computePipelineCreateInfos[] = { computePipelineCreateInfo };
+    BAIL_ON_BAD_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, computePipelineCreateInfos, hostAllocationCallbacks(), pipelines));
+
+    return pipelines[0];
+}
+
+uint32_t workgroupCount(uint32_t elementCount, uint32_t workgroupSize) {
+    return (uint32_t) (((uint64_t) elementCount + workgroupSize - 1) / workgroupSize);
+}
+
+void beginCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferUsageFlags usageFlags) {
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = usageFlags,
+        .pInheritanceInfo = NULL,
+    };
+
+    BAIL_ON_BAD_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+}
+
+KernelParameters contiguousKernelParameters(uint32_t elementCount) {
+    return (KernelParameters) {
+        .elementCount = elementCount,
+        .elementOffset = 0,
+        .elementStride = 1,
+    };
+}
+
+DispatchGrid dispatchGrid(const VkPhysicalDeviceLimits *limits, uint32_t elementCount, uint32_t workgroupSize) {
+    uint64_t groupCount = workgroupCount(elementCount, workgroupSize);
+    DispatchGrid grid = { .x = 1, .y = 1, .z = 1 };
+
+    if (groupCount == 0) {
+        return grid;
+    }
+
+    grid.x = groupCount < limits->maxComputeWorkGroupCount[0] ? (uint32_t) groupCount : limits->maxComputeWorkGroupCount[0];
+
+    uint64_t rows = (groupCount + grid.x - 1) / grid.x;
+    grid.y = rows < limits->maxComputeWorkGroupCount[1] ? (uint32_t) rows : limits->maxComputeWorkGroupCount[1];
+
+    uint64_t layers = (rows + grid.y - 1) / grid.y;
+
+    if (layers > limits->maxComputeWorkGroupCount[2]) {
+        fprintf(stderr, "%" PRIu32 " elements need more workgroups than the device can dispatch at once.\n", elementCount);
+        exit(1);
+    }
+
+    grid.z = (uint32_t) layers;
+
+    return grid;
+}
+
+void recordDispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+        VkDescriptorSet *descriptorSets, const KernelParameters *parameters, DispatchGrid grid) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    if (descriptorSets != NULL) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, descriptorSets, 0, NULL);
+    }
+
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(KernelParameters), parameters);
+
+    vkCmdDispatch(commandBuffer, grid.x, grid.y, grid.z);
+}
+
+void recordComputeBarrier(VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+}
+
+void recordIndirectBarrier(VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    // Indirect dispatch arguments are read in the draw-indirect stage, even for compute
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+}
+
+void updateStorageDescriptorSet(VkDevice device, VkDescriptorSet descriptorSet, const VkBuffer *buffers, uint32_t bufferCount) {
+    VkDescriptorBufferInfo descriptorBufferInfos[MAX_STORAGE_BINDINGS];
+    VkWriteDescriptorSet writeDescriptorSets[MAX_STORAGE_BINDINGS];
+
+    for (uint32_t i = 0; i < bufferCount; i += 1) {
+        descriptorBufferInfos[i] = (VkDescriptorBufferInfo) {
+            .buffer = buffers[i],
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+        };
+
+        writeDescriptorSets[i] = (VkWriteDescriptorSet) {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = NULL,
+            .dstSet = descriptorSet,
+            .dstBinding = i,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pImageInfo = NULL,
+            .pBufferInfo = &descriptorBufferInfos[i],
+            .pTexelBufferView = NULL,
+        };
+    }
+
+    vkUpdateDescriptorSets(device, bufferCount, writeDescriptorSets, 0, NULL);
+}
+
+void updateKernelDescriptorSet(VkDevice device, VkDescriptorSet descriptorSet, VkBuffer inputBuffer, VkBuffer outputBuffer) {
+    VkBuffer buffers[] = { inputBuffer, outputBuffer };
+
+    updateStorageDescriptorSet(device, descriptorSet, buffers, 2);
+}
+
+VkShaderModule createKernelShaderModule(VkDevice device, uint32_t shaderSize, uint32_t *shaderData) {
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .codeSize = shaderSize,
+        .pCode = shaderData,
+    };
+
+    VkShaderModule shaderModule;
+    BAIL_ON_BAD_RESULT(vkCreateShaderModule(device, &shaderModuleCreateInfo, hostAllocationCallbacks(), &shaderModule));
+
+    return shaderModule;
+}
+
+VkDescriptorSetLayout createStorageDescriptorSetLayoutWithFlags(VkDevice device, uint32_t bindingCount,
+        VkDescriptorSetLayoutCreateFlags flags) {
+    VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[MAX_STORAGE_BINDINGS];
+
+    for (uint32_t i = 0; i < bindingCount; i += 1) {
+        descriptorSetLayoutBindings[i] = (VkDescriptorSetLayoutBinding) {
+            .binding = i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = NULL,
+        };
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = flags,
+        .bindingCount = bindingCount,
+        .pBindings = descriptorSetLayoutBindings,
+    };
+
+    VkDescriptorSetLayout descriptorSetLayout;
+    BAIL_ON_BAD_RESULT(vkCreateDescriptorSetLayout(
+                device, &descriptorSetLayoutCreateInfo, hostAllocationCallbacks(), &descriptorSetLayout));
+
+    return descriptorSetLayout;
+}
+
+VkDescriptorSetLayout createStorageDescriptorSetLayout(VkDevice device, uint32_t bindingCount) {
+    return createStorageDescriptorSetLayoutWithFlags(device, bindingCount, 0);
+}
+
+VkDescriptorSetLayout createKernelDescriptorSetLayout(VkDevice device) {
+    return createStorageDescriptorSetLayout(device, 2);
+}
+
+VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout descriptorSetLayout, uint32_t pushConstantSize) {
+    VkDescriptorSetLayout descriptorSetLayouts[] = { descriptorSetLayout };
+    VkPushConstantRange pushConstantRanges[] = {
+        {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = pushConstantSize,
+        },
+    };
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .setLayoutCount = 1,
+        .pSetLayouts = descriptorSetLayouts,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = pushConstantRanges,
+    };
+
+    VkPipelineLayout pipelineLayout;
+    BAIL_ON_BAD_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, hostAllocationCallbacks(), &pipelineLayout));
+
+    return pipelineLayout;
+}
+
+VkPipelineLayout createKernelPipelineLayout(VkDevice device, VkDescriptorSetLayout descriptorSetLayout) {
+    return createPipelineLayout(device, descriptorSetLayout, sizeof(KernelParameters));
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+// The minimum `maxPerStageDescriptorStorageBuffers` every device supports
+#define MAX_STORAGE_BINDINGS 4
+
+// Binds the workgroup size to specialization constant 0 (`local_size_x_id = 0`)
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache, VkShaderModule shaderModule, VkPipelineLayout pipelineLayout, uint32_t workgroupSize);
+
+// Push constants of every kernel; element `i < elementCount` lives at `elementOffset + i * elementStride`
+typedef struct {
+    uint32_t elementCount;
+    uint32_t elementOffset;
+    uint32_t elementStride;
+} KernelParameters;
+
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t z;
+} DispatchGrid;
+
+uint32_t workgroupCount(uint32_t elementCount, uint32_t workgroupSize);
+
+// Contiguous elements starting at 0
+KernelParameters contiguousKernelParameters(uint32_t elementCount);
+
+// Enough workgroups for `elementCount` elements, spread over y and z once x reaches its limit
+DispatchGrid dispatchGrid(const VkPhysicalDeviceLimits *limits, uint32_t elementCount, uint32_t workgroupSize);
+
+void beginCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferUsageFlags usageFlags);
+
+// `descriptorSets` may be NULL when the descriptors are bound or pushed already, see descriptor.h
+void recordDispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkPipelineLayout pipelineLayout,
+        VkDescriptorSet *descriptorSets, const KernelParameters *parameters, DispatchGrid grid);
+
+// Makes shader writes of earlier dispatches visible to later ones
+void recordComputeBarrier(VkCommandBuffer commandBuffer);
+// Also makes them visible as the arguments of later `vkCmdDispatchIndirect` calls
+void recordIndirectBarrier(VkCommandBuffer commandBuffer);
+
+// Points binding `i` at the whole of `buffers[i]`
+void updateStorageDescriptorSet(VkDevice device, VkDescriptorSet descriptorSet, const VkBuffer *buffers, uint32_t bufferCount);
+
+// Points bindings 0 (input) and 1 (output) at the whole buffers
+void updateKernelDescriptorSet(VkDevice device, VkDescriptorSet descriptorSet, VkBuffer inputBuffer, VkBuffer outputBuffer);
+
+VkShaderModule createKernelShaderModule(VkDevice device, uint32_t shaderSize, uint32_t *shaderData);
+
+// `bindingCount` storage buffers at bindings 0 and up, at most MAX_STORAGE_BINDINGS
+VkDescriptorSetLayout createStorageDescriptorSetLayout(VkDevice device, uint32_t bindingCount);
+// Same, e.g. with VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR
+VkDescriptorSetLayout createStorageDescriptorSetLayoutWithFlags(VkDevice device, uint32_t bindingCount,
+        VkDescriptorSetLayoutCreateFlags flags);
+
+// Two storage buffers: binding 0 is the input, binding 1 the output
+VkDescriptorSetLayout createKernelDescriptorSetLayout(VkDevice device);
+
+// With a compute-stage push constant range of `pushConstantSize` bytes
+VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout descriptorSetLayout, uint32_t pushConstantSize);
+
+// With a compute-stage push constant range for `KernelParameters`
+VkPipelineLayout createKernelPipelineLayout(VkDevice device, VkDescriptorSetLayout descriptorSetLayout);
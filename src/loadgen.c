@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "util.h"
+#include "vkcsclient.h"
+
+#define LOADGEN_DEFAULT_CLIENTS 4
+#define LOADGEN_DEFAULT_JOBS 1000
+#define LOADGEN_DEFAULT_SIZE (64 << 10)
+#define LOADGEN_DEFAULT_IN_FLIGHT 4
+
+typedef struct {
+    const char *socketPath; // NULL falls back to VKCSCRATCH_SOCKET, then /tmp/vkcscratch.sock
+    uint32_t clientCount;
+    uint32_t jobsPerClient;
+    uint64_t size;
+    // Jobs each client keeps submitted at once, each with its own pair of buffers
+    uint32_t inFlight;
+} LoadgenOptions;
+
+typedef struct {
+    const LoadgenOptions *options;
+    uint32_t clientIndex;
+    // Submit to completion, one per job
+    double *latencies;
+    uint32_t completedJobs;
+    uint32_t failedJobs;
+    uint32_t mismatches;
+    bool connected;
+} LoadgenClient;
+
+void printLoadgenUsage(const char *programName) {
+    printf("Usage: %s [--socket PATH] [--clients N] [--jobs N] [--size SIZE] [--in-flight N]\n"
+           "Every client connects on its own thread and runs N copy jobs of SIZE bytes through the daemon.\n"
+           "SIZE is in bytes and may end with K, M or G.\n",
+           programName);
+}
+
+static uint32_t parsePositive(const char *string, const char *name) {
+    uint32_t value = (uint32_t) strtoul(string, NULL, 10);
+
+    if (value == 0) {
+        fprintf(stderr, "The %s must be positive.\n", name);
+        exit(1);
+    }
+
+    return value;
+}
+
+LoadgenOptions parseLoadgenOptions(int argc, char *argv[]) {
+    LoadgenOptions options = {
+        .socketPath = NULL,
+        .clientCount = LOADGEN_DEFAULT_CLIENTS,
+        .jobsPerClient = LOADGEN_DEFAULT_JOBS,
+        .size = LOADGEN_DEFAULT_SIZE,
+        .inFlight = LOADGEN_DEFAULT_IN_FLIGHT,
+    };
+
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            options.socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            options.clientCount = parsePositive(argv[++i], "client count");
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.jobsPerClient = parsePositive(argv[++i], "job count");
+        } else if (strcmp(argv[i], "--in-flight") == 0 && i + 1 < argc) {
+            options.inFlight = parsePositive(argv[++i], "number of jobs in flight");
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (!parseSize(argv[++i], &options.size)) {
+                fprintf(stderr, "Invalid size.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printLoadgenUsage(argv[0]);
+            exit(0);
+        } else {
+            printLoadgenUsage(argv[0]);
+            exit(1);
+        }
+    }
+
+    options.size = (options.size + sizeof(int32_t) - 1) / sizeof(int32_t) * sizeof(int32_t);
+
+    // Two buffers per job in flight
+    if (options.inFlight > VKCS_CLIENT_MAX_PENDING || options.inFlight * 2 > VKCS_CLIENT_MAX_BUFFERS) {
+        fprintf(stderr, "At most %u jobs per client can be in flight.\n", VKCS_CLIENT_MAX_BUFFERS / 2);
+        exit(1);
+    }
+
+    if (options.size / sizeof(int32_t) > UINT32_MAX) {
+        fprintf(stderr, "The size is too large.\n");
+        exit(1);
+    }
+
+    return options;
+}
+
+static void *runLoadgenClient(void *argument) {
+    LoadgenClient *loadgenClient = argument;
+    const LoadgenOptions *options = loadgenClient->options;
+    uint32_t elementCount = (uint32_t) (options->size / sizeof(int32_t));
+    VkcsClient *client = vkcsConnect(options->socketPath);
+
+    if (client == NULL) {
+        return NULL;
+    }
+
+    loadgenClient->connected = true;
+
+    VkcsClientBuffer *inputs[VKCS_CLIENT_MAX_PENDING];
+    VkcsClientBuffer *outputs[VKCS_CLIENT_MAX_PENDING];
+    uint64_t tickets[VKCS_CLIENT_MAX_PENDING];
+    double submitTimes[VKCS_CLIENT_MAX_PENDING];
+
+    for (uint32_t s = 0; s < options->inFlight; s += 1) {
+        inputs[s] = vkcsClientCreateBuffer(client, options->size);
+        outputs[s] = vkcsClientCreateBuffer(client, options->size);
+
+        if (inputs[s] == NULL || outputs[s] == NULL) {
+            fprintf(stderr, "Client %" PRIu32 " could not create its buffers.\n", loadgenClient->clientIndex);
+            exit(1);
+        }
+
+        int32_t *input = vkcsClientBufferMapping(inputs[s]);
+
+        for (uint32_t i = 0; i < elementCount; i += 1) {
+            input[i] = (int32_t) (loadgenClient->clientIndex * 7919u + s * 104729u + i);
+        }
+    }
+
+    // Keeps `inFlight` jobs submitted; job j uses slot j % inFlight and is waited for before the slot is reused
+    for (uint32_t j = 0; j < options->jobsPerClient + options->inFlight; j += 1) {
+        uint32_t s = j % options->inFlight;
+
+        if (j >= options->inFlight) {
+            bool succeeded = vkcsClientWait(client, tickets[s]);
+
+            loadgenClient->latencies[loadgenClient->completedJobs++] = timeNowSeconds() - submitTimes[s];
+            loadgenClient->failedJobs += succeeded ? 0 : 1;
+
+            if (succeeded && memcmp(vkcsClientBufferMapping(inputs[s]), vkcsClientBufferMapping(outputs[s]),
+                    options->size) != 0) {
+                loadgenClient->mismatches += 1;
+            }
+
+            memset(vkcsClientBufferMapping(outputs[s]), 0, options->size);
+        }
+
+        if (j < options->jobsPerClient) {
+            submitTimes[s] = timeNowSeconds();
+            tickets[s] = vkcsClientSubmit(client, 0, inputs[s], outputs[s], elementCount);
+
+            if (tickets[s] == 0) {
+                fprintf(stderr, "Client %" PRIu32 " lost its connection.\n", loadgenClient->clientIndex);
+                exit(1);
+            }
+        }
+    }
+
+    for (uint32_t s = 0; s < options->inFlight; s += 1) {
+        vkcsClientDestroyBuffer(outputs[s]);
+        vkcsClientDestroyBuffer(inputs[s]);
+    }
+
+    vkcsDisconnect(client);
+
+    return NULL;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double*) a, y = *(const double*) b;
+
+    return (x > y) - (x < y);
+}
+
+// `values` must be sorted
+static double percentile(const double *values, uint32_t count, double fraction) {
+    uint32_t index = (uint32_t) (fraction * (double) (count - 1) + 0.5);
+
+    return count > 0 ? values[index] : 0.0;
+}
+
+int main(int argc, char *argv[]) {
+    LoadgenOptions options = parseLoadgenOptions(argc, argv);
+    LoadgenClient *clients = calloc(options.clientCount, sizeof(LoadgenClient));
+    pthread_t *threads = calloc(options.clientCount, sizeof(pthread_t));
+    double *latencies = malloc((size_t) options.clientCount * options.jobsPerClient * sizeof(double));
+
+    if (clients == NULL || threads == NULL || latencies == NULL) {
+        fprintf(stderr, "Could not allocate memory for the clients.\n");
+        exit(1);
+    }
+
+    // Without a daemon every client would fail the same way
+    VkcsClient *probe = vkcsConnect(options.socketPath);
+    VkcsClientStatistics before, after;
+
+    if (probe == NULL || !vkcsClientStatistics(probe, &before)) {
+        fprintf(stderr, "No daemon answers on the socket.\n");
+        exit(1);
+    }
+
+    double startTime = timeNowSeconds();
+
+    for (uint32_t c = 0; c < options.clientCount; c += 1) {
+        clients[c] = (LoadgenClient) {
+            .options = &options,
+            .clientIndex = c,
+            .latencies = latencies + (size_t) c * options.jobsPerClient,
+        };
+
+        if (pthread_create(&threads[c], NULL, runLoadgenClient, &clients[c]) != 0) {
+            fprintf(stderr, "Could not start client %" PRIu32 ".\n", c);
+            exit(1);
+        }
+    }
+
+    for (uint32_t c = 0; c < options.clientCount; c += 1) {
+        pthread_join(threads[c], NULL);
+    }
+
+    double seconds = timeNowSeconds() - startTime;
+    uint32_t completedJobs = 0, failedJobs = 0, mismatches = 0, disconnectedClients = 0;
+
+    for (uint32_t c = 0; c < options.clientCount; c += 1) {
+        // Gathers the latencies at the front
+        memmove(latencies + completedJobs, clients[c].latencies, clients[c].completedJobs * sizeof(double));
+        completedJobs += clients[c].completedJobs;
+        failedJobs += clients[c].failedJobs;
+        mismatches += clients[c].mismatches;
+        disconnectedClients += clients[c].connected ? 0 : 1;
+    }
+
+    if (!vkcsClientStatistics(probe, &after)) {
+        fprintf(stderr, "Lost the connection to the daemon.\n");
+        exit(1);
+    }
+
+    vkcsDisconnect(probe);
+    qsort(latencies, completedJobs, sizeof(double), compareDoubles);
+
+    uint64_t batchedJobs = after.completedJobs - before.completedJobs;
+    uint64_t queueSubmits = after.queueSubmits - before.queueSubmits;
+
+    printf("loadgen { clients: %" PRIu32 ", jobs: %" PRIu32 ", size: %" PRIu64 ", inFlight: %" PRIu32 " }\n",
+            options.clientCount, completedJobs, options.size, options.inFlight);
+    printf("throughput { jobsPerSecond: %.1f, GBPerSecond: %.3f }\n",
+            seconds > 0.0 ? completedJobs / seconds : 0.0,
+            seconds > 0.0 ? (double) completedJobs * (double) options.size / seconds * 1e-9 : 0.0);
+    printf("latency { p50: %.1fus, p90: %.1fus, p99: %.1fus, max: %.1fus }\n",
+            percentile(latencies, completedJobs, 0.5) * 1e6, percentile(latencies, completedJobs, 0.9) * 1e6,
+            percentile(latencies, completedJobs, 0.99) * 1e6, percentile(latencies, completedJobs, 1.0) * 1e6);
+    // Other clients of the daemon count too while this runs
+    printf("batching { queueSubmits: %" PRIu64 ", averageBatch: %.2f, largestBatch: %" PRIu32 " }\n", queueSubmits,
+            queueSubmits > 0 ? (double) batchedJobs / (double) queueSubmits : 0.0, after.largestBatch);
+
+    free(latencies);
+    free(threads);
+    free(clients);
+
+    if (failedJobs > 0 || mismatches > 0 || disconnectedClients > 0) {
+        fprintf(stderr, "%" PRIu32 " jobs failed, %" PRIu32 " outputs mismatched, %" PRIu32 " clients could not connect.\n",
+                failedJobs, mismatches, disconnectedClients);
+        return 1;
+    }
+
+    return 0;
+}
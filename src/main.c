@@ -1,222 +1,699 @@
-#include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <ctype.h>
 #include <inttypes.h>
+#include <math.h>
+#include <string.h>
 #include <vulkan/vulkan.h>
 
-#include "shader.c"
+#include "util.h"
+#include "autotune.h"
+#include "descriptor.h"
+#include "cpu.h"
+#include "memory.h"
+#include "kernel.h"
+#include "stream.h"
+#include "filestream.h"
+#include "pipeline_cache.h"
+#include "profile.h"
+#include "device.h"
+#include "shader.h"
+#include "multi.h"
+#include "primitives.h"
+#include "graph.h"
+#include "format.h"
+#include "host_allocator.h"
+
+#define DEFAULT_ELEMENT_COUNT 16384
+
+typedef struct {
+    bool autotune;
+    uint32_t workgroupSize; // 0 picks the tuned size, or the default
+    MemoryPlacement memoryPlacement;
+    uint64_t streamSize; // 0 runs the single fixed-size dispatch instead
+    const char *inputPath; // streams this file into `outputPath` instead, when set
+    const char *outputPath;
+    const char *kernelName; // built-in kernel or SPIR-V file the files are streamed through, NULL for `copy`
+    VkDeviceSize chunkSize;
+    uint32_t inFlightCount;
+    bool pipelineCache;
+    bool transferQueue; // stream uploads and readbacks on a dedicated transfer queue when there is one
+    const char *profilePath; // NULL to only print the profile
+    const char *deviceSelection; // NULL falls back to VKCSCRATCH_DEVICE, then device 0
+    uint32_t elementCount; // of the single dispatch
+    ElementFormat format; // of the elements of the single dispatch
+    bool hostMemory; // the single dispatch works on application-owned memory, imported when possible
+    uint32_t primitiveCount; // elements to check the primitive kernels with, 0 to skip them
+    uint32_t graphStageCount; // copy kernels to run as a kernel graph, 0 to skip it
+    bool cpu; // run on the CPU engine even when there is a suitable device
+    CpuIsa cpuIsa; // widest instruction set the CPU engine may use
+    uint32_t cpuThreadCount; // 0 for one per processor
+    bool hostAllocator; // create every Vulkan object with our host allocator and report its counters
+} Options;
+
+void printUsage(const char *programName) {
+    printf("Usage: %s [--autotune] [--workgroup-size N] [--elements N [--host-memory] [--format int32|int16|int8|fp16]] [--memory auto|host-visible|device-local]\n"
+           "       [--stream SIZE [--chunk-size SIZE] [--in-flight N] [--no-transfer-queue]] [--no-pipeline-cache]\n"
+           "       [--profile REPORT.json|REPORT.csv] [--device all|N[,N...]] [--primitives N] [--graph N]\n"
+           "       [--input FILE --output FILE [--kernel NAME|FILE.spv]]\n"
+           "       [--cpu] [--cpu-isa scalar|sse4.1|avx2|avx512] [--cpu-threads N] [--host-allocator]\n"
+           "SIZE is in bytes and may end with K, M or G. The devices may also be given by VKCSCRATCH_DEVICE;\n"
+           "selecting several splits the --stream workload across all of them.\n"
+           "--input and --output stream a file through the kernel in chunks of --chunk-size on the first\n"
+           "selected device; `-` stands for stdin or stdout, and reports then go to stderr.\n"
+           "--cpu runs the copy kernel and the primitives on the CPU engine, which is also used when there is\n"
+           "no Vulkan device with a compute queue, and which verifies device results otherwise.\n"
+           "--format picks the element type of the single dispatch; devices without 8- or 16-bit storage\n"
+           "unpack 32-bit words in the kernel instead.\n"
+           "--graph runs N copy kernels of --elements elements as two independent chains recorded once into\n"
+           "a kernel graph.\n"
+           "--host-allocator passes our own VkAllocationCallbacks to every create call and adds its counters\n"
+           "by allocation scope to the profile.\n", programName);
+}
+
+Options parseOptions(int argc, char *argv[]) {
+    Options options = {
+        .autotune = false,
+        .workgroupSize = 0,
+        .memoryPlacement = MEMORY_PLACEMENT_AUTO,
+        .streamSize = 0,
+        .inputPath = NULL,
+        .outputPath = NULL,
+        .kernelName = NULL,
+        .chunkSize = STREAM_DEFAULT_CHUNK_SIZE,
+        .inFlightCount = STREAM_DEFAULT_IN_FLIGHT_COUNT,
+        .pipelineCache = true,
+        .transferQueue = true,
+        .profilePath = NULL,
+        .deviceSelection = NULL,
+        .elementCount = DEFAULT_ELEMENT_COUNT,
+        .format = ELEMENT_FORMAT_INT32,
+        .hostMemory = false,
+        .primitiveCount = 0,
+        .graphStageCount = 0,
+        .cpu = false,
+        .cpuIsa = CPU_ISA_AVX512,
+        .cpuThreadCount = 0,
+        .hostAllocator = false,
+    };
+
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--autotune") == 0) {
+            options.autotune = true;
+        } else if (strcmp(argv[i], "--no-pipeline-cache") == 0) {
+            options.pipelineCache = false;
+        } else if (strcmp(argv[i], "--host-memory") == 0) {
+            options.hostMemory = true;
+        } else if (strcmp(argv[i], "--no-transfer-queue") == 0) {
+            options.transferQueue = false;
+        } else if (strcmp(argv[i], "--host-allocator") == 0) {
+            options.hostAllocator = true;
+        } else if (strcmp(argv[i], "--cpu") == 0) {
+            options.cpu = true;
+        } else if (strcmp(argv[i], "--cpu-isa") == 0 && i + 1 < argc) {
+            if (!parseCpuIsa(argv[++i], &options.cpuIsa)) {
+                fprintf(stderr, "Invalid instruction set `%s`.\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--cpu-threads") == 0 && i + 1 < argc) {
+            options.cpuThreadCount = (uint32_t) strtoul(argv[++i], NULL, 10);
+
+            if (options.cpuThreadCount == 0) {
+                fprintf(stderr, "Invalid CPU thread count.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+            options.deviceSelection = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            options.profilePath = argv[++i];
+        } else if (strcmp(argv[i], "--workgroup-size") == 0 && i + 1 < argc) {
+            options.workgroupSize = (uint32_t) strtoul(argv[++i], NULL, 10);
+
+            if (options.workgroupSize == 0) {
+                fprintf(stderr, "Invalid workgroup size.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--elements") == 0 && i + 1 < argc) {
+            options.elementCount = (uint32_t) strtoul(argv[++i], NULL, 10);
+
+            if (options.elementCount == 0) {
+                fprintf(stderr, "Invalid element count.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--primitives") == 0 && i + 1 < argc) {
+            options.primitiveCount = (uint32_t) strtoul(argv[++i], NULL, 10);
+
+            if (options.primitiveCount == 0) {
+                fprintf(stderr, "Invalid primitive element count.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            if (!parseElementFormat(argv[++i], &options.format)) {
+                fprintf(stderr, "Unknown element format.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--graph") == 0 && i + 1 < argc) {
+            options.graphStageCount = (uint32_t) strtoul(argv[++i], NULL, 10);
+
+            // Each of the two chains needs one buffer more than it has stages
+            if (options.graphStageCount == 0 || options.graphStageCount + 2 > GRAPH_MAX_BUFFERS) {
+                fprintf(stderr, "The graph needs between 1 and %u stages.\n", GRAPH_MAX_BUFFERS - 2);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+            if (!parseMemoryPlacement(argv[++i], &options.memoryPlacement)) {
+                fprintf(stderr, "Invalid memory placement `%s`.\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            if (!parseSize(argv[++i], &options.streamSize) || options.streamSize % sizeof(int32_t) != 0) {
+                fprintf(stderr, "Stream size must be a positive multiple of 4 (in bytes).\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            options.inputPath = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options.outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            options.kernelName = argv[++i];
+        } else if (strcmp(argv[i], "--chunk-size") == 0 && i + 1 < argc) {
+            if (!parseSize(argv[++i], &options.chunkSize)) {
+                fprintf(stderr, "Invalid chunk size.\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--in-flight") == 0 && i + 1 < argc) {
+            options.inFlightCount = (uint32_t) strtoul(argv[++i], NULL, 10);
 
-#define BAIL_ON_BAD_RESULT(result) \
-if (VK_SUCCESS != (result)) { fprintf(stderr, "Failure at %u %s\n", __LINE__, __FILE__); exit(-1); }
+            if (options.inFlightCount == 0) {
+                fprintf(stderr, "Invalid in-flight chunk count.\n");
+                exit(1);
+            }
+        } else {
+            printUsage(argv[0]);
+            exit(strcmp(argv[i], "--help") == 0 ? 0 : 1);
+        }
+    }
+
+    if ((options.inputPath == NULL) != (options.outputPath == NULL)) {
+        fprintf(stderr, "--input and --output must be given together.\n");
+        exit(1);
+    }
+
+    if (options.kernelName != NULL && options.inputPath == NULL) {
+        fprintf(stderr, "--kernel only applies to --input and --output.\n");
+        exit(1);
+    }
 
-char* getPhysicalDeviceTypeString(int physicalDeviceType) {
-    switch (physicalDeviceType) {
-        case VK_PHYSICAL_DEVICE_TYPE_OTHER: return "Other";
-        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "Integrated GPU";
-        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "Discrete GPU";
-        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "Virtual GPU";
-        case VK_PHYSICAL_DEVICE_TYPE_CPU: return "CPU";
-        default: return "Undefined";
+    if (options.format != ELEMENT_FORMAT_INT32 && (options.streamSize > 0 || options.inputPath != NULL
+                || options.primitiveCount > 0 || options.graphStageCount > 0 || options.cpu)) {
+        fprintf(stderr, "--format only applies to the single dispatch on a device.\n");
+        exit(1);
     }
+
+    return options;
 }
 
-void printPhysicalDeviceProperties(VkPhysicalDeviceProperties *properties) {
-    printf("%s {\n\tapiVersion: %i.%i.%i\n\tdriverVersion: %i\n\tvendorID: %i\n\tdeviceID: %i\n\tdeviceType: %s\n\tdeviceName: %s\n}\n",
-            properties->deviceName,
-            VK_VERSION_MAJOR(properties->apiVersion),
-            VK_VERSION_MINOR(properties->apiVersion),
-            VK_VERSION_PATCH(properties->apiVersion),
-            properties->driverVersion,
-            properties->vendorID,
-            properties->deviceID,
-            getPhysicalDeviceTypeString(properties->deviceType),
-            properties->deviceName
-        );
+static void *allocateHostMemory(VkDeviceSize size, VkDeviceSize alignment) {
+    void *memory = aligned_alloc((size_t) alignment, (size_t) size);
+
+    if (memory == NULL) {
+        fprintf(stderr, "Could not allocate %" PRIu64 " bytes of host memory.\n", (uint64_t) size);
+        exit(1);
+    }
+
+    return memory;
 }
 
-void flushUnreadCharacters(FILE *stream) {
-    int ch;
-    while ((ch = fgetc(stream)) != EOF && ch != '\n') {}
+// Kernels streamed through must have the copy kernel's interface on 32-bit elements, which the
+// primitives and the narrow-format copies do not
+static void loadStreamKernel(const char *name, uint32_t *shaderSize, uint32_t **shaderData) {
+    size_t length = strlen(name);
+
+    if (length > 4 && strcmp(name + length - 4, ".spv") == 0) {
+        shaderLoadFile(shaderSize, shaderData, (char*) name);
+    } else if (strncmp(name, "primitive_", strlen("primitive_")) == 0 || strncmp(name, "copy_", strlen("copy_")) == 0
+            || !shaderLoadNamed(name, shaderSize, shaderData)) {
+        fprintf(stderr, "Unknown kernel `%s`, expected `copy` or a SPIR-V file.\n", name);
+        exit(1);
+    }
 }
 
-uint32_t choosePhysicalDeviceIndex(uint32_t physicalDeviceCount, VkPhysicalDevice *physicalDevices) {
-    uint32_t chosenPhysicalDeviceIndex = 0;
+// Everything the autotuner needs to time a dispatch of the copy kernel
+typedef struct {
+    VkDevice device;
+    VkQueue queue;
+    VkCommandPool commandPool;
+    VkPipelineCache pipelineCache;
+    VkShaderModule shaderModule;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSet *descriptorSets;
+    const VkPhysicalDeviceLimits *limits;
+    uint32_t elementCount;
+} DispatchBenchmark;
 
-    if (physicalDeviceCount <= 1) {
-        printf("Automatically choosing the only available device.\n");
-    } else {
-        do {
-            printf("Chosen physical device index: ");
+double benchmarkDispatch(uint32_t workgroupSize, uint32_t repetitions, void *userData) {
+    DispatchBenchmark *benchmark = (DispatchBenchmark*) userData;
+    VkPipeline pipeline = createComputePipeline(benchmark->device, benchmark->pipelineCache, benchmark->shaderModule,
+            benchmark->pipelineLayout, workgroupSize);
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = benchmark->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
 
-            int result = scanf("%i", &chosenPhysicalDeviceIndex);
-            flushUnreadCharacters(stdin);
+    VkCommandBuffer commandBuffer;
+    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(benchmark->device, &commandBufferAllocateInfo, &commandBuffer));
 
-            if (result != 1) {
-                fprintf(stderr, "Invalid input.\n");
-                continue;
-            }
+    beginCommandBuffer(commandBuffer, 0);
+    KernelParameters parameters = contiguousKernelParameters(benchmark->elementCount);
+    recordDispatch(commandBuffer, pipeline, benchmark->pipelineLayout, benchmark->descriptorSets, &parameters,
+            dispatchGrid(benchmark->limits, benchmark->elementCount, workgroupSize));
+    BAIL_ON_BAD_RESULT(vkEndCommandBuffer(commandBuffer));
 
-            if (chosenPhysicalDeviceIndex < 0
-                    || chosenPhysicalDeviceIndex >= physicalDeviceCount) {
-                fprintf(stderr, "Index out of range.\n");
-                continue;
-            }
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+
+    VkFence fence;
+    BAIL_ON_BAD_RESULT(vkCreateFence(benchmark->device, &fenceCreateInfo, hostAllocationCallbacks(), &fence));
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL,
+    };
+
+    double bestDuration = INFINITY;
+
+    // The first iteration is a warm-up and is not measured
+    for (uint32_t i = 0; i <= repetitions; i += 1) {
+        double start = timeNowSeconds();
+
+        BAIL_ON_BAD_RESULT(vkQueueSubmit(benchmark->queue, 1, &submitInfo, fence));
+        BAIL_ON_BAD_RESULT(vkWaitForFences(benchmark->device, 1, &fence, VK_TRUE, UINT64_MAX));
 
-            break;
-        } while (true);
+        double duration = timeNowSeconds() - start;
+
+        BAIL_ON_BAD_RESULT(vkResetFences(benchmark->device, 1, &fence));
+
+        if (i > 0 && duration < bestDuration) {
+            bestDuration = duration;
+        }
     }
 
-    return chosenPhysicalDeviceIndex;
+    vkDestroyFence(benchmark->device, fence, hostAllocationCallbacks());
+    vkFreeCommandBuffers(benchmark->device, benchmark->commandPool, 1, &commandBuffer);
+    vkDestroyPipeline(benchmark->device, pipeline, hostAllocationCallbacks());
+
+    return bestDuration;
 }
 
-// Prefer devices with VK_QUEUE_COMPUTE_BIT only
-uint32_t chooseQueueFamilyIndex(uint32_t queueFamilyPropertiesCount, VkQueueFamilyProperties *const queueFamilyProperties) {
-    uint32_t index;
-    bool foundIndex = false;
+// Cheap, reproducible stream contents, so that the output can be verified without keeping the input around
+static int32_t streamPatternValue(uint64_t elementIndex) {
+    return (int32_t) (uint32_t) ((elementIndex * 2654435761u) ^ (elementIndex >> 32));
+}
 
-    for (uint32_t i = 0; i < queueFamilyPropertiesCount; i += 1) {
-        VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+void fillStreamPattern(void *chunk, uint64_t offset, VkDeviceSize size, void *userData) {
+    int32_t *elements = (int32_t*) chunk;
+    uint64_t firstElement = offset / sizeof(int32_t);
 
-        if (!(VK_QUEUE_GRAPHICS_BIT & flags) && (VK_QUEUE_COMPUTE_BIT & flags))
-        {
-            return i;
-        }
+    for (uint64_t i = 0, count = size / sizeof(int32_t); i < count; i += 1) {
+        elements[i] = streamPatternValue(firstElement + i);
+    }
+}
+
+void verifyStreamPattern(const void *chunk, uint64_t offset, VkDeviceSize size, void *userData) {
+    const int32_t *elements = (const int32_t*) chunk;
+    uint64_t firstElement = offset / sizeof(int32_t);
+    uint64_t *mismatchCount = (uint64_t*) userData;
 
-        if (!foundIndex && (VK_QUEUE_COMPUTE_BIT & flags)) {
-            index = i;
-            foundIndex = true;
+    for (uint64_t i = 0, count = size / sizeof(int32_t); i < count; i += 1) {
+        if (elements[i] != streamPatternValue(firstElement + i)) {
+            *mismatchCount += 1;
         }
     }
+}
 
-    if (!foundIndex) {
-        fprintf(stderr, "Could not find any queue on this device with compute capabilities.\n");
-        exit(1);
+// Checks the primitive kernels against the CPU engine, then the shared-memory fallbacks too when the
+// subgroup variants were used
+uint32_t checkPrimitiveVariants(ComputeDevice *computeDevice, VkPipelineCache pipelineCache, const CpuEngine *verifier,
+        uint32_t count) {
+    Primitives primitives;
+    createPrimitives(computeDevice, pipelineCache, true, &primitives);
+    uint32_t mismatchCount = checkPrimitives(&primitives, verifier, count);
+    bool subgroups = primitives.subgroups;
+    destroyPrimitives(&primitives);
+
+    if (subgroups) {
+        createPrimitives(computeDevice, pipelineCache, false, &primitives);
+        mismatchCount += checkPrimitives(&primitives, verifier, count);
+        destroyPrimitives(&primitives);
     }
 
-    return index;
+    return mismatchCount;
 }
 
-uint32_t chooseMemoryTypeIndex(VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties, VkDeviceSize memorySize) {
-    for (uint32_t i = 0; i < physicalDeviceMemoryProperties->memoryTypeCount; i += 1) {
-        VkMemoryType *currentMemoryType = &physicalDeviceMemoryProperties->memoryTypes[i];
-        VkMemoryPropertyFlags flags = currentMemoryType->propertyFlags;
-        if ((VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT & flags) &&
-            (VK_MEMORY_PROPERTY_HOST_COHERENT_BIT & flags) &&
-            (memorySize < physicalDeviceMemoryProperties->memoryHeaps[currentMemoryType->heapIndex].size)) {
-            return i;
-        }
+// Compares the output of the copy kernel with its input
+static bool verifyCopy(const CpuEngine *engine, Profile *profile, const int32_t *input, const int32_t *output, uint64_t count) {
+    double startTime = timeNowSeconds();
+    uint64_t mismatchCount = cpuCountMismatches(engine, input, output, count);
+    double seconds = timeNowSeconds() - startTime;
+    profileHost(profile, "verify", seconds);
+
+    printf("verify { elements: %" PRIu64 ", mismatches: %" PRIu64 ", time: %.3f ms }\n", count, mismatchCount, seconds * 1e3);
+
+    if (mismatchCount > 0) {
+        fprintf(stderr, "%" PRIu64 " elements differ from the input.\n", mismatchCount);
+        return false;
     }
 
-    fprintf(stderr, "Could not find a sufficient memory type.\n");
-    exit(1);
+    return true;
 }
 
-static void appendPrefix(size_t *prefixLen, char *prefix, char character) {
-    if (*prefixLen > 0) {
-        prefix[(*prefixLen)++] = '|';
+// Same for elements of any format: whole 32-bit words first, then the bytes of a partial last word,
+// since native kernels leave the padding after the last element untouched
+static bool verifyFormatCopy(const CpuEngine *engine, Profile *profile, ElementFormat format, const void *input,
+        const void *output, uint64_t count) {
+    uint64_t size = elementFormatSize(format) * count;
+    uint64_t wordCount = size / sizeof(int32_t);
+    bool tailMatches = memcmp((const int32_t*) input + wordCount, (const int32_t*) output + wordCount,
+            (size_t) (size % sizeof(int32_t))) == 0;
+
+    if (!tailMatches) {
+        fprintf(stderr, "The last elements differ from the input.\n");
     }
 
-    prefix[(*prefixLen)++] = character;
+    return verifyCopy(engine, profile, input, output, wordCount) && tailMatches;
 }
 
-static void buildPrefix(VkDebugReportFlagsEXT *flags, size_t *prefixLen, char *prefix, VkDebugReportFlagBitsEXT bit, char character) {
-    if ((*flags & bit) == bit) {
-        appendPrefix(prefixLen, prefix, character);
+// Splits the workload across several devices and checks the merged output
+int runMultiDeviceMode(const Options *options, const CpuEngine *cpuEngine, Profile *profile,
+        VkPhysicalDevice *physicalDevices, const uint32_t *physicalDeviceIndices, uint32_t deviceCount) {
+    uint64_t size = options->streamSize > 0 ? options->streamSize : MULTI_DEVICE_DEFAULT_SIZE;
+    int32_t *input = malloc(size);
+    int32_t *output = malloc(size);
 
-        *flags -= bit;
+    if (input == NULL || output == NULL) {
+        fprintf(stderr, "Could not allocate memory for the multi-device workload.\n");
+        return 1;
     }
+
+    fillStreamPattern(input, 0, size, NULL);
+    memset(output, 0, size);
+
+    double deviceStartTime = timeNowSeconds();
+    MultiDevice multiDevice;
+    createMultiDevice(physicalDevices, physicalDeviceIndices, deviceCount, options->memoryPlacement,
+            options->workgroupSize, options->chunkSize, &multiDevice);
+    profileHost(profile, "deviceCreation", timeNowSeconds() - deviceStartTime);
+
+    runMultiDevice(&multiDevice, input, output, size);
+    profileHost(profile, "multiDeviceTotal", multiDevice.totalSeconds);
+    printMultiDeviceStatistics(&multiDevice);
+    destroyMultiDevice(&multiDevice);
+
+    bool matches = verifyCopy(cpuEngine, profile, input, output, size / sizeof(int32_t));
+
+    free(output);
+    free(input);
+
+    return matches ? 0 : 1;
 }
 
-static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
-        VkDebugReportFlagsEXT flags,
-        VkDebugReportObjectTypeEXT objType,
-        uint64_t obj,
-        size_t location,
-        int32_t code,
-        const char *layerPrefix,
-        const char *msg,
-        void *userData) {
-    size_t prefixLen = 0;
-    char prefix[12]; // max 5 items, max 1 unknown item, max 5 separators, zero byte
+// Runs `stageCount` copy kernels as two independent chains in one kernel graph, interleaved so that
+// each level holds a stage of both. The graph is run twice with new inputs to reuse its recording.
+static bool runGraphMode(ComputeDevice *computeDevice, MemoryPlacement memoryPlacement, VkPipeline pipeline,
+        VkPipelineLayout pipelineLayout, VkDescriptorSetLayout descriptorSetLayout, DispatchGrid grid,
+        uint32_t elementCount, uint32_t stageCount, const CpuEngine *verifier, Profile *profile) {
+    VkDevice device = computeDevice->device;
+    VkDeviceSize size = sizeof(int32_t) * (VkDeviceSize) elementCount;
+    uint32_t chainCount = stageCount > 1 ? 2 : 1;
+    // Chain c runs stages c, c + 2, ...: step k copies its buffer k into its buffer k + 1
+    uint32_t bufferCount = stageCount + chainCount;
+
+    PlacedBuffer buffers[GRAPH_MAX_BUFFERS];
+    uint32_t graphBuffers[GRAPH_MAX_BUFFERS];
+    int32_t *inputs[2];
+
+    KernelGraph graph;
+    createKernelGraph(computeDevice, &graph);
+
+    for (uint32_t c = 0, b = 0; c < chainCount; c += 1) {
+        uint32_t stepCount = (stageCount - c + 1) / 2;
+
+        for (uint32_t k = 0; k <= stepCount; k += 1, b += 1) {
+            GraphBufferRole role = k == 0 ? GRAPH_BUFFER_INPUT : k == stepCount ? GRAPH_BUFFER_OUTPUT : GRAPH_BUFFER_INTERNAL;
+            MemoryDirection direction = role == GRAPH_BUFFER_OUTPUT ? MEMORY_DIRECTION_READBACK : MEMORY_DIRECTION_UPLOAD;
+
+            createPlacedBuffer(&computeDevice->allocator, &computeDevice->properties, memoryPlacement, direction, size,
+                    computeDevice->queueFamilyIndex, &buffers[b]);
+            graphBuffers[b] = addGraphBuffer(&graph, &buffers[b], role);
+        }
+
+        inputs[c] = allocateHostMemory(size, sizeof(int32_t));
+    }
+
+    VkDescriptorPoolSize descriptorPoolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 2 * stageCount,
+    };
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = stageCount,
+        .poolSizeCount = 1,
+        .pPoolSizes = &descriptorPoolSize,
+    };
+
+    VkDescriptorPool descriptorPool;
+    BAIL_ON_BAD_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, hostAllocationCallbacks(), &descriptorPool));
+
+    KernelParameters parameters = contiguousKernelParameters(elementCount);
+    GraphAccess accesses[] = { GRAPH_ACCESS_READ, GRAPH_ACCESS_WRITE };
+
+    for (uint32_t s = 0; s < stageCount; s += 1) {
+        uint32_t chain = s % 2;
+        uint32_t source = (chain == 0 ? 0 : (stageCount + 1) / 2 + 1) + s / 2;
+
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .pNext = NULL,
+            .descriptorPool = descriptorPool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &descriptorSetLayout,
+        };
+
+        VkDescriptorSet descriptorSet;
+        BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &descriptorSet));
+        updateKernelDescriptorSet(device, descriptorSet, buffers[source].buffer, buffers[source + 1].buffer);
+
+        uint32_t stageBuffers[] = { graphBuffers[source], graphBuffers[source + 1] };
+        addGraphStage(&graph, pipeline, pipelineLayout, descriptorSet, &parameters, grid, stageBuffers, accesses, 2);
+    }
+
+    bool matches = true;
 
-    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_INFORMATION_BIT_EXT, 'I');
-    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_WARNING_BIT_EXT, 'W');
-    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT, 'P');
-    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_ERROR_BIT_EXT, 'E');
-    buildPrefix(&flags, &prefixLen, prefix, VK_DEBUG_REPORT_DEBUG_BIT_EXT, 'D');
+    for (uint32_t run = 0; run < 2; run += 1) {
+        for (uint32_t c = 0; c < chainCount; c += 1) {
+            PlacedBuffer *input = &buffers[c == 0 ? 0 : (stageCount + 1) / 2 + 1];
 
-    if (flags != 0) {
-        appendPrefix(&prefixLen, prefix, '?');
+            for (uint32_t i = 0; i < elementCount; i += 1) {
+                inputs[c][i] = rand();
+            }
+
+            memcpy(input->mapped, inputs[c], (size_t) size);
+        }
+
+        double runStartTime = timeNowSeconds();
+        runKernelGraph(&graph);
+        double seconds = timeNowSeconds() - runStartTime;
+        profileHost(profile, run == 0 ? "graphFirstRun" : "graphRun", seconds);
+
+        printf("graphRun { run: %" PRIu32 ", time: %.3f ms }\n", run, seconds * 1e3);
+
+        for (uint32_t c = 0; c < chainCount; c += 1) {
+            const PlacedBuffer *output = &buffers[c == 0 ? (stageCount + 1) / 2 : bufferCount - 1];
+            matches = verifyCopy(verifier, profile, inputs[c], output->mapped, elementCount) && matches;
+        }
     }
 
-    prefix[prefixLen] = '\0';
+    printKernelGraph(&graph);
 
-    printf("[%s] %s\n", prefix, msg);
+    vkDestroyDescriptorPool(device, descriptorPool, hostAllocationCallbacks());
+    destroyKernelGraph(&graph);
+
+    for (uint32_t b = 0; b < bufferCount; b += 1) {
+        destroyPlacedBuffer(&computeDevice->allocator, &buffers[b]);
+    }
 
-    return VK_FALSE;
+    for (uint32_t c = 0; c < chainCount; c += 1) {
+        free(inputs[c]);
+    }
+
+    return matches;
 }
 
-// Extensions need to be loaded manually
-VkResult loadVkCreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
-    PFN_vkCreateDebugReportCallbackEXT func = (PFN_vkCreateDebugReportCallbackEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
+// Runs the workload on the CPU engine: when --cpu is given, or when there is no suitable device.
+// Only the built-in copy kernel is available, since the engine cannot run SPIR-V.
+int runCpuMode(const Options *options, const CpuEngine *engine, Profile *profile, FileStream *fileStream) {
+    printCpuEngine(engine);
+
+    if (options->kernelName != NULL && strcmp(options->kernelName, "copy") != 0) {
+        fprintf(stderr, "The CPU engine only runs the `copy` kernel.\n");
+        return 1;
+    }
+
+    int exitCode = 0;
+
+    if (options->streamSize > 0 || options->inputPath != NULL) {
+        // Whole elements, like the device chunks
+        VkDeviceSize chunkSize = options->chunkSize / sizeof(int32_t) * sizeof(int32_t);
+        chunkSize = chunkSize > 0 ? chunkSize : sizeof(int32_t);
+        printf("stream { chunkSize: %" PRIu64 ", inFlight: 1 }\n", (uint64_t) chunkSize);
+
+        uint64_t mismatchCount = 0;
+        StreamStatistics statistics;
+
+        if (options->inputPath != NULL) {
+            if (!runCpuFileStream(engine, chunkSize, fileStream, &statistics)) {
+                exitCode = 1;
+            }
 
-    if (func != NULL) {
-        return func(instance, pCreateInfo, pAllocator, pCallback);
+            closeFileStream(fileStream);
+        } else {
+            runCpuStream(engine, chunkSize, options->streamSize, fillStreamPattern, verifyStreamPattern, &mismatchCount,
+                    &statistics);
+        }
+
+        printStreamStatistics(&statistics);
+
+        profileHost(profile, "streamFill", statistics.fillSeconds);
+        profileHost(profile, "streamDevice", statistics.deviceSeconds);
+        profileHost(profile, "streamDrain", statistics.drainSeconds);
+        profileHost(profile, "streamTotal", statistics.totalSeconds);
+
+        if (mismatchCount > 0) {
+            fprintf(stderr, "%" PRIu64 " streamed elements differ from the input.\n", mismatchCount);
+            exitCode = 1;
+        }
+    } else if (options->primitiveCount > 0) {
+        double primitivesStartTime = timeNowSeconds();
+        uint32_t mismatchCount = checkCpuPrimitives(engine, options->primitiveCount);
+        profileHost(profile, "primitives", timeNowSeconds() - primitivesStartTime);
+
+        if (mismatchCount > 0) {
+            fprintf(stderr, "%" PRIu32 " primitives differ from the scalar reference.\n", mismatchCount);
+            exitCode = 1;
+        }
     } else {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
+        int32_t *input = malloc(sizeof(int32_t) * (size_t) options->elementCount);
+        int32_t *output = malloc(sizeof(int32_t) * (size_t) options->elementCount);
+
+        if (input == NULL || output == NULL) {
+            fprintf(stderr, "Could not allocate memory for the CPU workload.\n");
+            exit(1);
+        }
+
+        for (uint32_t i = 0; i < options->elementCount; i += 1) {
+            input[i] = rand();
+        }
+
+        double dispatchStartTime = timeNowSeconds();
+        cpuCopy(engine, input, output, options->elementCount);
+        profileHost(profile, "dispatch", timeNowSeconds() - dispatchStartTime);
+
+        if (!verifyCopy(engine, profile, input, output, options->elementCount)) {
+            exitCode = 1;
+        }
+
+        free(output);
+        free(input);
+    }
+
+    profileHostAllocations(profile);
+    printProfile(profile);
+
+    // Stands in for the device in the report header
+    VkPhysicalDeviceProperties properties = {
+        .apiVersion = 0,
+        .driverVersion = 0,
+        .vendorID = 0,
+        .deviceID = 0,
+        .deviceType = VK_PHYSICAL_DEVICE_TYPE_CPU,
+    };
+    snprintf(properties.deviceName, sizeof(properties.deviceName), "vkcscratch cpu engine (%s)", cpuIsaString(engine->isa));
+
+    if (options->profilePath != NULL && !writeProfileReport(profile, &properties, options->profilePath)) {
+        exitCode = 1;
     }
+
+    return exitCode;
 }
 
 int main(int argc, char *argv[]) {
+    const double startTime = timeNowSeconds();
+    Options options = parseOptions(argc, argv);
+
+    // Opened first, since writing the data to stdout moves every report to stderr
+    FileStream fileStream;
+
+    if (options.inputPath != NULL) {
+        openFileStream(options.inputPath, options.outputPath, &fileStream);
+    }
+
     printf("Hello, world.\n");
 
-    const VkApplicationInfo applicationInfo = {
-        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-        .pNext = NULL,
-        .pApplicationName = "vkcscratch",
-        .applicationVersion = 0,
-        .pEngineName = NULL,
-        .engineVersion = 0,
-        .apiVersion = VK_MAKE_VERSION(1, 0, 65),
-    };
-    const char *enabledLayerNames[] = { "VK_LAYER_LUNARG_standard_validation" };
-    const char *enabledExtensionNames[] = { VK_EXT_DEBUG_REPORT_EXTENSION_NAME };
-    const VkDebugReportCallbackCreateInfoEXT debugReportCallbackCreateInfoEXT = {
-        .sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT,
-        .pNext = NULL,
-        .flags = VK_DEBUG_REPORT_INFORMATION_BIT_EXT
-            | VK_DEBUG_REPORT_WARNING_BIT_EXT
-            | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT
-            | VK_DEBUG_REPORT_ERROR_BIT_EXT
-            | VK_DEBUG_REPORT_DEBUG_BIT_EXT,
-        .pfnCallback = debugCallback,
-        .pUserData = NULL,
+    // Static and never destroyed: it has to outlive every Vulkan object, and not all are destroyed
+    static HostAllocator hostAllocator;
 
-    };
-    const VkInstanceCreateInfo instanceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .pApplicationInfo = &applicationInfo,
-        .enabledLayerCount = 1,
-        .ppEnabledLayerNames = enabledLayerNames,
-        .enabledExtensionCount = 1,
-        .ppEnabledExtensionNames = enabledExtensionNames,
-    };
+    if (options.hostAllocator) {
+        createHostAllocator(&hostAllocator);
+        installHostAllocator(&hostAllocator);
+    }
+
+    Profile profile;
+    initProfile(&profile);
+
+    // Also verifies the device results
+    CpuEngine cpuEngine;
+    createCpuEngine(options.cpuIsa, options.cpuThreadCount, &cpuEngine);
+
+    if (options.cpu) {
+        return runCpuMode(&options, &cpuEngine, &profile, &fileStream);
+    }
 
+    double instanceStartTime = timeNowSeconds();
+    bool validationEnabled;
     VkInstance instance;
-    BAIL_ON_BAD_RESULT(vkCreateInstance(&instanceCreateInfo, 0, &instance));
 
-    VkDebugReportCallbackEXT debugReportCallbackEXT;
-    BAIL_ON_BAD_RESULT(loadVkCreateDebugReportCallbackEXT(instance, &debugReportCallbackCreateInfoEXT, NULL, &debugReportCallbackEXT));
+    if (!tryCreateInstance(&validationEnabled, &instance)) {
+        fprintf(stderr, "Falling back to the CPU engine.\n");
+        return runCpuMode(&options, &cpuEngine, &profile, &fileStream);
+    }
 
-    uint32_t physicalDeviceCount;
-    BAIL_ON_BAD_RESULT(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, NULL));
+    profileHost(&profile, "instanceCreation", timeNowSeconds() - instanceStartTime);
 
-    VkPhysicalDevice *const physicalDevices = (VkPhysicalDevice*) malloc(sizeof(VkPhysicalDevice) * physicalDeviceCount);
-    BAIL_ON_BAD_RESULT(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices));
+    VkPhysicalDevice *physicalDevices;
+    uint32_t physicalDeviceCount = enumeratePhysicalDevices(instance, &physicalDevices);
+
+    if (physicalDeviceCount == 0) {
+        fprintf(stderr, "There are no Vulkan devices, falling back to the CPU engine.\n");
+        return runCpuMode(&options, &cpuEngine, &profile, &fileStream);
+    }
 
     for (uint32_t physicalDeviceIndex = 0; physicalDeviceIndex < physicalDeviceCount; physicalDeviceIndex += 1) {
         VkPhysicalDeviceProperties properties;
@@ -225,320 +702,345 @@ int main(int argc, char *argv[]) {
         printPhysicalDeviceProperties(&properties);
     }
 
-    uint32_t chosenPhysicalDeviceIndex = choosePhysicalDeviceIndex(
-            physicalDeviceCount, physicalDevices);
-    VkPhysicalDevice physicalDevice = physicalDevices[chosenPhysicalDeviceIndex];
+    uint32_t selectedDeviceIndices[MAX_SELECTED_DEVICES];
+    uint32_t selectedDeviceCount = selectPhysicalDevices(options.deviceSelection, physicalDeviceCount,
+            selectedDeviceIndices, MAX_SELECTED_DEVICES);
 
-    uint32_t queueFamilyPropertiesCount;
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, NULL);
+    for (uint32_t i = 0; i < selectedDeviceCount; i += 1) {
+        if (!hasComputeQueueFamily(physicalDevices[selectedDeviceIndices[i]])) {
+            fprintf(stderr, "Device %" PRIu32 " has no compute queue, falling back to the CPU engine.\n",
+                    selectedDeviceIndices[i]);
+            return runCpuMode(&options, &cpuEngine, &profile, &fileStream);
+        }
+    }
 
-    VkQueueFamilyProperties *const queueFamilyProperties =
-        (VkQueueFamilyProperties*) malloc(sizeof(VkQueueFamilyProperties) * queueFamilyPropertiesCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, queueFamilyProperties);
+    if (selectedDeviceCount > 1 && options.inputPath == NULL) {
+        int exitCode = runMultiDeviceMode(&options, &cpuEngine, &profile, physicalDevices, selectedDeviceIndices, selectedDeviceCount);
 
-    uint32_t queueFamilyPropertiesIndex = chooseQueueFamilyIndex(queueFamilyPropertiesCount, queueFamilyProperties);
+        profileHostAllocations(&profile);
+        printProfile(&profile);
 
-    const float queuePriorities[] = { 1.0f };
-    const VkDeviceQueueCreateInfo deviceQueueCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .queueFamilyIndex = queueFamilyPropertiesIndex,
-        .queueCount = 1,
-        .pQueuePriorities = queuePriorities,
-    };
-
-    const VkDeviceQueueCreateInfo queueCreateInfos[] = { deviceQueueCreateInfo };
-    const VkDeviceCreateInfo deviceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = queueCreateInfos, 
-        .enabledLayerCount = 0,
-        .ppEnabledLayerNames = NULL,
-        .enabledExtensionCount = 0,
-        .ppEnabledExtensionNames = NULL,
-        .pEnabledFeatures = NULL,
-    };
-
-    VkDevice device;
-    BAIL_ON_BAD_RESULT(vkCreateDevice(physicalDevice, &deviceCreateInfo, NULL, &device));
+        // The report header describes the first of the selected devices
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevices[selectedDeviceIndices[0]], &properties);
 
-    VkQueue queue;
-    vkGetDeviceQueue(device, queueFamilyPropertiesIndex, NULL, &queue);
+        if (options.profilePath != NULL && !writeProfileReport(&profile, &properties, options.profilePath)) {
+            exitCode = 1;
+        }
 
-    VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &physicalDeviceMemoryProperties);
+        return exitCode;
+    }
 
-    const uint32_t bufferLength = 16384;
-    const uint32_t bufferSize = sizeof(int32_t) * bufferLength;
-    const VkDeviceSize memorySize = bufferSize * 2; // input + output buffer in a single memory
-    uint32_t memoryTypeIndex = chooseMemoryTypeIndex(&physicalDeviceMemoryProperties, memorySize);
+    printf("Using device %" PRIu32 ".\n", selectedDeviceIndices[0]);
+    VkPhysicalDevice physicalDevice = physicalDevices[selectedDeviceIndices[0]];
 
-    const VkMemoryAllocateInfo memoryAllocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .pNext = NULL,
-        .allocationSize = memorySize,
-        .memoryTypeIndex = memoryTypeIndex,
-    };
+    double deviceStartTime = timeNowSeconds();
+    ComputeDevice computeDevice;
+    createComputeDevice(physicalDevice, &computeDevice);
+    profileHost(&profile, "deviceCreation", timeNowSeconds() - deviceStartTime);
 
-    VkDeviceMemory memory;
-    BAIL_ON_BAD_RESULT(vkAllocateMemory(device, &memoryAllocateInfo, NULL, &memory));
+    VkDevice device = computeDevice.device;
+    VkQueue queue = computeDevice.queue;
+    uint32_t queueFamilyPropertiesIndex = computeDevice.queueFamilyIndex;
+    VkPhysicalDeviceProperties physicalDeviceProperties = computeDevice.properties;
+    VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties = computeDevice.memoryProperties;
 
-    uint32_t *payload;
-    BAIL_ON_BAD_RESULT(vkMapMemory(device, memory, 0, memorySize, 0, (void**) &payload));
+    createProfileQueryPool(&profile, device, &physicalDeviceProperties, computeDevice.queueFamilyProperties.timestampValidBits);
 
-    for (uint32_t i = 0; i < memorySize / sizeof(uint32_t); i += 1) {
-        payload[i] = rand();
-    }
+    const uint32_t bufferLength = options.elementCount;
+    const VkDeviceSize bufferSize = elementFormatBufferSize(options.format, bufferLength);
 
-    vkUnmapMemory(device, memory);
+    FormatKernel formatKernel;
+    chooseFormatKernel(&computeDevice, options.format, &formatKernel);
+    printElementFormats(&computeDevice);
+    // The dispatch runs one invocation per element, or per 32-bit word for packed formats
+    const uint32_t invocationCount = formatKernelInvocationCount(&formatKernel, bufferLength);
 
-    const uint32_t queueFamilyIndices[] = { queueFamilyPropertiesIndex };
-    const VkBufferCreateInfo bufferCreateInfo = (VkBufferCreateInfo) {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .size = bufferSize,
-        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 1,
-        .pQueueFamilyIndices = queueFamilyIndices,
-    };
+    PlacedBuffer inputBuffer;
+    PlacedBuffer outputBuffer;
 
-    VkBuffer inputBuffer;
-    BAIL_ON_BAD_RESULT(vkCreateBuffer(device, &bufferCreateInfo, NULL, &inputBuffer));
+    if (options.hostMemory) {
+        // Page-aligned and padded, so that the device can import the arrays
+        VkDeviceSize alignment = hostImportAlignment(&computeDevice);
+        alignment = alignment > 0 ? alignment : sizeof(int32_t);
+        VkDeviceSize hostSize = (bufferSize + alignment - 1) / alignment * alignment;
 
-    // TODO ensure alignment
-    VkMemoryRequirements inputBufferMemoryRequirements;
-    vkGetBufferMemoryRequirements(device, inputBuffer, &inputBufferMemoryRequirements);
-    printf("input { size: %lu, alignment: %lu }\n", inputBufferMemoryRequirements.size, inputBufferMemoryRequirements.alignment);
+        createHostBuffer(&computeDevice, options.memoryPlacement, MEMORY_DIRECTION_UPLOAD,
+                allocateHostMemory(hostSize, alignment), hostSize, &inputBuffer);
+        createHostBuffer(&computeDevice, options.memoryPlacement, MEMORY_DIRECTION_READBACK,
+                allocateHostMemory(hostSize, alignment), hostSize, &outputBuffer);
+    } else {
+        createPlacedBuffer(&computeDevice.allocator, &physicalDeviceProperties, options.memoryPlacement,
+                MEMORY_DIRECTION_UPLOAD, bufferSize, queueFamilyPropertiesIndex, &inputBuffer);
+        createPlacedBuffer(&computeDevice.allocator, &physicalDeviceProperties, options.memoryPlacement,
+                MEMORY_DIRECTION_READBACK, bufferSize, queueFamilyPropertiesIndex, &outputBuffer);
+    }
 
-    BAIL_ON_BAD_RESULT(vkBindBufferMemory(device, inputBuffer, memory, 0));
+    printPlacedBuffer("input", &inputBuffer, &physicalDeviceMemoryProperties);
+    printPlacedBuffer("output", &outputBuffer, &physicalDeviceMemoryProperties);
 
-    VkBuffer outputBuffer;
-    BAIL_ON_BAD_RESULT(vkCreateBuffer(device, &bufferCreateInfo, NULL, &outputBuffer));
+    // The input is generated in ordinary memory, since reading back write-combined upload memory for
+    // the verification would be very slow; it is written to the mapping in one sequential pass
+    int32_t *input = (int32_t*) (options.hostMemory ? inputBuffer.hostPointer : allocateHostMemory(bufferSize, sizeof(int32_t)));
+    int32_t *output = (int32_t*) (options.hostMemory ? outputBuffer.hostPointer : outputBuffer.mapped);
 
-    // TODO ensure alignment
-    VkMemoryRequirements outputBufferMemoryRequirements;
-    vkGetBufferMemoryRequirements(device, outputBuffer, &outputBufferMemoryRequirements);
-    printf("output { size: %lu, alignment: %lu }\n", outputBufferMemoryRequirements.size, outputBufferMemoryRequirements.alignment);
+    fillElements(options.format, input, bufferLength, (uint32_t) rand());
 
-    BAIL_ON_BAD_RESULT(vkBindBufferMemory(device, outputBuffer, memory, bufferSize));
+    if (!options.hostMemory) {
+        memcpy(inputBuffer.mapped, input, (size_t) bufferSize);
+    }
 
     uint32_t shaderSize;
     uint32_t *shaderData;
 
-    shaderLoad(&shaderSize, &shaderData);
-
-    VkShaderModuleCreateInfo shaderModuleCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .codeSize = shaderSize,
-        .pCode = shaderData,
-    };
+    if (options.kernelName != NULL) {
+        loadStreamKernel(options.kernelName, &shaderSize, &shaderData);
+    } else if (!shaderLoadNamed(formatKernel.shaderName, &shaderSize, &shaderData)) {
+        fprintf(stderr, "The `%s` shader is not embedded.\n", formatKernel.shaderName);
+        exit(1);
+    }
 
     printf("shader { size: %u, last: %u }\n", shaderSize, shaderData[shaderSize / sizeof(uint32_t) - 1] - 65536);
 
-    VkShaderModule shaderModule;
-    BAIL_ON_BAD_RESULT(vkCreateShaderModule(device, &shaderModuleCreateInfo, 0, &shaderModule));
-
-    VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[2] = {
-        (VkDescriptorSetLayoutBinding) {
-            .binding = 0,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-            .pImmutableSamplers = NULL,
-        },
-        (VkDescriptorSetLayoutBinding) {
-            .binding = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .descriptorCount = 1,
-            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-            .pImmutableSamplers = NULL,
-        },
-    };
+    double shaderModuleStartTime = timeNowSeconds();
+    VkShaderModule shaderModule = createKernelShaderModule(device, shaderSize, shaderData);
+    profileHost(&profile, "shaderModuleCreation", timeNowSeconds() - shaderModuleStartTime);
+
+    bool pipelineCacheWarm = false;
+    double pipelineCacheStartTime = timeNowSeconds();
+    VkPipelineCache pipelineCache = options.pipelineCache
+        ? loadPipelineCache(device, &physicalDeviceProperties, &pipelineCacheWarm)
+        : VK_NULL_HANDLE;
+    double pipelineCacheEndTime = timeNowSeconds();
+    profileHost(&profile, "pipelineCacheLoad", pipelineCacheEndTime - pipelineCacheStartTime);
+
+    // The stream and graph modes allocate sets of the layout themselves, so it cannot be one for push descriptors
+    DescriptorCache descriptorCache;
+    createDescriptorCache(&computeDevice, preferredDescriptorMode(&computeDevice, false), 2, sizeof(KernelParameters),
+            &descriptorCache);
+    VkDescriptorSetLayout descriptorSetLayout = descriptorCache.descriptorSetLayout;
+    VkPipelineLayout pipelineLayout = descriptorCache.pipelineLayout;
 
-    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
-        .bindingCount = 2,
-        .pBindings = descriptorSetLayoutBindings,
+        .queueFamilyIndex = queueFamilyPropertiesIndex,
     };
 
-    VkDescriptorSetLayout descriptorSetLayout;
-    BAIL_ON_BAD_RESULT(vkCreateDescriptorSetLayout(
-                device, &descriptorSetLayoutCreateInfo, NULL, &descriptorSetLayout));
+    VkBuffer kernelBuffers[] = { inputBuffer.buffer, outputBuffer.buffer };
+    DescriptorBinding descriptorBinding;
+    descriptorCacheAcquire(&descriptorCache, kernelBuffers, &descriptorBinding);
+    VkDescriptorSet descriptorSets[] = { descriptorBinding.descriptorSet };
 
-    VkDescriptorSetLayout descriptorSetLayouts[] = { descriptorSetLayout };
-    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .setLayoutCount = 1,
-        .pSetLayouts = descriptorSetLayouts,
-        .pushConstantRangeCount = 0,
-        .pPushConstantRanges = NULL,
-    };
+    VkCommandPool commandPool;
+    BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, hostAllocationCallbacks(), &commandPool));
+
+    uint32_t workgroupSize = options.workgroupSize;
+
+    if (options.autotune) {
+        DispatchBenchmark benchmark = {
+            .device = device,
+            .queue = queue,
+            .commandPool = commandPool,
+            .pipelineCache = pipelineCache,
+            .shaderModule = shaderModule,
+            .pipelineLayout = pipelineLayout,
+            .descriptorSets = descriptorSets,
+            .limits = &physicalDeviceProperties.limits,
+            .elementCount = invocationCount,
+        };
+
+        workgroupSize = autotuneWorkgroupSize(&physicalDeviceProperties, benchmarkDispatch, &benchmark);
+    } else {
+        workgroupSize = chooseWorkgroupSize(&physicalDeviceProperties, workgroupSize);
+    }
 
-    VkPipelineLayout pipelineLayout;
-    BAIL_ON_BAD_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, &pipelineLayout));
+    // The autotuner times the generic variant; the one built for the chosen size replaces it
+    if (options.kernelName == NULL) {
+        ShaderVariant variant;
 
-    VkComputePipelineCreateInfo computePipelineCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .stage = (VkPipelineShaderStageCreateInfo) {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .pNext = NULL,
-            .flags = 0,
-            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
-            .module = shaderModule,
-            .pName = "main", // entry point name of the shader for this stage
-            .pSpecializationInfo = NULL,
-        },
-        .layout = pipelineLayout,
-        .basePipelineHandle = NULL,
-        .basePipelineIndex = 0,
-    };
+        if (!shaderSelectVariant(formatKernel.shaderName, shaderDeviceFeatures(&computeDevice), workgroupSize, &variant)) {
+            fprintf(stderr, "No variant of the `%s` shader runs on the device.\n", formatKernel.shaderName);
+            exit(1);
+        }
 
-    VkPipeline pipelines[1];
-    VkComputePipelineCreateInfo computePipelineCreateInfos[] = { computePipelineCreateInfo };
-    BAIL_ON_BAD_RESULT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, computePipelineCreateInfos, NULL, pipelines));
+        printShaderVariant(&variant);
 
-    VkCommandPoolCreateInfo commandPoolCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .queueFamilyIndex = queueFamilyPropertiesIndex,
-    };
+        if (variant.workgroupSize != 0) {
+            vkDestroyShaderModule(device, shaderModule, hostAllocationCallbacks());
 
-    VkDescriptorPoolSize descriptorPoolSize = {
-        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        .descriptorCount = 2,
-    };
+            shaderModuleStartTime = timeNowSeconds();
+            shaderModule = createKernelShaderModule(device, variant.size, (uint32_t*) variant.data);
+            profileHost(&profile, "variantShaderModuleCreation", timeNowSeconds() - shaderModuleStartTime);
+        }
+    }
 
-    VkDescriptorPoolSize descriptorPoolSizes[] = { descriptorPoolSize };
-    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .maxSets = 1,
-        .poolSizeCount = 1,
-        .pPoolSizes = descriptorPoolSizes,
-    };
+    DispatchGrid grid = dispatchGrid(&physicalDeviceProperties.limits, invocationCount, workgroupSize);
+    printf("workgroup { size: %" PRIu32 ", count: %" PRIu32 ", grid: %" PRIu32 "x%" PRIu32 "x%" PRIu32 " }\n",
+            workgroupSize, workgroupCount(invocationCount, workgroupSize), grid.x, grid.y, grid.z);
+    printf("format { elements: %s, access: %s, bytes: %" PRIu64 " }\n", elementFormatString(options.format),
+            formatKernel.native ? "native" : "packed", (uint64_t) bufferSize);
+
+    double pipelineStartTime = timeNowSeconds();
+    VkPipeline pipeline = createComputePipeline(device, pipelineCache, shaderModule, pipelineLayout, workgroupSize);
+    double pipelineEndTime = timeNowSeconds();
+    profileHost(&profile, "pipelineCreation", pipelineEndTime - pipelineStartTime);
+    profileHost(&profile, "startup", pipelineEndTime - startTime);
+
+    printf("startup { pipelineCache: %s, pipelineCacheLoad: %.3f ms, pipelineCreation: %.3f ms, total: %.3f ms }\n",
+            !options.pipelineCache ? "disabled" : pipelineCacheWarm ? "warm" : "cold",
+            (pipelineCacheEndTime - pipelineCacheStartTime) * 1e3,
+            (pipelineEndTime - pipelineStartTime) * 1e3,
+            (pipelineEndTime - startTime) * 1e3);
+
+    int exitCode = 0;
+
+    if (options.streamSize > 0 || options.inputPath != NULL) {
+        VkDeviceSize chunkSize = chooseStreamChunkSize(&physicalDeviceProperties, options.chunkSize);
+
+        Stream stream;
+        createStream(&computeDevice, options.transferQueue, options.memoryPlacement, pipeline, pipelineLayout,
+                descriptorSetLayout, workgroupSize, chunkSize, options.inFlightCount, &stream);
+        printf("stream { chunkSize: %" PRIu64 ", inFlight: %" PRIu32 ", ", (uint64_t) chunkSize, options.inFlightCount);
+
+        if (stream.transferQueueInUse) {
+            printf("transferQueue: family %" PRIu32 " }\n", stream.transferQueueFamilyIndex);
+        } else {
+            printf("transferQueue: none }\n");
+        }
 
-    VkDescriptorPool descriptorPool;
-    BAIL_ON_BAD_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, NULL, &descriptorPool));
+        printPlacedBuffer("chunk", &stream.slots[0].input, &physicalDeviceMemoryProperties);
 
-    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .pNext = NULL,
-        .descriptorPool = descriptorPool,
-        .descriptorSetCount = 1,
-        .pSetLayouts = descriptorSetLayouts,
-    };
+        uint64_t mismatchCount = 0;
+        StreamStatistics statistics;
 
-    VkDescriptorSet descriptorSets[1];
-    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, descriptorSets));
+        if (options.inputPath != NULL) {
+            if (!runFileStream(&stream, &fileStream, &statistics)) {
+                exitCode = 1;
+            }
 
-    VkDescriptorBufferInfo inputDescriptorBufferInfo = {
-        .buffer = inputBuffer,
-        .offset = 0,
-        .range = VK_WHOLE_SIZE,
-    };
+            closeFileStream(&fileStream);
+        } else {
+            runStream(&stream, options.streamSize, fillStreamPattern, verifyStreamPattern, &mismatchCount, &statistics);
+        }
 
-    VkDescriptorBufferInfo outputDescriptorBufferInfo = {
-        .buffer = outputBuffer,
-        .offset = 0,
-        .range = VK_WHOLE_SIZE,
-    };
+        printStreamStatistics(&statistics);
+        destroyStream(&stream);
 
-    VkWriteDescriptorSet writeDescriptorSet[2] = {
-        {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .pNext = NULL,
-            .dstSet = descriptorSets[0],
-            .dstBinding = 0,
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = NULL,
-            .pBufferInfo = &inputDescriptorBufferInfo,
-            .pTexelBufferView = NULL,
-        },
-        {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        profileHost(&profile, "streamFill", statistics.fillSeconds);
+        profileHost(&profile, "streamDevice", statistics.deviceSeconds);
+        profileHost(&profile, "streamDrain", statistics.drainSeconds);
+        profileHost(&profile, "streamTotal", statistics.totalSeconds);
+
+        if (mismatchCount > 0) {
+            fprintf(stderr, "%" PRIu64 " streamed elements differ from the input.\n", mismatchCount);
+            exitCode = 1;
+        }
+    } else if (options.graphStageCount > 0) {
+        if (!runGraphMode(&computeDevice, options.memoryPlacement, pipeline, pipelineLayout, descriptorSetLayout, grid,
+                bufferLength, options.graphStageCount, &cpuEngine, &profile)) {
+            exitCode = 1;
+        }
+    } else if (options.primitiveCount > 0) {
+        double primitivesStartTime = timeNowSeconds();
+        uint32_t mismatchCount = checkPrimitiveVariants(&computeDevice, pipelineCache, &cpuEngine,
+                options.primitiveCount);
+        profileHost(&profile, "primitives", timeNowSeconds() - primitivesStartTime);
+
+        if (mismatchCount > 0) {
+            fprintf(stderr, "%" PRIu32 " primitives differ from the CPU reference.\n", mismatchCount);
+            exitCode = 1;
+        }
+    } else {
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
             .pNext = NULL,
-            .dstSet = descriptorSets[0],
-            .dstBinding = 1,
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = NULL,
-            .pBufferInfo = &outputDescriptorBufferInfo,
-            .pTexelBufferView = NULL,
-        },
-    };
+            .commandPool = commandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
 
-    vkUpdateDescriptorSets(device, 2, writeDescriptorSet, 0, NULL);
+        VkCommandBuffer commandBuffer;
+        BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer));
 
-    VkCommandPool commandPool;
-    BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, NULL, &commandPool));
+        beginCommandBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        profileResetDeviceRegions(&profile, commandBuffer);
 
-    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .pNext = NULL,
-        .commandPool = commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1,
-    };
+        uint32_t uploadRegion = profileBeginDeviceRegion(&profile, commandBuffer, "upload");
+        recordPlacedBufferUpload(commandBuffer, &inputBuffer);
+        profileEndDeviceRegion(&profile, commandBuffer, uploadRegion);
 
-    VkCommandBuffer commandBuffer;
-    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer));
+        uint32_t dispatchRegion = profileBeginDeviceRegion(&profile, commandBuffer, "dispatch");
+        KernelParameters parameters = contiguousKernelParameters(invocationCount);
+        recordDispatch(commandBuffer, pipeline, pipelineLayout, descriptorSets, &parameters, grid);
+        profileEndDeviceRegion(&profile, commandBuffer, dispatchRegion);
 
-    VkCommandBufferBeginInfo commandBufferBeginInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .pNext = NULL,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-        .pInheritanceInfo = NULL,
-    };
+        uint32_t readbackRegion = profileBeginDeviceRegion(&profile, commandBuffer, "readback");
+        recordPlacedBufferReadback(commandBuffer, &outputBuffer);
+        profileEndDeviceRegion(&profile, commandBuffer, readbackRegion);
 
-    BAIL_ON_BAD_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+        BAIL_ON_BAD_RESULT(vkEndCommandBuffer(commandBuffer));
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0]);
+        VkFenceCreateInfo fenceCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+        };
 
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, descriptorSets, 0, NULL);
+        VkFence fence;
+        BAIL_ON_BAD_RESULT(vkCreateFence(device, &fenceCreateInfo, hostAllocationCallbacks(), &fence));
 
-    vkCmdDispatch(commandBuffer, bufferSize / sizeof(int32_t), 1, 1);
+        VkCommandBuffer commandBuffers[] = { commandBuffer };
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = NULL,
+            .waitSemaphoreCount = 0,
+            .pWaitSemaphores = NULL,
+            .pWaitDstStageMask = NULL,
+            .commandBufferCount = 1,
+            .pCommandBuffers = commandBuffers,
+            .signalSemaphoreCount = 0,
+            .pSignalSemaphores = NULL,
+        };
+
+        double submitTime = timeNowSeconds();
+        copyHostBufferIn(&inputBuffer);
+        flushPlacedBuffer(&computeDevice.allocator, &inputBuffer, bufferSize);
+        BAIL_ON_BAD_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+        BAIL_ON_BAD_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+        invalidatePlacedBuffer(&computeDevice.allocator, &outputBuffer, bufferSize);
+        copyHostBufferOut(&outputBuffer);
+        profileHost(&profile, "submitToFence", timeNowSeconds() - submitTime);
+        profileCollectDeviceRegions(&profile, device);
+
+        vkDestroyFence(device, fence, hostAllocationCallbacks());
+
+        if (!verifyFormatCopy(&cpuEngine, &profile, options.format, input, output, bufferLength)) {
+            exitCode = 1;
+        }
+    }
 
-    BAIL_ON_BAD_RESULT(vkEndCommandBuffer(commandBuffer));
+    AllocatorStatistics allocatorStatistics;
+    getAllocatorStatistics(&computeDevice.allocator, &allocatorStatistics);
+    printAllocatorStatistics(&allocatorStatistics);
 
-    VkCommandBuffer commandBuffers[] = { commandBuffer };
-    VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = NULL,
-        .waitSemaphoreCount = 0,
-        .pWaitSemaphores = NULL,
-        .pWaitDstStageMask = NULL,
-        .commandBufferCount = 1,
-        .pCommandBuffers = commandBuffers,
-        .signalSemaphoreCount = 0,
-        .pSignalSemaphores = NULL,
-    };
+    DescriptorCacheStatistics descriptorCacheStatistics;
+    getDescriptorCacheStatistics(&descriptorCache, &descriptorCacheStatistics);
+    printDescriptorCacheStatistics(&descriptorCache, &descriptorCacheStatistics);
+
+    if (options.pipelineCache) {
+        storePipelineCache(device, &physicalDeviceProperties, pipelineCache);
+    }
 
-    BAIL_ON_BAD_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-    BAIL_ON_BAD_RESULT(vkQueueWaitIdle(queue));
-    BAIL_ON_BAD_RESULT(vkMapMemory(device, memory, 0, memorySize, 0, (void**) &payload));
+    profileHostAllocations(&profile);
+    printProfile(&profile);
 
-    for (uint32_t i = 0, len = bufferSize / sizeof(int32_t); i < len; i++) {
-        /* printf("input: %u; output: %u\n", payload[i], payload[i + len]); */
-        assert(payload[i + len] == payload[i]);
+    if (options.profilePath != NULL && !writeProfileReport(&profile, &physicalDeviceProperties, options.profilePath)) {
+        exitCode = 1;
     }
 
-    return 0;
+    destroyProfile(&profile, device);
+
+    return exitCode;
 }
@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "util.h"
+#include "host_allocator.h"
+
+const char *memoryPlacementString(MemoryPlacement placement) {
+    switch (placement) {
+        case MEMORY_PLACEMENT_AUTO: return "auto";
+        case MEMORY_PLACEMENT_HOST_VISIBLE: return "host-visible";
+        case MEMORY_PLACEMENT_DEVICE_LOCAL: return "device-local";
+        default: return "undefined";
+    }
+}
+
+const char *memoryDirectionString(MemoryDirection direction) {
+    switch (direction) {
+        case MEMORY_DIRECTION_UPLOAD: return "upload";
+        case MEMORY_DIRECTION_READBACK: return "readback";
+        case MEMORY_DIRECTION_BIDIRECTIONAL: return "bidirectional";
+        default: return "undefined";
+    }
+}
+
+bool parseMemoryPlacement(const char *string, MemoryPlacement *placement) {
+    for (MemoryPlacement candidate = MEMORY_PLACEMENT_AUTO; candidate <= MEMORY_PLACEMENT_DEVICE_LOCAL; candidate += 1) {
+        if (strcmp(string, memoryPlacementString(candidate)) == 0) {
+            *placement = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t findMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties, uint32_t memoryTypeBits,
+        VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, VkDeviceSize memorySize) {
+    uint32_t fallbackIndex = UINT32_MAX;
+
+    for (uint32_t i = 0; i < physicalDeviceMemoryProperties->memoryTypeCount; i += 1) {
+        const VkMemoryType *currentMemoryType = &physicalDeviceMemoryProperties->memoryTypes[i];
+        VkMemoryPropertyFlags flags = currentMemoryType->propertyFlags;
+
+        if (!(memoryTypeBits & (1u << i)) ||
+            (flags & requiredFlags) != requiredFlags ||
+            memorySize >= physicalDeviceMemoryProperties->memoryHeaps[currentMemoryType->heapIndex].size) {
+            continue;
+        }
+
+        if ((flags & preferredFlags) == preferredFlags) {
+            return i;
+        }
+
+        if (fallbackIndex == UINT32_MAX) {
+            fallbackIndex = i;
+        }
+    }
+
+    return fallbackIndex;
+}
+
+uint32_t chooseMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties, uint32_t memoryTypeBits,
+        VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, VkDeviceSize memorySize) {
+    uint32_t index = findMemoryTypeIndex(physicalDeviceMemoryProperties, memoryTypeBits, requiredFlags, preferredFlags, memorySize);
+
+    if (index == UINT32_MAX) {
+        fprintf(stderr, "Could not find a sufficient memory type.\n");
+        exit(1);
+    }
+
+    return index;
+}
+
+// Unified memory: every device-local heap can also be mapped by the host
+static bool isUnifiedMemory(const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties) {
+    for (uint32_t heap = 0; heap < physicalDeviceMemoryProperties->memoryHeapCount; heap += 1) {
+        if (!(physicalDeviceMemoryProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+            continue;
+        }
+
+        bool hostVisible = false;
+
+        for (uint32_t i = 0; i < physicalDeviceMemoryProperties->memoryTypeCount; i += 1) {
+            const VkMemoryType *memoryType = &physicalDeviceMemoryProperties->memoryTypes[i];
+
+            if (memoryType->heapIndex == heap && (memoryType->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+                hostVisible = true;
+            }
+        }
+
+        if (!hostVisible) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+MemoryPlacement chooseMemoryPlacement(const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties, MemoryPlacement requested, VkDeviceSize size) {
+    bool deviceLocalFits = findMemoryTypeIndex(physicalDeviceMemoryProperties, UINT32_MAX,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, size) != UINT32_MAX;
+
+    if (requested == MEMORY_PLACEMENT_AUTO) {
+        // Staging is pure overhead when the host can map the memory the kernel works on anyway
+        bool staging = physicalDeviceProperties->deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU
+            && physicalDeviceProperties->deviceType != VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU
+            && !isUnifiedMemory(physicalDeviceMemoryProperties);
+
+        requested = staging ? MEMORY_PLACEMENT_DEVICE_LOCAL : MEMORY_PLACEMENT_HOST_VISIBLE;
+    }
+
+    if (requested == MEMORY_PLACEMENT_DEVICE_LOCAL && !deviceLocalFits) {
+        return MEMORY_PLACEMENT_HOST_VISIBLE;
+    }
+
+    return requested;
+}
+
+// The host-visible memory type for the mapped side of a buffer, ranked by the flags that matter
+// most for `direction`; `deviceLocal` when kernels access the memory directly. Types on heaps
+// without room for `memorySize` rank below all others, so that a small device-local heap the host
+// can map (the PCIe BAR of a discrete GPU) is not filled up before system memory. UINT32_MAX if none.
+static uint32_t chooseHostMemoryTypeIndex(Allocator *allocator, uint32_t memoryTypeBits, MemoryDirection direction,
+        bool deviceLocal, VkDeviceSize memorySize) {
+    const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties = &allocator->memoryProperties;
+    VkDeviceSize heapRoom[VK_MAX_MEMORY_HEAPS];
+    uint32_t bestIndex = UINT32_MAX;
+    uint32_t bestScore = 0;
+
+    getAllocatorHeapRoom(allocator, heapRoom);
+
+    for (uint32_t i = 0; i < physicalDeviceMemoryProperties->memoryTypeCount; i += 1) {
+        const VkMemoryType *memoryType = &physicalDeviceMemoryProperties->memoryTypes[i];
+        VkMemoryPropertyFlags flags = memoryType->propertyFlags;
+
+        if (!(memoryTypeBits & (1u << i)) || !(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ||
+            memorySize >= physicalDeviceMemoryProperties->memoryHeaps[memoryType->heapIndex].size) {
+            continue;
+        }
+
+        uint32_t local = deviceLocal && (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? 1 : 0;
+        uint32_t cached = (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) ? 1 : 0;
+        uint32_t coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) ? 1 : 0;
+        uint32_t room = memorySize <= heapRoom[memoryType->heapIndex] ? 1 : 0;
+
+        // Uploads want write-combining, which drivers expose as uncached memory; coherence only
+        // saves flushes, so it matters least
+        uint32_t score = 8 * room + (direction == MEMORY_DIRECTION_UPLOAD
+            ? 1 + 4 * local + 2 * (1 - cached) + coherent
+            : 1 + 4 * cached + 2 * local + coherent);
+
+        if (score > bestScore) {
+            bestIndex = i;
+            bestScore = score;
+        }
+    }
+
+    return bestIndex;
+}
+
+static void createBufferWithMemory(Allocator *allocator, VkDeviceSize size, VkBufferUsageFlags usage, uint32_t queueFamilyIndex,
+        bool hostVisible, MemoryDirection direction, bool deviceLocal, VkBuffer *buffer, Allocation *allocation) {
+    const uint32_t queueFamilyIndices[] = { queueFamilyIndex };
+    const VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = queueFamilyIndices,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateBuffer(allocator->device, &bufferCreateInfo, hostAllocationCallbacks(), buffer));
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(allocator->device, *buffer, &memoryRequirements);
+
+    // A memory type that is out of memory is dropped and the next best one tried
+    uint32_t memoryTypeBits = memoryRequirements.memoryTypeBits;
+
+    while (true) {
+        uint32_t memoryTypeIndex = hostVisible
+            ? chooseHostMemoryTypeIndex(allocator, memoryTypeBits, direction, deviceLocal, memoryRequirements.size)
+            : findMemoryTypeIndex(&allocator->memoryProperties, memoryTypeBits,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, memoryRequirements.size);
+
+        if (memoryTypeIndex == UINT32_MAX) {
+            fprintf(stderr, "Could not allocate %" PRIu64 " bytes of %s memory for a buffer.\n",
+                    (uint64_t) memoryRequirements.size, hostVisible ? "host-visible" : "device-local");
+            exit(1);
+        }
+
+        if (allocateDeviceMemory(allocator, memoryTypeIndex, &memoryRequirements, true, allocation)) {
+            break;
+        }
+
+        memoryTypeBits &= ~(1u << memoryTypeIndex);
+    }
+
+    BAIL_ON_BAD_RESULT(vkBindBufferMemory(allocator->device, *buffer, allocation->memory, allocation->offset));
+}
+
+void createPlacedBuffer(Allocator *allocator, const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        MemoryPlacement requested, MemoryDirection direction, VkDeviceSize size, uint32_t queueFamilyIndex,
+        PlacedBuffer *placedBuffer) {
+    *placedBuffer = (PlacedBuffer) {
+        .size = size,
+        .placement = chooseMemoryPlacement(physicalDeviceProperties, &allocator->memoryProperties, requested, size),
+        .direction = direction,
+        .stagingBuffer = VK_NULL_HANDLE,
+        .stagingAllocation = { .range = NULL },
+    };
+
+    const Allocation *mappedAllocation;
+
+    if (placedBuffer->placement == MEMORY_PLACEMENT_DEVICE_LOCAL) {
+        // Any placed buffer may also hold the arguments of indirect dispatches
+        createBufferWithMemory(allocator, size,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                    | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                queueFamilyIndex, false, direction, true,
+                &placedBuffer->buffer, &placedBuffer->allocation);
+        createBufferWithMemory(allocator, size,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                queueFamilyIndex, true, direction, false,
+                &placedBuffer->stagingBuffer, &placedBuffer->stagingAllocation);
+        mappedAllocation = &placedBuffer->stagingAllocation;
+    } else {
+        // On unified memory, the host-visible type of the device-local heap is the fast one
+        createBufferWithMemory(allocator, size,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, queueFamilyIndex,
+                true, direction, true,
+                &placedBuffer->buffer, &placedBuffer->allocation);
+        mappedAllocation = &placedBuffer->allocation;
+    }
+
+    placedBuffer->mapped = mappedAllocation->mapped;
+    placedBuffer->coherent = (allocator->memoryProperties.memoryTypes[mappedAllocation->memoryTypeIndex].propertyFlags
+            & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+void destroyPlacedBuffer(Allocator *allocator, PlacedBuffer *placedBuffer) {
+    if (placedBuffer->stagingBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(allocator->device, placedBuffer->stagingBuffer, hostAllocationCallbacks());
+        freeDeviceMemory(allocator, &placedBuffer->stagingAllocation);
+    }
+
+    vkDestroyBuffer(allocator->device, placedBuffer->buffer, hostAllocationCallbacks());
+
+    // Imported memory is a dedicated allocation outside the allocator's blocks
+    if (placedBuffer->imported) {
+        vkFreeMemory(allocator->device, placedBuffer->allocation.memory, hostAllocationCallbacks());
+    } else {
+        freeDeviceMemory(allocator, &placedBuffer->allocation);
+    }
+}
+
+VkDeviceSize hostImportAlignment(const ComputeDevice *computeDevice) {
+    if (!computeDevice->externalMemoryHost) {
+        return 0;
+    }
+
+    VkDeviceSize pageSize = (VkDeviceSize) sysconf(_SC_PAGESIZE);
+    VkDeviceSize alignment = computeDevice->minImportedHostPointerAlignment;
+
+    return alignment > pageSize ? alignment : pageSize;
+}
+
+// Returns false, with nothing created, when the driver does not accept the memory
+static bool importHostBuffer(ComputeDevice *computeDevice, void *hostPointer, VkDeviceSize size, PlacedBuffer *placedBuffer) {
+    const VkExternalMemoryHandleTypeFlagBits handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    VkDevice device = computeDevice->device;
+    VkDeviceSize alignment = hostImportAlignment(computeDevice);
+
+    if (alignment == 0 || size == 0 || (uintptr_t) hostPointer % alignment != 0 || size % alignment != 0) {
+        return false;
+    }
+
+    VkMemoryHostPointerPropertiesEXT hostPointerProperties = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+        .pNext = NULL,
+        .memoryTypeBits = 0,
+    };
+
+    if (computeDevice->getMemoryHostPointerProperties(device, handleType, hostPointer, &hostPointerProperties) != VK_SUCCESS) {
+        return false;
+    }
+
+    const VkExternalMemoryBufferCreateInfo externalMemoryBufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .handleTypes = handleType,
+    };
+
+    const uint32_t queueFamilyIndices[] = { computeDevice->queueFamilyIndex };
+    const VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = &externalMemoryBufferCreateInfo,
+        .flags = 0,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = queueFamilyIndices,
+    };
+
+    VkBuffer buffer;
+    BAIL_ON_BAD_RESULT(vkCreateBuffer(device, &bufferCreateInfo, hostAllocationCallbacks(), &buffer));
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+    // Coherent, so that host and kernel accesses need no flushes
+    uint32_t memoryTypeIndex = findMemoryTypeIndex(&computeDevice->memoryProperties,
+            memoryRequirements.memoryTypeBits & hostPointerProperties.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, 0);
+
+    if (memoryTypeIndex == UINT32_MAX || memoryRequirements.size > size) {
+        vkDestroyBuffer(device, buffer, hostAllocationCallbacks());
+        return false;
+    }
+
+    const VkImportMemoryHostPointerInfoEXT importMemoryHostPointerInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+        .pNext = NULL,
+        .handleType = handleType,
+        .pHostPointer = hostPointer,
+    };
+
+    const VkMemoryAllocateInfo memoryAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &importMemoryHostPointerInfo,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex,
+    };
+
+    VkDeviceMemory memory;
+
+    if (vkAllocateMemory(device, &memoryAllocateInfo, hostAllocationCallbacks(), &memory) != VK_SUCCESS) {
+        vkDestroyBuffer(device, buffer, hostAllocationCallbacks());
+        return false;
+    }
+
+    BAIL_ON_BAD_RESULT(vkBindBufferMemory(device, buffer, memory, 0));
+
+    *placedBuffer = (PlacedBuffer) {
+        .size = size,
+        .placement = MEMORY_PLACEMENT_HOST_VISIBLE,
+        .buffer = buffer,
+        .allocation = {
+            .range = NULL,
+            .memory = memory,
+            .offset = 0,
+            .size = size,
+            .memoryTypeIndex = memoryTypeIndex,
+            .mapped = hostPointer,
+        },
+        .direction = MEMORY_DIRECTION_BIDIRECTIONAL,
+        .mapped = hostPointer,
+        .coherent = true,
+        .stagingBuffer = VK_NULL_HANDLE,
+        .stagingAllocation = { .range = NULL },
+        .hostPointer = hostPointer,
+        .imported = true,
+    };
+
+    return true;
+}
+
+void createHostBuffer(ComputeDevice *computeDevice, MemoryPlacement fallbackPlacement, MemoryDirection direction,
+        void *hostPointer, VkDeviceSize size, PlacedBuffer *placedBuffer) {
+    if (importHostBuffer(computeDevice, hostPointer, size, placedBuffer)) {
+        placedBuffer->direction = direction;
+        return;
+    }
+
+    createPlacedBuffer(&computeDevice->allocator, &computeDevice->properties, fallbackPlacement, direction, size,
+            computeDevice->queueFamilyIndex, placedBuffer);
+    placedBuffer->hostPointer = hostPointer;
+}
+
+void copyHostBufferIn(const PlacedBuffer *placedBuffer) {
+    if (placedBuffer->hostPointer != NULL && !placedBuffer->imported) {
+        memcpy(placedBuffer->mapped, placedBuffer->hostPointer, placedBuffer->size);
+    }
+}
+
+void copyHostBufferOut(const PlacedBuffer *placedBuffer) {
+    if (placedBuffer->hostPointer != NULL && !placedBuffer->imported) {
+        memcpy(placedBuffer->hostPointer, placedBuffer->mapped, placedBuffer->size);
+    }
+}
+
+static void mappedMemoryRange(const Allocator *allocator, const PlacedBuffer *placedBuffer, VkDeviceSize size,
+        VkMappedMemoryRange *range) {
+    const Allocation *allocation = placedBuffer->stagingBuffer != VK_NULL_HANDLE
+        ? &placedBuffer->stagingAllocation : &placedBuffer->allocation;
+    // The allocator places non-coherent allocations on whole atoms, so the widened range stays inside
+    VkDeviceSize atomSize = allocator->nonCoherentAtomSize;
+    VkDeviceSize alignedSize = (size + atomSize - 1) / atomSize * atomSize;
+
+    *range = (VkMappedMemoryRange) {
+        .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .pNext = NULL,
+        .memory = allocation->memory,
+        .offset = allocation->offset,
+        .size = alignedSize < allocation->size ? alignedSize : allocation->size,
+    };
+}
+
+void flushPlacedBuffer(const Allocator *allocator, const PlacedBuffer *placedBuffer, VkDeviceSize size) {
+    if (placedBuffer->coherent || size == 0) {
+        return;
+    }
+
+    VkMappedMemoryRange range;
+    mappedMemoryRange(allocator, placedBuffer, size, &range);
+    BAIL_ON_BAD_RESULT(vkFlushMappedMemoryRanges(allocator->device, 1, &range));
+}
+
+void invalidatePlacedBuffer(const Allocator *allocator, const PlacedBuffer *placedBuffer, VkDeviceSize size) {
+    if (placedBuffer->coherent || size == 0) {
+        return;
+    }
+
+    VkMappedMemoryRange range;
+    mappedMemoryRange(allocator, placedBuffer, size, &range);
+    BAIL_ON_BAD_RESULT(vkInvalidateMappedMemoryRanges(allocator->device, 1, &range));
+}
+
+static void recordQueueFamilyBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer,
+        VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask,
+        VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask,
+        uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex) {
+    const VkBufferMemoryBarrier bufferMemoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = srcAccessMask,
+        .dstAccessMask = dstAccessMask,
+        .srcQueueFamilyIndex = srcQueueFamilyIndex,
+        .dstQueueFamilyIndex = dstQueueFamilyIndex,
+        .buffer = buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, NULL, 1, &bufferMemoryBarrier, 0, NULL);
+}
+
+static void recordBufferBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer,
+        VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask,
+        VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask) {
+    recordQueueFamilyBarrier(commandBuffer, buffer, srcStageMask, srcAccessMask, dstStageMask, dstAccessMask,
+            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+}
+
+void recordPlacedBufferUpload(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer) {
+    recordPlacedBufferRangeUpload(commandBuffer, placedBuffer, placedBuffer->size);
+}
+
+void recordPlacedBufferReadback(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer) {
+    recordPlacedBufferRangeReadback(commandBuffer, placedBuffer, placedBuffer->size);
+}
+
+void recordPlacedBufferRangeUpload(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer, VkDeviceSize size) {
+    // Host writes to coherent memory are made visible by the submission itself
+    if (placedBuffer->placement != MEMORY_PLACEMENT_DEVICE_LOCAL) {
+        return;
+    }
+
+    const VkBufferCopy bufferCopy = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = size,
+    };
+
+    vkCmdCopyBuffer(commandBuffer, placedBuffer->stagingBuffer, placedBuffer->buffer, 1, &bufferCopy);
+    recordBufferBarrier(commandBuffer, placedBuffer->buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void recordPlacedBufferRangeReadback(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer, VkDeviceSize size) {
+    if (placedBuffer->placement != MEMORY_PLACEMENT_DEVICE_LOCAL) {
+        recordBufferBarrier(commandBuffer, placedBuffer->buffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+        return;
+    }
+
+    const VkBufferCopy bufferCopy = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = size,
+    };
+
+    recordBufferBarrier(commandBuffer, placedBuffer->buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    vkCmdCopyBuffer(commandBuffer, placedBuffer->buffer, placedBuffer->stagingBuffer, 1, &bufferCopy);
+    recordBufferBarrier(commandBuffer, placedBuffer->stagingBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+// The release half of an ownership transfer only has a source scope, the acquire half only a
+// destination scope; the semaphore between the two submissions orders them.
+
+void recordPlacedBufferTransferUpload(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer, VkDeviceSize size,
+        uint32_t transferQueueFamilyIndex, uint32_t computeQueueFamilyIndex) {
+    const VkBufferCopy bufferCopy = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = size,
+    };
+
+    vkCmdCopyBuffer(commandBuffer, placedBuffer->stagingBuffer, placedBuffer->buffer, 1, &bufferCopy);
+    recordQueueFamilyBarrier(commandBuffer, placedBuffer->buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            transferQueueFamilyIndex, computeQueueFamilyIndex);
+}
+
+void recordPlacedBufferAcquireUpload(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer,
+        uint32_t transferQueueFamilyIndex, uint32_t computeQueueFamilyIndex) {
+    recordQueueFamilyBarrier(commandBuffer, placedBuffer->buffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            transferQueueFamilyIndex, computeQueueFamilyIndex);
+}
+
+void recordPlacedBufferReleaseReadback(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer,
+        uint32_t computeQueueFamilyIndex, uint32_t transferQueueFamilyIndex) {
+    recordQueueFamilyBarrier(commandBuffer, placedBuffer->buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            computeQueueFamilyIndex, transferQueueFamilyIndex);
+}
+
+void recordPlacedBufferTransferReadback(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer, VkDeviceSize size,
+        uint32_t computeQueueFamilyIndex, uint32_t transferQueueFamilyIndex) {
+    const VkBufferCopy bufferCopy = {
+        .srcOffset = 0,
+        .dstOffset = 0,
+        .size = size,
+    };
+
+    recordQueueFamilyBarrier(commandBuffer, placedBuffer->buffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+            computeQueueFamilyIndex, transferQueueFamilyIndex);
+    vkCmdCopyBuffer(commandBuffer, placedBuffer->buffer, placedBuffer->stagingBuffer, 1, &bufferCopy);
+    recordBufferBarrier(commandBuffer, placedBuffer->stagingBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+static void printMemoryType(const char *name, uint32_t memoryTypeIndex,
+        const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties) {
+    const VkMemoryType *memoryType = &physicalDeviceMemoryProperties->memoryTypes[memoryTypeIndex];
+    const VkMemoryHeap *memoryHeap = &physicalDeviceMemoryProperties->memoryHeaps[memoryType->heapIndex];
+    VkMemoryPropertyFlags flags = memoryType->propertyFlags;
+
+    printf("\n\t%s: { type: %" PRIu32 ", heap: %" PRIu32 ", heapSize: %" PRIu64 " MiB, flags:%s%s%s%s }",
+            name, memoryTypeIndex, memoryType->heapIndex, (uint64_t) (memoryHeap->size >> 20),
+            (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? " DEVICE_LOCAL" : "",
+            (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? " HOST_VISIBLE" : "",
+            (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) ? " HOST_COHERENT" : "",
+            (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) ? " HOST_CACHED" : "");
+}
+
+void printPlacedBuffer(const char *name, const PlacedBuffer *placedBuffer,
+        const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties) {
+    printf("%s { size: %" PRIu64 ", placement: %s, direction: %s,", name, (uint64_t) placedBuffer->size,
+            memoryPlacementString(placedBuffer->placement), memoryDirectionString(placedBuffer->direction));
+
+    if (placedBuffer->hostPointer != NULL) {
+        printf(" hostMemory: %s,", placedBuffer->imported ? "imported" : "copied");
+    }
+
+    printMemoryType("memory", placedBuffer->allocation.memoryTypeIndex, physicalDeviceMemoryProperties);
+
+    if (placedBuffer->stagingBuffer != VK_NULL_HANDLE) {
+        printMemoryType("staging", placedBuffer->stagingAllocation.memoryTypeIndex, physicalDeviceMemoryProperties);
+    }
+
+    printf("\n}\n");
+}
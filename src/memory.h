@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+#include "device.h"
+
+typedef enum {
+    MEMORY_PLACEMENT_AUTO,
+    // Mapped memory accessed by both the host and the kernel
+    MEMORY_PLACEMENT_HOST_VISIBLE,
+    // Memory only the device can access, filled and drained through a staging buffer
+    MEMORY_PLACEMENT_DEVICE_LOCAL,
+} MemoryPlacement;
+
+// How the host uses the mapped contents, which picks the host-visible memory type
+typedef enum {
+    // Written by the host, or not accessed by it at all: write-combined memory is the fastest to fill
+    MEMORY_DIRECTION_UPLOAD,
+    // Written by the device and read by the host: cached memory, since host reads of write-combined
+    // memory are uncached and very slow
+    MEMORY_DIRECTION_READBACK,
+    // Written and read by the host; cached like readbacks
+    MEMORY_DIRECTION_BIDIRECTIONAL,
+} MemoryDirection;
+
+typedef struct {
+    VkDeviceSize size;
+    MemoryPlacement placement;
+    VkBuffer buffer;
+    Allocation allocation;
+    MemoryDirection direction;
+    // Host-visible copy of the contents; either `allocation` itself or the staging allocation. It stays
+    // mapped for the whole life of the memory block.
+    void *mapped;
+    // `mapped` needs no `flushPlacedBuffer` or `invalidatePlacedBuffer`
+    bool coherent;
+    VkBuffer stagingBuffer;
+    Allocation stagingAllocation;
+    // Caller memory the buffer stands for, NULL when the buffer only has memory of its own. When
+    // `imported`, the buffer is bound to it directly; otherwise `mapped` is a separate copy.
+    void *hostPointer;
+    bool imported;
+} PlacedBuffer;
+
+const char *memoryPlacementString(MemoryPlacement placement);
+const char *memoryDirectionString(MemoryDirection direction);
+bool parseMemoryPlacement(const char *string, MemoryPlacement *placement);
+
+// Returns the first memory type allowed by `memoryTypeBits` with all `requiredFlags`, preferring
+// ones that also have all `preferredFlags`, on a heap larger than `memorySize`; UINT32_MAX if none.
+uint32_t findMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties, uint32_t memoryTypeBits,
+        VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, VkDeviceSize memorySize);
+
+// Like `findMemoryTypeIndex`, but exits when nothing is found
+uint32_t chooseMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties, uint32_t memoryTypeBits,
+        VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, VkDeviceSize memorySize);
+
+// Resolves `MEMORY_PLACEMENT_AUTO` (and impossible requests) from the device type and the heaps it reports
+MemoryPlacement chooseMemoryPlacement(const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties, MemoryPlacement requested, VkDeviceSize size);
+
+// The buffer and its staging copy are sub-allocated from `allocator`; `direction` picks the memory
+// type of whichever of them is mapped
+void createPlacedBuffer(Allocator *allocator, const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        MemoryPlacement requested, MemoryDirection direction, VkDeviceSize size, uint32_t queueFamilyIndex,
+        PlacedBuffer *placedBuffer);
+void destroyPlacedBuffer(Allocator *allocator, PlacedBuffer *placedBuffer);
+
+// Alignment of host allocations that can be imported: at least a page, 0 when the device cannot import
+VkDeviceSize hostImportAlignment(const ComputeDevice *computeDevice);
+// Wraps `size` bytes of caller memory at `hostPointer`, which must outlive the buffer. The memory is
+// imported through VK_EXT_external_memory_host, so kernels access it in place, when the device
+// supports it and `hostPointer` and `size` are aligned to `hostImportAlignment`. Otherwise the buffer
+// is placed as `fallbackPlacement` and `direction` request, and `copyHostBufferIn` and `copyHostBufferOut`
+// move the contents between the caller memory and `mapped`.
+void createHostBuffer(ComputeDevice *computeDevice, MemoryPlacement fallbackPlacement, MemoryDirection direction,
+        void *hostPointer, VkDeviceSize size, PlacedBuffer *placedBuffer);
+// No-ops for imported buffers and buffers without caller memory
+void copyHostBufferIn(const PlacedBuffer *placedBuffer);
+void copyHostBufferOut(const PlacedBuffer *placedBuffer);
+
+// Non-coherent memory only: makes the host writes to the first `size` bytes of `mapped` available
+// to the device before a submission, or the device writes visible to the host after its fence.
+// Ranges are widened to whole `nonCoherentAtomSize` atoms.
+void flushPlacedBuffer(const Allocator *allocator, const PlacedBuffer *placedBuffer, VkDeviceSize size);
+void invalidatePlacedBuffer(const Allocator *allocator, const PlacedBuffer *placedBuffer, VkDeviceSize size);
+
+// Makes the host-written contents of `mapped` visible to compute shaders
+void recordPlacedBufferUpload(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer);
+// Makes compute shader writes visible to the host through `mapped`
+void recordPlacedBufferReadback(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer);
+// Same as above, limited to the first `size` bytes
+void recordPlacedBufferRangeUpload(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer, VkDeviceSize size);
+void recordPlacedBufferRangeReadback(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer, VkDeviceSize size);
+
+// Device-local buffers only. Uploads and readbacks split across a transfer queue and the compute
+// queue: each copy runs on the transfer queue and the buffer changes queue family ownership, released
+// by one queue and acquired by the other. Previous contents need not be kept, so the buffer is not
+// handed back before the next upload or dispatch overwrites it.
+void recordPlacedBufferTransferUpload(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer, VkDeviceSize size,
+        uint32_t transferQueueFamilyIndex, uint32_t computeQueueFamilyIndex);
+void recordPlacedBufferAcquireUpload(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer,
+        uint32_t transferQueueFamilyIndex, uint32_t computeQueueFamilyIndex);
+void recordPlacedBufferReleaseReadback(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer,
+        uint32_t computeQueueFamilyIndex, uint32_t transferQueueFamilyIndex);
+void recordPlacedBufferTransferReadback(VkCommandBuffer commandBuffer, const PlacedBuffer *placedBuffer, VkDeviceSize size,
+        uint32_t computeQueueFamilyIndex, uint32_t transferQueueFamilyIndex);
+
+void printPlacedBuffer(const char *name, const PlacedBuffer *placedBuffer,
+        const VkPhysicalDeviceMemoryProperties *physicalDeviceMemoryProperties);
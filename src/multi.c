@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "multi.h"
+#include "autotune.h"
+#include "kernel.h"
+#include "pipeline_cache.h"
+#include "shader.h"
+#include "stream.h"
+#include "util.h"
+#include "host_allocator.h"
+
+// Weight of the newest chunk in the throughput estimate
+#define MULTI_DEVICE_THROUGHPUT_SMOOTHING 0.5
+
+static void createMultiDeviceWorker(VkPhysicalDevice physicalDevice, MemoryPlacement memoryPlacement,
+        uint32_t workgroupSize, VkDeviceSize chunkSize, MultiDeviceWorker *worker) {
+    createComputeDevice(physicalDevice, &worker->computeDevice);
+
+    VkDevice device = worker->computeDevice.device;
+    const VkPhysicalDeviceProperties *properties = &worker->computeDevice.properties;
+
+    bool pipelineCacheWarm;
+    worker->pipelineCache = loadPipelineCache(device, properties, &pipelineCacheWarm);
+
+    uint32_t shaderSize;
+    uint32_t *shaderData;
+    shaderLoad(&shaderSize, &shaderData);
+
+    worker->shaderModule = createKernelShaderModule(device, shaderSize, shaderData);
+    worker->descriptorSetLayout = createKernelDescriptorSetLayout(device);
+    worker->pipelineLayout = createKernelPipelineLayout(device, worker->descriptorSetLayout);
+    worker->workgroupSize = chooseWorkgroupSize(properties, workgroupSize);
+    worker->pipeline = createComputePipeline(device, worker->pipelineCache, worker->shaderModule,
+            worker->pipelineLayout, worker->workgroupSize);
+    worker->chunkCapacity = chooseStreamChunkSize(properties, chunkSize);
+
+    createPlacedBuffer(&worker->computeDevice.allocator, properties, memoryPlacement, MEMORY_DIRECTION_UPLOAD,
+            worker->chunkCapacity, worker->computeDevice.queueFamilyIndex, &worker->input);
+    createPlacedBuffer(&worker->computeDevice.allocator, properties, memoryPlacement, MEMORY_DIRECTION_READBACK,
+            worker->chunkCapacity, worker->computeDevice.queueFamilyIndex, &worker->output);
+
+    VkDescriptorPoolSize descriptorPoolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 2,
+    };
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = 1,
+        .poolSizeCount = 1,
+        .pPoolSizes = &descriptorPoolSize,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, hostAllocationCallbacks(), &worker->descriptorPool));
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = worker->descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &worker->descriptorSetLayout,
+    };
+
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &worker->descriptorSet));
+    updateKernelDescriptorSet(device, worker->descriptorSet, worker->input.buffer, worker->output.buffer);
+
+    // Chunk sizes change with every claim, so the command buffer is re-recorded each time
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = worker->computeDevice.queueFamilyIndex,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, hostAllocationCallbacks(), &worker->commandPool));
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = worker->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &worker->commandBuffer));
+
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateFence(device, &fenceCreateInfo, hostAllocationCallbacks(), &worker->fence));
+}
+
+void createMultiDevice(VkPhysicalDevice *physicalDevices, const uint32_t *physicalDeviceIndices, uint32_t deviceCount,
+        MemoryPlacement memoryPlacement, uint32_t workgroupSize, VkDeviceSize chunkSize, MultiDevice *multiDevice) {
+    *multiDevice = (MultiDevice) {
+        .workerCount = deviceCount < MAX_SELECTED_DEVICES ? deviceCount : MAX_SELECTED_DEVICES,
+    };
+
+    pthread_mutex_init(&multiDevice->mutex, NULL);
+
+    for (uint32_t i = 0; i < multiDevice->workerCount; i += 1) {
+        MultiDeviceWorker *worker = &multiDevice->workers[i];
+
+        worker->multiDevice = multiDevice;
+        worker->physicalDeviceIndex = physicalDeviceIndices[i];
+        createMultiDeviceWorker(physicalDevices[physicalDeviceIndices[i]], memoryPlacement, workgroupSize, chunkSize, worker);
+    }
+}
+
+void destroyMultiDevice(MultiDevice *multiDevice) {
+    for (uint32_t i = 0; i < multiDevice->workerCount; i += 1) {
+        MultiDeviceWorker *worker = &multiDevice->workers[i];
+        VkDevice device = worker->computeDevice.device;
+
+        storePipelineCache(device, &worker->computeDevice.properties, worker->pipelineCache);
+
+        vkDestroyFence(device, worker->fence, hostAllocationCallbacks());
+        vkDestroyCommandPool(device, worker->commandPool, hostAllocationCallbacks());
+        vkDestroyDescriptorPool(device, worker->descriptorPool, hostAllocationCallbacks());
+        destroyPlacedBuffer(&worker->computeDevice.allocator, &worker->input);
+        destroyPlacedBuffer(&worker->computeDevice.allocator, &worker->output);
+        vkDestroyPipeline(device, worker->pipeline, hostAllocationCallbacks());
+        vkDestroyPipelineLayout(device, worker->pipelineLayout, hostAllocationCallbacks());
+        vkDestroyDescriptorSetLayout(device, worker->descriptorSetLayout, hostAllocationCallbacks());
+        vkDestroyShaderModule(device, worker->shaderModule, hostAllocationCallbacks());
+        vkDestroyPipelineCache(device, worker->pipelineCache, hostAllocationCallbacks());
+        destroyComputeDevice(&worker->computeDevice);
+    }
+
+    pthread_mutex_destroy(&multiDevice->mutex);
+}
+
+// Called with the mutex held
+static bool claimMultiDeviceChunk(MultiDevice *multiDevice, MultiDeviceWorker *worker, uint64_t *offset, VkDeviceSize *size) {
+    uint64_t remaining = multiDevice->size - multiDevice->nextOffset;
+
+    if (remaining == 0) {
+        return false;
+    }
+
+    uint64_t chunkSize = MULTI_DEVICE_CALIBRATION_SIZE;
+
+    if (worker->throughput > 0.0) {
+        double totalThroughput = 0.0;
+
+        for (uint32_t i = 0; i < multiDevice->workerCount; i += 1) {
+            totalThroughput += multiDevice->workers[i].throughput;
+        }
+
+        chunkSize = (uint64_t) ((double) remaining * worker->throughput / totalThroughput / 2.0);
+    }
+
+    if (chunkSize < MULTI_DEVICE_MIN_CHUNK_SIZE) {
+        chunkSize = MULTI_DEVICE_MIN_CHUNK_SIZE;
+    }
+
+    if (chunkSize > worker->chunkCapacity) {
+        chunkSize = worker->chunkCapacity;
+    }
+
+    chunkSize -= chunkSize % sizeof(int32_t);
+
+    if (chunkSize > remaining) {
+        chunkSize = remaining;
+    }
+
+    *offset = multiDevice->nextOffset;
+    *size = chunkSize;
+    multiDevice->nextOffset += chunkSize;
+
+    return true;
+}
+
+static void *runMultiDeviceWorker(void *userData) {
+    MultiDeviceWorker *worker = (MultiDeviceWorker*) userData;
+    MultiDevice *multiDevice = worker->multiDevice;
+    VkDevice device = worker->computeDevice.device;
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &worker->commandBuffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL,
+    };
+
+    while (true) {
+        uint64_t offset;
+        VkDeviceSize size;
+
+        pthread_mutex_lock(&multiDevice->mutex);
+        bool claimed = claimMultiDeviceChunk(multiDevice, worker, &offset, &size);
+        pthread_mutex_unlock(&multiDevice->mutex);
+
+        if (!claimed) {
+            return NULL;
+        }
+
+        double startTime = timeNowSeconds();
+
+        memcpy(worker->input.mapped, multiDevice->input + offset, size);
+        flushPlacedBuffer(&worker->computeDevice.allocator, &worker->input, size);
+
+        BAIL_ON_BAD_RESULT(vkResetCommandBuffer(worker->commandBuffer, 0));
+        beginCommandBuffer(worker->commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        recordPlacedBufferRangeUpload(worker->commandBuffer, &worker->input, size);
+        KernelParameters parameters = contiguousKernelParameters((uint32_t) (size / sizeof(int32_t)));
+        recordDispatch(worker->commandBuffer, worker->pipeline, worker->pipelineLayout, &worker->descriptorSet, &parameters,
+                dispatchGrid(&worker->computeDevice.properties.limits, parameters.elementCount, worker->workgroupSize));
+        recordPlacedBufferRangeReadback(worker->commandBuffer, &worker->output, size);
+        BAIL_ON_BAD_RESULT(vkEndCommandBuffer(worker->commandBuffer));
+
+        BAIL_ON_BAD_RESULT(vkQueueSubmit(worker->computeDevice.queue, 1, &submitInfo, worker->fence));
+        BAIL_ON_BAD_RESULT(vkWaitForFences(device, 1, &worker->fence, VK_TRUE, UINT64_MAX));
+        BAIL_ON_BAD_RESULT(vkResetFences(device, 1, &worker->fence));
+
+        invalidatePlacedBuffer(&worker->computeDevice.allocator, &worker->output, size);
+        memcpy(multiDevice->output + offset, worker->output.mapped, size);
+
+        double seconds = timeNowSeconds() - startTime;
+        double throughput = seconds > 0.0 ? (double) size / seconds : 0.0;
+
+        pthread_mutex_lock(&multiDevice->mutex);
+        worker->throughput = worker->throughput > 0.0
+            ? MULTI_DEVICE_THROUGHPUT_SMOOTHING * throughput + (1.0 - MULTI_DEVICE_THROUGHPUT_SMOOTHING) * worker->throughput
+            : throughput;
+        worker->bytes += size;
+        worker->chunks += 1;
+        worker->busySeconds += seconds;
+        pthread_mutex_unlock(&multiDevice->mutex);
+    }
+}
+
+void runMultiDevice(MultiDevice *multiDevice, const void *input, void *output, uint64_t size) {
+    multiDevice->input = (const uint8_t*) input;
+    multiDevice->output = (uint8_t*) output;
+    multiDevice->size = size - size % sizeof(int32_t);
+    multiDevice->nextOffset = 0;
+
+    for (uint32_t i = 0; i < multiDevice->workerCount; i += 1) {
+        MultiDeviceWorker *worker = &multiDevice->workers[i];
+
+        worker->bytes = 0;
+        worker->chunks = 0;
+        worker->busySeconds = 0.0;
+    }
+
+    double startTime = timeNowSeconds();
+
+    for (uint32_t i = 0; i < multiDevice->workerCount; i += 1) {
+        if (pthread_create(&multiDevice->workers[i].thread, NULL, runMultiDeviceWorker, &multiDevice->workers[i]) != 0) {
+            fprintf(stderr, "Could not start the thread for device %" PRIu32 ".\n", multiDevice->workers[i].physicalDeviceIndex);
+            exit(1);
+        }
+    }
+
+    for (uint32_t i = 0; i < multiDevice->workerCount; i += 1) {
+        pthread_join(multiDevice->workers[i].thread, NULL);
+    }
+
+    multiDevice->totalSeconds = timeNowSeconds() - startTime;
+}
+
+void printMultiDeviceStatistics(const MultiDevice *multiDevice) {
+    printf("multiDevice { devices: %" PRIu32 ", bytes: %" PRIu64 ", total: %.3f ms, throughput: %.2f GB/s }\n",
+            multiDevice->workerCount, multiDevice->size, multiDevice->totalSeconds * 1e3,
+            multiDevice->totalSeconds > 0.0 ? (double) multiDevice->size / multiDevice->totalSeconds * 1e-9 : 0.0);
+
+    for (uint32_t i = 0; i < multiDevice->workerCount; i += 1) {
+        const MultiDeviceWorker *worker = &multiDevice->workers[i];
+
+        printf("\tdevice { index: %" PRIu32 ", name: %s, workgroupSize: %" PRIu32 ", memory: %s, chunks: %" PRIu64
+               ", bytes: %" PRIu64 ", share: %.1f%%, busy: %.3f ms, throughput: %.2f GB/s }\n",
+                worker->physicalDeviceIndex, worker->computeDevice.properties.deviceName, worker->workgroupSize,
+                memoryPlacementString(worker->input.placement), worker->chunks, worker->bytes,
+                multiDevice->size > 0 ? 100.0 * (double) worker->bytes / (double) multiDevice->size : 0.0,
+                worker->busySeconds * 1e3, worker->throughput * 1e-9);
+    }
+}
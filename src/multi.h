@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "memory.h"
+
+#define MULTI_DEVICE_DEFAULT_SIZE (64u << 20)
+// First chunk of every device, used to measure its throughput
+#define MULTI_DEVICE_CALIBRATION_SIZE (1u << 20)
+#define MULTI_DEVICE_MIN_CHUNK_SIZE (256u << 10)
+
+struct MultiDevice;
+
+// One device with its own queue, pipeline and buffers, driven by its own thread
+typedef struct {
+    struct MultiDevice *multiDevice;
+    uint32_t physicalDeviceIndex;
+    ComputeDevice computeDevice;
+    VkPipelineCache pipelineCache;
+    VkShaderModule shaderModule;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    PlacedBuffer input;
+    PlacedBuffer output;
+    uint32_t workgroupSize;
+    VkDeviceSize chunkCapacity;
+    // Bytes per second including the host copies, an exponential moving average over chunks; 0 until measured
+    double throughput;
+    uint64_t bytes;
+    uint64_t chunks;
+    double busySeconds;
+    pthread_t thread;
+} MultiDeviceWorker;
+
+typedef struct MultiDevice {
+    uint32_t workerCount;
+    MultiDeviceWorker workers[MAX_SELECTED_DEVICES];
+    pthread_mutex_t mutex;
+    const uint8_t *input;
+    uint8_t *output;
+    uint64_t size;
+    uint64_t nextOffset; // start of the part no device has claimed yet
+    double totalSeconds;
+} MultiDevice;
+
+// `workgroupSize` 0 picks the tuned size per device; `chunkSize` bounds the per-device buffers
+void createMultiDevice(VkPhysicalDevice *physicalDevices, const uint32_t *physicalDeviceIndices, uint32_t deviceCount,
+        MemoryPlacement memoryPlacement, uint32_t workgroupSize, VkDeviceSize chunkSize, MultiDevice *multiDevice);
+void destroyMultiDevice(MultiDevice *multiDevice);
+
+// Runs the kernel over `size` bytes of `input` on all devices at once and merges the results into `output`.
+// Every device claims chunks from the unclaimed remainder in proportion to its share of the measured
+// throughput, halved so the tail is spread out and no device is left with a long last chunk.
+void runMultiDevice(MultiDevice *multiDevice, const void *input, void *output, uint64_t size);
+
+void printMultiDeviceStatistics(const MultiDevice *multiDevice);
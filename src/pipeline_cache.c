@@ -0,0 +1,148 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "pipeline_cache.h"
+#include "util.h"
+#include "host_allocator.h"
+
+#define PIPELINE_CACHE_MAGIC "VKCPIPE1"
+#define PIPELINE_CACHE_HEADER_SIZE 32 // VkPipelineCacheHeaderVersionOne
+
+// Our own framing around the driver's blob, so truncated or damaged files are caught
+// before the driver sees them; not every driver validates the data it is given.
+typedef struct {
+    char magic[8];
+    uint64_t dataSize;
+    uint64_t checksum;
+} PipelineCacheFileHeader;
+
+static uint64_t fnv1a(const uint8_t *data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (size_t i = 0; i < size; i += 1) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// The pipeline cache header is defined as a little-endian byte stream
+static uint32_t readLittleEndian32(const uint8_t *bytes) {
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static void pipelineCacheFileName(char *fileName, size_t fileNameSize, const VkPhysicalDeviceProperties *physicalDeviceProperties) {
+    int length = snprintf(fileName, fileNameSize, "pipeline-cache-%08" PRIx32 "-%08" PRIx32 "-",
+            physicalDeviceProperties->vendorID, physicalDeviceProperties->deviceID);
+
+    for (uint32_t i = 0; i < VK_UUID_SIZE && length >= 0 && (size_t) length < fileNameSize; i += 1) {
+        length += snprintf(fileName + length, fileNameSize - length, "%02x", physicalDeviceProperties->pipelineCacheUUID[i]);
+    }
+}
+
+static bool isPipelineCacheCompatible(const uint8_t *data, size_t size, const VkPhysicalDeviceProperties *physicalDeviceProperties) {
+    if (size < PIPELINE_CACHE_HEADER_SIZE) {
+        return false;
+    }
+
+    uint32_t headerSize = readLittleEndian32(data);
+    uint32_t headerVersion = readLittleEndian32(data + 4);
+    uint32_t vendorID = readLittleEndian32(data + 8);
+    uint32_t deviceID = readLittleEndian32(data + 12);
+
+    return headerSize >= PIPELINE_CACHE_HEADER_SIZE
+        && headerSize <= size
+        && headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && vendorID == physicalDeviceProperties->vendorID
+        && deviceID == physicalDeviceProperties->deviceID
+        && memcmp(data + 16, physicalDeviceProperties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+static VkResult createPipelineCache(VkDevice device, const void *data, size_t size, VkPipelineCache *pipelineCache) {
+    const VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .initialDataSize = size,
+        .pInitialData = data,
+    };
+
+    return vkCreatePipelineCache(device, &pipelineCacheCreateInfo, hostAllocationCallbacks(), pipelineCache);
+}
+
+VkPipelineCache loadPipelineCache(VkDevice device, const VkPhysicalDeviceProperties *physicalDeviceProperties, bool *warm) {
+    char fileName[128];
+    pipelineCacheFileName(fileName, sizeof(fileName), physicalDeviceProperties);
+
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    size_t fileSize;
+    uint8_t *file = (uint8_t*) cacheRead(fileName, &fileSize);
+
+    *warm = false;
+
+    if (file != NULL) {
+        PipelineCacheFileHeader header;
+        const uint8_t *data = file + sizeof(header);
+
+        if (fileSize >= sizeof(header)) {
+            memcpy(&header, file, sizeof(header));
+        }
+
+        if (fileSize < sizeof(header)
+                || memcmp(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic)) != 0
+                || header.dataSize != fileSize - sizeof(header)
+                || header.checksum != fnv1a(data, header.dataSize)) {
+            fprintf(stderr, "Discarding the corrupt pipeline cache `%s`.\n", fileName);
+        } else if (!isPipelineCacheCompatible(data, header.dataSize, physicalDeviceProperties)) {
+            fprintf(stderr, "Discarding the stale pipeline cache `%s`.\n", fileName);
+        } else if (createPipelineCache(device, data, header.dataSize, &pipelineCache) == VK_SUCCESS) {
+            *warm = true;
+        } else {
+            fprintf(stderr, "The driver rejected the pipeline cache `%s`, discarding it.\n", fileName);
+            pipelineCache = VK_NULL_HANDLE;
+        }
+
+        free(file);
+    }
+
+    if (pipelineCache == VK_NULL_HANDLE) {
+        BAIL_ON_BAD_RESULT(createPipelineCache(device, NULL, 0, &pipelineCache));
+    }
+
+    return pipelineCache;
+}
+
+void storePipelineCache(VkDevice device, const VkPhysicalDeviceProperties *physicalDeviceProperties, VkPipelineCache pipelineCache) {
+    size_t dataSize;
+    BAIL_ON_BAD_RESULT(vkGetPipelineCacheData(device, pipelineCache, &dataSize, NULL));
+
+    uint8_t *file = (uint8_t*) malloc(sizeof(PipelineCacheFileHeader) + dataSize);
+
+    if (file == NULL) {
+        fprintf(stderr, "Could not allocate memory for the pipeline cache.\n");
+        return;
+    }
+
+    uint8_t *data = file + sizeof(PipelineCacheFileHeader);
+    BAIL_ON_BAD_RESULT(vkGetPipelineCacheData(device, pipelineCache, &dataSize, data));
+
+    PipelineCacheFileHeader header = {
+        .magic = PIPELINE_CACHE_MAGIC,
+        .dataSize = dataSize,
+        .checksum = fnv1a(data, dataSize),
+    };
+
+    memcpy(file, &header, sizeof(header));
+
+    char fileName[128];
+    pipelineCacheFileName(fileName, sizeof(fileName), physicalDeviceProperties);
+
+    if (!cacheWrite(fileName, file, sizeof(header) + dataSize)) {
+        fprintf(stderr, "Could not store the pipeline cache `%s`.\n", fileName);
+    }
+
+    free(file);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+#include <vulkan/vulkan.h>
+
+// Creates a pipeline cache seeded from disk when a cache written for this exact device and driver
+// (header vendorID/deviceID/pipelineCacheUUID) exists and is intact; otherwise creates an empty one.
+VkPipelineCache loadPipelineCache(VkDevice device, const VkPhysicalDeviceProperties *physicalDeviceProperties, bool *warm);
+
+// Writes the cache contents back to disk atomically
+void storePipelineCache(VkDevice device, const VkPhysicalDeviceProperties *physicalDeviceProperties, VkPipelineCache pipelineCache);
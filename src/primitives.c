@@ -0,0 +1,739 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "primitives.h"
+#include "cpu.h"
+#include "kernel.h"
+#include "shader.h"
+#include "util.h"
+#include "host_allocator.h"
+
+// Selected as `primitive_<name>`, see the variants in src/shader.c
+static const char *const primitiveKernelNames[PRIMITIVE_KERNEL_COUNT] = {
+    "reduce",
+    "scan",
+    "scan_add",
+    "compact",
+    "radix_histogram",
+    "radix_scatter",
+    "dispatch_args",
+};
+
+// The levels of a multi-pass scan. Level 0 scans the elements, every further level scans the block
+// sums of the previous one in place, until a single workgroup covers them.
+typedef struct {
+    uint32_t levelCount;
+    uint32_t elementCounts[PRIMITIVE_MAX_SCAN_LEVELS];
+    VkDescriptorSet descriptorSets[PRIMITIVE_MAX_SCAN_LEVELS];
+    // The block sums of the last level; its only element is the total
+    PlacedBuffer *total;
+} ScanPlan;
+
+bool subgroupPrimitivesSupported(const ComputeDevice *computeDevice) {
+    return (shaderDeviceFeatures(computeDevice) & SHADER_FEATURE_SUBGROUP_ARITHMETIC) != 0;
+}
+
+void createPrimitives(ComputeDevice *computeDevice, VkPipelineCache pipelineCache, bool allowSubgroups,
+        Primitives *primitives) {
+    VkDevice device = computeDevice->device;
+    uint32_t features = shaderDeviceFeatures(computeDevice);
+
+    if (!allowSubgroups) {
+        features &= ~(uint32_t) SHADER_FEATURE_SUBGROUP_ARITHMETIC;
+    }
+
+    primitives->computeDevice = computeDevice;
+    // Every kernel has the same variants, so they all agree on this
+    primitives->subgroups = (features & SHADER_FEATURE_SUBGROUP_ARITHMETIC) != 0;
+    primitives->descriptorSetLayout = createStorageDescriptorSetLayout(device, PRIMITIVE_BINDING_COUNT);
+    primitives->pipelineLayout = createPipelineLayout(device, primitives->descriptorSetLayout, sizeof(PrimitiveParameters));
+    primitives->scratchBufferCount = 0;
+
+    for (uint32_t kernel = 0; kernel < PRIMITIVE_KERNEL_COUNT; kernel += 1) {
+        char name[64];
+        snprintf(name, sizeof(name), "primitive_%s", primitiveKernelNames[kernel]);
+
+        ShaderVariant variant;
+
+        if (!shaderSelectVariant(name, features, PRIMITIVE_WORKGROUP_SIZE, &variant)) {
+            fprintf(stderr, "No variant of the `%s` shader runs on the device.\n", name);
+            exit(1);
+        }
+
+        primitives->shaderModules[kernel] = createKernelShaderModule(device, variant.size, (uint32_t*) variant.data);
+        // The workgroup size is fixed in the shaders, so the specialization constant goes unused
+        primitives->pipelines[kernel] = createComputePipeline(device, pipelineCache, primitives->shaderModules[kernel],
+                primitives->pipelineLayout, PRIMITIVE_WORKGROUP_SIZE);
+    }
+
+    VkDescriptorPoolSize descriptorPoolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = PRIMITIVE_MAX_DESCRIPTOR_SETS * PRIMITIVE_BINDING_COUNT,
+    };
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = PRIMITIVE_MAX_DESCRIPTOR_SETS,
+        .poolSizeCount = 1,
+        .pPoolSizes = &descriptorPoolSize,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, hostAllocationCallbacks(), &primitives->descriptorPool));
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = computeDevice->queueFamilyIndex,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, hostAllocationCallbacks(), &primitives->commandPool));
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = primitives->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &primitives->commandBuffer));
+
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateFence(device, &fenceCreateInfo, hostAllocationCallbacks(), &primitives->fence));
+}
+
+void destroyPrimitives(Primitives *primitives) {
+    VkDevice device = primitives->computeDevice->device;
+
+    vkDestroyFence(device, primitives->fence, hostAllocationCallbacks());
+    vkDestroyCommandPool(device, primitives->commandPool, hostAllocationCallbacks());
+    vkDestroyDescriptorPool(device, primitives->descriptorPool, hostAllocationCallbacks());
+
+    for (uint32_t kernel = 0; kernel < PRIMITIVE_KERNEL_COUNT; kernel += 1) {
+        vkDestroyPipeline(device, primitives->pipelines[kernel], hostAllocationCallbacks());
+        vkDestroyShaderModule(device, primitives->shaderModules[kernel], hostAllocationCallbacks());
+    }
+
+    vkDestroyPipelineLayout(device, primitives->pipelineLayout, hostAllocationCallbacks());
+    vkDestroyDescriptorSetLayout(device, primitives->descriptorSetLayout, hostAllocationCallbacks());
+}
+
+static PlacedBuffer *createScratchBuffer(Primitives *primitives, MemoryDirection direction, VkDeviceSize size) {
+    if (primitives->scratchBufferCount == PRIMITIVE_MAX_SCRATCH_BUFFERS) {
+        fprintf(stderr, "A primitive needs more than %u buffers.\n", PRIMITIVE_MAX_SCRATCH_BUFFERS);
+        exit(1);
+    }
+
+    ComputeDevice *computeDevice = primitives->computeDevice;
+    PlacedBuffer *placedBuffer = &primitives->scratchBuffers[primitives->scratchBufferCount++];
+
+    createPlacedBuffer(&computeDevice->allocator, &computeDevice->properties, MEMORY_PLACEMENT_AUTO, direction, size,
+            computeDevice->queueFamilyIndex, placedBuffer);
+
+    return placedBuffer;
+}
+
+static void releaseScratchBuffers(Primitives *primitives) {
+    for (uint32_t i = 0; i < primitives->scratchBufferCount; i += 1) {
+        destroyPlacedBuffer(&primitives->computeDevice->allocator, &primitives->scratchBuffers[i]);
+    }
+
+    primitives->scratchBufferCount = 0;
+}
+
+// Kernels that use fewer bindings still get all of them, pointed at buffers they ignore
+static VkDescriptorSet allocatePrimitiveDescriptorSet(Primitives *primitives, VkBuffer binding0, VkBuffer binding1,
+        VkBuffer binding2) {
+    VkDevice device = primitives->computeDevice->device;
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = NULL,
+        .descriptorPool = primitives->descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &primitives->descriptorSetLayout,
+    };
+
+    VkDescriptorSet descriptorSet;
+    BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &descriptorSet));
+
+    VkBuffer buffers[PRIMITIVE_BINDING_COUNT] = { binding0, binding1, binding2 };
+    updateStorageDescriptorSet(device, descriptorSet, buffers, PRIMITIVE_BINDING_COUNT);
+
+    return descriptorSet;
+}
+
+static void beginPrimitive(Primitives *primitives) {
+    BAIL_ON_BAD_RESULT(vkResetDescriptorPool(primitives->computeDevice->device, primitives->descriptorPool, 0));
+    beginCommandBuffer(primitives->commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+}
+
+static void submitPrimitive(Primitives *primitives) {
+    VkDevice device = primitives->computeDevice->device;
+
+    BAIL_ON_BAD_RESULT(vkEndCommandBuffer(primitives->commandBuffer));
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = NULL,
+        .pWaitDstStageMask = NULL,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &primitives->commandBuffer,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = NULL,
+    };
+
+    BAIL_ON_BAD_RESULT(vkQueueSubmit(primitives->computeDevice->queue, 1, &submitInfo, primitives->fence));
+    BAIL_ON_BAD_RESULT(vkWaitForFences(device, 1, &primitives->fence, VK_TRUE, UINT64_MAX));
+    BAIL_ON_BAD_RESULT(vkResetFences(device, 1, &primitives->fence));
+}
+
+static void bindPrimitive(Primitives *primitives, PrimitiveKernel kernel, VkDescriptorSet descriptorSet,
+        const PrimitiveParameters *parameters) {
+    VkCommandBuffer commandBuffer = primitives->commandBuffer;
+    PrimitiveParameters pushed = *parameters;
+    pushed.maxGroupCountX = primitives->computeDevice->properties.limits.maxComputeWorkGroupCount[0];
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, primitives->pipelines[kernel]);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, primitives->pipelineLayout, 0, 1,
+            &descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, primitives->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+            sizeof(PrimitiveParameters), &pushed);
+}
+
+// Dispatches `parameters->groupCount` workgroups and makes their writes visible to the next pass
+static void recordPrimitive(Primitives *primitives, PrimitiveKernel kernel, VkDescriptorSet descriptorSet,
+        const PrimitiveParameters *parameters) {
+    DispatchGrid grid = dispatchGrid(&primitives->computeDevice->properties.limits, parameters->groupCount, 1);
+
+    bindPrimitive(primitives, kernel, descriptorSet, parameters);
+    vkCmdDispatch(primitives->commandBuffer, grid.x, grid.y, grid.z);
+    recordComputeBarrier(primitives->commandBuffer);
+}
+
+// Same, with the grid read from the arguments record at `offset` when the dispatch executes
+static void recordPrimitiveIndirect(Primitives *primitives, PrimitiveKernel kernel, VkDescriptorSet descriptorSet,
+        const PrimitiveParameters *parameters, const PlacedBuffer *arguments, VkDeviceSize offset) {
+    bindPrimitive(primitives, kernel, descriptorSet, parameters);
+    vkCmdDispatchIndirect(primitives->commandBuffer, arguments->buffer, offset);
+    recordComputeBarrier(primitives->commandBuffer);
+}
+
+static void prepareScan(Primitives *primitives, VkBuffer input, VkBuffer output, uint32_t count, ScanPlan *plan) {
+    plan->levelCount = 0;
+
+    while (true) {
+        uint32_t groupCount = workgroupCount(count, PRIMITIVE_WORKGROUP_SIZE);
+        // The last level is the total, which compaction reads back
+        PlacedBuffer *blockSums = createScratchBuffer(primitives, groupCount == 1 ? MEMORY_DIRECTION_READBACK : MEMORY_DIRECTION_UPLOAD,
+                sizeof(uint32_t) * (VkDeviceSize) groupCount);
+
+        plan->elementCounts[plan->levelCount] = count;
+        plan->descriptorSets[plan->levelCount] = allocatePrimitiveDescriptorSet(primitives, input, output, blockSums->buffer);
+        plan->levelCount += 1;
+        plan->total = blockSums;
+
+        if (groupCount == 1) {
+            return;
+        }
+
+        input = blockSums->buffer;
+        output = blockSums->buffer;
+        count = groupCount;
+    }
+}
+
+// `flags` apply to level 0; the block sums are always scanned exclusively
+static void recordScan(Primitives *primitives, const ScanPlan *plan, uint32_t flags) {
+    for (uint32_t level = 0; level < plan->levelCount; level += 1) {
+        PrimitiveParameters parameters = {
+            .elementCount = plan->elementCounts[level],
+            .groupCount = workgroupCount(plan->elementCounts[level], PRIMITIVE_WORKGROUP_SIZE),
+            .operation = 0,
+            .flags = level == 0 ? flags : PRIMITIVE_FLAG_EXCLUSIVE,
+            .shift = 0,
+        };
+
+        recordPrimitive(primitives, PRIMITIVE_KERNEL_SCAN, plan->descriptorSets[level], &parameters);
+    }
+
+    // Top-down, so the block sums of a level are final before they are added to it
+    for (uint32_t level = plan->levelCount - 1; level > 0; level -= 1) {
+        PrimitiveParameters parameters = {
+            .elementCount = plan->elementCounts[level - 1],
+            .groupCount = workgroupCount(plan->elementCounts[level - 1], PRIMITIVE_WORKGROUP_SIZE),
+            .operation = 0,
+            .flags = 0,
+            .shift = 0,
+        };
+
+        recordPrimitive(primitives, PRIMITIVE_KERNEL_SCAN_ADD, plan->descriptorSets[level - 1], &parameters);
+    }
+}
+
+static int32_t reduceIdentity(ReduceOperation operation) {
+    switch (operation) {
+        case REDUCE_MIN: return INT32_MAX;
+        case REDUCE_MAX: return INT32_MIN;
+        default: return 0;
+    }
+}
+
+int32_t runReduce(Primitives *primitives, ReduceOperation operation, const int32_t *input, uint32_t count) {
+    if (count == 0) {
+        return reduceIdentity(operation);
+    }
+
+    beginPrimitive(primitives);
+
+    PlacedBuffer *current = createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD, sizeof(int32_t) * (VkDeviceSize) count);
+    memcpy(current->mapped, input, sizeof(int32_t) * (size_t) count);
+    flushPlacedBuffer(&primitives->computeDevice->allocator, current, sizeof(int32_t) * (VkDeviceSize) count);
+    recordPlacedBufferUpload(primitives->commandBuffer, current);
+
+    // Every pass leaves one partial result per workgroup
+    do {
+        uint32_t groupCount = workgroupCount(count, PRIMITIVE_WORKGROUP_SIZE);
+        PlacedBuffer *partials = createScratchBuffer(primitives, groupCount == 1 ? MEMORY_DIRECTION_READBACK : MEMORY_DIRECTION_UPLOAD,
+                sizeof(int32_t) * (VkDeviceSize) groupCount);
+        PrimitiveParameters parameters = {
+            .elementCount = count,
+            .groupCount = groupCount,
+            .operation = operation,
+            .flags = 0,
+            .shift = 0,
+        };
+
+        recordPrimitive(primitives, PRIMITIVE_KERNEL_REDUCE,
+                allocatePrimitiveDescriptorSet(primitives, current->buffer, partials->buffer, partials->buffer), &parameters);
+        current = partials;
+        count = groupCount;
+    } while (count > 1);
+
+    recordPlacedBufferRangeReadback(primitives->commandBuffer, current, sizeof(int32_t));
+    submitPrimitive(primitives);
+
+    invalidatePlacedBuffer(&primitives->computeDevice->allocator, current, sizeof(int32_t));
+    int32_t result = *(const int32_t*) current->mapped;
+    releaseScratchBuffers(primitives);
+
+    return result;
+}
+
+void runScan(Primitives *primitives, bool inclusive, const uint32_t *input, uint32_t *output, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    beginPrimitive(primitives);
+
+    VkDeviceSize size = sizeof(uint32_t) * (VkDeviceSize) count;
+    PlacedBuffer *inputBuffer = createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD, size);
+    PlacedBuffer *outputBuffer = createScratchBuffer(primitives, MEMORY_DIRECTION_READBACK, size);
+    memcpy(inputBuffer->mapped, input, size);
+    flushPlacedBuffer(&primitives->computeDevice->allocator, inputBuffer, size);
+    recordPlacedBufferUpload(primitives->commandBuffer, inputBuffer);
+
+    ScanPlan plan;
+    prepareScan(primitives, inputBuffer->buffer, outputBuffer->buffer, count, &plan);
+    recordScan(primitives, &plan, inclusive ? 0 : PRIMITIVE_FLAG_EXCLUSIVE);
+
+    recordPlacedBufferReadback(primitives->commandBuffer, outputBuffer);
+    submitPrimitive(primitives);
+
+    invalidatePlacedBuffer(&primitives->computeDevice->allocator, outputBuffer, size);
+    memcpy(output, outputBuffer->mapped, size);
+    releaseScratchBuffers(primitives);
+}
+
+uint32_t runCompact(Primitives *primitives, const int32_t *input, int32_t *output, uint32_t count) {
+    if (count == 0) {
+        return 0;
+    }
+
+    beginPrimitive(primitives);
+
+    VkDeviceSize size = sizeof(int32_t) * (VkDeviceSize) count;
+    PlacedBuffer *inputBuffer = createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD, size);
+    PlacedBuffer *positionBuffer = createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD, size);
+    PlacedBuffer *outputBuffer = createScratchBuffer(primitives, MEMORY_DIRECTION_READBACK, size);
+    memcpy(inputBuffer->mapped, input, size);
+    flushPlacedBuffer(&primitives->computeDevice->allocator, inputBuffer, size);
+    recordPlacedBufferUpload(primitives->commandBuffer, inputBuffer);
+
+    // The exclusive scan of the non-zero flags is the output position of each kept element
+    ScanPlan plan;
+    prepareScan(primitives, inputBuffer->buffer, positionBuffer->buffer, count, &plan);
+    recordScan(primitives, &plan, PRIMITIVE_FLAG_EXCLUSIVE | PRIMITIVE_FLAG_PREDICATE);
+
+    PrimitiveParameters parameters = {
+        .elementCount = count,
+        .groupCount = workgroupCount(count, PRIMITIVE_WORKGROUP_SIZE),
+        .operation = 0,
+        .flags = 0,
+        .shift = 0,
+    };
+
+    recordPrimitive(primitives, PRIMITIVE_KERNEL_COMPACT, allocatePrimitiveDescriptorSet(primitives,
+                inputBuffer->buffer, positionBuffer->buffer, outputBuffer->buffer), &parameters);
+
+    recordPlacedBufferReadback(primitives->commandBuffer, outputBuffer);
+    recordPlacedBufferRangeReadback(primitives->commandBuffer, plan.total, sizeof(uint32_t));
+    submitPrimitive(primitives);
+
+    invalidatePlacedBuffer(&primitives->computeDevice->allocator, plan.total, sizeof(uint32_t));
+    uint32_t keptCount = *(const uint32_t*) plan.total->mapped;
+    invalidatePlacedBuffer(&primitives->computeDevice->allocator, outputBuffer, sizeof(int32_t) * (VkDeviceSize) keptCount);
+    memcpy(output, outputBuffer->mapped, sizeof(int32_t) * (size_t) keptCount);
+    releaseScratchBuffers(primitives);
+
+    return keptCount;
+}
+
+int32_t runCompactReduce(Primitives *primitives, ReduceOperation operation, const int32_t *input, uint32_t count,
+        uint32_t *keptCount) {
+    if (count == 0) {
+        *keptCount = 0;
+        return reduceIdentity(operation);
+    }
+
+    beginPrimitive(primitives);
+
+    VkDeviceSize size = sizeof(int32_t) * (VkDeviceSize) count;
+    PlacedBuffer *inputBuffer = createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD, size);
+    PlacedBuffer *positionBuffer = createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD, size);
+    PlacedBuffer *keptBuffer = createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD, size);
+    memcpy(inputBuffer->mapped, input, size);
+    flushPlacedBuffer(&primitives->computeDevice->allocator, inputBuffer, size);
+    recordPlacedBufferUpload(primitives->commandBuffer, inputBuffer);
+
+    ScanPlan plan;
+    prepareScan(primitives, inputBuffer->buffer, positionBuffer->buffer, count, &plan);
+    recordScan(primitives, &plan, PRIMITIVE_FLAG_EXCLUSIVE | PRIMITIVE_FLAG_PREDICATE);
+
+    PrimitiveParameters compactParameters = {
+        .elementCount = count,
+        .groupCount = workgroupCount(count, PRIMITIVE_WORKGROUP_SIZE),
+        .operation = 0,
+        .flags = 0,
+        .shift = 0,
+    };
+
+    recordPrimitive(primitives, PRIMITIVE_KERNEL_COMPACT, allocatePrimitiveDescriptorSet(primitives,
+                inputBuffer->buffer, positionBuffer->buffer, keptBuffer->buffer), &compactParameters);
+
+    // The passes and their partial results are sized for all `count` elements surviving; the
+    // device dispatches only what the kept ones need
+    PlacedBuffer *partials[PRIMITIVE_MAX_SCAN_LEVELS];
+    uint32_t passCount = 0;
+
+    for (uint32_t elementCount = count; passCount == 0 || elementCount > 1; passCount += 1) {
+        elementCount = workgroupCount(elementCount, PRIMITIVE_WORKGROUP_SIZE);
+        partials[passCount] = createScratchBuffer(primitives, MEMORY_DIRECTION_READBACK, sizeof(int32_t) * (VkDeviceSize) elementCount);
+    }
+
+    PlacedBuffer *arguments = createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD,
+            sizeof(PrimitiveIndirectArguments) * (VkDeviceSize) passCount);
+    PrimitiveParameters argumentParameters = {
+        .elementCount = passCount,
+        .groupCount = 1,
+        .operation = 0,
+        .flags = 0,
+        .shift = 0,
+    };
+
+    recordPrimitive(primitives, PRIMITIVE_KERNEL_DISPATCH_ARGS, allocatePrimitiveDescriptorSet(primitives,
+                plan.total->buffer, arguments->buffer, arguments->buffer), &argumentParameters);
+    recordIndirectBarrier(primitives->commandBuffer);
+
+    PlacedBuffer *current = keptBuffer;
+
+    for (uint32_t pass = 0; pass < passCount; pass += 1) {
+        PrimitiveParameters parameters = {
+            .elementCount = 0,
+            .groupCount = 0,
+            .operation = operation,
+            .flags = PRIMITIVE_FLAG_INDIRECT,
+            .shift = pass,
+        };
+
+        recordPrimitiveIndirect(primitives, PRIMITIVE_KERNEL_REDUCE, allocatePrimitiveDescriptorSet(primitives,
+                    current->buffer, partials[pass]->buffer, arguments->buffer), &parameters,
+                arguments, sizeof(PrimitiveIndirectArguments) * (VkDeviceSize) pass);
+        current = partials[pass];
+    }
+
+    recordPlacedBufferRangeReadback(primitives->commandBuffer, current, sizeof(int32_t));
+    recordPlacedBufferRangeReadback(primitives->commandBuffer, plan.total, sizeof(uint32_t));
+    submitPrimitive(primitives);
+
+    invalidatePlacedBuffer(&primitives->computeDevice->allocator, current, sizeof(int32_t));
+    invalidatePlacedBuffer(&primitives->computeDevice->allocator, plan.total, sizeof(uint32_t));
+    int32_t result = *(const int32_t*) current->mapped;
+    *keptCount = *(const uint32_t*) plan.total->mapped;
+    releaseScratchBuffers(primitives);
+
+    return result;
+}
+
+void runRadixSort(Primitives *primitives, uint32_t *keys, uint32_t *values, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    beginPrimitive(primitives);
+
+    // Keys and values are interleaved, so a pass needs no more than the three bindings
+    uint32_t groupCount = workgroupCount(count, PRIMITIVE_WORKGROUP_SIZE);
+    VkDeviceSize pairsSize = 2 * sizeof(uint32_t) * (VkDeviceSize) count;
+    PlacedBuffer *pairBuffers[2] = {
+        createScratchBuffer(primitives, MEMORY_DIRECTION_BIDIRECTIONAL, pairsSize),
+        createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD, pairsSize),
+    };
+    PlacedBuffer *histogramBuffer = createScratchBuffer(primitives, MEMORY_DIRECTION_UPLOAD,
+            sizeof(uint32_t) * RADIX_SIZE * (VkDeviceSize) groupCount);
+    uint32_t *pairs = (uint32_t*) pairBuffers[0]->mapped;
+
+    for (uint32_t i = 0; i < count; i += 1) {
+        pairs[2 * i] = keys[i];
+        pairs[2 * i + 1] = values[i];
+    }
+
+    flushPlacedBuffer(&primitives->computeDevice->allocator, pairBuffers[0], pairsSize);
+    recordPlacedBufferUpload(primitives->commandBuffer, pairBuffers[0]);
+
+    // Passes alternate between the two pair buffers
+    VkDescriptorSet passDescriptorSets[2] = {
+        allocatePrimitiveDescriptorSet(primitives, pairBuffers[0]->buffer, pairBuffers[1]->buffer, histogramBuffer->buffer),
+        allocatePrimitiveDescriptorSet(primitives, pairBuffers[1]->buffer, pairBuffers[0]->buffer, histogramBuffer->buffer),
+    };
+
+    // The histogram is scanned in place; the plan is shared by all passes
+    ScanPlan plan;
+    prepareScan(primitives, histogramBuffer->buffer, histogramBuffer->buffer, RADIX_SIZE * groupCount, &plan);
+
+    for (uint32_t pass = 0; pass < 32 / RADIX_BITS; pass += 1) {
+        PrimitiveParameters parameters = {
+            .elementCount = count,
+            .groupCount = groupCount,
+            .operation = 0,
+            .flags = 0,
+            .shift = pass * RADIX_BITS,
+        };
+
+        recordPrimitive(primitives, PRIMITIVE_KERNEL_RADIX_HISTOGRAM, passDescriptorSets[pass % 2], &parameters);
+        recordScan(primitives, &plan, PRIMITIVE_FLAG_EXCLUSIVE);
+        recordPrimitive(primitives, PRIMITIVE_KERNEL_RADIX_SCATTER, passDescriptorSets[pass % 2], &parameters);
+    }
+
+    // An even number of passes ends in the buffer the pairs started in
+    recordPlacedBufferReadback(primitives->commandBuffer, pairBuffers[0]);
+    submitPrimitive(primitives);
+    invalidatePlacedBuffer(&primitives->computeDevice->allocator, pairBuffers[0], pairsSize);
+
+    for (uint32_t i = 0; i < count; i += 1) {
+        keys[i] = pairs[2 * i];
+        values[i] = pairs[2 * i + 1];
+    }
+
+    releaseScratchBuffers(primitives);
+}
+
+static uint32_t nextRandom(uint32_t *state) {
+    // xorshift32
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return *state;
+}
+
+static bool reportPrimitive(const char *name, bool matches, double seconds) {
+    printf("%s { result: %s, time: %.3f ms }\n", name, matches ? "ok" : "mismatch", seconds * 1e3);
+
+    return matches;
+}
+
+// The implementation under test: the device primitives, or a CPU engine when `primitives` is NULL
+typedef struct {
+    Primitives *primitives;
+    const CpuEngine *engine;
+} PrimitiveRunner;
+
+static int32_t runnerReduce(const PrimitiveRunner *runner, ReduceOperation operation, const int32_t *input, uint32_t count) {
+    return runner->primitives != NULL ? runReduce(runner->primitives, operation, input, count)
+        : cpuReduce(runner->engine, operation, input, count);
+}
+
+static void runnerScan(const PrimitiveRunner *runner, bool inclusive, const uint32_t *input, uint32_t *output, uint32_t count) {
+    if (runner->primitives != NULL) {
+        runScan(runner->primitives, inclusive, input, output, count);
+    } else {
+        cpuScan(runner->engine, inclusive, input, output, count);
+    }
+}
+
+static uint32_t runnerCompact(const PrimitiveRunner *runner, const int32_t *input, int32_t *output, uint32_t count) {
+    return runner->primitives != NULL ? runCompact(runner->primitives, input, output, count)
+        : (uint32_t) cpuCompact(runner->engine, input, output, count);
+}
+
+// `scratch` holds `count` elements, for the CPU engine's compaction
+static int32_t runnerCompactReduce(const PrimitiveRunner *runner, ReduceOperation operation, const int32_t *input,
+        int32_t *scratch, uint32_t count, uint32_t *keptCount) {
+    if (runner->primitives != NULL) {
+        return runCompactReduce(runner->primitives, operation, input, count, keptCount);
+    }
+
+    *keptCount = (uint32_t) cpuCompact(runner->engine, input, scratch, count);
+
+    return cpuReduce(runner->engine, operation, scratch, *keptCount);
+}
+
+static void runnerRadixSort(const PrimitiveRunner *runner, uint32_t *keys, uint32_t *values, uint32_t count) {
+    if (runner->primitives != NULL) {
+        runRadixSort(runner->primitives, keys, values, count);
+    } else {
+        cpuRadixSort(runner->engine, keys, values, count);
+    }
+}
+
+static uint32_t checkRunner(const PrimitiveRunner *runner, const CpuEngine *verifier, uint32_t count) {
+    size_t size = sizeof(uint32_t) * (size_t) (count > 0 ? count : 1);
+    int32_t *input = malloc(size);
+    int32_t *output = malloc(size);
+    int32_t *expected = malloc(size);
+    uint32_t *scanInput = malloc(size);
+    uint32_t *scanOutput = malloc(size);
+    uint32_t *expectedScan = malloc(size);
+    uint32_t *keys = malloc(size);
+    uint32_t *values = malloc(size);
+    uint32_t *expectedKeys = malloc(size);
+    uint32_t *expectedValues = malloc(size);
+
+    if (input == NULL || output == NULL || expected == NULL || scanInput == NULL || scanOutput == NULL
+            || expectedScan == NULL || keys == NULL || values == NULL || expectedKeys == NULL || expectedValues == NULL) {
+        fprintf(stderr, "Could not allocate memory for the primitive checks.\n");
+        exit(1);
+    }
+
+    uint32_t state = 2463534242u;
+
+    for (uint32_t i = 0; i < count; i += 1) {
+        uint32_t random = nextRandom(&state);
+
+        // About half of the elements are zero, for the compaction
+        input[i] = (random & 1) != 0 ? (int32_t) random : 0;
+        scanInput[i] = random & 0xff;
+        // Masked so that equal keys are common, which shows whether the sort is stable
+        keys[i] = nextRandom(&state) & 0xf0f0f0f0u;
+        values[i] = i;
+    }
+
+    memcpy(expectedKeys, keys, sizeof(uint32_t) * (size_t) count);
+    memcpy(expectedValues, values, sizeof(uint32_t) * (size_t) count);
+
+    if (runner->primitives != NULL) {
+        printf("primitives { variant: %s, subgroupSize: %" PRIu32 ", elements: %" PRIu32 ", verifier: %s }\n",
+                runner->primitives->subgroups ? "subgroup" : "shared",
+                runner->primitives->computeDevice->subgroupProperties.subgroupSize, count, cpuIsaString(verifier->isa));
+    } else {
+        printf("primitives { variant: cpu, isa: %s, threads: %" PRIu32 ", elements: %" PRIu32 " }\n",
+                cpuIsaString(runner->engine->isa), runner->engine->threadCount, count);
+    }
+
+    uint32_t mismatchCount = 0;
+    const char *reduceNames[] = { "reduceSum", "reduceMin", "reduceMax" };
+
+    for (uint32_t operation = REDUCE_SUM; operation <= REDUCE_MAX; operation += 1) {
+        double startTime = timeNowSeconds();
+        int32_t result = runnerReduce(runner, (ReduceOperation) operation, input, count);
+        double seconds = timeNowSeconds() - startTime;
+        bool matches = result == cpuReduce(verifier, (ReduceOperation) operation, input, count);
+
+        mismatchCount += reportPrimitive(reduceNames[operation], matches, seconds) ? 0 : 1;
+    }
+
+    for (uint32_t inclusive = 0; inclusive <= 1; inclusive += 1) {
+        double startTime = timeNowSeconds();
+        runnerScan(runner, inclusive, scanInput, scanOutput, count);
+        double seconds = timeNowSeconds() - startTime;
+        cpuScan(verifier, inclusive, scanInput, expectedScan, count);
+        bool matches = cpuCountMismatches(verifier, (const int32_t*) scanOutput, (const int32_t*) expectedScan, count) == 0;
+
+        mismatchCount += reportPrimitive(inclusive ? "inclusiveScan" : "exclusiveScan", matches, seconds) ? 0 : 1;
+    }
+
+    double compactStartTime = timeNowSeconds();
+    uint32_t keptCount = runnerCompact(runner, input, output, count);
+    double compactSeconds = timeNowSeconds() - compactStartTime;
+    bool compactMatches = keptCount == cpuCompact(verifier, input, expected, count)
+        && cpuCountMismatches(verifier, output, expected, keptCount) == 0;
+    mismatchCount += reportPrimitive("compact", compactMatches, compactSeconds) ? 0 : 1;
+
+    // `expected` still holds the compacted input
+    uint32_t expectedKeptCount = (uint32_t) cpuCompact(verifier, input, expected, count);
+    const char *compactReduceNames[] = { "compactReduceSum", "compactReduceMin", "compactReduceMax" };
+
+    for (uint32_t operation = REDUCE_SUM; operation <= REDUCE_MAX; operation += 1) {
+        uint32_t reducedKeptCount;
+        double startTime = timeNowSeconds();
+        int32_t result = runnerCompactReduce(runner, (ReduceOperation) operation, input, output, count, &reducedKeptCount);
+        double seconds = timeNowSeconds() - startTime;
+        bool matches = reducedKeptCount == expectedKeptCount
+            && result == cpuReduce(verifier, (ReduceOperation) operation, expected, expectedKeptCount);
+
+        mismatchCount += reportPrimitive(compactReduceNames[operation], matches, seconds) ? 0 : 1;
+    }
+
+    double sortStartTime = timeNowSeconds();
+    runnerRadixSort(runner, keys, values, count);
+    double sortSeconds = timeNowSeconds() - sortStartTime;
+    cpuRadixSort(verifier, expectedKeys, expectedValues, count);
+    bool sortMatches = cpuCountMismatches(verifier, (const int32_t*) keys, (const int32_t*) expectedKeys, count) == 0
+        && cpuCountMismatches(verifier, (const int32_t*) values, (const int32_t*) expectedValues, count) == 0;
+    mismatchCount += reportPrimitive("radixSort", sortMatches, sortSeconds) ? 0 : 1;
+
+    free(expectedValues);
+    free(expectedKeys);
+    free(values);
+    free(keys);
+    free(expectedScan);
+    free(scanOutput);
+    free(scanInput);
+    free(expected);
+    free(output);
+    free(input);
+
+    return mismatchCount;
+}
+
+uint32_t checkPrimitives(Primitives *primitives, const CpuEngine *verifier, uint32_t count) {
+    PrimitiveRunner runner = {
+        .primitives = primitives,
+        .engine = NULL,
+    };
+
+    return checkRunner(&runner, verifier, count);
+}
+
+uint32_t checkCpuPrimitives(const CpuEngine *engine, uint32_t count) {
+    PrimitiveRunner runner = {
+        .primitives = NULL,
+        .engine = engine,
+    };
+    CpuEngine verifier;
+    createCpuEngine(CPU_ISA_SCALAR, 1, &verifier);
+
+    return checkRunner(&runner, &verifier, count);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "memory.h"
+
+// Matches WORKGROUP_SIZE in shader/primitives.glsl
+#define PRIMITIVE_WORKGROUP_SIZE 128
+// Input, output and one scratch buffer (block sums, positions or the radix histogram)
+#define PRIMITIVE_BINDING_COUNT 3
+// 128^5 workgroups cover any 32-bit element count
+#define PRIMITIVE_MAX_SCAN_LEVELS 5
+#define PRIMITIVE_MAX_DESCRIPTOR_SETS 16
+#define PRIMITIVE_MAX_SCRATCH_BUFFERS 16
+#define RADIX_BITS 4
+#define RADIX_SIZE (1u << RADIX_BITS)
+
+#define PRIMITIVE_FLAG_EXCLUSIVE 1u
+#define PRIMITIVE_FLAG_PREDICATE 2u
+#define PRIMITIVE_FLAG_INDIRECT 4u
+
+typedef enum {
+    REDUCE_SUM,
+    REDUCE_MIN,
+    REDUCE_MAX,
+} ReduceOperation;
+
+typedef enum {
+    PRIMITIVE_KERNEL_REDUCE,
+    PRIMITIVE_KERNEL_SCAN,
+    PRIMITIVE_KERNEL_SCAN_ADD,
+    PRIMITIVE_KERNEL_COMPACT,
+    PRIMITIVE_KERNEL_RADIX_HISTOGRAM,
+    PRIMITIVE_KERNEL_RADIX_SCATTER,
+    PRIMITIVE_KERNEL_DISPATCH_ARGS,
+    PRIMITIVE_KERNEL_COUNT,
+} PrimitiveKernel;
+
+// Matches `Parameters` in shader/primitives.glsl
+typedef struct {
+    uint32_t elementCount;
+    uint32_t groupCount;
+    uint32_t operation;
+    uint32_t flags;
+    uint32_t shift;
+    // Set by the dispatch itself
+    uint32_t maxGroupCountX;
+} PrimitiveParameters;
+
+// Matches `IndirectArguments` in shader/primitives.glsl. Written by the `dispatch_args` kernel and
+// consumed by `vkCmdDispatchIndirect`, so the size of a pass can depend on earlier results without a
+// readback in between.
+typedef struct {
+    VkDispatchIndirectCommand command;
+    uint32_t elementCount;
+    uint32_t groupCount;
+} PrimitiveIndirectArguments;
+
+// Reduction, scan, compaction and radix sort kernels on one device. Every call uploads its input,
+// records all passes into one command buffer, waits for it and reads the result back.
+typedef struct {
+    ComputeDevice *computeDevice;
+    // The subgroup variants of the kernels are in use, otherwise the shared-memory fallbacks
+    bool subgroups;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkPipelineLayout pipelineLayout;
+    VkShaderModule shaderModules[PRIMITIVE_KERNEL_COUNT];
+    VkPipeline pipelines[PRIMITIVE_KERNEL_COUNT];
+    VkDescriptorPool descriptorPool;
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    // Buffers of the current call, released once it completes
+    PlacedBuffer scratchBuffers[PRIMITIVE_MAX_SCRATCH_BUFFERS];
+    uint32_t scratchBufferCount;
+} Primitives;
+
+// Compute-stage subgroups with basic and arithmetic operations
+bool subgroupPrimitivesSupported(const ComputeDevice *computeDevice);
+
+// Uses the subgroup variants when `allowSubgroups` is set and the device supports them
+void createPrimitives(ComputeDevice *computeDevice, VkPipelineCache pipelineCache, bool allowSubgroups,
+        Primitives *primitives);
+void destroyPrimitives(Primitives *primitives);
+
+int32_t runReduce(Primitives *primitives, ReduceOperation operation, const int32_t *input, uint32_t count);
+void runScan(Primitives *primitives, bool inclusive, const uint32_t *input, uint32_t *output, uint32_t count);
+// Copies the non-zero elements of `input` to `output` in order and returns how many there are
+uint32_t runCompact(Primitives *primitives, const int32_t *input, int32_t *output, uint32_t count);
+// Reduces the non-zero elements of `input` in one submission: the reduction passes are dispatched
+// indirectly with sizes the device derives from the compacted count, which goes to `keptCount`
+int32_t runCompactReduce(Primitives *primitives, ReduceOperation operation, const int32_t *input, uint32_t count,
+        uint32_t *keptCount);
+// Stable ascending sort of the pairs by key
+void runRadixSort(Primitives *primitives, uint32_t *keys, uint32_t *values, uint32_t count);
+
+struct CpuEngine;
+
+// Runs every primitive over `count` pseudo-random elements and compares the results with those of
+// the `verifier` CPU engine; returns the number of mismatching primitives
+uint32_t checkPrimitives(Primitives *primitives, const struct CpuEngine *verifier, uint32_t count);
+// Same checks for the CPU engine itself, against the single-threaded scalar one
+uint32_t checkCpuPrimitives(const struct CpuEngine *engine, uint32_t count);
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "util.h"
+
+static const char *profileDomainString(ProfileDomain domain) {
+    switch (domain) {
+        case PROFILE_DOMAIN_HOST: return "host";
+        case PROFILE_DOMAIN_DEVICE: return "device";
+        default: return "undefined";
+    }
+}
+
+void initProfile(Profile *profile) {
+    *profile = (Profile) {
+        .entryCount = 0,
+        .queryPool = VK_NULL_HANDLE,
+        .timestampPeriod = 0.0,
+        .timestampMask = 0,
+        .regionCount = 0,
+        .hasHostAllocations = false,
+    };
+}
+
+void createProfileQueryPool(Profile *profile, VkDevice device, const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        uint32_t timestampValidBits) {
+    if (timestampValidBits == 0) {
+        fprintf(stderr, "The queue does not support timestamps, device timings are unavailable.\n");
+        return;
+    }
+
+    const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2 * PROFILE_MAX_DEVICE_REGIONS,
+        .pipelineStatistics = 0,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateQueryPool(device, &queryPoolCreateInfo, hostAllocationCallbacks(), &profile->queryPool));
+
+    profile->timestampPeriod = physicalDeviceProperties->limits.timestampPeriod;
+    profile->timestampMask = timestampValidBits >= 64 ? UINT64_MAX : (UINT64_C(1) << timestampValidBits) - 1;
+}
+
+void destroyProfile(Profile *profile, VkDevice device) {
+    if (profile->queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, profile->queryPool, hostAllocationCallbacks());
+        profile->queryPool = VK_NULL_HANDLE;
+    }
+}
+
+static void addProfileEntry(Profile *profile, const char *name, ProfileDomain domain, double seconds) {
+    if (profile->entryCount >= PROFILE_MAX_ENTRIES) {
+        fprintf(stderr, "Too many profile entries, dropping `%s`.\n", name);
+        return;
+    }
+
+    profile->entries[profile->entryCount++] = (ProfileEntry) {
+        .name = name,
+        .domain = domain,
+        .seconds = seconds,
+    };
+}
+
+void profileHost(Profile *profile, const char *name, double seconds) {
+    addProfileEntry(profile, name, PROFILE_DOMAIN_HOST, seconds);
+}
+
+void profileHostAllocations(Profile *profile) {
+    HostAllocator *allocator = installedHostAllocator();
+
+    if (allocator != NULL) {
+        getHostAllocatorStatistics(allocator, &profile->hostAllocations);
+        profile->hasHostAllocations = true;
+    }
+}
+
+void profileResetDeviceRegions(Profile *profile, VkCommandBuffer commandBuffer) {
+    profile->regionCount = 0;
+
+    if (profile->queryPool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(commandBuffer, profile->queryPool, 0, 2 * PROFILE_MAX_DEVICE_REGIONS);
+    }
+}
+
+uint32_t profileBeginDeviceRegion(Profile *profile, VkCommandBuffer commandBuffer, const char *name) {
+    if (profile->queryPool == VK_NULL_HANDLE || profile->regionCount >= PROFILE_MAX_DEVICE_REGIONS) {
+        return UINT32_MAX;
+    }
+
+    uint32_t region = profile->regionCount++;
+
+    profile->regionNames[region] = name;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profile->queryPool, 2 * region);
+
+    return region;
+}
+
+void profileEndDeviceRegion(Profile *profile, VkCommandBuffer commandBuffer, uint32_t region) {
+    if (region == UINT32_MAX) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profile->queryPool, 2 * region + 1);
+}
+
+void profileCollectDeviceRegions(Profile *profile, VkDevice device) {
+    if (profile->queryPool == VK_NULL_HANDLE || profile->regionCount == 0) {
+        return;
+    }
+
+    uint64_t timestamps[2 * PROFILE_MAX_DEVICE_REGIONS];
+    BAIL_ON_BAD_RESULT(vkGetQueryPoolResults(device, profile->queryPool, 0, 2 * profile->regionCount,
+                sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+    for (uint32_t region = 0; region < profile->regionCount; region += 1) {
+        uint64_t ticks = (timestamps[2 * region + 1] - timestamps[2 * region]) & profile->timestampMask;
+
+        addProfileEntry(profile, profile->regionNames[region], PROFILE_DOMAIN_DEVICE,
+                (double) ticks * profile->timestampPeriod * 1e-9);
+    }
+
+    profile->regionCount = 0;
+}
+
+void printProfile(const Profile *profile) {
+    printf("profile {\n");
+
+    for (uint32_t i = 0; i < profile->entryCount; i += 1) {
+        const ProfileEntry *entry = &profile->entries[i];
+
+        printf("\t%s.%s: %.3f ms\n", profileDomainString(entry->domain), entry->name, entry->seconds * 1e3);
+    }
+
+    printf("}\n");
+
+    if (profile->hasHostAllocations) {
+        printHostAllocatorStatistics(&profile->hostAllocations);
+    }
+}
+
+static void writeJsonString(FILE *file, const char *string) {
+    fputc('"', file);
+
+    for (const char *c = string; *c != '\0'; c += 1) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned) *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+static void writeHostAllocationsJson(FILE *file, const HostAllocatorStatistics *statistics) {
+    fprintf(file, ",\n  \"hostAllocations\": {\n    \"bytesInUse\": %" PRIu64 ",\n    \"peakBytesInUse\": %" PRIu64
+            ",\n    \"poolAllocations\": %" PRIu64 ",\n    \"arenaBytesReserved\": %" PRIu64
+            ",\n    \"poolBytesReserved\": %" PRIu64 ",\n    \"allocationsPerSecond\": %.3f,\n    \"scopes\": [",
+            statistics->bytesInUse, statistics->peakBytesInUse, statistics->poolAllocations,
+            statistics->arenaBytesReserved, statistics->poolBytesReserved, statistics->allocationRate);
+
+    for (uint32_t s = 0; s < HOST_SCOPE_COUNT; s += 1) {
+        const HostScopeStatistics *scope = &statistics->scopes[s];
+
+        fprintf(file, "%s\n      { \"scope\": \"%s\", \"allocations\": %" PRIu64 ", \"reallocations\": %" PRIu64
+                ", \"frees\": %" PRIu64 ", \"bytesInUse\": %" PRIu64 ", \"peakBytesInUse\": %" PRIu64
+                ", \"internalAllocations\": %" PRIu64 ", \"internalBytesInUse\": %" PRIu64 " }",
+                s == 0 ? "" : ",", hostScopeString(s), scope->allocations, scope->reallocations, scope->frees,
+                scope->bytesInUse, scope->peakBytesInUse, scope->internalAllocations, scope->internalBytesInUse);
+    }
+
+    fprintf(file, "\n    ]\n  }");
+}
+
+static void writeProfileJson(FILE *file, const Profile *profile, const VkPhysicalDeviceProperties *physicalDeviceProperties) {
+    fprintf(file, "{\n  \"device\": {\n    \"name\": ");
+    writeJsonString(file, physicalDeviceProperties->deviceName);
+    fprintf(file, ",\n    \"vendorID\": %" PRIu32 ",\n    \"deviceID\": %" PRIu32 ",\n    \"driverVersion\": %" PRIu32
+            ",\n    \"apiVersion\": \"%u.%u.%u\"\n  },\n  \"timings\": [",
+            physicalDeviceProperties->vendorID, physicalDeviceProperties->deviceID, physicalDeviceProperties->driverVersion,
+            VK_VERSION_MAJOR(physicalDeviceProperties->apiVersion),
+            VK_VERSION_MINOR(physicalDeviceProperties->apiVersion),
+            VK_VERSION_PATCH(physicalDeviceProperties->apiVersion));
+
+    for (uint32_t i = 0; i < profile->entryCount; i += 1) {
+        const ProfileEntry *entry = &profile->entries[i];
+
+        fprintf(file, "%s\n    { \"domain\": \"%s\", \"name\": ", i == 0 ? "" : ",", profileDomainString(entry->domain));
+        writeJsonString(file, entry->name);
+        fprintf(file, ", \"milliseconds\": %.6f }", entry->seconds * 1e3);
+    }
+
+    fprintf(file, "\n  ]");
+
+    if (profile->hasHostAllocations) {
+        writeHostAllocationsJson(file, &profile->hostAllocations);
+    }
+
+    fprintf(file, "\n}\n");
+}
+
+static void writeProfileCsv(FILE *file, const Profile *profile, const VkPhysicalDeviceProperties *physicalDeviceProperties) {
+    fprintf(file, "vendorID,deviceID,driverVersion,domain,name,milliseconds\n");
+
+    for (uint32_t i = 0; i < profile->entryCount; i += 1) {
+        const ProfileEntry *entry = &profile->entries[i];
+
+        fprintf(file, "%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%s,%s,%.6f\n",
+                physicalDeviceProperties->vendorID, physicalDeviceProperties->deviceID, physicalDeviceProperties->driverVersion,
+                profileDomainString(entry->domain), entry->name, entry->seconds * 1e3);
+    }
+}
+
+bool writeProfileReport(const Profile *profile, const VkPhysicalDeviceProperties *physicalDeviceProperties, const char *path) {
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        fprintf(stderr, "Could not write the profile report to `%s`.\n", path);
+        return false;
+    }
+
+    size_t pathLength = strlen(path);
+
+    if (pathLength >= 4 && strcmp(path + pathLength - 4, ".csv") == 0) {
+        writeProfileCsv(file, profile, physicalDeviceProperties);
+    } else {
+        writeProfileJson(file, profile, physicalDeviceProperties);
+    }
+
+    return fclose(file) == 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+#include "host_allocator.h"
+
+#define PROFILE_MAX_ENTRIES 64
+#define PROFILE_MAX_DEVICE_REGIONS 32
+
+typedef enum {
+    PROFILE_DOMAIN_HOST,
+    PROFILE_DOMAIN_DEVICE,
+} ProfileDomain;
+
+typedef struct {
+    const char *name;
+    ProfileDomain domain;
+    double seconds;
+} ProfileEntry;
+
+// Host timings are added directly; device timings come from pairs of timestamp queries
+// written around regions of a command buffer and collected once it has completed.
+typedef struct {
+    uint32_t entryCount;
+    ProfileEntry entries[PROFILE_MAX_ENTRIES];
+    VkQueryPool queryPool; // VK_NULL_HANDLE when the queue cannot write timestamps
+    double timestampPeriod; // nanoseconds per tick
+    uint64_t timestampMask;
+    uint32_t regionCount;
+    const char *regionNames[PROFILE_MAX_DEVICE_REGIONS];
+    // Set by `profileHostAllocations` when Vulkan objects were created with our host allocator
+    bool hasHostAllocations;
+    HostAllocatorStatistics hostAllocations;
+} Profile;
+
+void initProfile(Profile *profile);
+// `timestampValidBits` comes from the queue family the regions will be recorded for
+void createProfileQueryPool(Profile *profile, VkDevice device, const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        uint32_t timestampValidBits);
+void destroyProfile(Profile *profile, VkDevice device);
+
+void profileHost(Profile *profile, const char *name, double seconds);
+// Takes a snapshot of the installed host allocator's counters, if there is one
+void profileHostAllocations(Profile *profile);
+
+// Must be recorded before the first region of the command buffer
+void profileResetDeviceRegions(Profile *profile, VkCommandBuffer commandBuffer);
+uint32_t profileBeginDeviceRegion(Profile *profile, VkCommandBuffer commandBuffer, const char *name);
+void profileEndDeviceRegion(Profile *profile, VkCommandBuffer commandBuffer, uint32_t region);
+// Call after the command buffer has completed
+void profileCollectDeviceRegions(Profile *profile, VkDevice device);
+
+void printProfile(const Profile *profile);
+
+// Writes CSV when `path` ends with `.csv`, JSON otherwise
+bool writeProfileReport(const Profile *profile, const VkPhysicalDeviceProperties *physicalDeviceProperties, const char *path);
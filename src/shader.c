@@ -1,6 +1,56 @@
 #include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include "shader_data.h"
+
+#include "format.h"
+#include "host_allocator.h"
+#include "shader.h"
+
+typedef struct {
+    const char *name;
+    const uint32_t *data;
+    uint32_t size;
+} EmbeddedShader;
+
+// Built by embed-spirv from every variant in meson.build, each optimized by spirv-opt
+#include "shader_variants_data.h"
+
+// Variants of every kernel in order of preference: the first one the device has the features for,
+// and whose fixed workgroup size (if any) is the one asked for, is selected
+typedef struct {
+    const char *kernel;
+    const char *name;
+    uint32_t requiredFeatures;
+    uint32_t workgroupSize;
+} ShaderVariantRule;
+
+#define COPY_VARIANTS(kernel, features) \
+    { kernel, kernel "_wg256", features, 256 }, \
+    { kernel, kernel "_wg128", features, 128 }, \
+    { kernel, kernel "_wg64", features, 64 }, \
+    { kernel, kernel, features, 0 }
+
+#define PRIMITIVE_VARIANTS(kernel) \
+    { "primitive_" kernel, "primitive_" kernel "_subgroup", SHADER_FEATURE_SUBGROUP_ARITHMETIC, 0 }, \
+    { "primitive_" kernel, "primitive_" kernel "_shared", 0, 0 }
+
+static const ShaderVariantRule shaderVariantRules[] = {
+    COPY_VARIANTS("copy", 0),
+    COPY_VARIANTS("copy_int16", SHADER_FEATURE_INT16),
+    COPY_VARIANTS("copy_int16_packed", 0),
+    COPY_VARIANTS("copy_int8", SHADER_FEATURE_INT8),
+    COPY_VARIANTS("copy_int8_packed", 0),
+    COPY_VARIANTS("copy_fp16", SHADER_FEATURE_FLOAT16),
+    COPY_VARIANTS("copy_fp16_packed", 0),
+    PRIMITIVE_VARIANTS("reduce"),
+    PRIMITIVE_VARIANTS("scan"),
+    PRIMITIVE_VARIANTS("scan_add"),
+    PRIMITIVE_VARIANTS("compact"),
+    PRIMITIVE_VARIANTS("radix_histogram"),
+    PRIMITIVE_VARIANTS("radix_scatter"),
+    PRIMITIVE_VARIANTS("dispatch_args"),
+};
 
 void shaderLoadFile(uint32_t *shaderSize, uint32_t **shaderData, char *shaderPath) {
     /* shaderLoadOld(shaderSize, shaderData); return; */
@@ -23,7 +73,7 @@ void shaderLoadFile(uint32_t *shaderSize, uint32_t **shaderData, char *shaderPat
 
     fseek(file, 0, SEEK_SET);
 
-    *shaderData = malloc(*shaderSize);
+    *shaderData = hostAllocate(*shaderSize);
 
     if (*shaderData == NULL) {
         fprintf(stderr, "Could not allocate memory for the shader.\n");
@@ -36,11 +86,78 @@ void shaderLoadFile(uint32_t *shaderSize, uint32_t **shaderData, char *shaderPat
 }
 
 void shaderLoadStatic(uint32_t *shaderSize, uint32_t **shaderData) {
-    *shaderSize = sizeof(shader);
-    *shaderData = (uint32_t*) shader;
+    *shaderSize = sizeof(spirv_copy);
+    *shaderData = (uint32_t*) spirv_copy;
 }
 
 void shaderLoad(uint32_t *shaderSize, uint32_t **shaderData) {
     shaderLoadStatic(shaderSize, shaderData);
     /* shaderLoadFile(shaderSize, shaderData,  "shader/shader.spv"); */
 }
+
+bool shaderLoadNamed(const char *name, uint32_t *shaderSize, uint32_t **shaderData) {
+    for (size_t i = 0; i < sizeof(embeddedShaders) / sizeof(embeddedShaders[0]); i += 1) {
+        if (strcmp(embeddedShaders[i].name, name) == 0) {
+            *shaderSize = embeddedShaders[i].size;
+            *shaderData = (uint32_t*) embeddedShaders[i].data;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t shaderDeviceFeatures(const ComputeDevice *computeDevice) {
+    const VkPhysicalDeviceSubgroupProperties *subgroupProperties = &computeDevice->subgroupProperties;
+    const VkSubgroupFeatureFlags subgroupOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    uint32_t features = 0;
+
+    if ((subgroupProperties->supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0
+            && (subgroupProperties->supportedOperations & subgroupOperations) == subgroupOperations) {
+        features |= SHADER_FEATURE_SUBGROUP_ARITHMETIC;
+    }
+
+    features |= elementFormatNative(computeDevice, ELEMENT_FORMAT_INT8) ? SHADER_FEATURE_INT8 : 0;
+    features |= elementFormatNative(computeDevice, ELEMENT_FORMAT_INT16) ? SHADER_FEATURE_INT16 : 0;
+    features |= elementFormatNative(computeDevice, ELEMENT_FORMAT_FLOAT16) ? SHADER_FEATURE_FLOAT16 : 0;
+
+    return features;
+}
+
+bool shaderSelectVariant(const char *kernel, uint32_t features, uint32_t workgroupSize, ShaderVariant *variant) {
+    for (size_t r = 0; r < sizeof(shaderVariantRules) / sizeof(shaderVariantRules[0]); r += 1) {
+        const ShaderVariantRule *rule = &shaderVariantRules[r];
+        uint32_t *data;
+
+        if (strcmp(rule->kernel, kernel) != 0 || (rule->requiredFeatures & ~features) != 0
+                || (rule->workgroupSize != 0 && rule->workgroupSize != workgroupSize)) {
+            continue;
+        }
+
+        if (!shaderLoadNamed(rule->name, &variant->size, &data)) {
+            fprintf(stderr, "The `%s` shader variant is not embedded.\n", rule->name);
+            exit(1);
+        }
+
+        variant->kernel = rule->kernel;
+        variant->name = rule->name;
+        variant->requiredFeatures = rule->requiredFeatures;
+        variant->workgroupSize = rule->workgroupSize;
+        variant->data = data;
+
+        return true;
+    }
+
+    return false;
+}
+
+void printShaderVariant(const ShaderVariant *variant) {
+    printf("variant { kernel: %s, name: %s, subgroups: %s, workgroupSize: ", variant->kernel, variant->name,
+            (variant->requiredFeatures & SHADER_FEATURE_SUBGROUP_ARITHMETIC) ? "yes" : "no");
+
+    if (variant->workgroupSize != 0) {
+        printf("%" PRIu32 " }\n", variant->workgroupSize);
+    } else {
+        printf("specialized }\n");
+    }
+}
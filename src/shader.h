@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "device.h"
+
+// The code is released with `hostFree`
+void shaderLoadFile(uint32_t *shaderSize, uint32_t **shaderData, char *shaderPath);
+
+void shaderLoadStatic(uint32_t *shaderSize, uint32_t **shaderData);
+
+// The generic copy kernel embedded at build time
+void shaderLoad(uint32_t *shaderSize, uint32_t **shaderData);
+
+// Looks up SPIR-V embedded at build time by name, e.g. `copy` or `primitive_scan_subgroup`;
+// returns false when there is no such shader
+bool shaderLoadNamed(const char *name, uint32_t *shaderSize, uint32_t **shaderData);
+
+// What a variant may need from the device beyond Vulkan 1.0
+typedef enum {
+    SHADER_FEATURE_SUBGROUP_ARITHMETIC = 1,
+    // Storage and arithmetic of the narrow type, see `elementFormatNative`
+    SHADER_FEATURE_INT8 = 2,
+    SHADER_FEATURE_INT16 = 4,
+    SHADER_FEATURE_FLOAT16 = 8,
+} ShaderFeature;
+
+// One build of a kernel, compiled and optimized at build time: kernels come in variants by element
+// access, fixed workgroup size, and subgroup or shared-memory reductions
+typedef struct {
+    const char *kernel; // e.g. `copy_int16` or `primitive_scan`
+    const char *name; // the embedded shader, e.g. `copy_int16_wg256`
+    uint32_t requiredFeatures;
+    // Fixed in the code; 0 when the code takes it from the specialization constant, or fixes it
+    // regardless of the size asked for (the primitives)
+    uint32_t workgroupSize;
+    const uint32_t *data;
+    uint32_t size;
+} ShaderVariant;
+
+uint32_t shaderDeviceFeatures(const ComputeDevice *computeDevice);
+// Picks the preferred variant of `kernel` that needs only `features`, with `workgroupSize` fixed in
+// its code where there is one; returns false when the device can run none of them
+bool shaderSelectVariant(const char *kernel, uint32_t features, uint32_t workgroupSize, ShaderVariant *variant);
+void printShaderVariant(const ShaderVariant *variant);
@@ -0,0 +1,507 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kernel.h"
+#include "stream.h"
+#include "util.h"
+#include "host_allocator.h"
+
+VkDeviceSize chooseStreamChunkSize(const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        VkDeviceSize requestedChunkSize) {
+    // Larger element counts than maxComputeWorkGroupCount[0] allows spill into a 2D/3D grid
+    VkDeviceSize maxChunkSize = physicalDeviceProperties->limits.maxStorageBufferRange;
+
+    VkDeviceSize chunkSize = requestedChunkSize < maxChunkSize ? requestedChunkSize : maxChunkSize;
+
+    // Whole elements only
+    chunkSize -= chunkSize % sizeof(int32_t);
+
+    return chunkSize > 0 ? chunkSize : sizeof(int32_t);
+}
+
+static VkCommandPool createCommandPool(VkDevice device, uint32_t queueFamilyIndex) {
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queueFamilyIndex = queueFamilyIndex,
+    };
+
+    VkCommandPool commandPool;
+    BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, hostAllocationCallbacks(), &commandPool));
+
+    return commandPool;
+}
+
+static VkCommandBuffer allocateCommandBuffer(VkDevice device, VkCommandPool commandPool) {
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer commandBuffer;
+    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer));
+
+    return commandBuffer;
+}
+
+static VkSemaphore createSemaphore(VkDevice device) {
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+
+    VkSemaphore semaphore;
+    BAIL_ON_BAD_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, hostAllocationCallbacks(), &semaphore));
+
+    return semaphore;
+}
+
+void createStream(ComputeDevice *computeDevice, bool allowTransferQueue, MemoryPlacement memoryPlacement,
+        VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSetLayout descriptorSetLayout,
+        uint32_t workgroupSize, VkDeviceSize chunkSize, uint32_t slotCount, Stream *stream) {
+    VkDevice device = computeDevice->device;
+    uint32_t queueFamilyIndex = computeDevice->queueFamilyIndex;
+    const VkPhysicalDeviceProperties *physicalDeviceProperties = &computeDevice->properties;
+    Allocator *allocator = &computeDevice->allocator;
+
+    // Host-visible buffers are read by the kernel in place, so there is nothing to copy
+    const bool transferQueueInUse = allowTransferQueue && computeDevice->dedicatedTransferQueue
+        && chooseMemoryPlacement(physicalDeviceProperties, &computeDevice->memoryProperties, memoryPlacement, chunkSize)
+            == MEMORY_PLACEMENT_DEVICE_LOCAL;
+    const uint32_t transferQueueFamilyIndex = computeDevice->transferQueueFamilyIndex;
+
+    *stream = (Stream) {
+        .device = device,
+        .queue = computeDevice->queue,
+        .transferQueueInUse = transferQueueInUse,
+        .transferQueue = transferQueueInUse ? computeDevice->transferQueue : VK_NULL_HANDLE,
+        .transferQueueFamilyIndex = transferQueueInUse ? transferQueueFamilyIndex : queueFamilyIndex,
+        .allocator = allocator,
+        .transferCommandPool = VK_NULL_HANDLE,
+        .chunkSize = chunkSize,
+        .slotCount = slotCount,
+        .slots = (StreamSlot*) calloc(slotCount, sizeof(StreamSlot)),
+    };
+
+    VkDescriptorPoolSize descriptorPoolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 2 * slotCount,
+    };
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .maxSets = slotCount,
+        .poolSizeCount = 1,
+        .pPoolSizes = &descriptorPoolSize,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, hostAllocationCallbacks(), &stream->descriptorPool));
+
+    stream->commandPool = createCommandPool(device, queueFamilyIndex);
+
+    if (transferQueueInUse) {
+        stream->transferCommandPool = createCommandPool(device, transferQueueFamilyIndex);
+    }
+
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+    };
+
+    for (uint32_t i = 0; i < slotCount; i += 1) {
+        StreamSlot *slot = &stream->slots[i];
+
+        createPlacedBuffer(allocator, physicalDeviceProperties, memoryPlacement, MEMORY_DIRECTION_UPLOAD, chunkSize,
+                queueFamilyIndex, &slot->input);
+        createPlacedBuffer(allocator, physicalDeviceProperties, memoryPlacement, MEMORY_DIRECTION_READBACK, chunkSize,
+                queueFamilyIndex, &slot->output);
+
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .pNext = NULL,
+            .descriptorPool = stream->descriptorPool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &descriptorSetLayout,
+        };
+
+        BAIL_ON_BAD_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &slot->descriptorSet));
+        updateKernelDescriptorSet(device, slot->descriptorSet, slot->input.buffer, slot->output.buffer);
+
+        slot->commandBuffer = allocateCommandBuffer(device, stream->commandPool);
+
+        // Recorded once for a full chunk and resubmitted for every chunk that uses the slot;
+        // the tail of a short last chunk is processed too, but never drained
+        KernelParameters parameters = contiguousKernelParameters((uint32_t) (chunkSize / sizeof(int32_t)));
+        DispatchGrid grid = dispatchGrid(&physicalDeviceProperties->limits, parameters.elementCount, workgroupSize);
+
+        if (transferQueueInUse) {
+            slot->uploadCommandBuffer = allocateCommandBuffer(device, stream->transferCommandPool);
+            slot->readbackCommandBuffer = allocateCommandBuffer(device, stream->transferCommandPool);
+            slot->uploadSemaphore = createSemaphore(device);
+            slot->computeSemaphore = createSemaphore(device);
+
+            beginCommandBuffer(slot->uploadCommandBuffer, 0);
+            recordPlacedBufferTransferUpload(slot->uploadCommandBuffer, &slot->input, chunkSize,
+                    transferQueueFamilyIndex, queueFamilyIndex);
+            BAIL_ON_BAD_RESULT(vkEndCommandBuffer(slot->uploadCommandBuffer));
+
+            beginCommandBuffer(slot->commandBuffer, 0);
+            recordPlacedBufferAcquireUpload(slot->commandBuffer, &slot->input, transferQueueFamilyIndex, queueFamilyIndex);
+            recordDispatch(slot->commandBuffer, pipeline, pipelineLayout, &slot->descriptorSet, &parameters, grid);
+            recordPlacedBufferReleaseReadback(slot->commandBuffer, &slot->output, queueFamilyIndex, transferQueueFamilyIndex);
+            BAIL_ON_BAD_RESULT(vkEndCommandBuffer(slot->commandBuffer));
+
+            beginCommandBuffer(slot->readbackCommandBuffer, 0);
+            recordPlacedBufferTransferReadback(slot->readbackCommandBuffer, &slot->output, chunkSize,
+                    queueFamilyIndex, transferQueueFamilyIndex);
+            BAIL_ON_BAD_RESULT(vkEndCommandBuffer(slot->readbackCommandBuffer));
+        } else {
+            beginCommandBuffer(slot->commandBuffer, 0);
+            recordPlacedBufferUpload(slot->commandBuffer, &slot->input);
+            recordDispatch(slot->commandBuffer, pipeline, pipelineLayout, &slot->descriptorSet, &parameters, grid);
+            recordPlacedBufferReadback(slot->commandBuffer, &slot->output);
+            BAIL_ON_BAD_RESULT(vkEndCommandBuffer(slot->commandBuffer));
+        }
+
+        BAIL_ON_BAD_RESULT(vkCreateFence(device, &fenceCreateInfo, hostAllocationCallbacks(), &slot->fence));
+
+        slot->state = STREAM_SLOT_FREE;
+    }
+}
+
+void destroyStream(Stream *stream) {
+    for (uint32_t i = 0; i < stream->slotCount; i += 1) {
+        StreamSlot *slot = &stream->slots[i];
+
+        vkDestroyFence(stream->device, slot->fence, hostAllocationCallbacks());
+
+        if (stream->transferQueueInUse) {
+            vkDestroySemaphore(stream->device, slot->uploadSemaphore, hostAllocationCallbacks());
+            vkDestroySemaphore(stream->device, slot->computeSemaphore, hostAllocationCallbacks());
+        }
+
+        destroyPlacedBuffer(stream->allocator, &slot->input);
+        destroyPlacedBuffer(stream->allocator, &slot->output);
+    }
+
+    vkDestroyCommandPool(stream->device, stream->commandPool, hostAllocationCallbacks());
+
+    if (stream->transferCommandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(stream->device, stream->transferCommandPool, hostAllocationCallbacks());
+    }
+
+    vkDestroyDescriptorPool(stream->device, stream->descriptorPool, hostAllocationCallbacks());
+    free(stream->slots);
+}
+
+typedef struct {
+    Stream *stream;
+    // Known once `ended` is set
+    uint64_t chunkCount;
+    bool ended;
+    StreamDrain drain;
+    void *userData;
+    StreamStatistics *statistics;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+} StreamRun;
+
+static void waitForSlotState(StreamRun *run, StreamSlot *slot, StreamSlotState state) {
+    pthread_mutex_lock(&run->mutex);
+
+    while (slot->state != state) {
+        pthread_cond_wait(&run->condition, &run->mutex);
+    }
+
+    pthread_mutex_unlock(&run->mutex);
+}
+
+static void setSlotState(StreamRun *run, StreamSlot *slot, StreamSlotState state) {
+    pthread_mutex_lock(&run->mutex);
+    slot->state = state;
+    pthread_cond_broadcast(&run->condition);
+    pthread_mutex_unlock(&run->mutex);
+}
+
+static void submitCommandBuffer(VkQueue queue, VkCommandBuffer commandBuffer,
+        VkSemaphore waitSemaphore, VkPipelineStageFlags waitStageMask, VkSemaphore signalSemaphore, VkFence fence) {
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = NULL,
+        .waitSemaphoreCount = waitSemaphore != VK_NULL_HANDLE ? 1 : 0,
+        .pWaitSemaphores = &waitSemaphore,
+        .pWaitDstStageMask = &waitStageMask,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer,
+        .signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1 : 0,
+        .pSignalSemaphores = &signalSemaphore,
+    };
+
+    BAIL_ON_BAD_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+}
+
+static void submitReadback(StreamRun *run, StreamSlot *slot) {
+    submitCommandBuffer(run->stream->transferQueue, slot->readbackCommandBuffer,
+            slot->computeSemaphore, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_NULL_HANDLE, slot->fence);
+    setSlotState(run, slot, STREAM_SLOT_SUBMITTED);
+}
+
+static void *drainChunks(void *userData) {
+    StreamRun *run = (StreamRun*) userData;
+    Stream *stream = run->stream;
+    double previousCompletionTime = 0.0;
+
+    for (uint64_t chunk = 0; ; chunk += 1) {
+        StreamSlot *slot = &stream->slots[chunk % stream->slotCount];
+
+        pthread_mutex_lock(&run->mutex);
+
+        while (slot->state != STREAM_SLOT_SUBMITTED && !(run->ended && chunk >= run->chunkCount)) {
+            pthread_cond_wait(&run->condition, &run->mutex);
+        }
+
+        bool ended = slot->state != STREAM_SLOT_SUBMITTED;
+        pthread_mutex_unlock(&run->mutex);
+
+        if (ended) {
+            break;
+        }
+
+        BAIL_ON_BAD_RESULT(vkWaitForFences(stream->device, 1, &slot->fence, VK_TRUE, UINT64_MAX));
+
+        double completionTime = timeNowSeconds();
+        double startTime = slot->submitTime > previousCompletionTime ? slot->submitTime : previousCompletionTime;
+
+        run->statistics->deviceSeconds += completionTime - startTime;
+        previousCompletionTime = completionTime;
+
+        BAIL_ON_BAD_RESULT(vkResetFences(stream->device, 1, &slot->fence));
+
+        invalidatePlacedBuffer(stream->allocator, &slot->output, slot->size);
+        run->drain(slot->output.mapped, slot->offset, slot->size, run->userData);
+        run->statistics->drainSeconds += timeNowSeconds() - completionTime;
+
+        setSlotState(run, slot, STREAM_SLOT_FREE);
+    }
+
+    return NULL;
+}
+
+static void runStreamChunks(Stream *stream, StreamRead read, void *readUserData, StreamDrain drain, void *drainUserData,
+        StreamStatistics *statistics) {
+    *statistics = (StreamStatistics) {
+        .bytes = 0,
+        .chunks = 0,
+    };
+
+    StreamRun run = {
+        .stream = stream,
+        .chunkCount = 0,
+        .ended = false,
+        .drain = drain,
+        .userData = drainUserData,
+        .statistics = statistics,
+    };
+
+    pthread_mutex_init(&run.mutex, NULL);
+    pthread_cond_init(&run.condition, NULL);
+
+    double startTime = timeNowSeconds();
+    pthread_t drainThread;
+
+    if (pthread_create(&drainThread, NULL, drainChunks, &run) != 0) {
+        fprintf(stderr, "Could not start the stream drain thread.\n");
+        exit(1);
+    }
+
+    // With the transfer queue, a chunk's readback waits on the transfer queue for its dispatch, so it
+    // is held back until the next chunk's upload is ahead of it in that queue
+    StreamSlot *pendingReadback = NULL;
+    uint64_t offset = 0;
+    uint64_t chunkCount = 0;
+    bool ended = false;
+
+    while (!ended) {
+        StreamSlot *slot = &stream->slots[chunkCount % stream->slotCount];
+
+        if (slot == pendingReadback) {
+            submitReadback(&run, pendingReadback);
+            pendingReadback = NULL;
+        }
+
+        waitForSlotState(&run, slot, STREAM_SLOT_FREE);
+
+        double fillStartTime = timeNowSeconds();
+        slot->offset = offset;
+        slot->size = read(slot->input.mapped, offset, stream->chunkSize, readUserData);
+
+        ended = slot->size < stream->chunkSize;
+
+        if (slot->size == 0) {
+            statistics->fillSeconds += timeNowSeconds() - fillStartTime;
+            break;
+        }
+
+        // Including the padding of a trailing partial element
+        flushPlacedBuffer(stream->allocator, &slot->input, (slot->size + sizeof(int32_t) - 1) / sizeof(int32_t) * sizeof(int32_t));
+        statistics->fillSeconds += timeNowSeconds() - fillStartTime;
+
+        offset += slot->size;
+        chunkCount += 1;
+        slot->submitTime = timeNowSeconds();
+
+        if (stream->transferQueueInUse) {
+            submitCommandBuffer(stream->transferQueue, slot->uploadCommandBuffer,
+                    VK_NULL_HANDLE, 0, slot->uploadSemaphore, VK_NULL_HANDLE);
+            submitCommandBuffer(stream->queue, slot->commandBuffer,
+                    slot->uploadSemaphore, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, slot->computeSemaphore, VK_NULL_HANDLE);
+
+            if (pendingReadback != NULL) {
+                submitReadback(&run, pendingReadback);
+            }
+
+            pendingReadback = slot;
+        } else {
+            submitCommandBuffer(stream->queue, slot->commandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, slot->fence);
+            setSlotState(&run, slot, STREAM_SLOT_SUBMITTED);
+        }
+    }
+
+    if (pendingReadback != NULL) {
+        submitReadback(&run, pendingReadback);
+    }
+
+    pthread_mutex_lock(&run.mutex);
+    run.chunkCount = chunkCount;
+    run.ended = true;
+    pthread_cond_broadcast(&run.condition);
+    pthread_mutex_unlock(&run.mutex);
+
+    pthread_join(drainThread, NULL);
+    statistics->bytes = offset;
+    statistics->chunks = chunkCount;
+    statistics->totalSeconds = timeNowSeconds() - startTime;
+
+    pthread_cond_destroy(&run.condition);
+    pthread_mutex_destroy(&run.mutex);
+}
+
+typedef struct {
+    uint64_t size;
+    StreamFill fill;
+    void *userData;
+} StreamFillReader;
+
+static VkDeviceSize readFilledChunk(void *chunk, uint64_t offset, VkDeviceSize capacity, void *userData) {
+    StreamFillReader *reader = (StreamFillReader*) userData;
+    VkDeviceSize size = reader->size - offset < capacity ? reader->size - offset : capacity;
+
+    if (size > 0) {
+        reader->fill(chunk, offset, size, reader->userData);
+    }
+
+    return size;
+}
+
+void runStream(Stream *stream, uint64_t size, StreamFill fill, StreamDrain drain, void *userData,
+        StreamStatistics *statistics) {
+    StreamFillReader reader = {
+        .size = size,
+        .fill = fill,
+        .userData = userData,
+    };
+
+    runStreamChunks(stream, readFilledChunk, &reader, drain, userData, statistics);
+}
+
+void runStreamReader(Stream *stream, StreamRead read, StreamDrain drain, void *userData, StreamStatistics *statistics) {
+    runStreamChunks(stream, read, userData, drain, userData, statistics);
+}
+
+static void runCpuStreamChunks(const CpuEngine *engine, VkDeviceSize chunkSize, StreamRead read, void *readUserData,
+        StreamDrain drain, void *drainUserData, StreamStatistics *statistics) {
+    int32_t *input = malloc((size_t) chunkSize);
+    int32_t *output = malloc((size_t) chunkSize);
+
+    if (input == NULL || output == NULL) {
+        fprintf(stderr, "Could not allocate memory for the CPU stream.\n");
+        exit(1);
+    }
+
+    *statistics = (StreamStatistics) { 0 };
+    double startTime = timeNowSeconds();
+
+    for (uint64_t offset = 0;;) {
+        double fillStartTime = timeNowSeconds();
+        VkDeviceSize size = read(input, offset, chunkSize, readUserData);
+        double fillEndTime = timeNowSeconds();
+        statistics->fillSeconds += fillEndTime - fillStartTime;
+
+        if (size == 0) {
+            break;
+        }
+
+        // A trailing partial element was padded by `read`
+        cpuCopy(engine, input, output, (size + sizeof(int32_t) - 1) / sizeof(int32_t));
+        double kernelEndTime = timeNowSeconds();
+        statistics->deviceSeconds += kernelEndTime - fillEndTime;
+
+        drain(output, offset, size, drainUserData);
+        statistics->drainSeconds += timeNowSeconds() - kernelEndTime;
+
+        statistics->bytes += size;
+        statistics->chunks += 1;
+        offset += size;
+
+        if (size < chunkSize) {
+            break;
+        }
+    }
+
+    statistics->totalSeconds = timeNowSeconds() - startTime;
+
+    free(output);
+    free(input);
+}
+
+void runCpuStream(const CpuEngine *engine, VkDeviceSize chunkSize, uint64_t size, StreamFill fill, StreamDrain drain,
+        void *userData, StreamStatistics *statistics) {
+    StreamFillReader reader = {
+        .size = size,
+        .fill = fill,
+        .userData = userData,
+    };
+
+    runCpuStreamChunks(engine, chunkSize, readFilledChunk, &reader, drain, userData, statistics);
+}
+
+void runCpuStreamReader(const CpuEngine *engine, VkDeviceSize chunkSize, StreamRead read, StreamDrain drain,
+        void *userData, StreamStatistics *statistics) {
+    runCpuStreamChunks(engine, chunkSize, read, userData, drain, userData, statistics);
+}
+
+static double gigabytesPerSecond(uint64_t bytes, double seconds) {
+    return seconds > 0.0 ? (double) bytes / seconds * 1e-9 : INFINITY;
+}
+
+void printStreamStatistics(const StreamStatistics *statistics) {
+    printf("stream {\n\tbytes: %" PRIu64 "\n\tchunks: %" PRIu64 "\n", statistics->bytes, statistics->chunks);
+    printf("\tfill: { seconds: %.6f, throughput: %.3f GB/s }\n",
+            statistics->fillSeconds, gigabytesPerSecond(statistics->bytes, statistics->fillSeconds));
+    printf("\tdevice: { seconds: %.6f, throughput: %.3f GB/s }\n",
+            statistics->deviceSeconds, gigabytesPerSecond(statistics->bytes, statistics->deviceSeconds));
+    printf("\tdrain: { seconds: %.6f, throughput: %.3f GB/s }\n",
+            statistics->drainSeconds, gigabytesPerSecond(statistics->bytes, statistics->drainSeconds));
+    printf("\ttotal: { seconds: %.6f, throughput: %.3f GB/s }\n}\n",
+            statistics->totalSeconds, gigabytesPerSecond(statistics->bytes, statistics->totalSeconds));
+}
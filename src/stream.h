@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+#include "cpu.h"
+#include "device.h"
+#include "memory.h"
+
+#define STREAM_DEFAULT_CHUNK_SIZE (16u << 20)
+#define STREAM_DEFAULT_IN_FLIGHT_COUNT 3
+
+// Fills `size` bytes of input for the chunk starting at byte `offset` of the stream
+typedef void (*StreamFill)(void *chunk, uint64_t offset, VkDeviceSize size, void *userData);
+// Reads up to `capacity` bytes of input for the chunk starting at byte `offset` of the stream and
+// returns how many it read; fewer than `capacity` ends the stream after this chunk
+typedef VkDeviceSize (*StreamRead)(void *chunk, uint64_t offset, VkDeviceSize capacity, void *userData);
+// Consumes `size` bytes of output for the chunk starting at byte `offset` of the stream
+typedef void (*StreamDrain)(const void *chunk, uint64_t offset, VkDeviceSize size, void *userData);
+
+typedef enum {
+    STREAM_SLOT_FREE,
+    STREAM_SLOT_SUBMITTED,
+} StreamSlotState;
+
+// One in-flight buffer set
+typedef struct {
+    PlacedBuffer input;
+    PlacedBuffer output;
+    VkDescriptorSet descriptorSet;
+    // Copies, dispatch and readback; with the transfer queue, only the dispatch between the ownership transfers
+    VkCommandBuffer commandBuffer;
+    // Transfer queue only: the upload signals `uploadSemaphore` for the dispatch, which signals
+    // `computeSemaphore` for the readback
+    VkCommandBuffer uploadCommandBuffer;
+    VkCommandBuffer readbackCommandBuffer;
+    VkSemaphore uploadSemaphore;
+    VkSemaphore computeSemaphore;
+    VkFence fence; // signalled by the last submission of the chunk
+    StreamSlotState state;
+    uint64_t offset;
+    VkDeviceSize size;
+    double submitTime;
+} StreamSlot;
+
+typedef struct {
+    VkDevice device;
+    VkQueue queue;
+    // Uploads and readbacks go to the device's dedicated transfer queue
+    bool transferQueueInUse;
+    VkQueue transferQueue;
+    uint32_t transferQueueFamilyIndex;
+    Allocator *allocator;
+    VkDescriptorPool descriptorPool;
+    VkCommandPool commandPool;
+    VkCommandPool transferCommandPool;
+    VkDeviceSize chunkSize;
+    uint32_t slotCount;
+    StreamSlot *slots;
+} Stream;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t chunks;
+    double fillSeconds;
+    // Time the queue spent on chunks, assuming it executes them in submission order
+    double deviceSeconds;
+    double drainSeconds;
+    double totalSeconds;
+} StreamStatistics;
+
+// Clamps the requested chunk size to what a single storage buffer binding can cover
+VkDeviceSize chooseStreamChunkSize(const VkPhysicalDeviceProperties *physicalDeviceProperties,
+        VkDeviceSize requestedChunkSize);
+
+// Uses the dedicated transfer queue when `allowTransferQueue` is set, the device has one and the
+// buffers are device-local; everything goes to the compute queue otherwise
+void createStream(ComputeDevice *computeDevice, bool allowTransferQueue, MemoryPlacement memoryPlacement,
+        VkPipeline pipeline, VkPipelineLayout pipelineLayout, VkDescriptorSetLayout descriptorSetLayout,
+        uint32_t workgroupSize, VkDeviceSize chunkSize, uint32_t slotCount, Stream *stream);
+void destroyStream(Stream *stream);
+
+// Pushes `size` bytes through the kernel. Chunks are filled and submitted on the calling thread
+// while a second thread waits for completed chunks and drains them, so host fill, kernel execution
+// and host readback of different chunks overlap. Chunks are drained in order. With the transfer
+// queue, the upload of the next chunk is submitted before the readback of the current one, so it
+// copies while the current chunk computes.
+void runStream(Stream *stream, uint64_t size, StreamFill fill, StreamDrain drain, void *userData,
+        StreamStatistics *statistics);
+// Same, for streams whose length is only known once `read` comes up short, such as pipes
+void runStreamReader(Stream *stream, StreamRead read, StreamDrain drain, void *userData, StreamStatistics *statistics);
+
+// The same chunks through the CPU engine's copy kernel instead of a device, one after another on
+// the calling thread; the kernel's time is reported as the device time
+void runCpuStream(const CpuEngine *engine, VkDeviceSize chunkSize, uint64_t size, StreamFill fill, StreamDrain drain,
+        void *userData, StreamStatistics *statistics);
+void runCpuStreamReader(const CpuEngine *engine, VkDeviceSize chunkSize, StreamRead read, StreamDrain drain,
+        void *userData, StreamStatistics *statistics);
+
+void printStreamStatistics(const StreamStatistics *statistics);
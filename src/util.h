@@ -0,0 +1,40 @@
+#pragma once
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BAIL_ON_BAD_RESULT(result) \
+if (VK_SUCCESS != (result)) { fprintf(stderr, "Failure at %u %s\n", __LINE__, __FILE__); exit(-1); }
+
+// Monotonic wall-clock time, used for host-side measurements
+static inline double timeNowSeconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double) time.tv_sec + (double) time.tv_nsec * 1e-9;
+}
+
+// Parses a positive byte count with an optional K, M or G suffix
+static inline bool parseSize(const char *string, uint64_t *size) {
+    char *end;
+    uint64_t value = strtoull(string, &end, 10);
+
+    if (end == string) {
+        return false;
+    }
+
+    switch (toupper(*end)) {
+        case 'G': value <<= 10; // fallthrough
+        case 'M': value <<= 10; // fallthrough
+        case 'K': value <<= 10; end += 1; break;
+        default: break;
+    }
+
+    *size = value;
+
+    return *end == '\0' && value > 0;
+}
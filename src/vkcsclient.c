@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+#include "vkcsclient.h"
+
+_Static_assert(VKCS_CLIENT_MAX_BUFFERS == DAEMON_MAX_BUFFERS, "client and daemon buffer limits differ");
+_Static_assert(VKCS_CLIENT_MAX_PENDING <= DAEMON_MAX_PENDING_JOBS, "more pending tickets than daemon jobs");
+
+typedef enum {
+    TICKET_FREE,
+    TICKET_PENDING,
+    TICKET_SUCCEEDED,
+    TICKET_FAILED,
+} TicketState;
+
+typedef struct {
+    uint64_t ticket;
+    TicketState state;
+} TicketSlot;
+
+struct VkcsClient {
+    int socket;
+    uint64_t importAlignment;
+    uint32_t kernelCount;
+    bool broken;
+    uint64_t nextTicket;
+    // Indexed by ticket modulo the slot count
+    TicketSlot tickets[VKCS_CLIENT_MAX_PENDING];
+    VkcsClientBuffer *buffers[VKCS_CLIENT_MAX_BUFFERS];
+};
+
+struct VkcsClientBuffer {
+    VkcsClient *client;
+    uint32_t index;
+    void *mapping;
+    size_t size;
+};
+
+static bool sendRequest(VkcsClient *client, const DaemonRequest *request, int fd) {
+    union {
+        struct cmsghdr header;
+        char data[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = {
+        .iov_base = (void*) request,
+        .iov_len = sizeof(DaemonRequest),
+    };
+    struct msghdr message = {
+        .msg_name = NULL,
+        .msg_namelen = 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = NULL,
+        .msg_controllen = 0,
+        .msg_flags = 0,
+    };
+
+    if (fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        message.msg_control = control.data;
+        message.msg_controllen = sizeof(control.data);
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    }
+
+    if (client->broken || sendmsg(client->socket, &message, MSG_NOSIGNAL) != sizeof(DaemonRequest)) {
+        client->broken = true;
+        return false;
+    }
+
+    return true;
+}
+
+// Receives replies until one of `type` arrives, recording the completions in between
+static bool receiveReply(VkcsClient *client, DaemonReplyType type, DaemonReply *reply) {
+    while (!client->broken) {
+        if (recv(client->socket, reply, sizeof(DaemonReply), 0) != sizeof(DaemonReply)) {
+            client->broken = true;
+            break;
+        }
+
+        if (reply->type == DAEMON_REPLY_COMPLETE) {
+            TicketSlot *slot = &client->tickets[reply->ticket % VKCS_CLIENT_MAX_PENDING];
+
+            if (slot->ticket == reply->ticket && slot->state == TICKET_PENDING) {
+                slot->state = reply->status == DAEMON_STATUS_OK ? TICKET_SUCCEEDED : TICKET_FAILED;
+            }
+        }
+
+        if (reply->type == type) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+VkcsClient *vkcsConnect(const char *socketPath) {
+    struct sockaddr_un address = {
+        .sun_family = AF_UNIX,
+    };
+
+    if (socketPath == NULL) {
+        socketPath = getenv(DAEMON_SOCKET_ENVIRONMENT_VARIABLE);
+    }
+
+    if (socketPath == NULL || socketPath[0] == '\0') {
+        socketPath = DAEMON_DEFAULT_SOCKET_PATH;
+    }
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        return NULL;
+    }
+
+    strcpy(address.sun_path, socketPath);
+
+    VkcsClient *client = calloc(1, sizeof(VkcsClient));
+
+    if (client == NULL) {
+        return NULL;
+    }
+
+    client->socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    client->nextTicket = 1;
+
+    DaemonRequest request = {
+        .type = DAEMON_REQUEST_HELLO,
+    };
+    DaemonReply reply;
+
+    if (client->socket < 0 || connect(client->socket, (struct sockaddr*) &address, sizeof(address)) != 0
+            || !sendRequest(client, &request, -1) || !receiveReply(client, DAEMON_REPLY_HELLO, &reply)
+            || reply.version != DAEMON_PROTOCOL_VERSION) {
+        if (client->socket >= 0) {
+            close(client->socket);
+        }
+
+        free(client);
+        return NULL;
+    }
+
+    client->importAlignment = reply.importAlignment;
+    client->kernelCount = reply.kernelCount;
+
+    return client;
+}
+
+void vkcsDisconnect(VkcsClient *client) {
+    if (client == NULL) {
+        return;
+    }
+
+    for (uint32_t t = 0; t < VKCS_CLIENT_MAX_PENDING; t += 1) {
+        if (client->tickets[t].state != TICKET_FREE) {
+            vkcsClientWait(client, client->tickets[t].ticket);
+        }
+    }
+
+    close(client->socket);
+    free(client);
+}
+
+uint32_t vkcsClientKernelCount(const VkcsClient *client) {
+    return client->kernelCount;
+}
+
+bool vkcsClientStatistics(VkcsClient *client, VkcsClientStatistics *statistics) {
+    DaemonRequest request = {
+        .type = DAEMON_REQUEST_STATISTICS,
+    };
+    DaemonReply reply;
+
+    if (!sendRequest(client, &request, -1) || !receiveReply(client, DAEMON_REPLY_STATISTICS, &reply)) {
+        return false;
+    }
+
+    *statistics = (VkcsClientStatistics) {
+        .completedJobs = reply.completedJobs,
+        .queueSubmits = reply.queueSubmits,
+        .largestBatch = reply.largestBatch,
+        .clientCount = reply.clientCount,
+    };
+
+    return true;
+}
+
+VkcsClientBuffer *vkcsClientCreateBuffer(VkcsClient *client, size_t size) {
+    size_t alignment = (size_t) sysconf(_SC_PAGESIZE);
+    uint32_t index = 0;
+
+    while (index < VKCS_CLIENT_MAX_BUFFERS && client->buffers[index] != NULL) {
+        index += 1;
+    }
+
+    if (client->importAlignment > alignment) {
+        alignment = client->importAlignment;
+    }
+
+    size = (size + alignment - 1) / alignment * alignment;
+
+    if (index == VKCS_CLIENT_MAX_BUFFERS || size == 0) {
+        return NULL;
+    }
+
+    VkcsClientBuffer *buffer = calloc(1, sizeof(VkcsClientBuffer));
+    int fd = memfd_create("vkcscratch", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    // The daemon only maps memory that cannot shrink under its mapping
+    if (buffer == NULL || fd < 0 || ftruncate(fd, (off_t) size) != 0
+            || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        goto fail;
+    }
+
+    buffer->mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (buffer->mapping == MAP_FAILED) {
+        buffer->mapping = NULL;
+        goto fail;
+    }
+
+    DaemonRequest request = {
+        .type = DAEMON_REQUEST_MAP_BUFFER,
+        .buffer = index,
+        .size = size,
+    };
+    DaemonReply reply;
+
+    if (!sendRequest(client, &request, fd) || !receiveReply(client, DAEMON_REPLY_BUFFER, &reply)
+            || reply.status != DAEMON_STATUS_OK) {
+        goto fail;
+    }
+
+    // The daemon holds its own mapping
+    close(fd);
+
+    buffer->client = client;
+    buffer->index = index;
+    buffer->size = size;
+    client->buffers[index] = buffer;
+
+    return buffer;
+
+fail:
+    if (buffer != NULL && buffer->mapping != NULL) {
+        munmap(buffer->mapping, size);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    free(buffer);
+
+    return NULL;
+}
+
+void vkcsClientDestroyBuffer(VkcsClientBuffer *buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+
+    VkcsClient *client = buffer->client;
+    DaemonRequest request = {
+        .type = DAEMON_REQUEST_UNMAP_BUFFER,
+        .buffer = buffer->index,
+    };
+    DaemonReply reply;
+
+    // The daemon waits for the jobs still using the buffer before it replies
+    if (sendRequest(client, &request, -1)) {
+        receiveReply(client, DAEMON_REPLY_BUFFER, &reply);
+    }
+
+    client->buffers[buffer->index] = NULL;
+    munmap(buffer->mapping, buffer->size);
+    free(buffer);
+}
+
+void *vkcsClientBufferMapping(const VkcsClientBuffer *buffer) {
+    return buffer->mapping;
+}
+
+size_t vkcsClientBufferSize(const VkcsClientBuffer *buffer) {
+    return buffer->size;
+}
+
+uint64_t vkcsClientSubmit(VkcsClient *client, uint32_t kernel, VkcsClientBuffer *input, VkcsClientBuffer *output,
+        uint32_t elementCount) {
+    uint64_t ticket = client->nextTicket;
+    TicketSlot *slot = &client->tickets[ticket % VKCS_CLIENT_MAX_PENDING];
+
+    if (slot->state != TICKET_FREE) {
+        return 0;
+    }
+
+    DaemonRequest request = {
+        .type = DAEMON_REQUEST_SUBMIT,
+        .kernel = kernel,
+        .input = input->index,
+        .output = output->index,
+        .elementCount = elementCount,
+        .ticket = ticket,
+    };
+
+    if (!sendRequest(client, &request, -1)) {
+        return 0;
+    }
+
+    *slot = (TicketSlot) {
+        .ticket = ticket,
+        .state = TICKET_PENDING,
+    };
+    client->nextTicket += 1;
+
+    return ticket;
+}
+
+bool vkcsClientWait(VkcsClient *client, uint64_t ticket) {
+    TicketSlot *slot = &client->tickets[ticket % VKCS_CLIENT_MAX_PENDING];
+    DaemonReply reply;
+
+    if (slot->ticket != ticket || slot->state == TICKET_FREE) {
+        return false;
+    }
+
+    while (slot->state == TICKET_PENDING && receiveReply(client, DAEMON_REPLY_COMPLETE, &reply)) {
+    }
+
+    bool succeeded = slot->state == TICKET_SUCCEEDED;
+
+    slot->state = TICKET_FREE;
+
+    return succeeded;
+}
+
+bool vkcsClientRun(VkcsClient *client, uint32_t kernel, VkcsClientBuffer *input, VkcsClientBuffer *output,
+        uint32_t elementCount) {
+    uint64_t ticket = vkcsClientSubmit(client, kernel, input, output, elementCount);
+
+    return ticket != 0 && vkcsClientWait(client, ticket);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+// Client of vkcscratch-daemon, which keeps a warm context and batches the jobs of all its clients
+// into shared queue submissions. Buffers are memfd shared memory mapped by both processes, so job
+// payloads are never copied through the socket; the device accesses them in place where it can
+// import host memory. A client and its buffers must be used from one thread at a time; threads
+// that submit concurrently each open their own connection.
+
+typedef struct VkcsClient VkcsClient;
+typedef struct VkcsClientBuffer VkcsClientBuffer;
+
+// Tickets a client may have submitted without waiting for them
+#define VKCS_CLIENT_MAX_PENDING 64
+// Buffers a client may hold at once
+#define VKCS_CLIENT_MAX_BUFFERS 64
+
+typedef struct {
+    // For the whole daemon, not only this client
+    uint64_t completedJobs;
+    uint64_t queueSubmits;
+    uint32_t largestBatch;
+    uint32_t clientCount;
+} VkcsClientStatistics;
+
+// `socketPath` NULL falls back to VKCSCRATCH_SOCKET, then /tmp/vkcscratch.sock. Returns NULL when
+// no daemon answers there.
+VkcsClient *vkcsConnect(const char *socketPath);
+// Waits for the jobs still pending; the buffers must have been destroyed
+void vkcsDisconnect(VkcsClient *client);
+// Kernel 0 is the built-in copy; the daemon may serve more
+uint32_t vkcsClientKernelCount(const VkcsClient *client);
+bool vkcsClientStatistics(VkcsClient *client, VkcsClientStatistics *statistics);
+
+// Rounded up to the daemon's import alignment, so the device can access it in place. NULL when the
+// memory cannot be created or the daemon refuses it.
+VkcsClientBuffer *vkcsClientCreateBuffer(VkcsClient *client, size_t size);
+void vkcsClientDestroyBuffer(VkcsClientBuffer *buffer);
+void *vkcsClientBufferMapping(const VkcsClientBuffer *buffer);
+size_t vkcsClientBufferSize(const VkcsClientBuffer *buffer);
+
+// Runs `kernel` from `input` into `output` over `elementCount` 32-bit elements. Returns the ticket
+// to wait for, or 0 when VKCS_CLIENT_MAX_PENDING tickets are outstanding or the connection broke.
+// Neither buffer may be touched until the ticket has been waited for.
+uint64_t vkcsClientSubmit(VkcsClient *client, uint32_t kernel, VkcsClientBuffer *input, VkcsClientBuffer *output,
+        uint32_t elementCount);
+// Returns whether the job completed successfully; every ticket must be waited for exactly once
+bool vkcsClientWait(VkcsClient *client, uint64_t ticket);
+bool vkcsClientRun(VkcsClient *client, uint32_t kernel, VkcsClientBuffer *input, VkcsClientBuffer *output,
+        uint32_t elementCount);
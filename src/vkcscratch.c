@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vkcscratch.h"
+#include "async.h"
+#include "autotune.h"
+#include "descriptor.h"
+#include "device.h"
+#include "kernel.h"
+#include "memory.h"
+#include "pipeline_cache.h"
+#include "shader.h"
+#include "util.h"
+#include "host_allocator.h"
+
+struct VkcsContext {
+    VkInstance instance;
+    ComputeDevice computeDevice;
+    bool pipelineCacheEnabled;
+    VkPipelineCache pipelineCache;
+    // Every kernel uses the same two-buffer interface, so the layouts and the bindings of buffer
+    // pairs are shared by all jobs
+    DescriptorCache descriptorCache;
+    VkCommandPool commandPool;
+    // Every submission goes through it, so jobs can be submitted from several threads
+    AsyncQueue asyncQueue;
+};
+
+struct VkcsBuffer {
+    VkcsContext *context;
+    PlacedBuffer placedBuffer;
+};
+
+struct VkcsKernel {
+    VkcsContext *context;
+    VkShaderModule shaderModule;
+    VkPipeline pipeline;
+    uint32_t workgroupSize;
+};
+
+struct VkcsJob {
+    VkcsContext *context;
+    VkcsBuffer *input;
+    VkcsBuffer *output;
+    DescriptorBinding binding;
+    VkCommandBuffer commandBuffer;
+    AsyncFuture future;
+    bool pending;
+    VkcsCallback callback;
+    void *callbackUserData;
+};
+
+static MemoryPlacement memoryPlacementFromVkcs(VkcsMemory memory) {
+    switch (memory) {
+        case VKCS_MEMORY_HOST_VISIBLE: return MEMORY_PLACEMENT_HOST_VISIBLE;
+        case VKCS_MEMORY_DEVICE_LOCAL: return MEMORY_PLACEMENT_DEVICE_LOCAL;
+        default: return MEMORY_PLACEMENT_AUTO;
+    }
+}
+
+void vkcsDefaultContextOptions(VkcsContextOptions *options) {
+    *options = (VkcsContextOptions) {
+        .deviceSelection = NULL,
+        .enablePipelineCache = true,
+        .enableTimelineSemaphores = true,
+    };
+}
+
+VkcsContext *vkcsCreateContext(const VkcsContextOptions *options) {
+    VkcsContextOptions defaultOptions;
+
+    if (options == NULL) {
+        vkcsDefaultContextOptions(&defaultOptions);
+        options = &defaultOptions;
+    }
+
+    VkcsContext *context = calloc(1, sizeof(VkcsContext));
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    bool validationEnabled;
+    context->instance = createInstance(&validationEnabled);
+
+    VkPhysicalDevice *physicalDevices;
+    uint32_t physicalDeviceCount = enumeratePhysicalDevices(context->instance, &physicalDevices);
+    uint32_t selectedDeviceIndices[MAX_SELECTED_DEVICES];
+    selectPhysicalDevices(options->deviceSelection, physicalDeviceCount, selectedDeviceIndices, MAX_SELECTED_DEVICES);
+
+    createComputeDevice(physicalDevices[selectedDeviceIndices[0]], &context->computeDevice);
+    hostFree(physicalDevices);
+
+    VkDevice device = context->computeDevice.device;
+    bool pipelineCacheWarm;
+
+    context->pipelineCacheEnabled = options->enablePipelineCache;
+    context->pipelineCache = options->enablePipelineCache
+        ? loadPipelineCache(device, &context->computeDevice.properties, &pipelineCacheWarm)
+        : VK_NULL_HANDLE;
+    // Job command buffers are recorded once, so pushed descriptors are as permanent as a set
+    createDescriptorCache(&context->computeDevice, preferredDescriptorMode(&context->computeDevice, true), 2,
+            sizeof(KernelParameters), &context->descriptorCache);
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queueFamilyIndex = context->computeDevice.queueFamilyIndex,
+    };
+
+    BAIL_ON_BAD_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, hostAllocationCallbacks(), &context->commandPool));
+    createAsyncQueue(&context->computeDevice, options->enableTimelineSemaphores, &context->asyncQueue);
+
+    return context;
+}
+
+void vkcsDestroyContext(VkcsContext *context) {
+    if (context == NULL) {
+        return;
+    }
+
+    VkDevice device = context->computeDevice.device;
+
+    destroyAsyncQueue(&context->asyncQueue);
+
+    if (context->pipelineCacheEnabled) {
+        storePipelineCache(device, &context->computeDevice.properties, context->pipelineCache);
+        vkDestroyPipelineCache(device, context->pipelineCache, hostAllocationCallbacks());
+    }
+
+    vkDestroyCommandPool(device, context->commandPool, hostAllocationCallbacks());
+    destroyDescriptorCache(&context->descriptorCache);
+    destroyComputeDevice(&context->computeDevice);
+    destroyInstance(context->instance);
+    free(context);
+}
+
+const VkPhysicalDeviceProperties *vkcsContextProperties(const VkcsContext *context) {
+    return &context->computeDevice.properties;
+}
+
+void vkcsContextStatistics(VkcsContext *context, VkcsStatistics *statistics) {
+    AsyncStatistics asyncStatistics;
+    getAsyncStatistics(&context->asyncQueue, &asyncStatistics);
+
+    *statistics = (VkcsStatistics) {
+        .completedJobs = asyncStatistics.jobs,
+        .queueSubmits = asyncStatistics.submits,
+        .largestBatch = asyncStatistics.largestBatch,
+        .timelineSemaphores = context->asyncQueue.timeline,
+    };
+}
+
+VkcsBuffer *vkcsCreateBuffer(VkcsContext *context, VkDeviceSize size, VkcsMemory memory) {
+    VkcsBuffer *buffer = calloc(1, sizeof(VkcsBuffer));
+
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    buffer->context = context;
+    createPlacedBuffer(&context->computeDevice.allocator, &context->computeDevice.properties,
+            memoryPlacementFromVkcs(memory), MEMORY_DIRECTION_BIDIRECTIONAL, size, context->computeDevice.queueFamilyIndex,
+            &buffer->placedBuffer);
+
+    return buffer;
+}
+
+void vkcsDestroyBuffer(VkcsBuffer *buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+
+    descriptorCacheForgetBuffer(&buffer->context->descriptorCache, buffer->placedBuffer.buffer);
+    destroyPlacedBuffer(&buffer->context->computeDevice.allocator, &buffer->placedBuffer);
+    free(buffer);
+}
+
+VkcsBuffer *vkcsImportBuffer(VkcsContext *context, void *pointer, VkDeviceSize size) {
+    VkcsBuffer *buffer = calloc(1, sizeof(VkcsBuffer));
+
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    buffer->context = context;
+    createHostBuffer(&context->computeDevice, MEMORY_PLACEMENT_AUTO, MEMORY_DIRECTION_BIDIRECTIONAL, pointer, size,
+            &buffer->placedBuffer);
+
+    return buffer;
+}
+
+VkDeviceSize vkcsImportAlignment(const VkcsContext *context) {
+    return hostImportAlignment(&context->computeDevice);
+}
+
+bool vkcsBufferImported(const VkcsBuffer *buffer) {
+    return buffer->placedBuffer.imported;
+}
+
+void *vkcsBufferMapping(const VkcsBuffer *buffer) {
+    return buffer->placedBuffer.hostPointer != NULL ? buffer->placedBuffer.hostPointer : buffer->placedBuffer.mapped;
+}
+
+VkDeviceSize vkcsBufferSize(const VkcsBuffer *buffer) {
+    return buffer->placedBuffer.size;
+}
+
+VkcsKernel *vkcsCreateKernel(VkcsContext *context, const uint32_t *spirv, size_t spirvSize, uint32_t workgroupSize) {
+    VkcsKernel *kernel = calloc(1, sizeof(VkcsKernel));
+
+    if (kernel == NULL) {
+        return NULL;
+    }
+
+    uint32_t shaderSize = (uint32_t) spirvSize;
+    uint32_t *shaderData = (uint32_t*) spirv;
+    VkDevice device = context->computeDevice.device;
+
+    kernel->context = context;
+    kernel->workgroupSize = chooseWorkgroupSize(&context->computeDevice.properties, workgroupSize);
+
+    if (spirv == NULL) {
+        ShaderVariant variant;
+
+        // The generic copy runs everywhere, so there always is one
+        shaderSelectVariant("copy", shaderDeviceFeatures(&context->computeDevice), kernel->workgroupSize, &variant);
+        shaderSize = variant.size;
+        shaderData = (uint32_t*) variant.data;
+    }
+
+    kernel->shaderModule = createKernelShaderModule(device, shaderSize, shaderData);
+    kernel->pipeline = createComputePipeline(device, context->pipelineCache, kernel->shaderModule,
+            context->descriptorCache.pipelineLayout, kernel->workgroupSize);
+
+    return kernel;
+}
+
+void vkcsDestroyKernel(VkcsKernel *kernel) {
+    if (kernel == NULL) {
+        return;
+    }
+
+    VkDevice device = kernel->context->computeDevice.device;
+
+    vkDestroyPipeline(device, kernel->pipeline, hostAllocationCallbacks());
+    vkDestroyShaderModule(device, kernel->shaderModule, hostAllocationCallbacks());
+    free(kernel);
+}
+
+uint32_t vkcsKernelWorkgroupSize(const VkcsKernel *kernel) {
+    return kernel->workgroupSize;
+}
+
+VkcsJob *vkcsCreateJob(VkcsKernel *kernel, VkcsBuffer *input, VkcsBuffer *output, uint32_t elementCount) {
+    VkcsContext *context = kernel->context;
+    VkDevice device = context->computeDevice.device;
+    VkcsJob *job = calloc(1, sizeof(VkcsJob));
+
+    if (job == NULL) {
+        return NULL;
+    }
+
+    job->context = context;
+    job->input = input;
+    job->output = output;
+
+    VkBuffer buffers[] = { input->placedBuffer.buffer, output->placedBuffer.buffer };
+    descriptorCacheAcquire(&context->descriptorCache, buffers, &job->binding);
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = context->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    BAIL_ON_BAD_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &job->commandBuffer));
+
+    beginCommandBuffer(job->commandBuffer, 0);
+    recordPlacedBufferUpload(job->commandBuffer, &input->placedBuffer);
+    KernelParameters parameters = contiguousKernelParameters(elementCount);
+    recordDescriptorBinding(&context->descriptorCache, job->commandBuffer, &job->binding);
+    recordDispatch(job->commandBuffer, kernel->pipeline, context->descriptorCache.pipelineLayout, NULL, &parameters,
+            dispatchGrid(&context->computeDevice.properties.limits, elementCount, kernel->workgroupSize));
+    recordPlacedBufferReadback(job->commandBuffer, &output->placedBuffer);
+    BAIL_ON_BAD_RESULT(vkEndCommandBuffer(job->commandBuffer));
+
+    return job;
+}
+
+void vkcsDestroyJob(VkcsJob *job) {
+    if (job == NULL) {
+        return;
+    }
+
+    VkDevice device = job->context->computeDevice.device;
+
+    vkcsWaitJob(job);
+    vkFreeCommandBuffers(device, job->context->commandPool, 1, &job->commandBuffer);
+    free(job);
+}
+
+static void completeJob(void *userData) {
+    VkcsJob *job = (VkcsJob*) userData;
+    const PlacedBuffer *output = &job->output->placedBuffer;
+
+    invalidatePlacedBuffer(&job->context->computeDevice.allocator, output, output->size);
+    copyHostBufferOut(output);
+
+    if (job->callback != NULL) {
+        job->callback(job, job->callbackUserData);
+    }
+}
+
+void vkcsSubmitJobWithCallback(VkcsJob *job, VkcsCallback callback, void *userData) {
+    // The command buffer is not simultaneous-use, so a previous run has to finish first
+    vkcsWaitJob(job);
+
+    job->callback = callback;
+    job->callbackUserData = userData;
+    job->pending = true;
+
+    // Host memory that could not be imported is copied on either side of the run, and non-coherent
+    // memory is flushed before it and invalidated after it
+    const PlacedBuffer *input = &job->input->placedBuffer;
+    const PlacedBuffer *output = &job->output->placedBuffer;
+    const bool completeOutput = (output->hostPointer != NULL && !output->imported) || !output->coherent;
+
+    copyHostBufferIn(input);
+    flushPlacedBuffer(&job->context->computeDevice.allocator, input, input->size);
+    asyncSubmit(&job->context->asyncQueue, job->commandBuffer, callback != NULL || completeOutput ? completeJob : NULL, job,
+            &job->future);
+}
+
+void vkcsSubmitJob(VkcsJob *job) {
+    vkcsSubmitJobWithCallback(job, NULL, NULL);
+}
+
+bool vkcsJobComplete(VkcsJob *job) {
+    return !job->pending || asyncPoll(&job->context->asyncQueue, &job->future);
+}
+
+void vkcsWaitJob(VkcsJob *job) {
+    if (!job->pending) {
+        return;
+    }
+
+    asyncWait(&job->context->asyncQueue, &job->future);
+    job->pending = false;
+}
+
+void vkcsRunJob(VkcsJob *job) {
+    vkcsSubmitJob(job);
+    vkcsWaitJob(job);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <vulkan/vulkan.h>
+
+// Retained-context API: everything expensive (instance, device, pipelines, descriptor sets,
+// command buffers) is created once and reused, so running a job on a warm context costs one
+// queue submission and one wait. Objects belong to a single context. Different jobs may be
+// submitted and waited for from several threads at once; everything else, including any one
+// job, must be used from one thread at a time.
+
+typedef struct VkcsContext VkcsContext;
+typedef struct VkcsBuffer VkcsBuffer;
+typedef struct VkcsKernel VkcsKernel;
+typedef struct VkcsJob VkcsJob;
+
+typedef enum {
+    VKCS_MEMORY_AUTO,
+    VKCS_MEMORY_HOST_VISIBLE,
+    VKCS_MEMORY_DEVICE_LOCAL,
+} VkcsMemory;
+
+typedef struct {
+    // Only the first selected device is used; NULL falls back to VKCSCRATCH_DEVICE, then device 0
+    const char *deviceSelection;
+    bool enablePipelineCache;
+    // Completion is tracked with a timeline semaphore where the device has one, otherwise a ring of fences
+    bool enableTimelineSemaphores;
+} VkcsContextOptions;
+
+typedef struct {
+    uint64_t completedJobs;
+    // Jobs submitted while the queue is busy share a `vkQueueSubmit`
+    uint64_t queueSubmits;
+    uint32_t largestBatch;
+    bool timelineSemaphores;
+} VkcsStatistics;
+
+// Runs on the context's completion thread once the job has finished. It may submit other jobs
+// that are not pending, but must not wait for any.
+typedef void (*VkcsCallback)(VkcsJob *job, void *userData);
+
+void vkcsDefaultContextOptions(VkcsContextOptions *options);
+
+VkcsContext *vkcsCreateContext(const VkcsContextOptions *options);
+void vkcsDestroyContext(VkcsContext *context);
+const VkPhysicalDeviceProperties *vkcsContextProperties(const VkcsContext *context);
+void vkcsContextStatistics(VkcsContext *context, VkcsStatistics *statistics);
+
+// The returned buffer is persistently mapped; for device-local memory the mapping is a staging
+// copy that jobs upload from and read back into.
+VkcsBuffer *vkcsCreateBuffer(VkcsContext *context, VkDeviceSize size, VkcsMemory memory);
+void vkcsDestroyBuffer(VkcsBuffer *buffer);
+// Wraps `size` bytes of the caller's memory, which must stay valid until the buffer is destroyed.
+// Kernels access it in place when the device supports VK_EXT_external_memory_host and `pointer` and
+// `size` are multiples of `vkcsImportAlignment`; otherwise jobs copy it into a buffer of their own
+// on submission and back once they complete.
+VkcsBuffer *vkcsImportBuffer(VkcsContext *context, void *pointer, VkDeviceSize size);
+// 0 when the device cannot import host memory
+VkDeviceSize vkcsImportAlignment(const VkcsContext *context);
+// Whether an imported buffer is accessed in place rather than copied
+bool vkcsBufferImported(const VkcsBuffer *buffer);
+// The caller's memory for imported buffers
+void *vkcsBufferMapping(const VkcsBuffer *buffer);
+VkDeviceSize vkcsBufferSize(const VkcsBuffer *buffer);
+
+// `spirv` NULL selects the built-in copy kernel. The kernel reads binding 0 and writes binding 1;
+// `workgroupSize` 0 picks the tuned size for the device, or the default.
+VkcsKernel *vkcsCreateKernel(VkcsContext *context, const uint32_t *spirv, size_t spirvSize, uint32_t workgroupSize);
+void vkcsDestroyKernel(VkcsKernel *kernel);
+uint32_t vkcsKernelWorkgroupSize(const VkcsKernel *kernel);
+
+// Records upload, dispatch over `elementCount` elements and readback once; every run resubmits it
+VkcsJob *vkcsCreateJob(VkcsKernel *kernel, VkcsBuffer *input, VkcsBuffer *output, uint32_t elementCount);
+void vkcsDestroyJob(VkcsJob *job);
+
+// Returns once the job is queued; the job acts as the future of the submission. A job that is
+// still pending is waited for first.
+void vkcsSubmitJob(VkcsJob *job);
+void vkcsSubmitJobWithCallback(VkcsJob *job, VkcsCallback callback, void *userData);
+bool vkcsJobComplete(VkcsJob *job);
+// Waits for the last submission; returns immediately when nothing is pending
+void vkcsWaitJob(VkcsJob *job);
+void vkcsRunJob(VkcsJob *job);